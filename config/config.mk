@@ -16,12 +16,16 @@ INSTALL_DIR := $(ROOT_DIR)/install
 VOLTMETER_YML ?= $(ROOT_DIR)/Voltmeter.yml # default Manifest (can be changed!)
 VOLTMETER     := $(shell echo "$(basename $(notdir $(VOLTMETER_YML)))" | tr A-Z a-z)
 VOLTMETER_MK  := $(CONFIG_DIR)/$(VOLTMETER).mk
+VOLTMETER_BUILD_MK := $(CONFIG_DIR)/$(VOLTMETER).build.mk # only the parameters that require a rebuild
+VOLTMETER_CAMPAIGN := $(CONFIG_DIR)/$(VOLTMETER).campaign.json # all frequencies × benchmarks, for --campaign
 VOLTMETER_BIN := $(INSTALL_DIR)/$(VOLTMETER)
 
 -include $(VOLTMETER_MK)
 
 # more directories
 TRACE_DIR ?= $(trace_dir)
+DATASET_DIR ?= $(TRACE_DIR)/dataset
+MODEL_FILE ?= $(TRACE_DIR)/model.json
 
 # platform-specific
 ifeq ($(platform),jetson_agx_xavier)
@@ -30,5 +34,8 @@ CUDA_PATH := /usr/local/cuda
 endif
 PLATFORM_DIR := $(UTILS_DIR)/jetson_agx_xavier
 endif
+ifeq ($(platform),linux)
+PLATFORM_DIR := $(UTILS_DIR)/linux
+endif
 
 # extension of files to lint with clang-format
@@ -0,0 +1,74 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+// voltmeter libraries
+#include <backend.h>
+#include <platform.h>
+#include <cpu.h>
+#include <gpu.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Globals                        ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// drivers of the platform
+const backend_t backend_hardware = {
+  .name = BACKEND_HARDWARE,
+  .has_gpu = HAS_GPU,
+  // CPU counters
+  .probe_pmu_cpu = probe_pmu_cpu,
+  .enable_pmu_cpu_core = enable_pmu_cpu_core,
+  .program_pmu_cpu_core = program_pmu_cpu_core,
+  .disable_pmu_cpu_core = disable_pmu_cpu_core,
+  .read_counters_cpu_core = read_counters_cpu_core,
+  .cpu_max_read_period_us = cpu_max_read_period_us,
+  // GPU counters
+  .enable_pmu_gpu = enable_pmu_gpu,
+  .disable_pmu_gpu = disable_pmu_gpu,
+  .read_counters_gpu = read_counters_gpu,
+  // power rails
+  .open_power_rails = open_power_rails,
+  .close_power_rails = close_power_rails,
+  .read_power_rail = read_power_rail,
+  // frequency sources
+  .open_cpu_freq = open_cpu_freq,
+  .close_cpu_freq = close_cpu_freq,
+  .get_cpu_freq = get_cpu_freq,
+  .get_cpu_core_freq = get_cpu_core_freq,
+  .set_cpu_freq = set_cpu_freq,
+  .clip_cpu_freq = clip_cpu_freq,
+  .get_gpu_freq = get_gpu_freq,
+  .set_gpu_freq = set_gpu_freq,
+  .clip_gpu_freq = clip_gpu_freq
+};
+
+// backend of the profiler (the hardware, unless selected otherwise by main)
+const backend_t *backend = &backend_hardware;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void backend_select(const char *name, uint64_t seed) {
+  if (!strcmp(name, BACKEND_HARDWARE)) {
+    backend = &backend_hardware;
+  } else if (!strcmp(name, BACKEND_SYNTHETIC)) {
+    backend = &backend_synthetic;
+    synthetic_init(seed);
+  } else {
+    printf("%s:%d: unknown backend '%s'.\n", __FILE__, __LINE__, name);
+    exit(1);
+  }
+}
@@ -0,0 +1,182 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Microbenchmark: cost per sample of the power estimator of mode 'estimate' in
+// the trace consumer, at 1 kHz sampling, vs. its budget and vs. writing the raw
+// sample to the trace; synthetic samples shaped as a CPU profile of the events
+// of a model (8 cores x 3 counters, 2 of which pad the PMU with cycles) with power.
+// It fails if the p99 cost of a sample, or more than 1% of the estimates, exceed
+// the budget: the consumer keeps up on average only if the tail does.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+// voltmeter libraries
+#include <scheduler.h>
+#include <writer.h>
+#include <trace.h>
+#include <model.h>
+#include <estimate.h>
+
+#define DEFAULT_ITERATIONS 1000000
+#define NUM_SAMPLES 4096
+#define NUM_CORES 8
+#define NUM_COUNTERS 3
+#define NUM_RAILS 6
+#define PERIOD_US 1000
+// estimates allowed over budget, as a fraction of the estimates
+#define OVER_BUDGET_FRACTION 0.01
+
+// xorshift: cheap, deterministic noise
+static uint64_t rng_state = 88172645463325252ULL;
+static uint32_t noise(uint32_t range) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (uint32_t)(rng_state % range);
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void build_schema(trace_schema_t *schema) {
+  char name[TRACE_COLUMN_NAME_LEN];
+  trace_schema_init(schema);
+  for (int c = 0; c < NUM_CORES; c++) {
+    sprintf(name, "cpu%d.freq", c);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+    for (int e = 0; e < NUM_COUNTERS; e++) {
+      sprintf(name, "cpu%d.0x%02x", c, e == 0 ? 0x08 : 0x11);
+      trace_schema_add(schema, name, sizeof(uint64_t), TRACE_ENCODING_VARINT);
+    }
+    sprintf(name, "cpu%d.clk", c);
+    trace_schema_add(schema, name, sizeof(uint64_t), TRACE_ENCODING_VARINT);
+  }
+  for (int r = 0; r < NUM_RAILS; r++) {
+    sprintf(name, "power%d", r);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+  }
+  trace_schema_add(schema, "sampling_time", sizeof(uint64_t), TRACE_ENCODING_VARINT);
+  trace_schema_add(schema, "deadline_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "wake_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "fresh", sizeof(uint32_t), TRACE_ENCODING_VARINT);
+}
+
+// fill a raw sample: counters around a phase-dependent rate, power every 10 samples
+static void synth_sample(uint8_t *sample, uint64_t seq) {
+  uint8_t *ptr = sample;
+  uint32_t u32;
+  uint64_t u64;
+  for (int c = 0; c < NUM_CORES; c++) {
+    u32 = 2265600;
+    memcpy(ptr, &u32, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+    for (int e = 0; e < NUM_COUNTERS; e++) {
+      u64 = (seq / 500 % 2 ? 1500000 : 400000) / (e + 1) + noise(2000);
+      memcpy(ptr, &u64, sizeof(uint64_t));
+      ptr += sizeof(uint64_t);
+    }
+    u64 = 2265600 + noise(64);
+    memcpy(ptr, &u64, sizeof(uint64_t));
+    ptr += sizeof(uint64_t);
+  }
+  for (int r = 0; r < NUM_RAILS; r++) {
+    u32 = 1000 * (r + 1) + noise(40);
+    memcpy(ptr, &u32, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+  }
+  u64 = 20000 + noise(5000);
+  memcpy(ptr, &u64, sizeof(uint64_t));
+  ptr += sizeof(uint64_t);
+  u64 = 1000000000ULL + seq * PERIOD_US * 1000;
+  memcpy(ptr, &u64, sizeof(uint64_t));
+  ptr += sizeof(uint64_t);
+  u64 += 50000 + noise(20000);
+  memcpy(ptr, &u64, sizeof(uint64_t));
+  ptr += sizeof(uint64_t);
+  u32 = seq % 10 == 0 ? 0x11 : 0x01;
+  memcpy(ptr, &u32, sizeof(uint32_t));
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  trace_schema_t schema;
+  trace_writer_t writer;
+  estimator_t estimator;
+  FILE *file;
+
+  build_schema(&schema);
+  uint8_t *samples = (uint8_t *)malloc(schema.sample_bytes * NUM_SAMPLES);
+  uint64_t *costs_ns = (uint64_t *)malloc(sizeof(uint64_t) * (iterations > 0 ? iterations : 1));
+  if (samples == NULL || costs_ns == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  for (unsigned int n = 0; n < NUM_SAMPLES; n++)
+    synth_sample(samples + n * schema.sample_bytes, n);
+  printf("%u columns, %lu bytes per raw sample, %u iterations at %u us\n", schema.num_columns, schema.sample_bytes, iterations, PERIOD_US);
+
+  // model of the events of the samples (as from a coefficient file)
+  model_feature_t features[2] = {{MODEL_FEATURE_CPU_CLK, 0}, {MODEL_FEATURE_CPU_EVENT, 0x08}};
+  double coefficients[2] = {5e-8, 1e-6};
+  power_model_t model = {
+    .cpu_freq = 2265600, .num_features = 2, .features = features, .intercept = 800, .coefficients = coefficients
+  };
+
+  // estimator, as in the trace consumer (timestamps wrap with the synthetic block)
+  memset(&estimator, 0, sizeof(estimator_t));
+  estimator.model = &model;
+  estimator.output = fopen("/dev/null", "w");
+  if (estimator.output == NULL) {
+    printf("%s:%d: failed to open file '/dev/null'.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  // cost of each sample (clock read included), for the tail
+  estimator_start(&estimator, &schema, PERIOD_US);
+  uint64_t start = monotonic_ns();
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t sample_start = monotonic_ns();
+    estimator_add(&estimator, samples + (i % NUM_SAMPLES) * schema.sample_bytes);
+    costs_ns[i] = monotonic_ns() - sample_start;
+  }
+  estimator_stop(&estimator);
+  double estimate_ns = (double)(monotonic_ns() - start) / iterations;
+  fclose(estimator.output);
+  qsort(costs_ns, iterations, sizeof(uint64_t), compare_u64);
+  uint64_t p99_ns = iterations > 0 ? costs_ns[(uint64_t)iterations * 99 / 100] : 0;
+  uint64_t max_ns = iterations > 0 ? costs_ns[iterations - 1] : 0;
+
+  // baseline: raw samples to the trace writer
+  file = tmpfile();
+  trace_writer_start(&writer, file);
+  start = monotonic_ns();
+  for (unsigned int i = 0; i < iterations; i++)
+    trace_writer_write(&writer, samples + (i % NUM_SAMPLES) * schema.sample_bytes, schema.sample_bytes);
+  trace_writer_stop(&writer);
+  double v1_ns = (double)(monotonic_ns() - start) / iterations;
+  fclose(file);
+
+  uint64_t max_over_budget = (uint64_t)(estimator.num_estimates * OVER_BUDGET_FRACTION);
+  int pass = p99_ns <= estimator.budget_ns && estimator.num_over_budget <= max_over_budget;
+  printf("estimator:         %8.1f ns/sample mean, %lu ns p99, %lu ns max\n", estimate_ns, p99_ns, max_ns);
+  printf("estimates:         %8lu (%lu ns max, %lu over budget, at most %lu allowed)\n",
+    estimator.num_estimates, estimator.max_cost_ns, estimator.num_over_budget, max_over_budget);
+  printf("v1 trace writer:   %8.1f ns/sample\n", v1_ns);
+  printf("budget:            %8lu ns/sample (%.1f%% of the period)\n", estimator.budget_ns, 100 * ESTIMATE_BUDGET_FRACTION);
+  printf("estimator overhead: %.3f%% mean, %.3f%% p99, %.3f%% max of the period\n", 100 * estimate_ns / (PERIOD_US * 1e3),
+    100 * p99_ns / (PERIOD_US * 1e3), 100 * max_ns / (PERIOD_US * 1e3));
+  printf("%s\n", pass ? "pass" : "fail: p99 cost or estimates over budget");
+
+  trace_schema_free(&schema);
+  free(samples);
+  free(costs_ns);
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,505 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Microbenchmark: latency (p50/p99/max) of the sampling path. End to end, the
+// sampler threads and the trace consumer profile into a trace for every number
+// of cores and sampling period: the trace gives the sampling time and the
+// wakeup jitter of every sample, the sampler threads the deadlines they missed.
+// In isolation, each stage of a sample: PMU read, frequency and power reads of
+// the backend, sysfs read, push into the sampler ring, barrier round of the
+// sampler threads (only paid at start), and write of a merged sample into the
+// trace (v1 writer, v2 encoder).
+// Usage: bench_sampler [iterations] [backend]; the default backend is synthetic,
+// so that no PMU access and no power monitor are needed. The sysfs stage reads
+// a fake sysfs tree in /tmp, unless VOLTMETER_SYSFS_ROOT is set.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+// voltmeter libraries
+#include <backend.h>
+#include <platform.h>
+#include <cpu.h>
+#include <profiler.h>
+#include <scheduler.h>
+#include <sensor.h>
+#include <ring.h>
+#include <writer.h>
+#include <trace.h>
+#include <trace_reader.h>
+#include <helper.h>
+
+#define DEFAULT_ITERATIONS 10000
+#define DEFAULT_BENCH_BACKEND BACKEND_SYNTHETIC
+// duration of each end-to-end profile, in microseconds
+#define SWEEP_DURATION_US 300000
+#define NUM_SWEEP_PERIODS 3
+#define NUM_SENSORS (NUM_POWER_RAILS + 1)
+
+extern cpu_events_freq_config_t cpu_events;
+extern profiler_config_t profiler_config;
+extern platform_power_t platform_power;
+
+typedef struct {
+  uint64_t p50;
+  uint64_t p99;
+  uint64_t max;
+} latency_t;
+
+typedef struct {
+  pthread_barrier_t *barrier;
+  unsigned int cpu;
+  unsigned int rounds;
+} barrier_args_t;
+
+static const uint32_t sweep_periods_us[NUM_SWEEP_PERIODS] = {100, 1000, 10000};
+// events of every core (NUM_COUNTERS_CPU)
+static const cpu_event_id_t bench_events[NUM_COUNTERS_CPU] = {0x08, 0x11, 0x12};
+// cores of the CPU, from get_cpu_num_cores
+static unsigned int num_cores_cpu;
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// percentiles of n latencies (sorted in place)
+static latency_t latency_stats(uint64_t *ns, uint64_t n) {
+  latency_t lat = {0, 0, 0};
+  if (n == 0)
+    return lat;
+  qsort(ns, n, sizeof(uint64_t), compare_u64);
+  lat.p50 = ns[n / 2];
+  lat.p99 = ns[n * 99 / 100 < n ? n * 99 / 100 : n - 1];
+  lat.max = ns[n - 1];
+  return lat;
+}
+
+static void print_stage(const char *name, latency_t lat) {
+  printf("%-28s %10lu %10lu %10lu\n", name, lat.p50, lat.p99, lat.max);
+}
+
+static void pin_thread(pthread_t thread, unsigned int cpu) {
+  cpu_set_t cpu_set;
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  pthread_setaffinity_np(thread, sizeof(cpu_set_t), &cpu_set);
+}
+
+// create all parent directories of path, then the file with an integer value
+static void fake_sysfs_file(const char *path, uint32_t value) {
+  char dir[SENSOR_PATH_LEN];
+  strcpy(dir, path);
+  for (char *p = dir + 1; *p; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      mkdir(dir, 0755);
+      *p = '/';
+    }
+  }
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, path);
+    exit(1);
+  }
+  fprintf(fp, "%u\n", value);
+  fclose(fp);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Stages                         │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+static void *barrier_rounds(void *args) {
+  barrier_args_t *barrier_args = (barrier_args_t *)args;
+  pin_thread(pthread_self(), barrier_args->cpu);
+  for (unsigned int i = 0; i < barrier_args->rounds; i++)
+    pthread_barrier_wait(barrier_args->barrier);
+  return NULL;
+}
+
+// a round of a barrier of the sampler threads and the consumer (the caller), as
+// paid at every sample before the sampler rings
+static latency_t time_barrier(uint64_t *ns, unsigned int iterations) {
+  pthread_barrier_t barrier;
+  pthread_t threads[num_cores_cpu];
+  barrier_args_t args[num_cores_cpu];
+  pthread_barrier_init(&barrier, NULL, num_cores_cpu + 1);
+  for (unsigned int t = 0; t < num_cores_cpu; t++) {
+    args[t] = (barrier_args_t){&barrier, t, iterations + 1};
+    if (pthread_create(&threads[t], NULL, barrier_rounds, &args[t]) != 0) {
+      perror("pthread_create");
+      printf("%s:%d: failed to create barrier thread.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+  // the first round waits for all the threads to start
+  pthread_barrier_wait(&barrier);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    pthread_barrier_wait(&barrier);
+    ns[i] = monotonic_ns() - start;
+  }
+  for (unsigned int t = 0; t < num_cores_cpu; t++)
+    pthread_join(threads[t], NULL);
+  pthread_barrier_destroy(&barrier);
+  return latency_stats(ns, iterations);
+}
+
+// record of a sampler thread (header and the counters of a core) into its ring;
+// the consumer side pops it outside of the timed region
+static latency_t time_ring_push(uint64_t *ns, unsigned int iterations) {
+  spsc_ring_t ring;
+  size_t core_bytes = sizeof(uint32_t) + (NUM_COUNTERS_CPU + 1) * sizeof(uint64_t);
+  cpu_counter_set_t *counter_set = &cpu_events.core[0].counter_set[0];
+  ring_init(&ring, sampler_ring_capacity(), sizeof(sample_header_t) + core_bytes);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    sample_header_t *record = (sample_header_t *)ring_reserve(&ring);
+    if (record != NULL) {
+      uint8_t *payload = (uint8_t *)(record + 1);
+      record->seq = i;
+      record->deadline_ns = start;
+      record->wake_ns = start;
+      record->fresh = FRESH_CPU_COUNTERS;
+      record->run = 0;
+      record->set_cpu = 0;
+      memcpy(payload, &cpu_events.core[0].freq_read, sizeof(uint32_t));
+      memcpy(payload + sizeof(uint32_t), counter_set->counter, NUM_COUNTERS_CPU * sizeof(uint64_t));
+      record->core_bytes = core_bytes;
+      record->device_bytes = 0;
+      record->end_ns = monotonic_ns();
+      ring_commit(&ring);
+    }
+    ns[i] = monotonic_ns() - start;
+    if (ring_front(&ring) != NULL)
+      ring_pop(&ring);
+  }
+  ring_free(&ring);
+  return latency_stats(ns, iterations);
+}
+
+// sysfs files of a sample of one thread (power rails, frequency of its core)
+static latency_t time_sysfs(uint64_t *ns, unsigned int iterations) {
+  char sensor_files[NUM_SENSORS][SENSOR_PATH_LEN];
+  sensor_t sensors[NUM_SENSORS];
+  char fake_root[] = "/tmp/voltmeter-sysfs-XXXXXX";
+  char path[SENSOR_PATH_LEN];
+  volatile uint32_t sink = 0;
+
+#ifdef __JETSON_AGX_XAVIER
+  const char *rail_files[NUM_POWER_RAILS] = {
+    INA_0x40_POWER_CH0_FILE, INA_0x40_POWER_CH1_FILE, INA_0x40_POWER_CH2_FILE,
+    INA_0x41_POWER_CH0_FILE, INA_0x41_POWER_CH1_FILE, INA_0x41_POWER_CH2_FILE
+  };
+  for (int r = 0; r < NUM_POWER_RAILS; r++)
+    strcpy(sensor_files[r], rail_files[r]);
+#endif
+  sprintf(sensor_files[NUM_POWER_RAILS], CORE_FREQ_CPU_FILE, 0);
+
+  // fake sysfs tree, unless a root is given (the backend opened its files already)
+  if (getenv(SENSOR_ROOT_ENV) == NULL) {
+    if (mkdtemp(fake_root) == NULL) {
+      perror("mkdtemp");
+      exit(1);
+    }
+    sensor_set_root(fake_root);
+    for (int s = 0; s < NUM_SENSORS; s++)
+      fake_sysfs_file(sensor_path(sensor_files[s], path), 1000 + s);
+  }
+  for (int s = 0; s < NUM_SENSORS; s++)
+    sensor_open(&sensors[s], sensor_files[s]);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    for (int s = 0; s < NUM_SENSORS; s++)
+      sink += sensor_read_u32(&sensors[s]);
+    ns[i] = monotonic_ns() - start;
+  }
+  for (int s = 0; s < NUM_SENSORS; s++)
+    sensor_close(&sensors[s]);
+
+  // clean up fake tree
+  if (getenv(SENSOR_ROOT_ENV) == NULL) {
+    char cmd[SENSOR_PATH_LEN + 16];
+    sprintf(cmd, "rm -rf %s", fake_root);
+    system(cmd);
+  }
+  return latency_stats(ns, iterations);
+}
+
+// merged samples of a trace into the v1 trace writer and into the v2 encoder
+static void time_trace_write(trace_reader_t *reader, uint64_t *ns, unsigned int iterations, latency_t *v1, latency_t *v2) {
+  trace_iter_t iter;
+  trace_writer_t writer;
+  trace_encoder_t encoder;
+  uint64_t num_samples = reader->num_samples;
+  uint8_t *samples = (uint8_t *)malloc_or_exit(reader->sample_bytes * num_samples);
+  uint64_t n = 0;
+  trace_iter_init(&iter, reader, 0, num_samples);
+  while (trace_iter_next(&iter) > 0)
+    memcpy(samples + n++ * reader->sample_bytes, iter.sample, reader->sample_bytes);
+  trace_iter_free(&iter);
+
+  FILE *file = tmpfile();
+  if (file == NULL) {
+    printf("%s:%d: failed to open temporary file.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  trace_writer_start(&writer, file);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    trace_writer_write(&writer, samples + (i % n) * reader->sample_bytes, reader->sample_bytes);
+    ns[i] = monotonic_ns() - start;
+  }
+  *v1 = latency_stats(ns, iterations);
+  // blocks are encoded when full: the tail of the distribution
+  trace_encoder_init(&encoder, &reader->schema);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    trace_encoder_add(&encoder, &writer, samples + (i % n) * reader->sample_bytes);
+    ns[i] = monotonic_ns() - start;
+  }
+  *v2 = latency_stats(ns, iterations);
+  trace_encoder_flush(&encoder, &writer);
+  trace_encoder_free(&encoder);
+  trace_writer_stop(&writer);
+  fclose(file);
+  free(samples);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                      End to end                       │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// profile for SWEEP_DURATION_US with one sampler thread on each of the first
+// num_threads cores, as main does for a benchmark; return the sampling deadlines
+// missed (the most of any thread, the threads share the deadlines)
+static uint64_t profile_sweep_point(unsigned int num_threads, uint32_t period_us, FILE *trace_file) {
+  profiler_args_t *profiler_args = (profiler_args_t *)malloc_or_exit(sizeof(profiler_args_t) * num_threads);
+  pthread_t *profiler_threads = (pthread_t *)malloc_or_exit(sizeof(pthread_t) * num_threads);
+  spsc_ring_t *profiler_rings = (spsc_ring_t *)malloc_or_exit(sizeof(spsc_ring_t) * num_threads);
+  pthread_t consumer_thread;
+  pthread_attr_t pthread_attr;
+  pthread_barrier_t profiler_barrier;
+  profiler_args_t consumer_args;
+  uint64_t profiler_epoch_ns = 0;
+  atomic_uint profiler_num_done;
+  profiler_runs_t profiler_runs;
+  volatile int complete = 0;
+  cpu_set_t cpu_set;
+
+  profiler_config.sample_period_us = period_us;
+  cpu_events.num_cores = num_threads;
+  atomic_init(&profiler_num_done, 0);
+  profiler_runs_init(&profiler_runs, 1);
+  assign_device_sensors(num_threads);
+  pthread_barrier_init(&profiler_barrier, NULL, num_threads + 1);
+  for (unsigned int t = 0; t < num_threads; t++) {
+    profiler_args[t] = (profiler_args_t){
+      .thread_id = t, .trace_file = trace_file, .signal = &complete, .barrier = &profiler_barrier,
+      .set_id_cpu = 0, .set_id_gpu = 0, .num_threads = num_threads, .rings = profiler_rings,
+      .epoch_ns = &profiler_epoch_ns, .num_done = &profiler_num_done, .runs = &profiler_runs,
+      .online_model = NULL, .estimator = NULL, .log_file = NULL, .overruns = 0
+    };
+    pthread_attr_init(&pthread_attr);
+    CPU_ZERO(&cpu_set);
+    CPU_SET(t, &cpu_set);
+    pthread_attr_setaffinity_np(&pthread_attr, sizeof(cpu_set_t), &cpu_set);
+    if (pthread_create(&profiler_threads[t], &pthread_attr, events_profiler, &profiler_args[t]) != 0) {
+      perror("pthread_create");
+      printf("%s:%d: failed to create profiler thread.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+  consumer_args = profiler_args[0];
+  consumer_args.thread_id = num_threads;
+  if (pthread_create(&consumer_thread, NULL, trace_consumer, &consumer_args) != 0) {
+    perror("pthread_create");
+    printf("%s:%d: failed to create trace consumer thread.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  profiler_run_start(&profiler_runs, 0);
+  usleep(SWEEP_DURATION_US);
+  profiler_run_end(&profiler_runs, 0);
+  complete = 1;
+  uint64_t missed = 0;
+  for (unsigned int t = 0; t < num_threads; t++) {
+    pthread_join(profiler_threads[t], NULL);
+    if (profiler_args[t].overruns > missed)
+      missed = profiler_args[t].overruns;
+  }
+  pthread_join(consumer_thread, NULL);
+
+  for (unsigned int t = 0; t < num_threads; t++)
+    ring_free(&profiler_rings[t]);
+  pthread_barrier_destroy(&profiler_barrier);
+  profiler_runs_free(&profiler_runs);
+  free(profiler_rings);
+  free(profiler_threads);
+  free(profiler_args);
+  cpu_events.num_cores = num_cores_cpu;
+  return missed;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  const char *backend_name = argc > 2 ? argv[2] : DEFAULT_BENCH_BACKEND;
+  cpu_set_t main_cpu_set;
+  trace_reader_t reader;
+  latency_t stages[7];
+  latency_t v1, v2;
+  int traced = 0;
+  volatile uint64_t sink = 0;
+
+  if (iterations == 0) {
+    printf("%s:%d: iterations must be positive.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  FILE *log_file = fopen("/dev/null", "w");
+  if (log_file == NULL) {
+    printf("%s:%d: failed to open file '/dev/null'.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  uint64_t *ns = (uint64_t *)malloc_or_exit(sizeof(uint64_t) * iterations);
+
+  // devices, as main does for a CPU profile
+  backend_select(backend_name, DEFAULT_SYNTHETIC_SEED);
+  profiler_config.cpu = 1;
+  profiler_config.power_period_us = 0;
+  profiler_config.freq_period_us = 0;
+  setup_platform();
+  setup_cpu(log_file);
+  num_cores_cpu = get_cpu_num_cores();
+  cpu_event_id_t events[num_cores_cpu * NUM_COUNTERS_CPU];
+  for (int e = 0; e < num_cores_cpu * NUM_COUNTERS_CPU; e++)
+    events[e] = bench_events[e % NUM_COUNTERS_CPU];
+  cpu_events_from_cli(events, num_cores_cpu * NUM_COUNTERS_CPU, log_file);
+  printf("backend: %s, %u core(s), %u power rail(s), %u iterations per stage\n", backend->name, num_cores_cpu,
+    platform_power.num_power_rails, iterations);
+
+  // end to end: sampling time (earliest wake to latest end of the threads) and
+  // wakeup jitter (earliest wake after the deadline) of every merged sample
+  printf("\nEnd to end, %u ms per point (ns)\n", SWEEP_DURATION_US / 1000);
+  printf("%5s %9s %8s %8s %10s %10s %10s %10s %10s %10s\n", "cores", "period_us", "samples", "missed",
+    "time_p50", "time_p99", "time_max", "jit_p50", "jit_p99", "jit_max");
+  unsigned int num_threads = 1;
+  while (1) {
+    for (int p = 0; p < NUM_SWEEP_PERIODS; p++) {
+      char trace_path[] = "/tmp/voltmeter-bench-XXXXXX";
+      int fd = mkstemp(trace_path);
+      FILE *trace_file = fd < 0 ? NULL : fdopen(fd, "wb");
+      if (trace_file == NULL) {
+        printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, trace_path);
+        exit(1);
+      }
+      uint64_t missed = profile_sweep_point(num_threads, sweep_periods_us[p], trace_file);
+      fclose(trace_file);
+
+      if (trace_reader_open(&reader, trace_path, 0)) {
+        printf("%s:%d: %s\n", __FILE__, __LINE__, reader.error);
+        exit(1);
+      }
+      uint64_t num_samples = reader.num_samples;
+      uint64_t *sampling_ns = (uint64_t *)malloc_or_exit(sizeof(uint64_t) * (num_samples + 1));
+      uint64_t *jitter_ns = (uint64_t *)malloc_or_exit(sizeof(uint64_t) * (num_samples + 1));
+      uint64_t n = 0;
+      trace_iter_t iter;
+      trace_iter_init(&iter, &reader, 0, num_samples);
+      while (trace_iter_next(&iter) > 0) {
+        uint64_t deadline = trace_deadline_ns(&reader, iter.sample);
+        uint64_t wake = trace_wake_ns(&reader, iter.sample);
+        sampling_ns[n] = trace_sampling_time(&reader, iter.sample);
+        jitter_ns[n++] = wake > deadline ? wake - deadline : 0;
+      }
+      trace_iter_free(&iter);
+      latency_t sampling = latency_stats(sampling_ns, n);
+      latency_t jitter = latency_stats(jitter_ns, n);
+      printf("%5u %9u %8lu %8lu %10lu %10lu %10lu %10lu %10lu %10lu\n", num_threads, sweep_periods_us[p], n, missed,
+        sampling.p50, sampling.p99, sampling.max, jitter.p50, jitter.p99, jitter.max);
+      free(sampling_ns);
+      free(jitter_ns);
+
+      // per-sample write: the merged samples of the widest trace at the shortest period
+      if (num_threads == num_cores_cpu && p == 0 && n > 0) {
+        time_trace_write(&reader, ns, iterations, &v1, &v2);
+        traced = 1;
+      }
+      trace_reader_close(&reader);
+      unlink(trace_path);
+    }
+    if (num_threads == num_cores_cpu)
+      break;
+    num_threads = num_threads * 2 < num_cores_cpu ? num_threads * 2 : num_cores_cpu;
+  }
+
+  // stages, in isolation on core 0 (the PMU of a core is read from the core)
+  pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &main_cpu_set);
+  pin_thread(pthread_self(), 0);
+  backend->enable_pmu_cpu_core(0, 0);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    ns[i] = monotonic_ns() - start;
+  }
+  stages[0] = latency_stats(ns, iterations);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    backend->read_counters_cpu_core(0, 0);
+    ns[i] = monotonic_ns() - start;
+  }
+  stages[1] = latency_stats(ns, iterations);
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    sink += backend->get_cpu_core_freq(0);
+    ns[i] = monotonic_ns() - start;
+  }
+  stages[2] = latency_stats(ns, iterations);
+  // all the rails, as read at every power sample by the sampler threads together
+  for (unsigned int i = 0; i < iterations; i++) {
+    uint64_t start = monotonic_ns();
+    for (unsigned int r = 0; r < platform_power.num_power_rails; r++)
+      sink += backend->read_power_rail(r);
+    ns[i] = monotonic_ns() - start;
+  }
+  stages[3] = latency_stats(ns, iterations);
+  stages[4] = time_ring_push(ns, iterations);
+  backend->disable_pmu_cpu_core(0);
+  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &main_cpu_set);
+  stages[5] = time_barrier(ns, iterations);
+  stages[6] = time_sysfs(ns, iterations);
+
+  printf("\nStages (ns)\n");
+  printf("%-28s %10s %10s %10s\n", "stage", "p50", "p99", "max");
+  print_stage("clock read (overhead)", stages[0]);
+  print_stage("PMU read (core)", stages[1]);
+  print_stage("frequency read (core)", stages[2]);
+  print_stage("power read (all rails)", stages[3]);
+  print_stage("sysfs read (one thread)", stages[6]);
+  print_stage("ring push (one thread)", stages[4]);
+  print_stage("barrier round (start only)", stages[5]);
+  if (traced) {
+    print_stage("trace write v1 (merged)", v1);
+    print_stage("trace encode v2 (merged)", v2);
+  }
+
+  deinit_cpu();
+  deinit_platform();
+  fclose(log_file);
+  free(ns);
+  return 0;
+}
@@ -0,0 +1,130 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Microbenchmark: cost per sample of reading the power rails and per-core
+// frequency files, with fopen/fscanf/fclose vs. persistent sensor handles.
+// Without VOLTMETER_SYSFS_ROOT, a fake sysfs tree is created in /tmp; set
+// VOLTMETER_SYSFS_ROOT="" to measure the real sysfs nodes of the board.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+// voltmeter libraries
+#include <platform.h>
+#include <cpu.h>
+#include <sensor.h>
+#include <scheduler.h>
+
+#define DEFAULT_ITERATIONS 10000
+
+// sensor files of one sample: the power rails, then the frequency of each core
+static char (*sensor_files)[SENSOR_PATH_LEN];
+static unsigned int num_sensors;
+
+// create all parent directories of path, then the file with an integer value
+static void fake_sysfs_file(const char *path, uint32_t value) {
+  char dir[SENSOR_PATH_LEN];
+  strcpy(dir, path);
+  for (char *p = dir + 1; *p; p++) {
+    if (*p == '/') {
+      *p = '\0';
+      mkdir(dir, 0755);
+      *p = '/';
+    }
+  }
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, path);
+    exit(1);
+  }
+  fprintf(fp, "%u\n", value);
+  fclose(fp);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  char fake_root[] = "/tmp/voltmeter-sysfs-XXXXXX";
+  char path[SENSOR_PATH_LEN];
+  unsigned int num_cores = get_cpu_num_cores();
+  volatile uint32_t sink = 0;
+
+  // sensor files of one sample
+  num_sensors = NUM_POWER_RAILS + num_cores;
+  sensor_files = malloc(num_sensors * SENSOR_PATH_LEN);
+  sensor_t *sensors = (sensor_t *)malloc(num_sensors * sizeof(sensor_t));
+  if (sensor_files == NULL || sensors == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+#ifdef __JETSON_AGX_XAVIER
+  const char *rail_files[NUM_POWER_RAILS] = {
+    INA_0x40_POWER_CH0_FILE, INA_0x40_POWER_CH1_FILE, INA_0x40_POWER_CH2_FILE,
+    INA_0x41_POWER_CH0_FILE, INA_0x41_POWER_CH1_FILE, INA_0x41_POWER_CH2_FILE
+  };
+  for (int r = 0; r < NUM_POWER_RAILS; r++)
+    strcpy(sensor_files[r], rail_files[r]);
+#endif
+  for (int c = 0; c < num_cores; c++)
+    sprintf(sensor_files[NUM_POWER_RAILS + c], CORE_FREQ_CPU_FILE, c);
+
+  // fake sysfs tree, unless a root is given
+  if (getenv(SENSOR_ROOT_ENV) == NULL) {
+    if (mkdtemp(fake_root) == NULL) {
+      perror("mkdtemp");
+      exit(1);
+    }
+    sensor_set_root(fake_root);
+    for (int s = 0; s < num_sensors; s++)
+      fake_sysfs_file(sensor_path(sensor_files[s], path), 1000 + s);
+  }
+  printf("sysfs root: '%s', %u sensors per sample, %u iterations\n", sensor_root(), num_sensors, iterations);
+
+  // stdio: open, parse and close every file at every sample
+  uint64_t start = monotonic_ns();
+  for (unsigned int i = 0; i < iterations; i++) {
+    for (int s = 0; s < num_sensors; s++) {
+      uint32_t value = 0;
+      FILE *fp = fopen(sensor_path(sensor_files[s], path), "r");
+      if (fp == NULL) {
+        printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, path);
+        exit(1);
+      }
+      fscanf(fp, "%u", &value);
+      fclose(fp);
+      sink += value;
+    }
+  }
+  double stdio_ns = (double)(monotonic_ns() - start) / iterations;
+
+  // sensor handles: open once, pread at offset 0 at every sample
+  for (int s = 0; s < num_sensors; s++)
+    sensor_open(&sensors[s], sensor_files[s]);
+  start = monotonic_ns();
+  for (unsigned int i = 0; i < iterations; i++)
+    for (int s = 0; s < num_sensors; s++)
+      sink += sensor_read_u32(&sensors[s]);
+  double pread_ns = (double)(monotonic_ns() - start) / iterations;
+  for (int s = 0; s < num_sensors; s++)
+    sensor_close(&sensors[s]);
+
+  printf("fopen/fscanf/fclose: %10.0f ns/sample (%8.0f ns/read)\n", stdio_ns, stdio_ns / num_sensors);
+  printf("sensor handle pread: %10.0f ns/sample (%8.0f ns/read)\n", pread_ns, pread_ns / num_sensors);
+  printf("speedup: %.1fx\n", stdio_ns / pread_ns);
+
+  // clean up fake tree
+  if (getenv(SENSOR_ROOT_ENV) == NULL) {
+    char cmd[SENSOR_PATH_LEN + 16];
+    sprintf(cmd, "rm -rf %s", fake_root);
+    system(cmd);
+  }
+  free(sensors);
+  free(sensor_files);
+  return 0;
+}
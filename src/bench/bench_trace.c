@@ -0,0 +1,171 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Microbenchmark: size and consumer cost per sample of trace version 1 (raw
+// samples) vs. version 2 (columnar, delta/varint encoded, compressed blocks), on
+// synthetic samples shaped as a CPU profile (8 cores x 3 counters, one of which
+// is a rare event) with power.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+// voltmeter libraries
+#include <scheduler.h>
+#include <writer.h>
+#include <trace.h>
+
+#define DEFAULT_ITERATIONS 200000
+#define NUM_CORES 8
+#define NUM_COUNTERS 3
+#define NUM_RAILS 6
+#define PERIOD_NS 100000
+
+// xorshift: cheap, deterministic noise
+static uint64_t rng_state = 88172645463325252ULL;
+static uint32_t noise(uint32_t range) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (uint32_t)(rng_state % range);
+}
+
+static void build_schema(trace_schema_t *schema) {
+  char name[TRACE_COLUMN_NAME_LEN];
+  trace_schema_init(schema);
+  for (int c = 0; c < NUM_CORES; c++) {
+    sprintf(name, "cpu%d.freq", c);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+    for (int e = 0; e < NUM_COUNTERS; e++) {
+      sprintf(name, "cpu%d.0x%02x", c, 0x08 + e);
+      trace_schema_add(schema, name, sizeof(uint64_t), TRACE_ENCODING_VARINT);
+    }
+    sprintf(name, "cpu%d.clk", c);
+    trace_schema_add(schema, name, sizeof(uint64_t), TRACE_ENCODING_VARINT);
+  }
+  for (int r = 0; r < NUM_RAILS; r++) {
+    sprintf(name, "power%d", r);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+  }
+  trace_schema_add(schema, "sampling_time", sizeof(uint64_t), TRACE_ENCODING_VARINT);
+  trace_schema_add(schema, "deadline_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "wake_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "fresh", sizeof(uint32_t), TRACE_ENCODING_VARINT);
+}
+
+// fill a raw sample: counters around a phase-dependent rate, slowly varying power
+static void synth_sample(uint8_t *sample, uint64_t seq) {
+  uint8_t *ptr = sample;
+  uint32_t u32;
+  uint64_t u64;
+  for (int c = 0; c < NUM_CORES; c++) {
+    u32 = 2265600;
+    memcpy(ptr, &u32, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+    for (int e = 0; e < NUM_COUNTERS; e++) {
+      if (e == NUM_COUNTERS - 1)
+        u64 = noise(100) < 5 ? noise(16) : 0;
+      else
+        u64 = (seq / 5000 % 2 ? 150000 : 40000) / (e + 1) + noise(2000);
+      memcpy(ptr, &u64, sizeof(uint64_t));
+      ptr += sizeof(uint64_t);
+    }
+    u64 = 226560 + noise(64);
+    memcpy(ptr, &u64, sizeof(uint64_t));
+    ptr += sizeof(uint64_t);
+  }
+  for (int r = 0; r < NUM_RAILS; r++) {
+    u32 = 1000 * (r + 1) + (seq / 5000 % 2 ? 3000 : 0) + noise(40);
+    memcpy(ptr, &u32, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+  }
+  u64 = 20000 + noise(5000);
+  memcpy(ptr, &u64, sizeof(uint64_t));
+  ptr += sizeof(uint64_t);
+  u64 = 1000000000ULL + seq * PERIOD_NS;
+  memcpy(ptr, &u64, sizeof(uint64_t));
+  ptr += sizeof(uint64_t);
+  u64 += 50000 + noise(20000);
+  memcpy(ptr, &u64, sizeof(uint64_t));
+  ptr += sizeof(uint64_t);
+  u32 = 0x11;
+  memcpy(ptr, &u32, sizeof(uint32_t));
+}
+
+// encode and decode every column of a block of samples; return the mismatches
+static unsigned int check_round_trip(trace_schema_t *schema, const uint8_t *samples, unsigned int num_samples) {
+  uint8_t *encoded = (uint8_t *)malloc((size_t)num_samples * TRACE_VARINT_MAX_BYTES);
+  uint64_t *values = (uint64_t *)malloc(sizeof(uint64_t) * num_samples);
+  unsigned int mismatches = 0;
+  for (unsigned int i = 0; i < schema->num_columns; i++) {
+    trace_column_t *column = &schema->columns[i];
+    size_t len = trace_encode_column(encoded, samples, num_samples, schema->sample_bytes, column);
+    if (trace_decode_column(values, num_samples, encoded, len, column)) {
+      mismatches += num_samples;
+      continue;
+    }
+    for (unsigned int n = 0; n < num_samples; n++) {
+      uint64_t value = 0;
+      memcpy(&value, samples + n * schema->sample_bytes + column->offset, column->size);
+      if (values[n] != value)
+        mismatches++;
+    }
+  }
+  free(encoded);
+  free(values);
+  return mismatches;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int iterations = argc > 1 ? atoi(argv[1]) : DEFAULT_ITERATIONS;
+  trace_schema_t schema;
+  trace_encoder_t encoder;
+  trace_writer_t writer;
+  FILE *file;
+
+  build_schema(&schema);
+  uint8_t *samples = (uint8_t *)malloc(schema.sample_bytes * TRACE_BLOCK_SAMPLES);
+  for (unsigned int n = 0; n < TRACE_BLOCK_SAMPLES; n++)
+    synth_sample(samples + n * schema.sample_bytes, n);
+  printf("%u columns, %lu bytes per raw sample, %u iterations\n", schema.num_columns, schema.sample_bytes, iterations);
+
+  // version 1: raw samples to the trace writer
+  file = tmpfile();
+  trace_writer_start(&writer, file);
+  uint64_t start = monotonic_ns();
+  for (unsigned int i = 0; i < iterations; i++)
+    trace_writer_write(&writer, samples + (i % TRACE_BLOCK_SAMPLES) * schema.sample_bytes, schema.sample_bytes);
+  trace_writer_stop(&writer);
+  double v1_ns = (double)(monotonic_ns() - start) / iterations;
+  uint64_t v1_bytes = writer.bytes;
+  fclose(file);
+
+  // version 2: encoder, then trace writer
+  file = tmpfile();
+  trace_writer_start(&writer, file);
+  trace_encoder_init(&encoder, &schema);
+  start = monotonic_ns();
+  for (unsigned int i = 0; i < iterations; i++)
+    trace_encoder_add(&encoder, &writer, samples + (i % TRACE_BLOCK_SAMPLES) * schema.sample_bytes);
+  trace_encoder_flush(&encoder, &writer);
+  trace_writer_stop(&writer);
+  double v2_ns = (double)(monotonic_ns() - start) / iterations;
+  uint64_t v2_bytes = writer.bytes;
+  trace_encoder_free(&encoder);
+  fclose(file);
+
+  unsigned int mismatches = check_round_trip(&schema, samples, TRACE_BLOCK_SAMPLES);
+
+  printf("v1 raw samples:    %10lu bytes, %8.1f ns/sample\n", v1_bytes, v1_ns);
+  printf("v2 columnar:       %10lu bytes, %8.1f ns/sample\n", v2_bytes, v2_ns);
+  printf("size reduction: %.1fx\n", (double)v1_bytes / v2_bytes);
+  printf("round trip: %s\n", mismatches == 0 ? "ok" : "MISMATCH");
+
+  trace_schema_free(&schema);
+  free(samples);
+  return mismatches == 0 ? 0 : 1;
+}
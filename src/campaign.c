@@ -0,0 +1,311 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <dlfcn.h>
+// third-party libraries
+#include <jsmn.h>
+// voltmeter libraries
+#include <helper.h>
+#include <campaign.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static char *json_strdup(const char *str_json, jsmntok_t *tok);
+static int json_key_is(const char *str_json, jsmntok_t *tok, const char *key);
+static int parse_freqs(const char *str_json, jsmntok_t *t, int i, unsigned int *num_freqs, uint32_t **freqs);
+static int parse_benchmark(const char *str_json, jsmntok_t *t, int i, benchmark_t *benchmark);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                       Campaign                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// parse the expanded manifest generated by utils/parse_config/parse_config.py:
+// {"frequencies_cpu": [...], "frequencies_gpu": [...], "benchmarks": [{"path": ..., "args": [...]}, ...]}
+void parse_campaign_json(char *campaign_file, campaign_t *campaign){
+  jsmn_parser p;
+  jsmntok_t *t;
+  int ret;
+
+  // read campaign_file into a string
+  FILE *fp = fopen(campaign_file, "rb");
+  if (fp == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, campaign_file);
+    exit(1);
+  }
+  fseek(fp, 0L, SEEK_END);
+  size_t sz = ftell(fp);
+  rewind(fp);
+  char *str_json = (char *)malloc((sz + 1) * sizeof(char));
+  if (str_json == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  fread(str_json, sz, 1, fp);
+  str_json[sz] = '\0';
+  fclose(fp);
+
+  // count tokens first: the number of benchmarks is not bounded
+  jsmn_init(&p);
+  ret = jsmn_parse(&p, str_json, sz, NULL, 0);
+  if (ret < 0) {
+    printf("%s:%d: failed to parse JSON '%s' (error %d).\n", __FILE__, __LINE__, campaign_file, ret);
+    exit(1);
+  }
+  t = (jsmntok_t *)malloc(ret * sizeof(jsmntok_t));
+  if (t == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  jsmn_init(&p);
+  ret = jsmn_parse(&p, str_json, sz, t, ret);
+  if (ret < 0) {
+    printf("%s:%d: failed to parse JSON '%s' (error %d).\n", __FILE__, __LINE__, campaign_file, ret);
+    exit(1);
+  }
+
+  campaign->num_freqs_cpu = 0;
+  campaign->freqs_cpu = NULL;
+  campaign->num_freqs_gpu = 0;
+  campaign->freqs_gpu = NULL;
+  campaign->num_benchmarks = 0;
+  campaign->benchmarks = NULL;
+
+  int i = 0;
+  if (t[i].type != JSMN_OBJECT) {
+    printf("%s:%d: unexpected token type %d (expected JSMN_OBJECT).\n", __FILE__, __LINE__, t[i].type);
+    exit(1);
+  }
+  // loop over all keys of the root object
+  int num_keys = t[i].size;
+  for (int k = 0; k < num_keys; k++) {
+    if (t[++i].type != JSMN_STRING) {
+      printf("%s:%d: unexpected token type %d (expected JSMN_STRING).\n", __FILE__, __LINE__, t[i].type);
+      exit(1);
+    }
+    if (json_key_is(str_json, &t[i], "frequencies_cpu")) {
+      i = parse_freqs(str_json, t, i + 1, &campaign->num_freqs_cpu, &campaign->freqs_cpu);
+    } else if (json_key_is(str_json, &t[i], "frequencies_gpu")) {
+      i = parse_freqs(str_json, t, i + 1, &campaign->num_freqs_gpu, &campaign->freqs_gpu);
+    } else if (json_key_is(str_json, &t[i], "benchmarks")) {
+      if (t[++i].type != JSMN_ARRAY) {
+        printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
+        exit(1);
+      }
+      campaign->num_benchmarks = t[i].size;
+      campaign->benchmarks = (benchmark_t *)malloc(campaign->num_benchmarks * sizeof(benchmark_t));
+      if (campaign->benchmarks == NULL) {
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      for (int b = 0; b < campaign->num_benchmarks; b++)
+        i = parse_benchmark(str_json, t, i + 1, &campaign->benchmarks[b]);
+    } else {
+      printf("%s:%d: unexpected key '%.*s' in '%s'.\n", __FILE__, __LINE__, t[i].end - t[i].start, str_json + t[i].start, campaign_file);
+      exit(1);
+    }
+  }
+  if (campaign->num_benchmarks == 0) {
+    printf("%s:%d: no benchmarks in '%s'.\n", __FILE__, __LINE__, campaign_file);
+    exit(1);
+  }
+  free(t);
+  free(str_json);
+}
+
+void free_campaign(campaign_t *campaign){
+  for (int b = 0; b < campaign->num_benchmarks; b++) {
+    close_benchmark(&campaign->benchmarks[b]);
+    for (int a = 1; a <= campaign->benchmarks[b].num_args; a++)
+      free(campaign->benchmarks[b].args[a]);
+    free(campaign->benchmarks[b].args);
+    free(campaign->benchmarks[b].name);
+    free(campaign->benchmarks[b].path);
+  }
+  free(campaign->benchmarks);
+  free(campaign->freqs_cpu);
+  free(campaign->freqs_gpu);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                      Benchmarks                       │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// dlopen the benchmark and resolve its main; no-op if already open; return 0 on
+// success, 1 if the benchmark is not a library with a main
+int open_benchmark(benchmark_t *benchmark){
+  if (benchmark->handle != NULL)
+    return 0;
+  dlerror();
+  benchmark->handle = dlopen(benchmark->path, RTLD_NOW | RTLD_LOCAL);
+  if (!benchmark->handle) {
+    fputs(dlerror(), stdout);
+    printf("\n");
+    printf("%s:%d: benchmark %s cannot be opened.\n", __FILE__, __LINE__, benchmark->path);
+    return 1;
+  }
+  benchmark->main = (benchmark_main_t)dlsym(benchmark->handle, "main");
+  if (!benchmark->main) {
+    fputs(dlerror(), stdout);
+    printf("\n");
+    printf("%s:%d: benchmark %s cannot be run.\n", __FILE__, __LINE__, benchmark->path);
+    dlclose(benchmark->handle);
+    benchmark->handle = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+void close_benchmark(benchmark_t *benchmark){
+  if (benchmark->handle == NULL)
+    return;
+  dlclose(benchmark->handle);
+  // handle dl errors
+  char *error = dlerror();
+  if (error != NULL) {
+    fputs(error, stdout);
+    printf("\n");
+    printf("%s:%d: benchmark %s cannot be closed.\n", __FILE__, __LINE__, benchmark->path);
+    exit(1);
+  }
+  benchmark->handle = NULL;
+  benchmark->main = NULL;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// copy a JSON string token, resolving the escapes generated by Python's json module
+static char *json_strdup(const char *str_json, jsmntok_t *tok) {
+  if (tok->type != JSMN_STRING) {
+    printf("%s:%d: unexpected token type %d (expected JSMN_STRING).\n", __FILE__, __LINE__, tok->type);
+    exit(1);
+  }
+  char *str = (char *)malloc(tok->end - tok->start + 1);
+  if (str == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  int len = 0;
+  for (int c = tok->start; c < tok->end; c++) {
+    if (str_json[c] == '\\' && c + 1 < tok->end) {
+      c++;
+      if (str_json[c] == 't')
+        str[len++] = '\t';
+      else if (str_json[c] == 'n')
+        str[len++] = '\n';
+      else
+        str[len++] = str_json[c]; // '"', '\\', '/'
+    } else {
+      str[len++] = str_json[c];
+    }
+  }
+  str[len] = '\0';
+  return str;
+}
+
+static int json_key_is(const char *str_json, jsmntok_t *tok, const char *key) {
+  return (int)strlen(key) == tok->end - tok->start && !strncmp(str_json + tok->start, key, tok->end - tok->start);
+}
+
+// parse an array of frequencies starting at token i; return the index of its last token
+static int parse_freqs(const char *str_json, jsmntok_t *t, int i, unsigned int *num_freqs, uint32_t **freqs) {
+  if (t[i].type != JSMN_ARRAY) {
+    printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
+    exit(1);
+  }
+  *num_freqs = t[i].size;
+  *freqs = (uint32_t *)malloc(*num_freqs * sizeof(uint32_t));
+  if (*freqs == NULL && *num_freqs > 0) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  for (int f = 0; f < *num_freqs; f++) {
+    if (t[++i].type != JSMN_PRIMITIVE) {
+      printf("%s:%d: unexpected token type %d (expected JSMN_PRIMITIVE).\n", __FILE__, __LINE__, t[i].type);
+      exit(1);
+    }
+    jsmn_parse_token(str_json, &t[i], "%u", &(*freqs)[f]);
+  }
+  return i;
+}
+
+// parse a benchmark object starting at token i; return the index of its last token
+static int parse_benchmark(const char *str_json, jsmntok_t *t, int i, benchmark_t *benchmark) {
+  if (t[i].type != JSMN_OBJECT) {
+    printf("%s:%d: unexpected token type %d (expected JSMN_OBJECT).\n", __FILE__, __LINE__, t[i].type);
+    exit(1);
+  }
+  benchmark->name = NULL;
+  benchmark->path = NULL;
+  benchmark->num_args = 0;
+  benchmark->args = NULL;
+  benchmark->handle = NULL;
+  benchmark->main = NULL;
+  int num_keys = t[i].size;
+  for (int k = 0; k < num_keys; k++) {
+    i++;
+    if (json_key_is(str_json, &t[i], "path")) {
+      benchmark->path = json_strdup(str_json, &t[++i]);
+    } else if (json_key_is(str_json, &t[i], "args")) {
+      if (t[++i].type != JSMN_ARRAY) {
+        printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
+        exit(1);
+      }
+      benchmark->num_args = t[i].size;
+      // +2 for argv[0] and NULL
+      benchmark->args = (char **)malloc((benchmark->num_args + 2) * sizeof(char *));
+      if (benchmark->args == NULL) {
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      for (int a = 1; a <= benchmark->num_args; a++)
+        benchmark->args[a] = json_strdup(str_json, &t[++i]);
+    } else {
+      printf("%s:%d: unexpected benchmark key '%.*s'.\n", __FILE__, __LINE__, t[i].end - t[i].start, str_json + t[i].start);
+      exit(1);
+    }
+  }
+  if (benchmark->path == NULL) {
+    printf("%s:%d: benchmark without path.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  if (benchmark->args == NULL) {
+    benchmark->args = (char **)malloc(2 * sizeof(char *));
+    if (benchmark->args == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+  // traces are named after the library, as with --benchmark
+  char *path = strdup(benchmark->path);
+  benchmark->name = strdup(path_basename(path));
+  free(path);
+  benchmark->args[0] = benchmark->path;
+  benchmark->args[benchmark->num_args + 1] = NULL;
+  return i;
+}
@@ -12,6 +12,13 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 // third-party libraries
 #include <jsmn.h>
 #ifdef __JETSON_AGX_XAVIER
@@ -21,7 +28,9 @@
 // voltmeter libraries
 #include <platform.h>
 #include <helper.h>
+#include <sensor.h>
 #include <cpu.h>
+#include <backend.h>
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -31,6 +40,19 @@
 
 static void free_events_freq_config(cpu_events_freq_config_t *events_freq_config);
 static void free_events_config(cpu_events_config_t *events_config);
+static int abort_events_json(cpu_events_config_t *events_config, char *str_json);
+static void probe_pmu(cpu_pmu_t *pmu);
+#ifdef __CPU_PERF_EVENT
+static int perf_open_group(cpu_perf_group_t *group, unsigned int core_id, cpu_counter_set_t *counter_set);
+static void perf_close_group(cpu_perf_group_t *group);
+static void perf_read_group(cpu_perf_group_t *group, uint64_t *values, uint64_t *time_enabled, uint64_t *time_running);
+static int perf_read_user(cpu_perf_group_t *group, uint64_t *values, uint64_t *time_enabled, uint64_t *time_running);
+static inline uint64_t perf_rdpmc(unsigned int counter);
+static inline uint64_t perf_user_cycles();
+#else
+static inline void write_pmevtyper(unsigned int counter, uint64_t type);
+static inline uint32_t read_pmevcntr(unsigned int counter);
+#endif
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -40,6 +62,15 @@ static void free_events_config(cpu_events_config_t *events_config);
 
 cpu_events_freq_config_t cpu_events;
 
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
+// persistent handles of the per-core frequency files
+static sensor_t *cpu_freq_sensors = NULL;
+// whether the frequencies can be read (cpufreq is optional on a generic machine)
+static int cpu_freq_available = 0;
+// PMU capabilities, the same for all cores
+static cpu_pmu_t cpu_pmu;
+#endif
+
 /*
  * ╔═══════════════════════════════════════════════════════╗
  * ║                       Functions                       ║
@@ -53,23 +84,43 @@ cpu_events_freq_config_t cpu_events;
  */
 
 uint32_t setup_cpu(FILE *log_file) {
-#ifdef __JETSON_AGX_XAVIER
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
+  backend->open_cpu_freq();
   // init global variable cpu_events
-  cpu_events.frequency = clip_cpu_freq(get_cpu_freq());
-  cpu_events.num_cores = NUM_CORES_CPU;
-  cpu_events.core = (cpu_core_events_t *)malloc(NUM_CORES_CPU * sizeof(cpu_core_events_t));
+  cpu_events.frequency = backend->clip_cpu_freq(backend->get_cpu_freq());
+  cpu_events.num_cores = get_cpu_num_cores();
+  cpu_events.core = (cpu_core_events_t *)malloc(cpu_events.num_cores * sizeof(cpu_core_events_t));
   if (cpu_events.core == NULL) {
     printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
     exit(1);
   }
-  for (int i = 0; i < NUM_CORES_CPU; i++) {
+  for (int i = 0; i < cpu_events.num_cores; i++) {
     cpu_events.core[i].freq_read = 0;
     cpu_events.core[i].counter_clk = 0;
     cpu_events.core[i].counter_set = NULL;
     cpu_events.core[i].num_sets = 0;
   }
-  printf_file(log_file, "CPU cores: %d\n", NUM_CORES_CPU);
-  printf_file(log_file, "Counters per CPU core: %d\n", NUM_COUNTERS_CPU);
+  // PMU capabilities: the cores are identical, probe the current one
+  backend->probe_pmu_cpu(&cpu_pmu);
+  if (cpu_pmu.num_counters < NUM_COUNTERS_CPU) {
+    printf("%s:%d: the CPU PMU has %u counters (expected at least %d).\n", __FILE__, __LINE__, cpu_pmu.num_counters, NUM_COUNTERS_CPU);
+    exit(1);
+  }
+  printf_file(log_file, "CPU cores: %u\n", cpu_events.num_cores);
+  if (backend == &backend_hardware && !cpu_freq_available)
+    printf_file(log_file, "CPU frequency: not available (no cpufreq), read as 0\n");
+#ifdef __CPU_PERF_EVENT
+  printf_file(log_file, "CPU counters: %s\n", backend == &backend_hardware ? "perf_event_open" : backend->name);
+#else
+  printf_file(log_file, "CPU counters: %s\n", backend == &backend_hardware ? "PMU registers" : backend->name);
+#endif
+  printf_file(log_file, "Counters per CPU core: %u\n", cpu_pmu.num_counters);
+#ifdef CPU_ARMV8_EVENTS
+  printf_file(log_file, "Common CPU events implemented: %d of %d\n", __builtin_popcountll(cpu_pmu.common_events), ARMV8_NUM_COMMON_EVENTS);
+#else
+  if (backend == &backend_hardware)
+    printf_file(log_file, "CPU events: raw codes of this CPU (no ARMv8 common events)\n");
+#endif
   return cpu_events.frequency;
 #else
 #error "Platform not supported."
@@ -78,6 +129,66 @@ uint32_t setup_cpu(FILE *log_file) {
 
 void deinit_cpu(){
   free_events_freq_config(&cpu_events);
+  backend->close_cpu_freq();
+}
+
+// pin the CPU frequency with the userspace governor (as utils/<platform>/set_freq_cpu.sh);
+// freq is in kHz as in AVAIL_FREQ_CPU_FILE, 0 selects the max; return the frequency set, in Hz
+uint32_t set_cpu_freq(uint32_t freq) {
+#ifdef __JETSON_AGX_XAVIER
+  if (freq == 0)
+    freq = sensor_read_max_u32(MAX_AVAIL_FREQ_CPU_FILE);
+  sensor_write(GOVERNOR_CPU_FILE, "userspace");
+  // max, min, max: the range stays valid whether the frequency goes up or down
+  sensor_write_u32(MAX_FREQ_CPU_FILE, freq);
+  sensor_write_u32(MIN_FREQ_CPU_FILE, freq);
+  sensor_write_u32(MAX_FREQ_CPU_FILE, freq);
+  sensor_write_u32(SET_FREQ_CPU_FILE, freq);
+  // kHz to Hz
+  return clip_cpu_freq(freq * 1000);
+#elif defined(__LINUX_GENERIC)
+  char file[SENSOR_PATH_LEN];
+  if (freq == 0)
+    freq = sensor_read_max_u32(MAX_AVAIL_FREQ_CPU_FILE);
+  // the policy of each core (cores may share one)
+  unsigned int num_cores = get_cpu_num_cores();
+  for (int c = 0; c < num_cores; c++) {
+    sprintf(file, GOVERNOR_CPU_FILE, c);
+    sensor_write(file, "userspace");
+    sprintf(file, MAX_FREQ_CPU_FILE, c);
+    sensor_write_u32(file, freq);
+    sprintf(file, MIN_FREQ_CPU_FILE, c);
+    sensor_write_u32(file, freq);
+    sprintf(file, MAX_FREQ_CPU_FILE, c);
+    sensor_write_u32(file, freq);
+    sprintf(file, SET_FREQ_CPU_FILE, c);
+    sensor_write_u32(file, freq);
+  }
+  // kHz to Hz
+  return clip_cpu_freq(freq * 1000);
+#else
+#error "Platform not supported."
+#endif
+}
+
+// drop the selected events, so that new ones can be selected for a new frequency (in Hz)
+void reset_cpu_events(uint32_t frequency) {
+  for (int c = 0; c < cpu_events.num_cores; c++) {
+    // cpu_events_all shares the counter sets of core 0 with all cores
+    if (c > 0 && cpu_events.core[c].counter_set == cpu_events.core[0].counter_set) {
+      cpu_events.core[c].counter_set = NULL;
+      cpu_events.core[c].num_sets = 0;
+      continue;
+    }
+    for (int s = 0; s < cpu_events.core[c].num_sets; s++) {
+      free(cpu_events.core[c].counter_set[s].event_id);
+      free(cpu_events.core[c].counter_set[s].counter);
+    }
+    free(cpu_events.core[c].counter_set);
+    cpu_events.core[c].counter_set = NULL;
+    cpu_events.core[c].num_sets = 0;
+  }
+  cpu_events.frequency = frequency;
 }
 
 /*
@@ -86,35 +197,25 @@ void deinit_cpu(){
  * └───────────────────────────────────────────────────────┘
  */
 
+// the events implemented by the PMU, packed into all its counters
 unsigned int cpu_events_all(FILE *log_file) {
-#ifdef __JETSON_AGX_XAVIER
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
+#ifndef CPU_ARMV8_EVENTS
+  // raw event codes of the CPU: sweeping them as ARMv8 event numbers is meaningless
+  if (backend == &backend_hardware) {
+    printf("%s:%d: all_events needs ARMv8 events; give the raw event codes of this CPU with cli or config.\n", __FILE__, __LINE__);
+    return 0;
+  }
+#endif
   unsigned int max_id = 0xFF;
-  // compute number of required sets
-  cpu_events.core[0].num_sets = (unsigned int)ceil((double)(max_id + 1) / NUM_COUNTERS_CPU);
+  cpu_event_id_t events[max_id + 1];
+  unsigned int num_events = cpu_pmu_events(&cpu_pmu, max_id, events);
   // compute for cpu_events.core[0], then copy pointer to all cores
-  cpu_events.core[0].counter_set = (cpu_counter_set_t*)malloc(sizeof(cpu_counter_set_t) * cpu_events.core[0].num_sets);
-  if (cpu_events.core[0].counter_set == NULL) {
-    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-    exit(1);
-  }
-  for (int s = 0; s < cpu_events.core[0].num_sets; s++) {
-    cpu_events.core[0].counter_set[s].num_counters = NUM_COUNTERS_CPU;
-    cpu_events.core[0].counter_set[s].counter = (cpu_counter_t*)malloc(sizeof(cpu_counter_t) * NUM_COUNTERS_CPU);
-    if (cpu_events.core[0].counter_set[s].counter == NULL) {
-      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-      exit(1);
-    }
-    cpu_events.core[0].counter_set[s].event_id = (cpu_event_id_t*)malloc(sizeof(cpu_event_id_t) * NUM_COUNTERS_CPU);
-    if (cpu_events.core[0].counter_set[s].event_id == NULL) {
-      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-      exit(1);
-    }
-    for (int e = 0; e < NUM_COUNTERS_CPU; e++) {
-      cpu_events.core[0].counter_set[s].event_id[e] = (cpu_event_id_t)(s * NUM_COUNTERS_CPU + e);
-    }
-  }
+  cpu_events.core[0].num_sets = cpu_pmu_pack(num_events, events, cpu_pmu.num_counters, &cpu_events.core[0].counter_set);
+  printf_file(log_file, "CPU events: %u of %u implemented, in sets of %u\n", num_events, max_id + 1, cpu_pmu.num_counters);
   // copy pointer to all cores
   for (int c = 1; c < cpu_events.num_cores; c++) {
+    cpu_events.core[c].num_sets = cpu_events.core[0].num_sets;
     cpu_events.core[c].counter_set = cpu_events.core[0].counter_set;
   }
   return cpu_events.core[0].num_sets;
@@ -124,13 +225,13 @@ unsigned int cpu_events_all(FILE *log_file) {
 }
 
 unsigned int cpu_events_from_cli(cpu_event_id_t *events, unsigned int num_events, FILE *log_file){
-#ifdef __JETSON_AGX_XAVIER
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
   // only supports cpu_events.core[c].num_sets = 1
   // events are expected in the order:
   // core0_event0 core0_event1 core0_event2 core1_event0 core1_event1 ...
-  if (num_events != NUM_CORES_CPU * NUM_COUNTERS_CPU) {
-    printf("%s:%d: unexpected number of events %d (expected %d).\n", __FILE__, __LINE__, num_events, NUM_CORES_CPU * NUM_COUNTERS_CPU);
-    exit(1);
+  if (num_events != cpu_events.num_cores * NUM_COUNTERS_CPU) {
+    printf("%s:%d: unexpected number of events %d (expected %d).\n", __FILE__, __LINE__, num_events, cpu_events.num_cores * NUM_COUNTERS_CPU);
+    return 0;
   }
   for (int c = 0; c < cpu_events.num_cores; c++) {
     cpu_events.core[c].num_sets = 1; // only 1 set supported (i.e. 3 counters per core)
@@ -164,7 +265,8 @@ unsigned int cpu_events_from_cli(cpu_event_id_t *events, unsigned int num_events
 
 unsigned int cpu_events_from_config(char *config_file, FILE *log_file) {
   cpu_events_config_t events_config;
-  parse_cpu_events_json(config_file, &events_config);
+  if (parse_cpu_events_json(config_file, &events_config))
+    return 0;
 
   // find CPU frequency in events_config
   uint32_t freq = cpu_events.frequency;
@@ -174,7 +276,8 @@ unsigned int cpu_events_from_config(char *config_file, FILE *log_file) {
   }
   if (f == events_config.num_freqs) {
     printf("%s:%d: CPU frequency %u not found in events_config.\n", __FILE__, __LINE__, freq);
-    exit(1);
+    free_events_config(&events_config);
+    return 0;
   }
   // set events
   for (int c = 0; c < cpu_events.num_cores; c++) {
@@ -206,7 +309,7 @@ unsigned int cpu_events_from_config(char *config_file, FILE *log_file) {
   return cpu_events.core[0].num_sets; // num_sets is the same for all cores
 }
 
-void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config){
+int parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config){
   jsmn_parser p;
   jsmntok_t t[1500]; // max 1500 tokens expected
   int ret;
@@ -215,7 +318,7 @@ void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config
   FILE *fp = fopen(config_file, "rb");
   if (fp == NULL) {
     printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, config_file);
-    exit(1);
+    return 1;
   }
   fseek(fp, 0L, SEEK_END);
   size_t sz = ftell(fp);
@@ -232,9 +335,10 @@ void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config
   // parse json string into tokens
   jsmn_init(&p);
   ret = jsmn_parse(&p, str_json, sz, t, 1500);
-  if (ret < 0) {
+  if (ret < 1 || t[0].type != JSMN_OBJECT) {
       printf("%s:%d: failed to parse JSON '%s' (error %d).\n", __FILE__, __LINE__, config_file, ret);
-      exit(1);
+      free(str_json);
+      return 1;
   }
 
   uint32_t frequency;
@@ -247,7 +351,8 @@ void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config
   num_frequencies_json = t[i].size;
   // allocate events_config with num_frequencies_json frequencies
   events_config->num_freqs = num_frequencies_json;
-  events_config->cpu_events_freq_config = (cpu_events_freq_config_t *)malloc(num_frequencies_json * sizeof(cpu_events_freq_config_t));
+  // zeroed: a partially parsed config is freed on invalid input
+  events_config->cpu_events_freq_config = (cpu_events_freq_config_t *)calloc(num_frequencies_json, sizeof(cpu_events_freq_config_t));
   if (events_config->cpu_events_freq_config == NULL) {
     printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
     exit(1);
@@ -258,22 +363,22 @@ void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config
     // frequency
     if (t[++i].type != JSMN_STRING) {
       printf("%s:%d: unexpected token type %d (expected JSMN_STRING).\n", __FILE__, __LINE__, t[i].type);
-      exit(1);
+      return abort_events_json(events_config, str_json);
     }
     jsmn_parse_token(str_json, &t[i], "%d", &frequency);
     events_config->cpu_events_freq_config[f].frequency = frequency;
     if (t[++i].type != JSMN_OBJECT) {
       printf("%s:%d: unexpected token type %d (expected JSMN_OBJECT).\n", __FILE__, __LINE__, t[i].type);
-      exit(1);
+      return abort_events_json(events_config, str_json);
     }
     num_cores_json = t[i].size;
-    if (num_cores_json != NUM_CORES_CPU) {
-      printf("%s:%d: unexpected number of cores %d (expected %d).\n", __FILE__, __LINE__, num_cores_json, NUM_CORES_CPU);
-      exit(1);
+    if (num_cores_json != get_cpu_num_cores()) {
+      printf("%s:%d: unexpected number of cores %d (expected %u).\n", __FILE__, __LINE__, num_cores_json, get_cpu_num_cores());
+      return abort_events_json(events_config, str_json);
     }
     // allocate space for cores
     events_config->cpu_events_freq_config[f].num_cores = num_cores_json;
-    events_config->cpu_events_freq_config[f].core = (cpu_core_events_t *)malloc(num_cores_json * sizeof(cpu_core_events_t));
+    events_config->cpu_events_freq_config[f].core = (cpu_core_events_t *)calloc(num_cores_json, sizeof(cpu_core_events_t));
     if (events_config->cpu_events_freq_config[f].core == NULL) {
       printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
       exit(1);
@@ -282,16 +387,16 @@ void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config
       // cores list
       if (t[++i].type != JSMN_STRING) {
         printf("%s:%d: unexpected token type %d (expected JSMN_STRING).\n", __FILE__, __LINE__, t[i].type);
-        exit(1);
+        return abort_events_json(events_config, str_json);
       }
       if (t[++i].type != JSMN_ARRAY) {
         printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
-        exit(1);
+        return abort_events_json(events_config, str_json);
       }
       num_counters_core_json = t[i].size;
       if (num_counters_core_json != NUM_COUNTERS_CPU) {
         printf("%s:%d: unexpected number of events %d per core(expected %d).\n", __FILE__, __LINE__, num_counters_core_json, NUM_COUNTERS_CPU);
-        exit(1);
+        return abort_events_json(events_config, str_json);
       }
 
       // allocate space for events
@@ -315,7 +420,7 @@ void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config
         // events list
         if (t[++i].type != JSMN_PRIMITIVE) {
           printf("%s:%d: unexpected token type %d (expected JSMN_PRIMITIVE).\n", __FILE__, __LINE__, t[i].type);
-          exit(1);
+          return abort_events_json(events_config, str_json);
         }
         jsmn_parse_token(str_json, &t[i], "%d", &event);
         // assign events (only 1 set supported)
@@ -323,77 +428,191 @@ void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config
       }
     }
   }
+  free(str_json);
+  return 0;
 }
 
 /*
  * ┌───────────────────────────────────────────────────────┐
- * │                      PMU driver                       │
+ * │                   PMU capabilities                    │
  * └───────────────────────────────────────────────────────┘
  */
 
-void enable_pmu_cpu_core(unsigned int core_id, unsigned int set_id) {
-#if defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
-  cpu_event_id_t event[NUM_COUNTERS_CPU];
+// from the values of the PMU registers: PMCR_EL0.N counters; PMCEID0_EL0 and
+// PMCEID1_EL0 bits 31:0 tell the common events 0x00-0x1f and 0x20-0x3f implemented
+// (their bits 63:32, the events from 0x4000, are not used)
+void cpu_pmu_discover(cpu_pmu_t *pmu, uint64_t pmcr, uint64_t pmceid0, uint64_t pmceid1) {
+  pmu->num_counters = (pmcr >> ARMV8_PMCR_N_SHIFT) & ARMV8_PMCR_N_MASK;
+  pmu->common_events = (pmceid0 & 0xffffffff) | ((pmceid1 & 0xffffffff) << 32);
+}
 
-  for (int i = 0; i < NUM_COUNTERS_CPU; i++)
-    event[i] = cpu_events.core[core_id].counter_set[set_id].event_id[i] & ARMV8_PMEVTYPER_EVTCOUNT_MASK;
+// events after the common ones are implementation defined: the PMU does not tell
+// whether they are implemented, they are assumed so
+int cpu_pmu_event_implemented(const cpu_pmu_t *pmu, cpu_event_id_t event) {
+  if (event >= ARMV8_NUM_COMMON_EVENTS)
+    return 1;
+  return (pmu->common_events >> event) & 1;
+}
 
-  __asm__ __volatile__("isb");
-  // use counters 0-2
-  __asm__ __volatile__("msr pmevtyper0_el0, %0" : : "r" (event[0]));
-  __asm__ __volatile__("msr pmevtyper1_el0, %0" : : "r" (event[1]));
-  __asm__ __volatile__("msr pmevtyper2_el0, %0" : : "r" (event[2]));
+// implemented events up to max_id, in events (max_id + 1 entries); return their number
+unsigned int cpu_pmu_events(const cpu_pmu_t *pmu, cpu_event_id_t max_id, cpu_event_id_t *events) {
+  unsigned int num_events = 0;
+  for (cpu_event_id_t e = 0; e <= max_id; e++) {
+    if (cpu_pmu_event_implemented(pmu, e))
+      events[num_events++] = e;
+  }
+  return num_events;
+}
 
-  // Performance Monitors Count Enable Set register bit 30:1 disable, 31,1 enable
-  uint32_t r = 0;
-  __asm__ __volatile__("mrs %0, pmcr_el0" : "=r" (r));
-  // clear counters
-  __asm__ __volatile__("msr pmcr_el0, %0" : : "r" (r|(1<<1)|(1<<2)));
+// pack the events into sets of num_counters counters (the last one is padded with
+// clock cycles, so that all sets have the same size); return the number of sets
+unsigned int cpu_pmu_pack(unsigned int num_events, cpu_event_id_t *events, unsigned int num_counters, cpu_counter_set_t **sets) {
+  if (num_counters == 0) {
+    printf("%s:%d: the CPU PMU has no counter.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  unsigned int num_sets = (num_events + num_counters - 1) / num_counters;
+  *sets = (cpu_counter_set_t*)malloc(sizeof(cpu_counter_set_t) * (num_sets > 0 ? num_sets : 1));
+  if (*sets == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  for (int s = 0; s < num_sets; s++) {
+    cpu_counter_set_t *set = &(*sets)[s];
+    set->num_counters = num_counters;
+    set->counter = (cpu_counter_t*)malloc(sizeof(cpu_counter_t) * num_counters);
+    if (set->counter == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    set->event_id = (cpu_event_id_t*)malloc(sizeof(cpu_event_id_t) * num_counters);
+    if (set->event_id == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    for (int e = 0; e < num_counters; e++) {
+      unsigned int i = s * num_counters + e;
+      set->event_id[e] = i < num_events ? events[i] : CPU_EVENT_CYCLES;
+    }
+  }
+  return num_sets;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                      PMU driver                       │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// PMU capabilities of the current core
+void probe_pmu_cpu(cpu_pmu_t *pmu) {
+  probe_pmu(pmu);
+}
 
+// counters are left free-running: the events of a sample are the difference
+// from the previous read, which enable and program take as the starting point
+void enable_pmu_cpu_core(unsigned int core_id, unsigned int set_id) {
+#if defined(__CPU_PERF_EVENT)
+  cpu_events.core[core_id].perf_group.num_events = 0;
+  program_pmu_cpu_core(core_id, set_id);
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
+  program_pmu_cpu_core(core_id, set_id);
+
+  // Performance Monitors Count Enable Set register: enable the counters of the set
+  uint32_t r = 0;
   __asm__ __volatile__("mrs %0, pmcntenset_el0" : "=r" (r));
-  __asm__ __volatile__("msr pmcntenset_el0, %0" : : "r" (r|111));
+  __asm__ __volatile__("msr pmcntenset_el0, %0" : : "r" (r|((1u << cpu_events.core[core_id].counter_set[set_id].num_counters) - 1)));
+  __asm__ __volatile__("isb");
+  __asm__ __volatile__("mrs %0, pmccntr_el0" : "=r" (cpu_events.core[core_id].counter_clk_prev));
+  for (int i = 0; i < cpu_events.core[core_id].counter_set[set_id].num_counters; i++)
+    cpu_events.core[core_id].counter_prev[i] = read_pmevcntr(i);
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
 }
 
-void disable_pmu_cpu_core() {
-#if defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
-  // Performance Monitors Count Enable Set register: clear bit 0
-  uint32_t r = 0;
+// count the events of a set from now on (e.g., when multiplexing), the clock
+// cycles counter is not affected (with perf_event_open, the group of the set
+// replaces that of the previous one, clock cycles included)
+void program_pmu_cpu_core(unsigned int core_id, unsigned int set_id) {
+#if defined(__CPU_PERF_EVENT)
+  cpu_perf_group_t *group = &cpu_events.core[core_id].perf_group;
+  cpu_counter_set_t *counter_set = &cpu_events.core[core_id].counter_set[set_id];
+  if (group->num_events > 0)
+    perf_close_group(group);
+  if (perf_open_group(group, core_id, counter_set)) {
+    printf("%s:%d: failed to open the perf events of set %u on core %u (%s).\n", __FILE__, __LINE__, set_id, core_id, strerror(errno));
+    exit(1);
+  }
+  if (ioctl(group->fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0) {
+    printf("%s:%d: failed to enable the perf events of core %u (%s).\n", __FILE__, __LINE__, core_id, strerror(errno));
+    exit(1);
+  }
+  perf_read_group(group, group->value_prev, &group->time_enabled_prev, &group->time_running_prev);
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
+  cpu_counter_set_t *counter_set = &cpu_events.core[core_id].counter_set[set_id];
 
-  __asm__ __volatile__("mrs %0, pmcntenset_el0" : "=r" (r));
-  __asm__ __volatile__("msr pmcntenset_el0, %0" : : "r" (r && 0xfffffff8));
+  __asm__ __volatile__("isb");
+  // use counters 0 to num_counters - 1
+  for (int i = 0; i < counter_set->num_counters; i++)
+    write_pmevtyper(i, counter_set->event_id[i] & ARMV8_PMEVTYPER_EVTCOUNT_MASK);
+  __asm__ __volatile__("isb");
+  for (int i = 0; i < counter_set->num_counters; i++)
+    cpu_events.core[core_id].counter_prev[i] = read_pmevcntr(i);
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
 }
 
-void read_counters_cpu_core(unsigned int core_id, unsigned int set_id) {
-#if defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
-  __asm__ __volatile__("mrs %0, pmccntr_el0"   : "=r" (cpu_events.core[core_id].counter_clk));
-  __asm__ __volatile__("mrs %0, pmevcntr0_el0" : "=r" (cpu_events.core[core_id].counter_set[set_id].counter[0]));
-  __asm__ __volatile__("mrs %0, pmevcntr1_el0" : "=r" (cpu_events.core[core_id].counter_set[set_id].counter[1]));
-  __asm__ __volatile__("mrs %0, pmevcntr2_el0" : "=r" (cpu_events.core[core_id].counter_set[set_id].counter[2]));
+void disable_pmu_cpu_core(unsigned int core_id) {
+#if defined(__CPU_PERF_EVENT)
+  perf_close_group(&cpu_events.core[core_id].perf_group);
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
+  // Performance Monitors Count Enable Clear register: disable the configurable counters
+  uint32_t r = (1u << cpu_pmu.num_counters) - 1;
+  __asm__ __volatile__("msr pmcntenclr_el0, %0" : : "r" (r));
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
 }
 
-void reset_counters_cpu_core() {
-#if defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
-  // Performance Monitors Count Enable Set register
-  uint32_t r = 0;
-  __asm__ __volatile__("mrs %0, pmcr_el0" : "=r" (r));
-  // clear counters
-  __asm__ __volatile__("msr pmcr_el0, %0" : : "r" (r|(1<<1)|(1<<2)));
+// events since the previous read, as 64-bit deltas of the free-running counters
+void read_counters_cpu_core(unsigned int core_id, unsigned int set_id) {
+#if defined(__CPU_PERF_EVENT)
+  cpu_core_events_t *core = &cpu_events.core[core_id];
+  cpu_counter_set_t *counter_set = &core->counter_set[set_id];
+  cpu_perf_group_t *group = &core->perf_group;
+  uint64_t values[CPU_PERF_MAX_EVENTS];
+  uint64_t time_enabled, time_running;
+  perf_read_group(group, values, &time_enabled, &time_running);
+  // the events of a group are on the PMU together: the same scaling for all
+  uint64_t enabled = time_enabled - group->time_enabled_prev;
+  uint64_t running = time_running - group->time_running_prev;
+  core->counter_clk = cpu_counter_scale(values[0] - group->value_prev[0], enabled, running);
+  for (int i = 0; i < counter_set->num_counters; i++)
+    counter_set->counter[i] = cpu_counter_scale(values[1 + i] - group->value_prev[1 + i], enabled, running);
+  memcpy(group->value_prev, values, sizeof(uint64_t) * group->num_events);
+  group->time_enabled_prev = time_enabled;
+  group->time_running_prev = time_running;
+#elif defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
+  cpu_core_events_t *core = &cpu_events.core[core_id];
+  cpu_counter_set_t *counter_set = &core->counter_set[set_id];
+  uint64_t clk;
+  __asm__ __volatile__("mrs %0, pmccntr_el0"   : "=r" (clk));
+  core->counter_clk = cpu_counter_clk_delta(core->counter_clk_prev, clk);
+  core->counter_clk_prev = clk;
+  for (int i = 0; i < counter_set->num_counters; i++) {
+    uint32_t value = read_pmevcntr(i);
+    counter_set->counter[i] = cpu_counter_delta(core->counter_prev[i], value);
+    core->counter_prev[i] = value;
+  }
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
 }
 
 void read_cpu_core_freq(unsigned int core_id) {
-  cpu_events.core[core_id].freq_read = get_cpu_core_freq(core_id);
+  cpu_events.core[core_id].freq_read = backend->get_cpu_core_freq(core_id);
 }
 
 /*
@@ -402,12 +621,77 @@ void read_cpu_core_freq(unsigned int core_id) {
  * └───────────────────────────────────────────────────────┘
  */
 
+// open per-core frequency files once, they are read at every sample
+void open_cpu_freq() {
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
+  unsigned int num_cores = get_cpu_num_cores();
+  cpu_freq_sensors = (sensor_t *)malloc(num_cores * sizeof(sensor_t));
+  if (cpu_freq_sensors == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  cpu_freq_available = 1;
+  for (int i = 0; i < num_cores; i++) {
+    char freq_core_file[SENSOR_PATH_LEN];
+    sprintf(freq_core_file, CORE_FREQ_CPU_FILE, i);
+#ifdef __LINUX_GENERIC
+    // no cpufreq (e.g., a virtual machine): the frequencies are reported as 0
+    if (sensor_try_open(&cpu_freq_sensors[i], freq_core_file) != 0)
+      cpu_freq_available = 0;
+#else
+    sensor_open(&cpu_freq_sensors[i], freq_core_file);
+#endif
+  }
+  if (!cpu_freq_available) {
+    for (int i = 0; i < num_cores; i++)
+      sensor_close(&cpu_freq_sensors[i]);
+  }
+#else
+#error "Platform not supported."
+#endif
+}
+
+void close_cpu_freq() {
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
+  if (cpu_freq_sensors == NULL)
+    return;
+  for (int i = 0; i < get_cpu_num_cores(); i++)
+    sensor_close(&cpu_freq_sensors[i]);
+  free(cpu_freq_sensors);
+  cpu_freq_sensors = NULL;
+#else
+#error "Platform not supported."
+#endif
+}
+
+// cores of the CPU: fixed on the Jetson, those of the machine Voltmeter runs on otherwise
+unsigned int get_cpu_num_cores() {
+#if defined(__JETSON_AGX_XAVIER)
+  return NUM_CORES_CPU;
+#elif defined(__LINUX_GENERIC)
+  long num_cores = sysconf(_SC_NPROCESSORS_CONF);
+  if (num_cores < 1) {
+    printf("%s:%d: failed to get the number of CPU cores.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  return num_cores;
+#else
+#error "Platform not supported."
+#endif
+}
+
 uint32_t get_cpu_freq(){
-#ifdef __JETSON_AGX_XAVIER
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
   uint32_t freq = 0;
-  FILE *fp = fopen(CUR_FREQ_CPU_FILE, "r");
+  char path[SENSOR_PATH_LEN];
+  FILE *fp = fopen(sensor_path(CUR_FREQ_CPU_FILE, path), "r");
+#ifdef __LINUX_GENERIC
+  // no cpufreq: unknown frequency
+  if (fp == NULL)
+    return 0;
+#endif
   if (fp == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, CUR_FREQ_CPU_FILE);
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, path);
     exit(1);
   }
   fscanf(fp, "%d", &freq);
@@ -420,17 +704,11 @@ uint32_t get_cpu_freq(){
 }
 
 uint32_t get_cpu_core_freq(unsigned int core_id){
-#ifdef __JETSON_AGX_XAVIER
-  uint32_t freq = 0;
-  char freq_core_file[100];
-  sprintf(freq_core_file, CORE_FREQ_CPU_FILE, core_id);
-  FILE *fp = fopen(freq_core_file, "r");
-  if (fp == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, CUR_FREQ_CPU_FILE);
-    exit(1);
-  }
-  fscanf(fp, "%d", &freq);
-  fclose(fp);
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
+  if (!cpu_freq_available)
+    return 0;
+  // persistent handle opened in setup_cpu
+  uint32_t freq = sensor_read_u32(&cpu_freq_sensors[core_id]);
   // fetched in kHz, convert to Hz
   return freq * 1000;
 #else
@@ -440,14 +718,20 @@ uint32_t get_cpu_core_freq(unsigned int core_id){
 
 // clip CPU frequency to the closest available advertised frequency
 uint32_t clip_cpu_freq(uint32_t freq){
-#ifdef __JETSON_AGX_XAVIER
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
   // read a list of integers from a file
   uint32_t *avail_freqs = NULL;
   uint32_t num_avail_freqs = 0;
   uint32_t freq_read;
-  FILE *fp = fopen(AVAIL_FREQ_CPU_FILE, "r");
+  char path[SENSOR_PATH_LEN];
+  FILE *fp = fopen(sensor_path(AVAIL_FREQ_CPU_FILE, path), "r");
+#ifdef __LINUX_GENERIC
+  // no list of frequencies (e.g., intel_pstate): the frequency is taken as is
+  if (fp == NULL)
+    return freq;
+#endif
   if (fp == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, AVAIL_FREQ_CPU_FILE);
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, path);
     exit(1);
   }
   while (fscanf(fp, "%d", &freq_read) != EOF) {
@@ -505,6 +789,22 @@ void print_cpu_events_set(FILE *log_file, unsigned int set_id) {
   }
 }
 
+// longest sample period (in us) at which a 32-bit counter counts fewer than 2^32
+// events between reads, at the highest CPU frequency and with the most events a
+// counter can count per cycle
+uint64_t cpu_max_read_period_us() {
+#if defined(__CPU_PERF_EVENT)
+  // the kernel accumulates the counters into 64-bit totals
+  return UINT64_MAX;
+#elif defined(__JETSON_AGX_XAVIER)
+  // kHz
+  uint64_t max_freq = sensor_read_max_u32(AVAIL_FREQ_CPU_FILE);
+  return max_freq > 0 ? (1ULL << 32) * 1000 / (max_freq * MAX_EVENTS_PER_CYCLE_CPU) : UINT64_MAX;
+#else
+#error "Platform not supported."
+#endif
+}
+
 /*
  * ╔═══════════════════════════════════════════════════════╗
  * ║                   Static functions                    ║
@@ -513,6 +813,9 @@ void print_cpu_events_set(FILE *log_file, unsigned int set_id) {
 
 static void free_events_freq_config(cpu_events_freq_config_t *events_freq_config) {
   for (int c = 0; c < events_freq_config->num_cores; c++) {
+    // cpu_events_all shares the counter sets of core 0 with all cores
+    if (c > 0 && events_freq_config->core[c].counter_set == events_freq_config->core[0].counter_set)
+      continue;
     for (int s = 0; s < events_freq_config->core[c].num_sets; s++) {
       free(events_freq_config->core[c].counter_set[s].event_id);
       free(events_freq_config->core[c].counter_set[s].counter);
@@ -528,3 +831,269 @@ static void free_events_config(cpu_events_config_t *events_config) {
   }
   free(events_config->cpu_events_freq_config);
 }
+
+// free a partially parsed events config on invalid input; return 1 (error)
+static int abort_events_json(cpu_events_config_t *events_config, char *str_json) {
+  free_events_config(events_config);
+  free(str_json);
+  return 1;
+}
+
+#if defined(__CPU_PERF_EVENT)
+
+// PMU of the current core through perf_event_open: its counters are those of the
+// largest group of clock cycles events the kernel puts on the PMU (e.g., the NMI
+// watchdog may hold one), its common events those the kernel accepts (on ARM only:
+// elsewhere raw codes are not ARMv8 event numbers, and the kernel accepts them all)
+static void probe_pmu(cpu_pmu_t *pmu) {
+  unsigned int core_id = sched_getcpu();
+  cpu_event_id_t event_id[ARMV8_MAX_COUNTERS];
+  cpu_counter_set_t counter_set = {0, event_id, NULL};
+  cpu_perf_group_t group;
+  uint64_t values[CPU_PERF_MAX_EVENTS];
+  uint64_t time_enabled, time_running;
+  for (int e = 0; e < ARMV8_MAX_COUNTERS; e++)
+    event_id[e] = CPU_EVENT_CYCLES;
+
+  pmu->num_counters = 0;
+  for (unsigned int n = 1; n <= ARMV8_MAX_COUNTERS; n++) {
+    counter_set.num_counters = n;
+    if (perf_open_group(&group, core_id, &counter_set)) {
+      // not even one counter: perf_event_open is not permitted or there is no PMU
+      if (n == 1) {
+        printf("%s:%d: failed to open the CPU perf events (%s), see /proc/sys/kernel/perf_event_paranoid.\n", __FILE__, __LINE__, strerror(errno));
+        exit(1);
+      }
+      break;
+    }
+    ioctl(group.fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    usleep(1000);
+    ioctl(group.fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    perf_read_group(&group, values, &time_enabled, &time_running);
+    perf_close_group(&group);
+    if (time_running == 0)
+      break;
+    pmu->num_counters = n;
+  }
+  pmu->common_events = 0;
+#ifdef CPU_ARMV8_EVENTS
+  counter_set.num_counters = 1;
+  for (cpu_event_id_t e = 0; e < ARMV8_NUM_COMMON_EVENTS; e++) {
+    event_id[0] = e;
+    if (!perf_open_group(&group, core_id, &counter_set)) {
+      pmu->common_events |= 1ULL << e;
+      perf_close_group(&group);
+    }
+  }
+#endif
+}
+
+// group of a counter set on a core (all tasks, user and kernel), disabled: the clock
+// cycles lead, the raw events of the counters follow; their user pages are mapped
+// for reads without system calls; return 0, or -1 with errno set
+static int perf_open_group(cpu_perf_group_t *group, unsigned int core_id, cpu_counter_set_t *counter_set) {
+  struct perf_event_attr attr;
+  long page_size = sysconf(_SC_PAGESIZE);
+  group->num_events = 0;
+  for (unsigned int e = 0; e < 1 + counter_set->num_counters; e++) {
+    memset(&attr, 0, sizeof(struct perf_event_attr));
+    attr.size = sizeof(struct perf_event_attr);
+    attr.type = e == 0 ? PERF_TYPE_HARDWARE : PERF_TYPE_RAW;
+    attr.config = e == 0 ? PERF_COUNT_HW_CPU_CYCLES : counter_set->event_id[e - 1];
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.disabled = e == 0;
+#ifdef __aarch64__
+    // user-space access to the counters (if the perf_user_access sysctl allows it)
+    attr.config1 = 0x2;
+#endif
+    int fd = syscall(SYS_perf_event_open, &attr, -1, core_id, e == 0 ? -1 : group->fd[0], 0);
+    if (fd < 0) {
+      int err = errno;
+      perf_close_group(group);
+      errno = err;
+      return -1;
+    }
+    group->fd[e] = fd;
+    group->page[e] = mmap(NULL, page_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (group->page[e] == MAP_FAILED)
+      group->page[e] = NULL;
+    group->num_events++;
+  }
+  return 0;
+}
+
+static void perf_close_group(cpu_perf_group_t *group) {
+  long page_size = sysconf(_SC_PAGESIZE);
+  if (group->num_events > 0)
+    ioctl(group->fd[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  // the leader last
+  for (int e = group->num_events - 1; e >= 0; e--) {
+    if (group->page[e] != NULL)
+      munmap(group->page[e], page_size);
+    close(group->fd[e]);
+  }
+  group->num_events = 0;
+}
+
+// totals of the events of a group and the times it was enabled and on the PMU (ns):
+// from the user pages if possible, else with a single read of the whole group
+static void perf_read_group(cpu_perf_group_t *group, uint64_t *values, uint64_t *time_enabled, uint64_t *time_running) {
+  // PERF_FORMAT_GROUP layout: number of events, time enabled, time running, values
+  uint64_t buf[3 + CPU_PERF_MAX_EVENTS];
+  ssize_t size = sizeof(uint64_t) * (3 + group->num_events);
+  if (perf_read_user(group, values, time_enabled, time_running))
+    return;
+  if (read(group->fd[0], buf, size) != size) {
+    printf("%s:%d: failed to read the CPU perf events (%s).\n", __FILE__, __LINE__, strerror(errno));
+    exit(1);
+  }
+  *time_enabled = buf[1];
+  *time_running = buf[2];
+  memcpy(values, &buf[3], sizeof(uint64_t) * group->num_events);
+}
+
+// read of a group in user space, with the protocol of struct perf_event_mmap_page:
+// possible if the kernel allows user access to the counters and the group is on the
+// PMU of the current core (i.e., not multiplexed out; the reader is pinned to the
+// core); the times are extrapolated from the last update of the kernel with the
+// time stamp counter; return 0 if a system call is needed
+static int perf_read_user(cpu_perf_group_t *group, uint64_t *values, uint64_t *time_enabled, uint64_t *time_running) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__aarch64__))
+  for (unsigned int e = 0; e < group->num_events; e++) {
+    volatile struct perf_event_mmap_page *page = group->page[e];
+    uint32_t seq, index;
+    uint64_t count, enabled, running;
+    if (page == NULL)
+      return 0;
+    do {
+      seq = page->lock;
+      __asm__ __volatile__("" : : : "memory");
+      index = page->index;
+      if (!page->cap_user_rdpmc || index == 0 || (e == 0 && !page->cap_user_time))
+        return 0;
+      enabled = page->time_enabled;
+      running = page->time_running;
+      if (e == 0) {
+        uint64_t cycles = perf_user_cycles();
+        if (page->cap_user_time_short)
+          cycles = page->time_cycles + ((cycles - page->time_cycles) & page->time_mask);
+        uint64_t quot = cycles >> page->time_shift;
+        uint64_t rem = cycles & (((uint64_t)1 << page->time_shift) - 1);
+        uint64_t delta = page->time_offset + quot * page->time_mult + ((rem * page->time_mult) >> page->time_shift);
+        enabled += delta;
+        running += delta;
+      }
+      // the counter holds the low pmc_width bits of the count since offset
+      int64_t pmc = perf_rdpmc(index - 1);
+      pmc <<= 64 - page->pmc_width;
+      pmc >>= 64 - page->pmc_width;
+      count = page->offset + pmc;
+      __asm__ __volatile__("" : : : "memory");
+    } while (page->lock != seq);
+    values[e] = count;
+    if (e == 0) {
+      *time_enabled = enabled;
+      *time_running = running;
+    }
+  }
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+// hardware counter of the current core (index of the user page minus one)
+static inline uint64_t perf_rdpmc(unsigned int counter) {
+#if defined(__GNUC__) && defined(__x86_64__)
+  uint32_t low, high;
+  __asm__ __volatile__("rdpmc" : "=a" (low), "=d" (high) : "c" (counter));
+  return ((uint64_t)high << 32) | low;
+#elif defined(__GNUC__) && defined(__aarch64__)
+  uint64_t value;
+  // counter 31 is the clock cycles counter
+  if (counter == 31) {
+    __asm__ __volatile__("mrs %0, pmccntr_el0" : "=r" (value));
+  } else {
+    __asm__ __volatile__("msr pmselr_el0, %0" : : "r" ((uint64_t)counter));
+    __asm__ __volatile__("isb");
+    __asm__ __volatile__("mrs %0, pmxevcntr_el0" : "=r" (value));
+  }
+  return value;
+#else
+  return 0;
+#endif
+}
+
+// time stamp counter the times of the user pages are extrapolated with
+static inline uint64_t perf_user_cycles() {
+#if defined(__GNUC__) && defined(__x86_64__)
+  uint32_t low, high;
+  __asm__ __volatile__("rdtsc" : "=a" (low), "=d" (high));
+  return ((uint64_t)high << 32) | low;
+#elif defined(__GNUC__) && defined(__aarch64__)
+  uint64_t value;
+  __asm__ __volatile__("isb");
+  __asm__ __volatile__("mrs %0, cntvct_el0" : "=r" (value));
+  return value;
+#else
+  return 0;
+#endif
+}
+
+#else
+
+// identification registers of the PMU of the current core
+static void probe_pmu(cpu_pmu_t *pmu) {
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
+  uint64_t pmcr, pmceid0, pmceid1;
+  __asm__ __volatile__("mrs %0, pmcr_el0" : "=r" (pmcr));
+  __asm__ __volatile__("mrs %0, pmceid0_el0" : "=r" (pmceid0));
+  __asm__ __volatile__("mrs %0, pmceid1_el0" : "=r" (pmceid1));
+  cpu_pmu_discover(pmu, pmcr, pmceid0, pmceid1);
+#else
+#error "Unsupported platform/architecture/compiler".
+#endif
+}
+
+// counters 0-5 have their own registers; the others are selected with PMSELR_EL0
+static inline void write_pmevtyper(unsigned int counter, uint64_t type) {
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
+  switch (counter) {
+    case 0: __asm__ __volatile__("msr pmevtyper0_el0, %0" : : "r" (type)); break;
+    case 1: __asm__ __volatile__("msr pmevtyper1_el0, %0" : : "r" (type)); break;
+    case 2: __asm__ __volatile__("msr pmevtyper2_el0, %0" : : "r" (type)); break;
+    case 3: __asm__ __volatile__("msr pmevtyper3_el0, %0" : : "r" (type)); break;
+    case 4: __asm__ __volatile__("msr pmevtyper4_el0, %0" : : "r" (type)); break;
+    case 5: __asm__ __volatile__("msr pmevtyper5_el0, %0" : : "r" (type)); break;
+    default:
+      __asm__ __volatile__("msr pmselr_el0, %0" : : "r" ((uint64_t)counter));
+      __asm__ __volatile__("isb");
+      __asm__ __volatile__("msr pmxevtyper_el0, %0" : : "r" (type));
+  }
+#else
+#error "Unsupported platform/architecture/compiler".
+#endif
+}
+
+static inline uint32_t read_pmevcntr(unsigned int counter) {
+#if defined(__GNUC__) && defined(__aarch64__) && defined(__JETSON_AGX_XAVIER)
+  uint64_t value;
+  switch (counter) {
+    case 0: __asm__ __volatile__("mrs %0, pmevcntr0_el0" : "=r" (value)); break;
+    case 1: __asm__ __volatile__("mrs %0, pmevcntr1_el0" : "=r" (value)); break;
+    case 2: __asm__ __volatile__("mrs %0, pmevcntr2_el0" : "=r" (value)); break;
+    case 3: __asm__ __volatile__("mrs %0, pmevcntr3_el0" : "=r" (value)); break;
+    case 4: __asm__ __volatile__("mrs %0, pmevcntr4_el0" : "=r" (value)); break;
+    case 5: __asm__ __volatile__("mrs %0, pmevcntr5_el0" : "=r" (value)); break;
+    default:
+      __asm__ __volatile__("msr pmselr_el0, %0" : : "r" ((uint64_t)counter));
+      __asm__ __volatile__("isb");
+      __asm__ __volatile__("mrs %0, pmxevcntr_el0" : "=r" (value));
+  }
+  return (uint32_t)value;
+#else
+#error "Unsupported platform/architecture/compiler".
+#endif
+}
+
+#endif
@@ -0,0 +1,275 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+// voltmeter libraries
+#include <daemon.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static void *daemon_listener(void *args);
+static daemon_job_t *read_job(int fd, int *shutdown);
+static void enqueue_job(daemon_t *daemon, daemon_job_t *job);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// bind the job socket and start accepting jobs in a listener thread
+void daemon_start(daemon_t *daemon, char *socket_path) {
+  struct sockaddr_un addr;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    printf("%s:%d: socket path too long '%s'.\n", __FILE__, __LINE__, socket_path);
+    exit(1);
+  }
+  daemon->socket_path = socket_path;
+  daemon->head = NULL;
+  daemon->tail = NULL;
+  daemon->num_jobs = 0;
+  daemon->shutdown = 0;
+  pthread_mutex_init(&daemon->lock, NULL);
+  pthread_cond_init(&daemon->cond, NULL);
+
+  daemon->socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (daemon->socket_fd < 0) {
+    perror("socket");
+    printf("%s:%d: failed to create socket.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, socket_path);
+  // a stale socket is left behind if a previous daemon was killed
+  unlink(socket_path);
+  if (bind(daemon->socket_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("bind");
+    printf("%s:%d: failed to bind socket '%s'.\n", __FILE__, __LINE__, socket_path);
+    exit(1);
+  }
+  if (listen(daemon->socket_fd, DAEMON_BACKLOG) < 0) {
+    perror("listen");
+    printf("%s:%d: failed to listen on socket '%s'.\n", __FILE__, __LINE__, socket_path);
+    exit(1);
+  }
+  int ret = pthread_create(&daemon->listener, NULL, daemon_listener, daemon);
+  if (ret != 0) {
+    perror("pthread_create");
+    printf("%s:%d: failed to create daemon listener thread.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+}
+
+// join the listener (it ends on a shutdown request) and remove the socket
+void daemon_stop(daemon_t *daemon) {
+  int ret = pthread_join(daemon->listener, NULL);
+  if (ret != 0) {
+    perror("pthread_join");
+    printf("%s:%d: failed to join daemon listener thread.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  close(daemon->socket_fd);
+  unlink(daemon->socket_path);
+  pthread_mutex_destroy(&daemon->lock);
+  pthread_cond_destroy(&daemon->cond);
+}
+
+// block until a job is queued; NULL once shut down and all queued jobs were taken
+daemon_job_t *daemon_next_job(daemon_t *daemon) {
+  pthread_mutex_lock(&daemon->lock);
+  while (daemon->head == NULL && !daemon->shutdown)
+    pthread_cond_wait(&daemon->cond, &daemon->lock);
+  daemon_job_t *job = daemon->head;
+  if (job != NULL) {
+    daemon->head = job->next;
+    if (daemon->head == NULL)
+      daemon->tail = NULL;
+  }
+  pthread_mutex_unlock(&daemon->lock);
+  return job;
+}
+
+// send a reply line to the client of a job
+void daemon_reply(daemon_job_t *job, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  // the client may be gone: replies are best effort
+  if (job->fd >= 0 && vdprintf(job->fd, format, args) < 0)
+    perror("vdprintf");
+  va_end(args);
+}
+
+// close the client connection and free the job
+void daemon_free_job(daemon_job_t *job) {
+  if (job->fd >= 0)
+    close(job->fd);
+  free(job->benchmark);
+  for (int a = 1; a <= job->num_args; a++)
+    free(job->args[a]);
+  free(job->args);
+  free(job->events);
+  free(job->config_cpu);
+  free(job->config_gpu);
+  free(job->cli_cpu);
+  free(job->cli_gpu);
+  free(job->trace);
+  free(job);
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// accept one connection at a time: jobs are short to send, and run serially anyway
+static void *daemon_listener(void *args) {
+  daemon_t *daemon = (daemon_t *)args;
+  while (1) {
+    int fd = accept4(daemon->socket_fd, NULL, NULL, SOCK_CLOEXEC);
+    if (fd < 0) {
+      perror("accept4");
+      continue;
+    }
+    int shutdown = 0;
+    daemon_job_t *job = read_job(fd, &shutdown);
+    if (shutdown) {
+      dprintf(fd, "shutdown\n");
+      close(fd);
+      pthread_mutex_lock(&daemon->lock);
+      daemon->shutdown = 1;
+      pthread_cond_broadcast(&daemon->cond);
+      pthread_mutex_unlock(&daemon->lock);
+      break;
+    }
+    if (job == NULL) {
+      close(fd);
+      continue;
+    }
+    enqueue_job(daemon, job);
+  }
+  return (void *)NULL;
+}
+
+static void enqueue_job(daemon_t *daemon, daemon_job_t *job) {
+  pthread_mutex_lock(&daemon->lock);
+  job->id = daemon->num_jobs++;
+  job->next = NULL;
+  if (daemon->tail == NULL)
+    daemon->head = job;
+  else
+    daemon->tail->next = job;
+  daemon->tail = job;
+  daemon_reply(job, "queued %u\n", job->id);
+  pthread_cond_broadcast(&daemon->cond);
+  pthread_mutex_unlock(&daemon->lock);
+}
+
+// read "<key> <value>" lines up to an empty line; NULL (and an error reply) if invalid
+static daemon_job_t *read_job(int fd, int *shutdown) {
+  // the connection stays open for the replies: read through a duplicate
+  FILE *fp = fdopen(dup(fd), "r");
+  if (fp == NULL) {
+    perror("fdopen");
+    return NULL;
+  }
+  daemon_job_t *job = (daemon_job_t *)calloc(1, sizeof(daemon_job_t));
+  if (job == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  job->fd = -1;
+  // +2 for argv[0] and NULL
+  job->args = (char **)malloc(2 * sizeof(char *));
+  if (job->args == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+  const char *error = NULL;
+  while ((len = getline(&line, &line_size, fp)) > 0) {
+    // strip newline
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+      line[--len] = '\0';
+    if (len == 0)
+      break;
+    char *value = strchr(line, ' ');
+    if (value != NULL)
+      *value++ = '\0';
+    if (!strcmp(line, DAEMON_KEY_SHUTDOWN)) {
+      *shutdown = 1;
+    } else if (value == NULL) {
+      error = "missing value";
+    } else if (!strcmp(line, DAEMON_KEY_BENCHMARK)) {
+      free(job->benchmark);
+      job->benchmark = strdup(value);
+    } else if (!strcmp(line, DAEMON_KEY_ARG)) {
+      job->num_args++;
+      job->args = (char **)realloc(job->args, (job->num_args + 2) * sizeof(char *));
+      if (job->args == NULL) {
+        printf("%s:%d: realloc failed.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      job->args[job->num_args] = strdup(value);
+    } else if (!strcmp(line, DAEMON_KEY_EVENTS)) {
+      free(job->events);
+      job->events = strdup(value);
+    } else if (!strcmp(line, DAEMON_KEY_CONFIG_CPU)) {
+      free(job->config_cpu);
+      job->config_cpu = strdup(value);
+    } else if (!strcmp(line, DAEMON_KEY_CONFIG_GPU)) {
+      free(job->config_gpu);
+      job->config_gpu = strdup(value);
+    } else if (!strcmp(line, DAEMON_KEY_CLI_CPU)) {
+      free(job->cli_cpu);
+      job->cli_cpu = strdup(value);
+    } else if (!strcmp(line, DAEMON_KEY_CLI_GPU)) {
+      free(job->cli_gpu);
+      job->cli_gpu = strdup(value);
+    } else if (!strcmp(line, DAEMON_KEY_TRACE)) {
+      free(job->trace);
+      job->trace = strdup(value);
+    } else {
+      error = "unknown key";
+    }
+    if (error != NULL)
+      break;
+  }
+  free(line);
+  fclose(fp);
+  job->args[0] = NULL;
+  job->args[job->num_args + 1] = NULL;
+  if (error == NULL && !*shutdown) {
+    if (job->benchmark == NULL)
+      error = "missing " DAEMON_KEY_BENCHMARK;
+    else if (job->trace == NULL)
+      error = "missing " DAEMON_KEY_TRACE;
+  }
+  if (error != NULL || *shutdown) {
+    if (error != NULL)
+      dprintf(fd, "error %s\n", error);
+    daemon_free_job(job);
+    return NULL;
+  }
+  job->fd = fd;
+  return job;
+}
@@ -0,0 +1,215 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+// voltmeter libraries
+#include <helper.h>
+#include <model.h>
+#include <estimate.h>
+#include <profiler.h>
+#include <scheduler.h>
+#include <trace.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static int model_feature_index(power_model_t *model, model_feature_t *feature);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void estimator_init(estimator_t *estimator, char *model_file) {
+  memset(estimator, 0, sizeof(estimator_t));
+  parse_model_json(model_file, &estimator->set);
+  if (estimator->set.target != MODEL_TARGET_TOTAL)
+    printf("Power estimator: the models of '%s' estimate power rail %d only.\n", model_file, estimator->set.target);
+}
+
+void estimator_free(estimator_t *estimator) {
+  free_model_set(&estimator->set);
+  estimator->model = NULL;
+}
+
+// model of an operating point, NULL if none
+power_model_t *estimator_select(estimator_t *estimator, uint32_t cpu_freq, uint32_t gpu_freq) {
+  estimator->model = find_model(&estimator->set, cpu_freq, gpu_freq);
+  return estimator->model;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                    Trace consumer                     │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// map the columns of the merged samples of a trace to the features of the model;
+// an event counted by more counters of a core (the events of a pass are padded
+// to the counters of the PMU) is read from the first one
+void estimator_start(estimator_t *estimator, trace_schema_t *schema, uint32_t sample_period_us) {
+  power_model_t *model = estimator->model;
+  model_feature_t feature;
+  int *found = (int *)calloc(model->num_features > 0 ? model->num_features : 1, sizeof(int));
+  if (found == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  estimator->num_inputs = 0;
+  estimator->inputs = (estimator_input_t *)malloc_or_exit(sizeof(estimator_input_t) * (schema->num_columns > 0 ? schema->num_columns : 1));
+  estimator->fresh_needed = 0;
+  for (unsigned int c = 0; c < schema->num_columns; c++) {
+    trace_column_t *column = &schema->columns[c];
+    if (!model_feature_of_column(column->name, &feature)) {
+      int f = model_feature_index(model, &feature);
+      int duplicate = 0;
+      for (unsigned int p = 0; p < c && !duplicate; p++)
+        duplicate = !strcmp(schema->columns[p].name, column->name);
+      if (f < 0 || duplicate)
+        continue;
+      estimator_input_t *input = &estimator->inputs[estimator->num_inputs++];
+      input->offset = column->offset;
+      input->size = column->size;
+      input->feature = f;
+      input->fresh = feature.kind == MODEL_FEATURE_GPU_EVENT ? FRESH_GPU_COUNTERS : FRESH_CPU_COUNTERS;
+      estimator->fresh_needed |= input->fresh;
+      found[f] = 1;
+    } else if (!strcmp(column->name, "deadline_ns")) {
+      estimator->deadline_offset = column->offset;
+    } else if (!strcmp(column->name, "fresh")) {
+      estimator->fresh_offset = column->offset;
+    }
+  }
+  for (unsigned int f = 0; f < model->num_features; f++) {
+    if (!found[f]) {
+      char name[MODEL_FEATURE_NAME_LEN];
+      model_feature_name(&model->features[f], name);
+      printf("%s:%d: feature '%s' of the power model is not profiled.\n", __FILE__, __LINE__, name);
+      exit(1);
+    }
+  }
+  free(found);
+
+  estimator->counts = (double *)calloc(model->num_features > 0 ? model->num_features : 1, sizeof(double));
+  estimator->rates = (double *)malloc_or_exit(sizeof(double) * (model->num_features > 0 ? model->num_features : 1));
+  if (estimator->counts == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  estimator->sample_period_ns = sample_period_us * 1e3;
+  estimator->has_prev = 0;
+  estimator->window_samples = 0;
+  estimator->budget_ns = (uint64_t)(estimator->sample_period_ns * ESTIMATE_BUDGET_FRACTION);
+  estimator->num_estimates = 0;
+  estimator->num_over_budget = 0;
+  estimator->cost_ns = 0;
+  estimator->max_cost_ns = 0;
+  fprintf(estimator->output, "deadline_ns,power_mw\n");
+}
+
+// merged sample, in v1 layout: counters are accumulated until all the counters of
+// the model are fresh (i.e., at every sample, with all the counters read at the
+// base period), then power is estimated from their rates since the previous estimate
+void estimator_add(estimator_t *estimator, const uint8_t *sample) {
+  uint64_t start_ns = monotonic_ns();
+  power_model_t *model = estimator->model;
+  uint32_t fresh;
+  uint64_t deadline, value;
+  memcpy(&fresh, sample + estimator->fresh_offset, sizeof(uint32_t));
+  estimator->window_samples++;
+  for (unsigned int i = 0; i < estimator->num_inputs; i++) {
+    estimator_input_t *input = &estimator->inputs[i];
+    if (!(fresh & input->fresh))
+      continue;
+    if (input->size == sizeof(uint32_t)) {
+      uint32_t value32;
+      memcpy(&value32, sample + input->offset, sizeof(uint32_t));
+      value = value32;
+    } else {
+      memcpy(&value, sample + input->offset, sizeof(uint64_t));
+    }
+    estimator->counts[input->feature] += value;
+  }
+  if ((fresh & estimator->fresh_needed) != estimator->fresh_needed)
+    return;
+  memcpy(&deadline, sample + estimator->deadline_offset, sizeof(uint64_t));
+  // the first window of a trace lasts its sampling periods
+  double interval_ns = estimator->has_prev ? (double)(deadline - estimator->prev_deadline) : estimator->window_samples * estimator->sample_period_ns;
+  if (interval_ns > 0) {
+    for (unsigned int f = 0; f < model->num_features; f++)
+      estimator->rates[f] = estimator->counts[f] * 1e9 / interval_ns;
+    fprintf(estimator->output, "%lu,%.1f\n", deadline, model_estimate(model, estimator->rates));
+  }
+  estimator->prev_deadline = deadline;
+  estimator->has_prev = 1;
+  estimator->window_samples = 0;
+  memset(estimator->counts, 0, sizeof(double) * model->num_features);
+
+  uint64_t cost_ns = monotonic_ns() - start_ns;
+  estimator->num_estimates++;
+  estimator->cost_ns += cost_ns;
+  if (cost_ns > estimator->max_cost_ns)
+    estimator->max_cost_ns = cost_ns;
+  if (cost_ns > estimator->budget_ns)
+    estimator->num_over_budget++;
+}
+
+// make the estimates merged so far visible to a live reader
+void estimator_flush(estimator_t *estimator) {
+  fflush(estimator->output);
+}
+
+void estimator_stop(estimator_t *estimator) {
+  fflush(estimator->output);
+  free(estimator->inputs);
+  free(estimator->counts);
+  free(estimator->rates);
+  estimator->inputs = NULL;
+  estimator->counts = NULL;
+  estimator->rates = NULL;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Results                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// cost of the estimates of the last trace against the budget
+void estimator_report(estimator_t *estimator, FILE *log_file) {
+  if (estimator->num_estimates == 0) {
+    printf_file(log_file, "Power estimator: no estimate.\n");
+    return;
+  }
+  double mean_ns = (double)estimator->cost_ns / estimator->num_estimates;
+  printf_file(log_file, "Power estimator: %lu estimate(s), %.0f ns mean, %lu ns max per estimate (budget %lu ns), %lu over budget.\n",
+    estimator->num_estimates, mean_ns, estimator->max_cost_ns, estimator->budget_ns, estimator->num_over_budget);
+  if (mean_ns > estimator->budget_ns)
+    printf_file(log_file, "Power estimator: mean cost over budget, consider a longer sample_period_us.\n");
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// index of the feature in the model, -1 if not used
+static int model_feature_index(power_model_t *model, model_feature_t *feature) {
+  for (unsigned int f = 0; f < model->num_features; f++) {
+    if (model->features[f].kind == feature->kind && model->features[f].event_id == feature->event_id)
+      return f;
+  }
+  return -1;
+}
@@ -8,6 +8,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 // third-party libraries
 #include <jsmn.h>
 #ifdef __JETSON_AGX_XAVIER
@@ -17,7 +18,9 @@
 // voltmeter libraries
 #include <platform.h>
 #include <helper.h>
+#include <sensor.h>
 #include <gpu.h>
+#include <backend.h>
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -27,6 +30,8 @@
 
 static void free_events_freq_config(gpu_events_freq_config_t *events_freq_config);
 static void free_events_config(gpu_events_config_t *events_config);
+static void free_events_config_json(gpu_events_config_t *events_config);
+static int abort_events_json(gpu_events_config_t *events_config, char *str_json);
 #ifdef __JETSON_AGX_XAVIER
 static uint32_t cupti_create_event_group_sets(CUpti_EventID *event_ids, int num_events_tot, FILE *log_file);
 #endif
@@ -43,6 +48,8 @@ gpu_events_freq_config_t gpu_events;
 static CUdevice cu_device;
 static CUcontext cu_context;
 #endif
+// persistent handle of the GPU frequency file
+static sensor_t gpu_freq_sensor;
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -82,8 +89,10 @@ uint32_t setup_gpu(FILE *log_file){
   ret_cuda = cuCtxCreate(&cu_context, 0, cu_device);
   CHECK_CU_ERROR(ret_cuda, "cuCtxCreate");
 
+  // open GPU frequency file once, it is read at every sample
+  sensor_open(&gpu_freq_sensor, CUR_FREQ_GPU_FILE);
   // fill global variable gpu_events
-  gpu_events.frequency = clip_gpu_freq(get_gpu_freq());
+  gpu_events.frequency = backend->clip_gpu_freq(backend->get_gpu_freq());
   // will be allocated in gpu_events_all/gpu_events_from_config/gpu_events_from_cli
   gpu_events.num_counters = 0;
   gpu_events.event_id = NULL;
@@ -91,6 +100,8 @@ uint32_t setup_gpu(FILE *log_file){
   gpu_events.counter = NULL;
 
   return gpu_events.frequency;
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Platform not supported."
 #endif
@@ -98,6 +109,38 @@ uint32_t setup_gpu(FILE *log_file){
 
 void deinit_gpu(){
   free_events_freq_config(&gpu_events);
+  sensor_close(&gpu_freq_sensor);
+}
+
+// pin the GPU frequency (as utils/jetson_agx_xavier/set_freq_gpu.sh); freq is in Hz as in
+// AVAIL_FREQ_GPU_FILE, 0 selects the max; return the frequency set, in Hz
+uint32_t set_gpu_freq(uint32_t freq) {
+#ifdef __JETSON_AGX_XAVIER
+  if (freq == 0)
+    freq = sensor_read_max_u32(AVAIL_FREQ_GPU_FILE);
+  // max, min, max: the range stays valid whether the frequency goes up or down
+  sensor_write_u32(MAX_FREQ_GPU_FILE, freq);
+  sensor_write_u32(MIN_FREQ_GPU_FILE, freq);
+  sensor_write_u32(MAX_FREQ_GPU_FILE, freq);
+  return clip_gpu_freq(freq);
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
+#else
+#error "Platform not supported."
+#endif
+}
+
+// drop the selected events and their CUPTI event group sets, so that new ones can be
+// selected for a new frequency (in Hz); the CUDA context is kept
+void reset_gpu_events(uint32_t frequency) {
+  free_events_freq_config(&gpu_events);
+  gpu_events.frequency = frequency;
+  gpu_events.num_counters = 0;
+  gpu_events.event_id = NULL;
+#ifdef __JETSON_AGX_XAVIER
+  gpu_events.event_group_sets = NULL;
+#endif
+  gpu_events.counter = NULL;
 }
 
 /*
@@ -170,6 +213,8 @@ uint32_t gpu_events_all(FILE *log_file){
   free(domain_ids);
   free(num_domain_events);
   return num_sets;
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Platform not supported."
 #endif
@@ -189,6 +234,8 @@ uint32_t gpu_events_from_cli(gpu_event_id_t *events, unsigned int num_events, FI
   // create CUPTI event group sets (i.e., sets of CUPTI event groups)
   uint32_t num_sets = cupti_create_event_group_sets(events, num_events, log_file);
   return num_sets;
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Platform not supported."
 #endif
@@ -196,7 +243,9 @@ uint32_t gpu_events_from_cli(gpu_event_id_t *events, unsigned int num_events, FI
 
 uint32_t gpu_events_from_config(char *config_file, FILE *log_file){
   gpu_events_config_t events_config;
-  parse_gpu_events_json(config_file, &events_config);
+  uint32_t num_sets = 0;
+  if (parse_gpu_events_json(config_file, &events_config))
+    return 0;
 
   // find GPU frequency in events_config
   uint32_t freq = gpu_events.frequency;
@@ -206,26 +255,25 @@ uint32_t gpu_events_from_config(char *config_file, FILE *log_file){
   }
   if (f == events_config.num_freqs) {
     printf("%s:%d: GPU frequency %u not found in events_config.\n", __FILE__, __LINE__, freq);
-    exit(1);
-  }
-  // set events
-  gpu_events.num_counters = events_config.gpu_events_freq_config[f].num_counters;
-  gpu_events.event_id = (gpu_event_id_t *)malloc(gpu_events.num_counters * sizeof(gpu_event_id_t));
-  for (int e = 0; e < events_config.gpu_events_freq_config[f].num_counters; e++) {
-    gpu_events.event_id[e] = events_config.gpu_events_freq_config[f].event_id[e];
-  }
-  // create CUPTI event group sets (i.e., sets of CUPTI event groups)
-  uint32_t num_sets = cupti_create_event_group_sets(events_config.gpu_events_freq_config[f].event_id, events_config.gpu_events_freq_config[f].num_counters, log_file);
-  // free events_config
-  for (int f = 0; f < events_config.num_freqs; f++) {
-    free(events_config.gpu_events_freq_config[f].event_id);
-    free(events_config.gpu_events_freq_config[f].counter);
+  } else {
+    // set events
+    gpu_events.num_counters = events_config.gpu_events_freq_config[f].num_counters;
+    gpu_events.event_id = (gpu_event_id_t *)malloc(gpu_events.num_counters * sizeof(gpu_event_id_t));
+    for (int e = 0; e < events_config.gpu_events_freq_config[f].num_counters; e++) {
+      gpu_events.event_id[e] = events_config.gpu_events_freq_config[f].event_id[e];
+    }
+#ifdef __JETSON_AGX_XAVIER
+    // create CUPTI event group sets (i.e., sets of CUPTI event groups)
+    num_sets = cupti_create_event_group_sets(events_config.gpu_events_freq_config[f].event_id, events_config.gpu_events_freq_config[f].num_counters, log_file);
+#else
+    NO_GPU_ERROR();
+#endif
   }
-  free(events_config.gpu_events_freq_config);
+  free_events_config_json(&events_config);
   return num_sets;
 }
 
-void parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config){
+int parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config){
   jsmn_parser p;
   jsmntok_t t[1500]; // max 1500 tokens expected
   int ret;
@@ -234,7 +282,7 @@ void parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config
   FILE *fp = fopen(config_file, "rb");
   if (fp == NULL) {
     printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, config_file);
-    exit(1);
+    return 1;
   }
   fseek(fp, 0L, SEEK_END);
   size_t sz = ftell(fp);
@@ -251,9 +299,10 @@ void parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config
   // parse json string into tokens
   jsmn_init(&p);
   ret = jsmn_parse(&p, str_json, strlen(str_json), t, 1500);
-  if (ret < 0) {
+  if (ret < 1 || t[0].type != JSMN_OBJECT) {
       printf("%s:%d: failed to parse JSON '%s' (error %d).\n", __FILE__, __LINE__, config_file, ret);
-      exit(1);
+      free(str_json);
+      return 1;
   }
 
   uint32_t frequency;
@@ -265,7 +314,8 @@ void parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config
   num_frequencies_json = t[i].size;
   // allocate events_config with num_frequencies_json frequencies
   events_config->num_freqs = num_frequencies_json;
-  events_config->gpu_events_freq_config = (gpu_events_freq_config_t *)malloc(num_frequencies_json * sizeof(gpu_events_freq_config_t));
+  // zeroed: a partially parsed config is freed on invalid input
+  events_config->gpu_events_freq_config = (gpu_events_freq_config_t *)calloc(num_frequencies_json, sizeof(gpu_events_freq_config_t));
   if (events_config->gpu_events_freq_config == NULL) {
     printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
     exit(1);
@@ -276,14 +326,14 @@ void parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config
     // frequency
     if (t[++i].type != JSMN_STRING) {
       printf("%s:%d: unexpected token type %d (expected JSMN_STRING).\n", __FILE__, __LINE__, t[i].type);
-      exit(1);
+      return abort_events_json(events_config, str_json);
     }
     //printf("%.*s\n", t[i].end - t[i].start, str_json + t[i].start); // DEBUG
     jsmn_parse_token(str_json, &t[i], "%d", &frequency);
     events_config->gpu_events_freq_config[f].frequency = frequency;
     if (t[++i].type != JSMN_ARRAY) {
       printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
-      exit(1);
+      return abort_events_json(events_config, str_json);
     }
     //printf("%.*s\n", t[i].end - t[i].start, str_json + t[i].start); // DEBUG
     num_events_json = t[i].size;
@@ -299,13 +349,15 @@ void parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config
       // events list
       if (t[++i].type != JSMN_PRIMITIVE) {
         printf("%s:%d: unexpected token type %d (expected JSMN_PRIMITIVE).\n", __FILE__, __LINE__, t[i].type);
-        exit(1);
+        return abort_events_json(events_config, str_json);
       }
       //printf("%.*s\n", t[i].end - t[i].start, str_json + t[i].start); // DEBUG
       jsmn_parse_token(str_json, &t[i], "%d", &event);
       events_config->gpu_events_freq_config[f].event_id[e] = event;
     }
   }
+  free(str_json);
+  return 0;
 }
 
 /*
@@ -397,6 +449,8 @@ void enable_pmu_gpu(unsigned int set_id) {
 
   // do a first dummy read to reset counters and fill the IDs buffer
   read_counters_gpu(set_id);
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
@@ -420,6 +474,8 @@ void disable_pmu_gpu(unsigned int set_id) {
   }
   free(gpu_events.event_ids_buffer);
   free(gpu_events.counters_buffer);
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
@@ -446,6 +502,8 @@ void read_counters_gpu(unsigned int set_id) {
       exit(1);
     }
   }
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
@@ -455,6 +513,8 @@ void reset_counters_gpu() {
 #ifdef __JETSON_AGX_XAVIER
   printf("%s:%d: reset_counters_gpu not implemented.\n", __FILE__, __LINE__);
   exit(1);
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Unsupported platform/architecture/compiler".
 #endif
@@ -462,7 +522,80 @@ void reset_counters_gpu() {
 
 
 void read_gpu_freq() {
-  gpu_events.freq_read = get_gpu_freq();
+  gpu_events.freq_read = backend->get_gpu_freq();
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                     Trace layout                      │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// bytes of the counters of a set in a sample
+size_t trace_bytes_gpu(unsigned int set_id) {
+#ifdef __JETSON_AGX_XAVIER
+  size_t bytes = 0;
+  for (int g = 0; g < gpu_events.event_group_sets->sets[set_id].numEventGroups; g++)
+    bytes += gpu_events.sizes_counters_group[g];
+  return bytes;
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
+#else
+#error "Platform not supported."
+#endif
+}
+
+// counters of a set, as read: per each group, per each instance, per each event;
+// return the bytes written
+size_t serialize_counters_gpu(uint8_t *dst, unsigned int set_id) {
+#ifdef __JETSON_AGX_XAVIER
+  uint8_t *ptr = dst;
+  for (int g = 0; g < gpu_events.event_group_sets->sets[set_id].numEventGroups; g++) {
+    memcpy(ptr, gpu_events.counters_buffer[g], gpu_events.sizes_counters_group[g]);
+    ptr += gpu_events.sizes_counters_group[g];
+  }
+  return ptr - dst;
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
+#else
+#error "Platform not supported."
+#endif
+}
+
+// columns of the counters of a set, in the order of serialize_counters_gpu
+void trace_columns_gpu(trace_schema_t *schema, unsigned int set_id) {
+#ifdef __JETSON_AGX_XAVIER
+  char name[TRACE_COLUMN_NAME_LEN];
+  for (int g = 0; g < gpu_events.event_group_sets->sets[set_id].numEventGroups; g++) {
+    for (unsigned int i = 0; i < gpu_events.num_instances_group[g]; i++) {
+      for (unsigned int e = 0; e < gpu_events.num_events_group[g]; e++) {
+        sprintf(name, "gpu.g%d.i%u.%u", g, i, (unsigned int)gpu_events.event_ids_buffer[g][e]);
+        trace_schema_add(schema, name, sizeof(gpu_counter_t), TRACE_ENCODING_VARINT);
+      }
+    }
+  }
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
+#else
+#error "Platform not supported."
+#endif
+}
+
+// trace header of the events of a set: number of groups, then per each group its
+// number of events, of instances, and its event ids
+void trace_header_gpu(FILE *stream, unsigned int set_id) {
+#ifdef __JETSON_AGX_XAVIER
+  fwrite(&gpu_events.event_group_sets->sets[set_id].numEventGroups, sizeof(uint32_t), 1, stream);
+  for (int g = 0; g < gpu_events.event_group_sets->sets[set_id].numEventGroups; g++) {
+    fwrite(&gpu_events.num_events_group[g], sizeof(uint32_t), 1, stream);
+    fwrite(&gpu_events.num_instances_group[g], sizeof(uint32_t), 1, stream);
+    fwrite(gpu_events.event_ids_buffer[g], sizeof(gpu_event_id_t) * gpu_events.num_events_group[g], 1, stream);
+  }
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
+#else
+#error "Platform not supported."
+#endif
 }
 
 /*
@@ -473,16 +606,12 @@ void read_gpu_freq() {
 
 uint32_t get_gpu_freq(){
 #ifdef __JETSON_AGX_XAVIER
-  uint32_t freq = 0;
-  FILE *fp = fopen(CUR_FREQ_GPU_FILE, "r");
-  if (fp == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, CUR_FREQ_GPU_FILE);
-    exit(1);
-  }
-  fscanf(fp, "%d", &freq);
-  fclose(fp);
+  // persistent handle opened in setup_gpu
+  uint32_t freq = sensor_read_u32(&gpu_freq_sensor);
   // fetched in Hz
   return freq;
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Platform not supported."
 #endif
@@ -495,9 +624,10 @@ uint32_t clip_gpu_freq(uint32_t freq){
   uint32_t *avail_freqs = NULL;
   uint32_t num_avail_freqs = 0;
   uint32_t freq_read;
-  FILE *fp = fopen(AVAIL_FREQ_GPU_FILE, "r");
+  char path[SENSOR_PATH_LEN];
+  FILE *fp = fopen(sensor_path(AVAIL_FREQ_GPU_FILE, path), "r");
   if (fp == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, AVAIL_FREQ_GPU_FILE);
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, path);
     exit(1);
   }
   while (fscanf(fp, "%d", &freq_read) != EOF) {
@@ -520,6 +650,8 @@ uint32_t clip_gpu_freq(uint32_t freq){
   }
   free(avail_freqs);
   return closest_freq;
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Platform not supported."
 #endif
@@ -565,6 +697,8 @@ void print_gpu_events_set(FILE *log_file, uint32_t set_id) {
     printf_file(log_file, "\n");
     free(event_ids);
   }
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Platform not supported."
 #endif
@@ -576,6 +710,8 @@ void sync_gpu_slave() {
   //cuCtxSynchronize();
   ret_cuda = cudaDeviceSynchronize();
   CHECK_CU_ERROR(ret_cuda, "cuDeviceGet");
+#elif defined(__LINUX_GENERIC)
+  NO_GPU_ERROR();
 #else
 #error "Platform not supported."
 #endif
@@ -605,6 +741,22 @@ static void free_events_config(gpu_events_config_t *events_config) {
   free(events_config->gpu_events_freq_config);
 }
 
+// events config parsed from JSON (no CUPTI event group sets)
+static void free_events_config_json(gpu_events_config_t *events_config) {
+  for (int f = 0; f < events_config->num_freqs; f++) {
+    free(events_config->gpu_events_freq_config[f].event_id);
+    free(events_config->gpu_events_freq_config[f].counter);
+  }
+  free(events_config->gpu_events_freq_config);
+}
+
+// free a partially parsed events config on invalid input; return 1 (error)
+static int abort_events_json(gpu_events_config_t *events_config, char *str_json) {
+  free_events_config_json(events_config);
+  free(str_json);
+  return 1;
+}
+
 
 #ifdef __JETSON_AGX_XAVIER
 // CUPTI-specific functions
@@ -614,7 +766,14 @@ static uint32_t cupti_create_event_group_sets(CUpti_EventID *event_ids, int num_
   size_t size;
   size = sizeof(CUpti_EventID) * num_events_tot;
   ret = cuptiEventGroupSetsCreate(cu_context, size, event_ids, &gpu_events.event_group_sets);
-  CHECK_CUPTI_ERROR(ret, "cuptiEventGroupSetsCreate");
+  // invalid events: no event sets
+  if (ret != CUPTI_SUCCESS) {
+    const char *errstr;
+    cuptiGetResultString(ret, &errstr);
+    printf("%s:%d: error %s for CUPTI API function '%s'.\n", __FILE__, __LINE__, errstr, "cuptiEventGroupSetsCreate");
+    gpu_events.event_group_sets = NULL;
+    return 0;
+  }
   // return number of requires passes to profile all contained events
   return gpu_events.event_group_sets->numSets;
 }
@@ -6,13 +6,25 @@
 
 // standard includes
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <pthread.h>
+#include <stdatomic.h>
 // voltmeter libraries
 #include <helper.h>
 // third-party libraries
 #include <jsmn.h>
 
+// tasks of a pool of threads
+typedef struct {
+  void (*function)(unsigned int);
+  unsigned int size;
+  atomic_uint next;
+} pool_t;
+
+static void *pool_worker(void *arg);
+
 // concatenate a path with a filename
 int cat_path(char *path, char *filename, char *full_path) {
   char format_string[20];
@@ -58,3 +70,40 @@ int printf_file(FILE *file, const char *format, ...) {
   va_end(args);
   return ret;
 }
+
+// allocate or exit: for the buffers without which nothing can proceed
+void *malloc_or_exit(size_t size) {
+  void *ptr = malloc(size);
+  if (ptr == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  return ptr;
+}
+
+// run function(0), ..., function(size - 1) on a pool of up to num_threads threads,
+// each taking the next task as soon as its previous one is done
+void run_pool(void (*function)(unsigned int), unsigned int size, unsigned int num_threads) {
+  pool_t pool = {function, size};
+  atomic_init(&pool.next, 0);
+  if (num_threads > size)
+    num_threads = size;
+  pthread_t *threads = (pthread_t *)malloc_or_exit(sizeof(pthread_t) * (num_threads > 0 ? num_threads : 1));
+  for (unsigned int t = 0; t < num_threads; t++) {
+    if (pthread_create(&threads[t], NULL, pool_worker, &pool) != 0) {
+      printf("%s:%d: failed to create thread.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+  for (unsigned int t = 0; t < num_threads; t++)
+    pthread_join(threads[t], NULL);
+  free(threads);
+}
+
+static void *pool_worker(void *arg) {
+  pool_t *pool = (pool_t *)arg;
+  unsigned int i;
+  while ((i = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed)) < pool->size)
+    pool->function(i);
+  return NULL;
+}
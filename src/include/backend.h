@@ -0,0 +1,88 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+// standard includes
+#include <stdint.h>
+// voltmeter libraries
+#include <platform.h>
+#include <cpu.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+#define BACKEND_HARDWARE "hardware"
+#define BACKEND_SYNTHETIC "synthetic"
+#define DEFAULT_BACKEND BACKEND_HARDWARE
+
+// synthetic backend
+#define DEFAULT_SYNTHETIC_SEED 1
+#define SYNTHETIC_MAX_CPU_FREQ 2265600U // kHz, as the max of the Jetson AGX Xavier
+#define SYNTHETIC_PHASE_SAMPLES 50      // sampling periods of a phase of the synthetic workload
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// sources of the samples, selected at runtime: the sampler threads and the setup
+// of the devices only read counters, power and frequencies through the backend;
+// the 'hardware' backend is the driver of the platform (cpu.c, gpu.c, platform.c)
+typedef struct {
+  const char *name;
+  // whether the backend has a GPU: its functions are only called if so
+  int has_gpu;
+  // CPU counters (see cpu.h)
+  void (*probe_pmu_cpu)(cpu_pmu_t *pmu);
+  void (*enable_pmu_cpu_core)(unsigned int core_id, unsigned int set_id);
+  void (*program_pmu_cpu_core)(unsigned int core_id, unsigned int set_id);
+  void (*disable_pmu_cpu_core)(unsigned int core_id);
+  void (*read_counters_cpu_core)(unsigned int core_id, unsigned int set_id);
+  uint64_t (*cpu_max_read_period_us)();
+  // GPU counters (see gpu.h), NULL if the backend has no GPU implementation
+  void (*enable_pmu_gpu)(unsigned int set_id);
+  void (*disable_pmu_gpu)(unsigned int set_id);
+  void (*read_counters_gpu)(unsigned int set_id);
+  // power rails (see platform.h): open returns the number of rails
+  unsigned int (*open_power_rails)();
+  void (*close_power_rails)();
+  power_t (*read_power_rail)(unsigned int rail);
+  // frequency sources, in Hz (set_cpu_freq takes kHz, set_gpu_freq Hz, 0 = max)
+  void (*open_cpu_freq)();
+  void (*close_cpu_freq)();
+  uint32_t (*get_cpu_freq)();
+  uint32_t (*get_cpu_core_freq)(unsigned int core_id);
+  uint32_t (*set_cpu_freq)(uint32_t freq);
+  uint32_t (*clip_cpu_freq)(uint32_t freq);
+  uint32_t (*get_gpu_freq)();
+  uint32_t (*set_gpu_freq)(uint32_t freq);
+  uint32_t (*clip_gpu_freq)(uint32_t freq);
+} backend_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+extern const backend_t *backend;
+extern const backend_t backend_hardware;
+extern const backend_t backend_synthetic;
+
+// select the backend by name (exit if unknown), before the setup of the devices
+void backend_select(const char *name, uint64_t seed);
+
+// synthetic backend: counters and power are a function of the seed, of the core or
+// rail, and of the index of the read only, so that traces are reproducible
+void synthetic_init(uint64_t seed);
+
+#endif // _BACKEND_H
@@ -0,0 +1,56 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _CAMPAIGN_H
+#define _CAMPAIGN_H
+
+// standard includes
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+typedef void (*benchmark_main_t)(int argc, char **argv);
+
+// benchmark compiled as a dynamic library, opened once and run many times
+typedef struct {
+  char *name;
+  char *path;
+  unsigned int num_args;
+  char **args;              // args[0] is the path, args[num_args + 1] is NULL
+  void *handle;
+  benchmark_main_t main;
+} benchmark_t;
+
+// expanded manifest: all CPU frequencies × GPU frequencies × benchmarks
+typedef struct {
+  unsigned int num_freqs_cpu; // 0 = keep the current frequency
+  uint32_t *freqs_cpu;        // in the unit of the platform DVFS knobs; 0 = max
+  unsigned int num_freqs_gpu;
+  uint32_t *freqs_gpu;
+  unsigned int num_benchmarks;
+  benchmark_t *benchmarks;
+} campaign_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// campaign
+void parse_campaign_json(char *campaign_file, campaign_t *campaign);
+void free_campaign(campaign_t *campaign);
+
+// benchmarks
+int open_benchmark(benchmark_t *benchmark);
+void close_benchmark(benchmark_t *benchmark);
+
+#endif // _CAMPAIGN_H
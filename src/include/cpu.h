@@ -25,35 +25,101 @@
   #define CUR_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/cpuinfo_cur_freq"
   #define CORE_FREQ_CPU_FILE "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_cur_freq"
   #define AVAIL_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/scaling_available_frequencies"
+  // DVFS knobs (frequencies in kHz)
+  #define GOVERNOR_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/scaling_governor"
+  #define MIN_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/scaling_min_freq"
+  #define MAX_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/scaling_max_freq"
+  #define SET_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/scaling_setspeed"
+  #define MAX_AVAIL_FREQ_CPU_FILE AVAIL_FREQ_CPU_FILE
   // define CPU hardware
   #define NUM_CORES_CPU 8
   #define NUM_COUNTERS_CPU 3 // per core (only configurable counters; then Jetson has 1 more for clock)
-  // ARM PMU defines (Carmel SoC)
-  #define ARMV8_PMEVTYPER_P              (1 << 31) // EL1 modes filtering bit
-  #define ARMV8_PMEVTYPER_U              (1 << 30) // EL0 filtering bit
-  #define ARMV8_PMEVTYPER_NSK            (1 << 29) // Non-secure EL1 (kernel) modes filtering bit
-  #define ARMV8_PMEVTYPER_NSU            (1 << 28) // Non-secure User mode filtering bit
-  #define ARMV8_PMEVTYPER_NSH            (1 << 27) // Non-secure Hyp modes filtering bit
-  #define ARMV8_PMEVTYPER_M              (1 << 26) // Secure EL3 filtering bit
-  #define ARMV8_PMEVTYPER_MT             (1 << 25) // Multithreading
-  #define ARMV8_PMEVTYPER_EVTCOUNT_MASK  0x3ff
+  #define MAX_EVENTS_PER_CYCLE_CPU 10 // events a counter can count per cycle (Carmel is 10-wide)
+  // event filling the counters of a set not needed
+  #define CPU_EVENT_CYCLES ARMV8_EVENT_CPU_CYCLES
+  // events are ARMv8 event numbers (common events discovered from the PMU)
+  #define CPU_ARMV8_EVENTS
+#elif defined(__LINUX_GENERIC)
+  // files (cpufreq; scaling_cur_freq is readable without root)
+  #define CUR_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/scaling_cur_freq"
+  #define CORE_FREQ_CPU_FILE "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_cur_freq"
+  #define AVAIL_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/scaling_available_frequencies" // not with intel_pstate
+  #define MAX_AVAIL_FREQ_CPU_FILE "/sys/devices/system/cpu/cpufreq/policy0/cpuinfo_max_freq"
+  // DVFS knobs of each core (frequencies in kHz)
+  #define GOVERNOR_CPU_FILE "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor"
+  #define MIN_FREQ_CPU_FILE "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_min_freq"
+  #define MAX_FREQ_CPU_FILE "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_max_freq"
+  #define SET_FREQ_CPU_FILE "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_setspeed"
+  // define CPU hardware (the number of cores is the one of the machine, see get_cpu_num_cores)
+  #define NUM_COUNTERS_CPU 3 // per core (configurable counters, plus the clock cycles of the perf event group)
+  // event filling the counters of a set not needed (raw event code of the CPU)
+  #if defined(__x86_64__) || defined(__i386__)
+    #define CPU_EVENT_CYCLES 0x3c // architectural event UnHalted Core Cycles
+  #else
+    #define CPU_EVENT_CYCLES ARMV8_EVENT_CPU_CYCLES
+  #endif
+  // events are ARMv8 event numbers only on ARM: elsewhere they are raw codes with no
+  // common numbering (e.g., umask << 8 | event select on x86), so all_events and the
+  // discovery of the common events are not supported
+  #ifdef __aarch64__
+    #define CPU_ARMV8_EVENTS
+  #endif
+  // the CPU counters are only accessible through perf_event_open
+  #ifndef __CPU_PERF_EVENT
+    #define __CPU_PERF_EVENT
+  #endif
 #else
   #error "Platform not supported."
 #endif
 
+// ARM PMU defines (Carmel SoC)
+#define ARMV8_PMEVTYPER_P              (1 << 31) // EL1 modes filtering bit
+#define ARMV8_PMEVTYPER_U              (1 << 30) // EL0 filtering bit
+#define ARMV8_PMEVTYPER_NSK            (1 << 29) // Non-secure EL1 (kernel) modes filtering bit
+#define ARMV8_PMEVTYPER_NSU            (1 << 28) // Non-secure User mode filtering bit
+#define ARMV8_PMEVTYPER_NSH            (1 << 27) // Non-secure Hyp modes filtering bit
+#define ARMV8_PMEVTYPER_M              (1 << 26) // Secure EL3 filtering bit
+#define ARMV8_PMEVTYPER_MT             (1 << 25) // Multithreading
+#define ARMV8_PMEVTYPER_EVTCOUNT_MASK  0x3ff
+// ARM PMU identification (PMCR_EL0, PMCEID0_EL0, PMCEID1_EL0)
+#define ARMV8_PMCR_N_SHIFT             11        // number of configurable counters
+#define ARMV8_PMCR_N_MASK              0x1f
+#define ARMV8_MAX_COUNTERS             31
+#define ARMV8_NUM_COMMON_EVENTS        0x40      // common events 0x00-0x3f, 32 per PMCEID register (bits 31:0)
+// ARMv8 common event, e.g., to fill the counters of a set not needed
+#define ARMV8_EVENT_CPU_CYCLES         0x11
+
+#ifdef __CPU_PERF_EVENT
+  // perf_event_open backend: max events of a group (the clock cycles, then the counters)
+  #define CPU_PERF_MAX_EVENTS            (1 + ARMV8_MAX_COUNTERS)
+#endif
+
 /*
  * ╔═══════════════════════════════════════════════════════╗
  * ║                         Types                         ║
  * ╚═══════════════════════════════════════════════════════╝
  */
 
-#ifdef __JETSON_AGX_XAVIER
-typedef uint32_t cpu_event_id_t;
-typedef uint32_t cpu_counter_t;
+#if defined(__JETSON_AGX_XAVIER) || defined(__LINUX_GENERIC)
+typedef uint32_t cpu_event_id_t;    // with perf_event_open, raw event code (PERF_TYPE_RAW)
+typedef uint64_t cpu_counter_t;     // events since the previous read
 #else
 #error "Platform not supported."
 #endif
 
+#ifdef __CPU_PERF_EVENT
+// perf event group of a counter set on a core: the clock cycles are the leader, the
+// counters follow; the kernel counts 64-bit totals, each read takes their difference
+typedef struct {
+  unsigned int num_events;
+  int fd[CPU_PERF_MAX_EVENTS];
+  struct perf_event_mmap_page *page[CPU_PERF_MAX_EVENTS]; // user page of each event, NULL if not mapped
+  uint64_t value_prev[CPU_PERF_MAX_EVENTS];
+  uint64_t time_enabled_prev;
+  uint64_t time_running_prev;
+} cpu_perf_group_t;
+#endif
+
 typedef struct {
   unsigned int num_counters;
   cpu_event_id_t *event_id;
@@ -64,13 +130,26 @@ typedef struct {
   // configurable PMU perf counters
   unsigned int num_sets;
   cpu_counter_set_t *counter_set;
-#ifdef __JETSON_AGX_XAVIER
-  // ARM PMU clock cycles counter
+  // clock cycles counter
   uint64_t counter_clk;
+#if defined(__CPU_PERF_EVENT)
+  // perf event group of the counter set being counted
+  cpu_perf_group_t perf_group;
+#elif defined(__JETSON_AGX_XAVIER)
+  // PMU counters are free-running: their values at the previous read
+  uint32_t counter_prev[ARMV8_MAX_COUNTERS];
+  uint64_t counter_clk_prev;
 #endif
   uint32_t freq_read;
 } cpu_core_events_t;
 
+// capabilities of the PMU of a core, from its identification registers (or, with
+// perf_event_open, from the groups and events the kernel accepts)
+typedef struct {
+  unsigned int num_counters;  // configurable counters
+  uint64_t common_events;     // bit e set if common event e is implemented
+} cpu_pmu_t;
+
 typedef struct {
   uint32_t frequency;
   unsigned int num_cores;
@@ -91,26 +170,71 @@ typedef struct {
 // setup
 uint32_t setup_cpu(FILE *log_file);
 void deinit_cpu();
+uint32_t set_cpu_freq(uint32_t freq);
+void reset_cpu_events(uint32_t frequency);
 
-// events parsing
+// events parsing: the number of event sets, 0 if the selection is invalid (e.g.,
+// the frequency is not in the config), so that a daemon job can be rejected
 unsigned int cpu_events_all(FILE *log_file);
 unsigned int cpu_events_from_cli(cpu_event_id_t *events, unsigned int num_events, FILE *log_file);
 unsigned int cpu_events_from_config(char *config_file, FILE *log_file);
-void parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config);
+int parse_cpu_events_json(char *config_file, cpu_events_config_t *events_config);
+
+// performance monitoring unit capabilities (from the values of its registers)
+void cpu_pmu_discover(cpu_pmu_t *pmu, uint64_t pmcr, uint64_t pmceid0, uint64_t pmceid1);
+int cpu_pmu_event_implemented(const cpu_pmu_t *pmu, cpu_event_id_t event);
+unsigned int cpu_pmu_events(const cpu_pmu_t *pmu, cpu_event_id_t max_id, cpu_event_id_t *events);
+unsigned int cpu_pmu_pack(unsigned int num_events, cpu_event_id_t *events, unsigned int num_counters, cpu_counter_set_t **sets);
 
-// performance monitoring unit driver
+// performance monitoring unit driver (PMU registers, or perf_event_open with __CPU_PERF_EVENT);
+// the sampler threads go through the backend (see backend.h)
+void probe_pmu_cpu(cpu_pmu_t *pmu);
 void enable_pmu_cpu_core(unsigned int core_id, unsigned int set_id);
-void disable_pmu_cpu_core();
+void program_pmu_cpu_core(unsigned int core_id, unsigned int set_id);
+void disable_pmu_cpu_core(unsigned int core_id);
 void read_counters_cpu_core(unsigned int core_id, unsigned int set_id);
-void reset_counters_cpu_core();
 
 void read_cpu_core_freq(unsigned int core_id);
 
 // helper functions
+void open_cpu_freq();
+void close_cpu_freq();
+unsigned int get_cpu_num_cores();
 uint32_t get_cpu_freq();
 uint32_t get_cpu_core_freq(unsigned int core_id);
 uint32_t clip_cpu_freq(uint32_t freq);
 void print_cpu_events(FILE *log_file);
 void print_cpu_events_set(FILE *log_file, unsigned int set_id);
+uint64_t cpu_max_read_period_us();
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                    Counter deltas                     ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// events counted by a free-running 32-bit PMU counter between two reads: a wrap
+// shows as cur < prev, and the modular difference accounts for it, as long as
+// fewer than 2^32 events are counted between reads (a counter passing its
+// previous value loses 2^32 events, see cpu_max_read_period_us)
+static inline cpu_counter_t cpu_counter_delta(uint32_t prev, uint32_t cur) {
+  return (uint32_t)(cur - prev);
+}
+
+// 64-bit clock cycles counter
+static inline uint64_t cpu_counter_clk_delta(uint64_t prev, uint64_t cur) {
+  return cur - prev;
+}
+
+// events of a perf event group between two reads, scaled to the time it was enabled
+// when the kernel multiplexed it with other groups (running < enabled); none if it
+// was never on the PMU
+static inline cpu_counter_t cpu_counter_scale(uint64_t delta, uint64_t enabled, uint64_t running) {
+  if (running == 0)
+    return 0;
+  if (running >= enabled)
+    return delta;
+  return (cpu_counter_t)((double)delta * enabled / running);
+}
 
 #endif // _CPU_H
@@ -0,0 +1,81 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _DAEMON_H
+#define _DAEMON_H
+
+// standard includes
+#include <stdio.h>
+#include <pthread.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+#define DAEMON_SOCKET_DEFAULT "/tmp/voltmeter.sock"
+// max pending connections on the job socket
+#define DAEMON_BACKLOG 16
+
+// job protocol: the client sends one "<key> <value>" line per field and an empty line,
+// the daemon answers "queued <id>", then "done <id>" or "error <message>"
+#define DAEMON_KEY_BENCHMARK  "benchmark"   // path of the benchmark dynamic library
+#define DAEMON_KEY_ARG        "arg"         // one benchmark argument, repeatable
+#define DAEMON_KEY_EVENTS     "events"      // 'all_events', 'config' or 'cli'
+#define DAEMON_KEY_CONFIG_CPU "config_cpu"
+#define DAEMON_KEY_CONFIG_GPU "config_gpu"
+#define DAEMON_KEY_CLI_CPU    "cli_cpu"     // comma-separated event IDs
+#define DAEMON_KEY_CLI_GPU    "cli_gpu"
+#define DAEMON_KEY_TRACE      "trace"       // path of the trace file
+#define DAEMON_KEY_SHUTDOWN   "shutdown"    // no value: stop once the queued jobs are done
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+typedef struct daemon_job {
+  unsigned int id;
+  int fd;                   // client connection, kept open for the final reply
+  char *benchmark;
+  unsigned int num_args;
+  char **args;              // args[0] is reserved for the path, args[num_args + 1] is NULL
+  char *events;             // NULL = daemon default
+  char *config_cpu;
+  char *config_gpu;
+  char *cli_cpu;
+  char *cli_gpu;
+  char *trace;
+  struct daemon_job *next;
+} daemon_job_t;
+
+typedef struct {
+  char *socket_path;
+  int socket_fd;
+  pthread_t listener;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  daemon_job_t *head;       // FIFO of queued jobs
+  daemon_job_t *tail;
+  unsigned int num_jobs;    // jobs received so far (job ids)
+  int shutdown;
+} daemon_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void daemon_start(daemon_t *daemon, char *socket_path);
+void daemon_stop(daemon_t *daemon);
+daemon_job_t *daemon_next_job(daemon_t *daemon);
+void daemon_reply(daemon_job_t *job, const char *format, ...);
+void daemon_free_job(daemon_job_t *job);
+
+#endif // _DAEMON_H
@@ -0,0 +1,84 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _ESTIMATE_H
+#define _ESTIMATE_H
+
+// standard includes
+#include <stdio.h>
+#include <stdint.h>
+// voltmeter libraries
+#include <model.h>
+#include <trace.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// cost budget of an estimate, as a fraction of the sampling period
+#define ESTIMATE_BUDGET_FRACTION 0.01
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// column of a merged sample feeding a feature of the model
+typedef struct {
+  size_t offset;
+  size_t size;                // 4 or 8 bytes
+  unsigned int feature;       // index in the model
+  uint32_t fresh;             // FRESH_* flag of the column
+} estimator_input_t;
+
+// software power meter: the trace consumer estimates the power of every merged
+// sample with the model of the operating point, from the rates of its events
+typedef struct {
+  model_set_t set;
+  // operating point and trace being profiled, set by main
+  power_model_t *model;
+  FILE *output;               // CSV: deadline_ns, power_mw
+  // trace being profiled, used by the consumer only
+  unsigned int num_inputs;
+  estimator_input_t *inputs;
+  uint32_t fresh_needed;      // FRESH_* flags of all the inputs
+  size_t deadline_offset;
+  size_t fresh_offset;
+  double sample_period_ns;
+  double *counts;             // per feature, since the previous estimate
+  double *rates;
+  uint64_t prev_deadline;
+  int has_prev;
+  unsigned int window_samples;
+  // cost of the estimates of the trace
+  uint64_t budget_ns;
+  uint64_t num_estimates;
+  uint64_t num_over_budget;
+  uint64_t cost_ns;
+  uint64_t max_cost_ns;
+} estimator_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void estimator_init(estimator_t *estimator, char *model_file);
+void estimator_free(estimator_t *estimator);
+power_model_t *estimator_select(estimator_t *estimator, uint32_t cpu_freq, uint32_t gpu_freq);
+// trace consumer
+void estimator_start(estimator_t *estimator, trace_schema_t *schema, uint32_t sample_period_us);
+void estimator_add(estimator_t *estimator, const uint8_t *sample);
+void estimator_flush(estimator_t *estimator);
+void estimator_stop(estimator_t *estimator);
+// results
+void estimator_report(estimator_t *estimator, FILE *log_file);
+
+#endif // _ESTIMATE_H
@@ -8,9 +8,12 @@
 #define _GPU_H
 
 // standard includes
+#include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 // voltmeter libraries
 #include <platform.h>
+#include <trace.h>
 // third-party libraries
 #ifdef __JETSON_AGX_XAVIER
 #include <cuda_runtime_api.h>
@@ -27,8 +30,13 @@
   // files
   #define CUR_FREQ_GPU_FILE "/sys/devices/17000000.gv11b/devfreq/17000000.gv11b/cur_freq"
   #define AVAIL_FREQ_GPU_FILE "/sys/devices/17000000.gv11b/devfreq/17000000.gv11b/available_frequencies"
+  // DVFS knobs (frequencies in Hz)
+  #define MIN_FREQ_GPU_FILE "/sys/devices/17000000.gv11b/devfreq/17000000.gv11b/min_freq"
+  #define MAX_FREQ_GPU_FILE "/sys/devices/17000000.gv11b/devfreq/17000000.gv11b/max_freq"
   // statically select GPU 0
   #define CUDA_DEV_NUM 0
+  // the platform has a GPU to profile
+  #define HAS_GPU 1
 
   // macros
   #define CHECK_CU_ERROR(err, cufunc)                                                                \
@@ -44,6 +52,14 @@
     printf("%s:%d: error %s for CUPTI API function '%s'.\n", __FILE__, __LINE__, errstr, cuptifunc); \
     exit(1);                                                                                         \
   }
+#elif defined(__LINUX_GENERIC)
+  #define HAS_GPU 0
+  // no GPU: profiling it is an error
+  #define NO_GPU_ERROR()                                            \
+  {                                                                 \
+    printf("%s:%d: no GPU on this platform.\n", __FILE__, __LINE__); \
+    exit(1);                                                        \
+  }
 #else
   #error "Platform not supported."
 #endif
@@ -57,6 +73,9 @@
 #ifdef __JETSON_AGX_XAVIER
 typedef CUpti_EventID gpu_event_id_t;
 typedef uint64_t gpu_counter_t;
+#elif defined(__LINUX_GENERIC)
+typedef uint32_t gpu_event_id_t;
+typedef uint64_t gpu_counter_t;
 #else
 #error "Platform not supported."
 #endif
@@ -93,12 +112,14 @@ typedef struct {
 // setup
 uint32_t setup_gpu(FILE *log_file);
 void deinit_gpu();
+uint32_t set_gpu_freq(uint32_t freq);
+void reset_gpu_events(uint32_t frequency);
 
-// events parsing
+// events parsing: the number of event sets, 0 if the selection is invalid
 uint32_t gpu_events_all(FILE *log_file);
 uint32_t gpu_events_from_cli(gpu_event_id_t *events, unsigned int num_events, FILE *log_file);
 uint32_t gpu_events_from_config(char *config_file, FILE *log_file);
-void parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config);
+int parse_gpu_events_json(char *config_file, gpu_events_config_t *events_config);
 
 // performance monitoring unit driver
 void enable_pmu_gpu(unsigned int set_id);
@@ -108,6 +129,12 @@ void reset_counters_gpu();
 
 void read_gpu_freq();
 
+// trace layout of the counters of a set (the GPU frequency is a column of its own)
+size_t trace_bytes_gpu(unsigned int set_id);
+size_t serialize_counters_gpu(uint8_t *dst, unsigned int set_id);
+void trace_columns_gpu(trace_schema_t *schema, unsigned int set_id);
+void trace_header_gpu(FILE *stream, unsigned int set_id);
+
 // helper functions
 uint32_t get_gpu_freq();
 uint32_t clip_gpu_freq(uint32_t freq);
@@ -7,6 +7,9 @@
 #ifndef _HELPER_H
 #define _HELPER_H
 
+// standard includes
+#include <stdio.h>
+#include <stddef.h>
 // third-party libraries
 #include <jsmn.h>
 
@@ -20,5 +23,7 @@ int cat_path(char *path, char *filename, char *full_path);
 char *path_basename(char *path);
 int jsmn_parse_token(const char *json_string, jsmntok_t *tok, const char *format, ...);
 int printf_file(FILE *file, const char *format, ...);
+void *malloc_or_exit(size_t size);
+void run_pool(void (*function)(unsigned int), unsigned int size, unsigned int num_threads);
 
 #endif // _HELPER_H
@@ -0,0 +1,136 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _MODEL_H
+#define _MODEL_H
+
+// standard includes
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// max length of a feature name ("cpu.clk", "cpu.0x08", "gpu.123")
+#define MODEL_FEATURE_NAME_LEN 32
+// rows of the block accumulated at once into the normal equations
+#define GRAM_BLOCK_ROWS 64
+// target of the models: power of a rail, or of all the rails
+#define MODEL_TARGET_TOTAL -1
+// recursive least squares: features are scaled to events per microsecond, and the
+// initial inverse correlation is RLS_INIT_P times the identity (a weak prior)
+#define RLS_FEATURE_SCALE 1e-6
+#define RLS_INIT_P 1e6
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+typedef enum {
+  MODEL_FEATURE_CPU_CLK,      // clock cycles of all the cores, per second
+  MODEL_FEATURE_CPU_EVENT,    // PMU event of all the cores, per second
+  MODEL_FEATURE_GPU_EVENT     // CUPTI event of all the domain instances, per second
+} model_feature_kind_t;
+
+typedef struct {
+  model_feature_kind_t kind;
+  uint32_t event_id;          // CPU/GPU events only
+} model_feature_t;
+
+// linear model of the power (mW) at an operating point:
+// power = intercept + sum(coefficients[f] * features[f])
+typedef struct {
+  uint32_t cpu_freq;          // frequencies set, 0 = any
+  uint32_t gpu_freq;
+  unsigned int num_features;
+  model_feature_t *features;
+  double intercept;
+  double *coefficients;
+  // quality of the fit
+  uint64_t num_samples;
+  unsigned int num_benchmarks;
+  double rmse_mw;             // on the training samples
+  double cv_error;            // leave-one-benchmark-out RMSE over mean power, -1 if not run
+  double online_error;        // fitted online: RMSE of the estimates made before each update over mean power, -1 if not
+} power_model_t;
+
+// coefficient file written by voltmeter-fit
+typedef struct {
+  int target;                 // power rail index, or MODEL_TARGET_TOTAL
+  unsigned int num_models;
+  power_model_t *models;
+} model_set_t;
+
+// normal equations of a linear least squares problem with intercept:
+// x = [1, features], xtx = sum(x x^T), xty = sum(x y); xtx is filled above the
+// diagonal while accumulating, see gram_finish
+typedef struct {
+  unsigned int dim;           // 1 + number of features
+  double *xtx;                // dim x dim, row-major
+  double *xty;
+  double yty;
+  uint64_t num_samples;
+  // rows not accumulated yet
+  double *block;              // GRAM_BLOCK_ROWS x dim, row-major
+  double *block_y;
+  unsigned int block_rows;
+} gram_t;
+
+// recursive least squares with intercept, updated one sample at a time
+typedef struct {
+  unsigned int dim;           // 1 + number of features
+  double forgetting;          // weight of the past at every update, 1 = none
+  double *w;                  // [intercept, coefficients], of the scaled features
+  double *p;                  // dim x dim inverse correlation matrix, row-major
+  double *x;                  // scaled sample
+  double *px;                 // p x
+  // residuals
+  uint64_t num_samples;
+  double sum_y;
+  double sse_prior;           // of the estimates before each update
+  double sse_post;            // of the estimates after each update
+} rls_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// coefficient file
+void parse_model_json(char *model_file, model_set_t *set);
+void write_model_json(FILE *file, model_set_t *set);
+void free_model_set(model_set_t *set);
+power_model_t *find_model(model_set_t *set, uint32_t cpu_freq, uint32_t gpu_freq);
+int model_feature_name(const model_feature_t *feature, char *name);
+int parse_model_feature(const char *name, model_feature_t *feature);
+int model_feature_of_column(const char *column, model_feature_t *feature);
+double model_estimate(const power_model_t *model, const double *features);
+
+// normal equations
+void gram_init(gram_t *gram, unsigned int num_features);
+void gram_free(gram_t *gram);
+void gram_add(gram_t *gram, const double *features, double y);
+void gram_finish(gram_t *gram);
+void gram_merge(gram_t *dst, const gram_t *src);
+double gram_sse(const gram_t *gram, const double *w);
+
+// solvers: w = [intercept, coefficients]; return 1 if the system is singular
+int solve_ls(const gram_t *gram, double ridge, double *w);
+int solve_nnls(const gram_t *gram, double ridge, double *w);
+
+// recursive least squares
+void rls_init(rls_t *rls, unsigned int num_features, double forgetting);
+void rls_free(rls_t *rls);
+void rls_update(rls_t *rls, const double *features, double y);
+void rls_coefficients(const rls_t *rls, double *intercept, double *coefficients);
+
+#endif // _MODEL_H
@@ -0,0 +1,93 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _ONLINE_H
+#define _ONLINE_H
+
+// standard includes
+#include <stdio.h>
+#include <stdint.h>
+// voltmeter libraries
+#include <model.h>
+#include <trace.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// weight of the past samples at every update of the online models (1 = none):
+// the models of an operating point are fitted on all its benchmarks
+#define ONLINE_FORGETTING 1.0
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// online model of an operating point
+typedef struct {
+  uint32_t cpu_freq;
+  uint32_t gpu_freq;
+  unsigned int num_features;
+  model_feature_t *features;
+  rls_t rls;
+  unsigned int num_traces;
+} online_point_t;
+
+// column of a merged sample feeding a feature
+typedef struct {
+  size_t offset;
+  size_t size;                // 4 or 8 bytes
+  unsigned int feature;
+  uint32_t fresh;             // FRESH_* flag of the column
+} online_input_t;
+
+// power models fitted by the trace consumer while the benchmarks run, with
+// recursive least squares: a model sample is a power read, its features the
+// rates of the events read since the previous power read
+typedef struct {
+  // operating point being profiled, set by main
+  uint32_t cpu_freq;
+  uint32_t gpu_freq;
+  unsigned int num_points;
+  online_point_t *points;
+  unsigned int num_skipped;   // traces multiplexed, or whose events differ from those of their operating point
+  // trace being profiled, used by the consumer only
+  online_point_t *point;      // NULL if the trace is not modeled
+  unsigned int num_inputs;
+  online_input_t *inputs;
+  unsigned int num_power;
+  size_t *power_offsets;
+  size_t deadline_offset;
+  size_t fresh_offset;
+  double sample_period_ns;
+  double *counts;             // per feature, since the previous power read
+  double *rates;
+  uint64_t prev_deadline;
+  int has_prev;
+  unsigned int window_samples;
+} online_model_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void online_model_init(online_model_t *online);
+void online_model_free(online_model_t *online);
+void online_model_select(online_model_t *online, uint32_t cpu_freq, uint32_t gpu_freq);
+// trace consumer
+void online_model_start(online_model_t *online, trace_schema_t *schema, uint32_t sample_period_us);
+void online_model_add(online_model_t *online, const uint8_t *sample);
+void online_model_stop(online_model_t *online);
+// results
+void online_model_write(online_model_t *online, char *model_file, FILE *log_file);
+
+#endif // _ONLINE_H
@@ -14,15 +14,9 @@
  */
 
 // platform
-#if !defined(__JETSON_AGX_XAVIER)
+#if !defined(__JETSON_AGX_XAVIER) && !defined(__LINUX_GENERIC)
 #error "No platform supported."
 #endif
-#ifndef CPU
-#define CPU 0
-#endif
-#ifndef GPU
-#define CPU 0
-#endif
 
 #ifdef __JETSON_AGX_XAVIER
   #define NUM_POWER_RAILS 6
@@ -33,9 +27,15 @@
   #define INA_0x41_POWER_CH0_FILE "/sys/bus/i2c/drivers/ina3221x/1-0041/iio:device1/in_power0_input"
   #define INA_0x41_POWER_CH1_FILE "/sys/bus/i2c/drivers/ina3221x/1-0041/iio:device1/in_power1_input"
   #define INA_0x41_POWER_CH2_FILE "/sys/bus/i2c/drivers/ina3221x/1-0041/iio:device1/in_power2_input"
+#elif defined(__LINUX_GENERIC)
+  // no power monitors known: traces have no power rails
+  #define NUM_POWER_RAILS 0
 #else
   #error "Platform not supported."
 #endif
+// rails of the synthetic backend (see backend.h), as those of the Jetson AGX Xavier
+#define SYNTHETIC_NUM_POWER_RAILS 6
+#define MAX_POWER_RAILS (NUM_POWER_RAILS > SYNTHETIC_NUM_POWER_RAILS ? NUM_POWER_RAILS : SYNTHETIC_NUM_POWER_RAILS)
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -47,7 +47,7 @@ typedef uint32_t power_t;
 
 typedef struct {
   unsigned int num_power_rails;
-  power_t power_measures[NUM_POWER_RAILS];
+  power_t power_measures[MAX_POWER_RAILS];
 } platform_power_t;
 
 /*
@@ -60,5 +60,11 @@ uint32_t setup_platform();
 void deinit_platform();
 
 void read_platform_power();
+void read_platform_power_rail(unsigned int rail);
+
+// power sensor driver (hardware backend)
+unsigned int open_power_rails();
+void close_power_rails();
+power_t read_power_rail(unsigned int rail);
 
 #endif // _PLATFORM_H
@@ -9,6 +9,16 @@
 
 // standard includes
 #include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <stdatomic.h>
+// voltmeter libraries
+#include <platform.h>
+#include <ring.h>
+#include <writer.h>
+#include <trace.h>
+#include <online.h>
+#include <estimate.h>
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -16,14 +26,18 @@
  * ╚═══════════════════════════════════════════════════════╝
  */
 
-// number of runs of each benchmark, to be averaged
-#ifndef NUM_RUN
-#define NUM_RUN 3
-#endif
-// sampling period duration in microseconds
-#ifndef SAMPLE_PERIOD_US
-#define SAMPLE_PERIOD_US 100000
-#endif
+// default number of runs of each benchmark, to be averaged
+#define DEFAULT_NUM_RUN 3
+// default sampling period duration in microseconds
+#define DEFAULT_SAMPLE_PERIOD_US 100000
+// period of the trace consumer merging the sampler rings, in microseconds
+#define CONSUMER_PERIOD_US 10000
+// minimum capacity of each sampler ring, in samples
+#define RING_MIN_SAMPLES 64
+// sampler thread hosting the GPU PMU (CUPTI event groups are bound to its context)
+#define GPU_HOST_THREAD 0
+// max number of device sensors read at every sample besides the cores
+#define MAX_DEVICE_SENSORS (2 + MAX_POWER_RAILS)
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -31,22 +45,111 @@
  * ╚═══════════════════════════════════════════════════════╝
  */
 
+// runtime configuration of the profiler, set from the command line
+typedef struct {
+  int cpu;                    // profile the CPU (PMU counters, core frequencies)
+  int gpu;                    // profile the GPU (CUPTI counters, frequency)
+  unsigned int num_run;       // number of runs of each benchmark, to be averaged
+  uint32_t sample_period_us;  // base sampling period (PMU counters)
+  uint32_t power_period_us;   // power rails period, rounded to a multiple of the base period; 0 = base
+  uint32_t freq_period_us;    // CPU/GPU frequencies period, same rounding; 0 = base
+  int realtime;               // real-time priority, locked and prefaulted memory
+  unsigned int trace_version; // TRACE_VERSION_RAW or TRACE_VERSION_COLUMNAR
+  uint32_t mux_samples;       // CPU event sets rotate every mux_samples samples in one pass; 0 = one pass per set
+} profiler_config_t;
+
+// runs of the benchmark in a trace: set by main, tagged into the samples by the
+// sampler threads and indexed in the trace footer by the consumer
+typedef struct {
+  unsigned int num_run;
+  atomic_uint current;        // run in progress (published after its start time)
+  atomic_uint num_ended;      // runs ended (published after their end time)
+  uint64_t *start_ns;         // CLOCK_MONOTONIC
+  uint64_t *end_ns;           // CLOCK_MONOTONIC
+} profiler_runs_t;
+
 // arguments for thread call
 typedef struct profiler_args {
   unsigned int thread_id;
   FILE *trace_file;
   volatile int *signal;
-  pthread_barrier_t *barrier;
-  unsigned int set_id_cpu;
+  pthread_barrier_t *barrier; // start barrier (sampler threads + consumer)
+  unsigned int set_id_cpu;    // first live set, if multiplexed
   unsigned int set_id_gpu;
+  // shared among sampler threads and consumer
+  unsigned int num_threads;   // number of sampler threads
+  spsc_ring_t *rings;         // one ring per sampler thread
+  uint64_t *epoch_ns;         // deadline of the first sample, common to all threads
+  atomic_uint *num_done;      // number of sampler threads that stopped sampling
+  profiler_runs_t *runs;      // runs of the benchmark in the trace
+  online_model_t *online_model; // fitted by the consumer with the merged samples, NULL if disabled
+  estimator_t *estimator;     // estimates the power of the merged samples, NULL if disabled
+  FILE *log_file;             // log of the trace for the profiler reports (also on stdout), NULL for none
+  // set by each sampler thread when it stops
+  uint64_t overruns;          // sampling deadlines missed by the thread
 } profiler_args_t;
 
+// header of each record pushed by a sampler thread into its ring; it is followed
+// by the serialized trace bytes of the core (core_bytes), then by the bytes of
+// the devices sampled by the thread (device_bytes)
+typedef struct {
+  uint64_t seq;           // index of the sampling deadline since epoch
+  uint64_t deadline_ns;   // scheduled deadline (CLOCK_MONOTONIC)
+  uint64_t wake_ns;       // actual wake time (CLOCK_MONOTONIC)
+  uint64_t end_ns;        // end of sampling (CLOCK_MONOTONIC)
+  uint32_t core_bytes;
+  uint32_t device_bytes;
+  uint32_t fresh;         // FRESH_* flags of the streams read by the thread
+  uint32_t run;           // run in progress when the sample was taken
+  uint32_t set_cpu;       // CPU event set counted since the previous sample
+} sample_header_t;
+
+// destination of the merged samples of the trace consumer
+typedef struct {
+  trace_writer_t writer;
+  trace_schema_t schema;      // fields of a merged sample, in trace order
+  trace_encoder_t encoder;    // trace version 2 only
+  uint8_t *sample;            // merged sample, in v1 layout
+  trace_footer_t footer;      // sample count and run boundaries
+  unsigned int next_run;      // next run whose first sample is awaited
+} trace_output_t;
+
+// sampling rate of a stream, as a multiple of the base sampling period
+typedef struct {
+  unsigned int divider;   // stream period / base sampling period
+  uint64_t next_seq;      // sequence number of the next due read
+} stream_rate_t;
+
+// kind of a device sensor; the enum order is the order of the devices in the trace
+typedef enum {
+  SENSOR_GPU_FREQ,
+  SENSOR_GPU_COUNTERS,
+  SENSOR_POWER_RAIL
+} device_sensor_kind_t;
+
+// device sensor read at every sample by one of the sampler threads
+typedef struct {
+  device_sensor_kind_t kind;
+  unsigned int index;         // power rail index (SENSOR_POWER_RAIL only)
+  unsigned int thread_id;     // sampler thread reading the sensor
+  size_t bytes;               // trace bytes per sample, set by the reading thread
+} device_sensor_t;
+
 /*
  * ╔═══════════════════════════════════════════════════════╗
  * ║                     Declarations                      ║
  * ╚═══════════════════════════════════════════════════════╝
  */
 
+void profiler_runs_init(profiler_runs_t *runs, unsigned int num_run);
+void profiler_run_start(profiler_runs_t *runs, unsigned int run);
+void profiler_run_end(profiler_runs_t *runs, unsigned int run);
+void profiler_runs_free(profiler_runs_t *runs);
+size_t sampler_ring_capacity();
+unsigned int stream_divider(uint32_t period_us);
+void assign_device_sensors(unsigned int num_threads);
+void print_device_sensors(FILE *log_file);
 void *events_profiler(void *args);
+void *trace_consumer(void *args);
 
 #endif // _PROFILER_H
@@ -0,0 +1,57 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _RING_H
+#define _RING_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+#define RING_CACHE_LINE 64
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// lock-free single-producer/single-consumer ring of fixed-size elements
+typedef struct {
+  uint8_t *buffer;
+  size_t elem_size;   // bytes per element (multiple of 8)
+  size_t capacity;    // number of elements (power of 2)
+  uint64_t dropped;   // elements not pushed because the ring was full (producer only)
+  // producer and consumer indexes on separate cache lines
+  _Alignas(RING_CACHE_LINE) atomic_size_t tail; // written by producer
+  _Alignas(RING_CACHE_LINE) atomic_size_t head; // written by consumer
+} spsc_ring_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void ring_init(spsc_ring_t *ring, size_t capacity, size_t elem_size);
+void ring_free(spsc_ring_t *ring);
+
+// producer side
+void *ring_reserve(spsc_ring_t *ring);
+void ring_commit(spsc_ring_t *ring);
+
+// consumer side
+void *ring_front(spsc_ring_t *ring);
+void ring_pop(spsc_ring_t *ring);
+
+#endif // _RING_H
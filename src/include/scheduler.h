@@ -0,0 +1,56 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _SCHEDULER_H
+#define _SCHEDULER_H
+
+// standard includes
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// SCHED_FIFO priority of the profiler threads (only with real-time sampling)
+#define SAMPLER_RT_PRIORITY 80
+// stack memory to prefault in each profiler thread (only with real-time sampling)
+#define SAMPLER_PREFAULT_STACK (64 * 1024)
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// absolute-deadline sampler clock (CLOCK_MONOTONIC, nanoseconds)
+typedef struct {
+  uint64_t epoch_ns;    // deadline of the first sample
+  uint64_t period_ns;   // sampling period
+  uint64_t seq;         // index of the next deadline since epoch
+  uint64_t overruns;    // number of deadlines skipped because already elapsed
+} sampler_clock_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// sampler clock
+uint64_t monotonic_ns();
+void sampler_clock_init(sampler_clock_t *clock, uint64_t epoch_ns, uint64_t period_ns);
+uint64_t sampler_clock_wait(sampler_clock_t *clock, uint64_t *deadline_ns);
+
+// real-time setup
+void setup_realtime(FILE *log_file);
+void set_realtime_attr(pthread_attr_t *attr);
+void prefault_stack();
+
+#endif // _SCHEDULER_H
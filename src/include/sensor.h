@@ -0,0 +1,63 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _SENSOR_H
+#define _SENSOR_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// environment variable overriding the sysfs root (e.g., a fake directory tree)
+#define SENSOR_ROOT_ENV "VOLTMETER_SYSFS_ROOT"
+// max length of a sensor path (root included)
+#define SENSOR_PATH_LEN 256
+// read buffer of a sensor: sysfs integer nodes are small
+#define SENSOR_BUF_LEN 32
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// sysfs node opened once at setup, then read with pread at offset 0
+typedef struct {
+  int fd;
+  char path[SENSOR_PATH_LEN];
+  char buf[SENSOR_BUF_LEN];
+} sensor_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// sysfs root
+void sensor_set_root(const char *root);
+const char *sensor_root();
+char *sensor_path(const char *path, char *full_path);
+
+// sensor handles
+void sensor_open(sensor_t *sensor, const char *path);
+int sensor_try_open(sensor_t *sensor, const char *path);
+void sensor_close(sensor_t *sensor);
+uint32_t sensor_read_u32(sensor_t *sensor);
+int sensor_parse_u32(const char *buf, size_t len, uint32_t *value);
+
+// sysfs knobs
+void sensor_write(const char *path, const char *value);
+void sensor_write_u32(const char *path, uint32_t value);
+uint32_t sensor_read_max_u32(const char *path);
+
+#endif // _SENSOR_H
@@ -0,0 +1,168 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _TRACE_H
+#define _TRACE_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+// zlib
+#include <zlib.h>
+// voltmeter libraries
+#include <writer.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// trace versions: 1 = array of raw samples, 2 = compressed blocks of columns
+#define TRACE_VERSION_RAW      1
+#define TRACE_VERSION_COLUMNAR 2
+#define DEFAULT_TRACE_VERSION  TRACE_VERSION_RAW
+// first bytes of a trace ("VMTR", little endian), followed by its version; legacy
+// v1 traces, written before the layout was versioned, have no magic (see trace.c)
+#define TRACE_MAGIC 0x52544d56
+// magic of each v2 block ("VMBK", little endian)
+#define TRACE_BLOCK_MAGIC 0x4b424d56
+// magic of the footer, at its start and at the end of the trace ("VMFT", little endian)
+#define TRACE_FOOTER_MAGIC 0x54464d56
+// version of the footer layout
+#define TRACE_FOOTER_VERSION 1
+// bytes of the footer trailer: footer size (u64), magic (u32)
+#define TRACE_FOOTER_TRAILER_BYTES (sizeof(uint64_t) + sizeof(uint32_t))
+// profiled devices, in the footer
+#define TRACE_DEVICE_CPU (1 << 0)
+#define TRACE_DEVICE_GPU (1 << 1)
+// footer flags: CPU event sets multiplexed within the runs (each core holds the
+// counters of all its sets, only those of its set live in a sample are counted;
+// the live set of each core follows the fresh flags, as u32 columns cpu<c>.set)
+#define TRACE_FLAG_CPU_MUX (1 << 0)
+// CPU counters are u64 (events since the previous sample, from free-running PMU
+// counters); u32 otherwise (traces profiled with counters reset at every sample)
+#define TRACE_FLAG_CPU_COUNTERS_64 (1 << 1)
+// fresh flags of a sample: streams refreshed in it (stale values repeat the last read)
+#define FRESH_CPU_COUNTERS (1 << 0)
+#define FRESH_CPU_FREQ     (1 << 1) // only when the frequency of any core changed
+#define FRESH_GPU_COUNTERS (1 << 2)
+#define FRESH_GPU_FREQ     (1 << 3) // only when the frequency changed
+#define FRESH_POWER        (1 << 4)
+// samples per v2 block (the last block of a trace may hold less)
+#define TRACE_BLOCK_SAMPLES 1024
+// max length of a column name, terminator included
+#define TRACE_COLUMN_NAME_LEN 48
+// max bytes of a varint-encoded 64-bit value
+#define TRACE_VARINT_MAX_BYTES 10
+// zlib level and strategy of the column payloads: the consumer budget favors
+// speed, and varint columns are mostly runs (e.g., zero counters) and literals
+#define TRACE_ZLIB_LEVEL 1
+#define TRACE_ZLIB_STRATEGY Z_RLE
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// encoding of a column, before block compression
+typedef enum {
+  TRACE_ENCODING_VARINT = 0,  // LEB128 of the value (e.g., events since the previous read)
+  TRACE_ENCODING_DELTA = 1    // LEB128 of the zigzag delta from the previous value (e.g., timestamps)
+} trace_encoding_t;
+
+// field of a sample, stored as a column in v2 traces
+typedef struct {
+  char name[TRACE_COLUMN_NAME_LEN];
+  uint32_t size;              // bytes of the value in a raw sample: 4 or 8
+  trace_encoding_t encoding;
+  size_t offset;              // byte offset of the value in a raw sample
+} trace_column_t;
+
+// fields of a raw (v1) sample, in trace order
+typedef struct {
+  unsigned int num_columns;
+  trace_column_t *columns;
+  size_t sample_bytes;        // bytes of a raw sample
+} trace_schema_t;
+
+// v2 encoder: buffers raw samples, then writes them as one block of columns
+typedef struct {
+  trace_schema_t *schema;
+  unsigned int num_samples;   // raw samples in the current block
+  uint8_t *samples;           // TRACE_BLOCK_SAMPLES raw samples
+  uint8_t *encoded;           // varint bytes of one column
+  uint8_t *compressed;        // compressed bytes of one column
+  uint8_t *block;             // all the compressed columns of the block
+  uint32_t *sizes;            // per column: compressed and varint bytes
+  z_stream stream;            // deflate state, reset at every column
+  size_t encoded_capacity;
+  size_t compressed_capacity;
+  uint64_t *block_offsets;    // file offset of each block written
+  uint64_t block_offsets_capacity;
+  // statistics
+  uint64_t num_blocks;
+  uint64_t raw_bytes;         // bytes of the samples in v1 layout
+  uint64_t encoded_bytes;     // bytes of the blocks written
+} trace_encoder_t;
+
+// run of the benchmark in a trace
+typedef struct {
+  uint64_t first_sample;      // index of the first sample of the run (num_samples if none)
+  uint64_t offset;            // file offset of the first sample (v1), or of its block (v2)
+  uint64_t start_ns;          // start of the run (CLOCK_MONOTONIC)
+  uint64_t wall_ns;           // wall time of the run
+} trace_run_t;
+
+// index at the end of a trace: from the trailer, a reader finds the footer and
+// seeks to any sample of any run without scanning the trace
+typedef struct {
+  uint32_t trace_version;
+  uint32_t devices;           // TRACE_DEVICE_* flags
+  uint32_t flags;             // TRACE_FLAG_* flags
+  uint32_t num_runs;
+  uint64_t num_samples;
+  uint64_t sample_bytes;      // bytes of a raw sample
+  uint64_t data_offset;       // file offset of the first sample (v1) or block (v2)
+  trace_run_t *runs;
+  uint64_t num_blocks;        // v2 only, 0 otherwise
+  uint64_t *block_offsets;    // v2 only: block b holds samples from b * TRACE_BLOCK_SAMPLES
+  uint32_t mux_samples;       // TRACE_FLAG_CPU_MUX only: samples a set stays live
+  uint32_t mux_set_counters;  // TRACE_FLAG_CPU_MUX only: counters of each set
+} trace_footer_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// schema
+void trace_schema_init(trace_schema_t *schema);
+void trace_schema_add(trace_schema_t *schema, const char *name, uint32_t size, trace_encoding_t encoding);
+void trace_schema_free(trace_schema_t *schema);
+
+// headers
+void trace_write_header_v1(trace_writer_t *writer, const void *header_v1, uint32_t header_v1_bytes);
+void trace_write_header_v2(trace_writer_t *writer, trace_schema_t *schema, const void *header_v1, uint32_t header_v1_bytes);
+
+// v2 encoder
+void trace_encoder_init(trace_encoder_t *encoder, trace_schema_t *schema);
+void trace_encoder_add(trace_encoder_t *encoder, trace_writer_t *writer, const uint8_t *sample);
+void trace_encoder_flush(trace_encoder_t *encoder, trace_writer_t *writer);
+void trace_encoder_free(trace_encoder_t *encoder);
+
+// footer
+void trace_write_footer(trace_writer_t *writer, trace_footer_t *footer);
+
+// column codec
+size_t trace_varint_put(uint8_t *dst, uint64_t value);
+size_t trace_varint_get(const uint8_t *src, size_t len, uint64_t *value);
+size_t trace_encode_column(uint8_t *dst, const uint8_t *samples, unsigned int num_samples, size_t sample_bytes, const trace_column_t *column);
+int trace_decode_column(uint64_t *values, unsigned int num_samples, const uint8_t *src, size_t len, const trace_column_t *column);
+
+#endif // _TRACE_H
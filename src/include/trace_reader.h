@@ -0,0 +1,218 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _TRACE_READER_H
+#define _TRACE_READER_H
+
+// standard includes
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+// voltmeter libraries
+#include <trace.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// max length of a reader error message
+#define TRACE_READER_ERROR_LEN 256
+// max bytes of a sample of a v1 trace without samples to bound it (header counts
+// are not trusted beyond the bytes of the file)
+#define TRACE_READER_MAX_SAMPLE_BYTES (1 << 20)
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// CPU core in a sample: frequency, counters, clock cycles
+typedef struct {
+  uint32_t num_counters;
+  const uint32_t *event_ids;  // in the mapped header
+  size_t offset;              // byte offset of the core in a raw sample
+} trace_core_layout_t;
+
+// GPU event group in a sample: per each instance, per each event, a u64 counter
+typedef struct {
+  uint32_t num_events;
+  uint32_t num_instances;
+  const uint32_t *event_ids;  // in the mapped header
+  size_t offset;              // byte offset of the group counters in a raw sample
+} trace_gpu_group_layout_t;
+
+// trace file mapped in memory; v1 samples are read in place, v2 blocks are
+// decoded by the iterators
+typedef struct {
+  // mapping
+  int fd;
+  const uint8_t *map;
+  size_t size;
+  // header
+  uint32_t version;           // TRACE_VERSION_RAW or TRACE_VERSION_COLUMNAR
+  int legacy;                 // v1 trace without magic: its samples are upgraded by the iterators
+  uint32_t block_samples;     // v2 only: samples per block
+  uint32_t devices;           // TRACE_DEVICE_* flags
+  const uint8_t *header_v1;   // v1 header, in the mapping (embedded in the v2 header), or legacy_header
+  uint8_t *legacy_header;     // legacy only: the v1 header with the periods of the streams
+  uint32_t header_v1_bytes;
+  uint32_t num_cores;
+  uint32_t counter_bytes;     // bytes of a CPU counter: 8 with TRACE_FLAG_CPU_COUNTERS_64, 4 otherwise
+  trace_core_layout_t *cores;
+  uint32_t num_gpu_groups;
+  trace_gpu_group_layout_t *gpu_groups;
+  size_t gpu_freq_offset;
+  uint32_t num_power_rails;
+  size_t power_offset;
+  uint32_t sample_period_us;
+  uint32_t power_period_us;
+  uint32_t freq_period_us;
+  size_t time_offset;         // sampling time, deadline, wake time, fresh flags
+  size_t sample_bytes;        // bytes of a raw sample
+  size_t file_sample_bytes;   // v1 only: bytes of a sample in the file (less than sample_bytes if legacy)
+  trace_schema_t schema;      // columns of a raw sample (from the v2 header, or from the v1 layout)
+  // data
+  size_t data_offset;         // first sample (v1) or block (v2)
+  size_t data_end;            // footer, or end of file
+  uint64_t num_samples;
+  uint64_t num_blocks;        // v2 only
+  uint64_t *block_offsets;    // v2 only
+  // footer (runs are those of the footer, or a single one without footer)
+  int has_footer;
+  uint32_t flags;             // TRACE_FLAG_* flags
+  uint32_t num_runs;
+  trace_run_t *runs;
+  // multiplexed CPU event sets (TRACE_FLAG_CPU_MUX only): the counters of a core
+  // are those of mux_num_sets sets of mux_set_counters events, set after set
+  uint32_t mux_samples;       // samples a set stays live
+  uint32_t mux_set_counters;
+  uint32_t mux_num_sets;
+  size_t mux_set_offset;      // live set of each core in a sample (after the fresh flags)
+  char error[TRACE_READER_ERROR_LEN];
+} trace_reader_t;
+
+// sequential iterator over a range of samples; sample points into the mapping
+// (v1), into an upgraded sample (legacy v1) or into a decoded block (v2), and is
+// valid until the next call
+typedef struct {
+  trace_reader_t *reader;
+  uint64_t next;              // index of the next sample
+  uint64_t end;
+  const uint8_t *sample;      // current sample, in v1 layout
+  uint8_t *rows;              // v2: raw samples of the decoded block; legacy v1: the upgraded sample
+  uint64_t block;             // v2 only: decoded block, UINT64_MAX if none
+  uint64_t *values;           // v2 only: decoded column
+  uint8_t *inflated;          // v2 only: varint bytes of a column
+  size_t inflated_capacity;
+  z_stream stream;            // v2 only: inflate state, reset at every column
+  int failed;                 // not initialized: no sample, the reason in reader->error
+} trace_iter_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// reader
+int trace_reader_open(trace_reader_t *reader, const char *path, uint32_t devices);
+void trace_reader_close(trace_reader_t *reader);
+int trace_reader_column(trace_reader_t *reader, const char *name);
+
+// iterators
+void trace_iter_init(trace_iter_t *iter, trace_reader_t *reader, uint64_t first, uint64_t end);
+void trace_iter_run(trace_iter_t *iter, trace_reader_t *reader, unsigned int run);
+int trace_iter_next(trace_iter_t *iter);
+void trace_iter_free(trace_iter_t *iter);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Sample accessors                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// u32 arrays are 4-byte aligned in v1 samples and in decoded blocks; u64 values
+// may not be 8-byte aligned, hence they are copied
+static inline uint64_t trace_load_u64(const uint8_t *src) {
+  uint64_t value;
+  memcpy(&value, src, sizeof(uint64_t));
+  return value;
+}
+
+static inline uint32_t trace_core_freq(const trace_reader_t *reader, const uint8_t *sample, unsigned int core) {
+  return *(const uint32_t *)(sample + reader->cores[core].offset);
+}
+
+// counter e of a core: events since the previous sample
+static inline uint64_t trace_core_counter(const trace_reader_t *reader, const uint8_t *sample, unsigned int core, unsigned int e) {
+  const uint8_t *counter = sample + reader->cores[core].offset + sizeof(uint32_t) + reader->counter_bytes * e;
+  if (reader->counter_bytes == sizeof(uint32_t))
+    return *(const uint32_t *)counter;
+  return trace_load_u64(counter);
+}
+
+static inline uint64_t trace_core_clk(const trace_reader_t *reader, const uint8_t *sample, unsigned int core) {
+  return trace_load_u64(sample + reader->cores[core].offset + sizeof(uint32_t) + reader->counter_bytes * reader->cores[core].num_counters);
+}
+
+static inline uint32_t trace_gpu_freq(const trace_reader_t *reader, const uint8_t *sample) {
+  return *(const uint32_t *)(sample + reader->gpu_freq_offset);
+}
+
+// counter of an event on a GPU domain instance
+static inline uint64_t trace_gpu_counter(const trace_reader_t *reader, const uint8_t *sample, unsigned int group, unsigned int instance, unsigned int event) {
+  const trace_gpu_group_layout_t *layout = &reader->gpu_groups[group];
+  return trace_load_u64(sample + layout->offset + sizeof(uint64_t) * (instance * layout->num_events + event));
+}
+
+static inline const uint32_t *trace_power(const trace_reader_t *reader, const uint8_t *sample) {
+  return (const uint32_t *)(sample + reader->power_offset);
+}
+
+static inline uint64_t trace_sampling_time(const trace_reader_t *reader, const uint8_t *sample) {
+  return trace_load_u64(sample + reader->time_offset);
+}
+
+static inline uint64_t trace_deadline_ns(const trace_reader_t *reader, const uint8_t *sample) {
+  return trace_load_u64(sample + reader->time_offset + sizeof(uint64_t));
+}
+
+static inline uint64_t trace_wake_ns(const trace_reader_t *reader, const uint8_t *sample) {
+  return trace_load_u64(sample + reader->time_offset + 2 * sizeof(uint64_t));
+}
+
+static inline uint32_t trace_fresh(const trace_reader_t *reader, const uint8_t *sample) {
+  return *(const uint32_t *)(sample + reader->time_offset + 3 * sizeof(uint64_t));
+}
+
+// TRACE_FLAG_CPU_MUX only: event set of a core counted in the sample
+static inline uint32_t trace_mux_set(const trace_reader_t *reader, const uint8_t *sample, unsigned int core) {
+  return *(const uint32_t *)(sample + reader->mux_set_offset + sizeof(uint32_t) * core);
+}
+
+// whether counter e of a core was counted in the sample (always, unless multiplexed)
+static inline int trace_core_counter_live(const trace_reader_t *reader, const uint8_t *sample, unsigned int core, unsigned int e) {
+  return !(reader->flags & TRACE_FLAG_CPU_MUX) || e / reader->mux_set_counters == trace_mux_set(reader, sample, core);
+}
+
+// standard scaling of a multiplexed counter: its total over num_samples samples,
+// from its total over the live_samples samples in which it was counted
+static inline double trace_mux_scale(double live_total, uint64_t live_samples, uint64_t num_samples) {
+  return live_samples > 0 ? live_total * num_samples / live_samples : 0;
+}
+
+// any column of the schema
+static inline uint64_t trace_column_value(const trace_reader_t *reader, const uint8_t *sample, unsigned int column) {
+  const trace_column_t *layout = &reader->schema.columns[column];
+  if (layout->size == sizeof(uint32_t))
+    return *(const uint32_t *)(sample + layout->offset);
+  return trace_load_u64(sample + layout->offset);
+}
+
+#endif // _TRACE_READER_H
@@ -0,0 +1,58 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _WRITER_H
+#define _WRITER_H
+
+// standard includes
+#include <stdio.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// number of trace blocks in flight between trace consumer and writer thread
+#define TRACE_WRITER_NUM_BUFFERS 3
+// size of each trace block, written with one sequential write
+#define TRACE_WRITER_BLOCK_SIZE (1 << 20)
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+typedef struct {
+  FILE *file;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  uint8_t *buffer[TRACE_WRITER_NUM_BUFFERS];
+  size_t fill[TRACE_WRITER_NUM_BUFFERS];
+  uint64_t submitted;     // blocks handed to the writer thread
+  uint64_t written;       // blocks written to file
+  int stop;
+  uint64_t offset;        // bytes handed to the writer so far, i.e., file offset of the next write
+  // statistics
+  uint64_t bytes;         // total bytes written
+  uint64_t backpressure;  // times no free block was available to the producer
+} trace_writer_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                     Declarations                      ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void trace_writer_start(trace_writer_t *writer, FILE *file);
+void trace_writer_write(trace_writer_t *writer, const void *data, size_t size);
+void trace_writer_stop(trace_writer_t *writer);
+
+#endif // _WRITER_H
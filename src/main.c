@@ -4,18 +4,6 @@
 //
 // Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
 
-// Supported devices
-#ifndef CPU
-#define CPU 0
-#endif
-#ifndef GPU
-#define GPU 0
-#endif
-
-#if !CPU && !GPU
-#error No supported devices have been specified.
-#endif
-
 // standard includes
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,18 +13,21 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <time.h>
-#include <dlfcn.h>
 #include <sched.h>
+#include <stdatomic.h>
 // voltmeter libraries
 #include <platform.h>
 #include <profiler.h>
+#include <scheduler.h>
+#include <ring.h>
 #include <helper.h>
-#if CPU
 #include <cpu.h>
-#endif
-#if GPU
 #include <gpu.h>
-#endif
+#include <campaign.h>
+#include <daemon.h>
+#include <online.h>
+#include <estimate.h>
+#include <backend.h>
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -49,42 +40,72 @@ const char *argp_program_bug_address = "<smazzola@iis.ee.ethz.ch>";
 static char doc[] = "Power and performance counters profiler.";
 static char args_doc[] = "";
 static struct argp_option options[] = {
+    {"devices", 'd', "DEVICES", 0, "Devices to profile, separated by commas; DEVICES can contain 'cpu' and 'gpu'", 0},
     {"events", 'e', "EVENTS_SOURCE", 0, "Source of events to profile; EVENTS_SOURCE can be 'all_events', 'config', or 'cli'", 0},
-#if CPU
     {"config_cpu", 'c', "CONFIG_FILE_CPU", 0, "Path to the event configuration file for the CPU profiling; only if events == 'config'", 1},
     {"cli_cpu", 'l', "CLI_EVENTS_CPU", 0, "List of CPU events to profile, separated by commas; only if events == 'cli'", 3},
-#endif
-#if GPU
     {"config_gpu", 'g', "CONFIG_FILE_GPU", 0, "Path to the event configuration file for the GPU profiling; only if events == 'config'", 2},
     {"cli_gpu", 'm', "CLI_EVENTS_GPU", 0, "List of GPU events to profile, separated by commas; only if events == 'cli'", 4},
-#endif
-    {"mode", 'r', "MODE", 0, "Decide in which mode to run Voltmeter; MODE can be 'char', 'profile' 'num_passes'", 5},
+    {"mode", 'r', "MODE", 0, "Decide in which mode to run Voltmeter; MODE can be 'char', 'profile', 'num_passes', 'daemon', 'estimate'", 5},
     {"trace_dir", 't', "TRACE_DIR", 0, "Path to the directory where to store the trace files; only if mode == 'char' or 'profile'", 6},
     {"benchmark", 'b', "BENCHMARK_PATH", 0, "Path of benchmark compiled as a dynamic library; only if mode == 'char' or 'profile'", 7},
     {"benchmark_args", 'a', "BENCHMARK_ARGS", 0, "Comma-separated arguments to be passed to the benchmark, in the same order; only if mode == 'char' or 'profile'", 8},
+    {"num_run", 'n', "NUM_RUN", 0, "Number of runs of each benchmark, to be averaged (default: 3)", 9},
+    {"sample_period_us", 's', "PERIOD_US", 0, "Sampling period of the performance counters, in microseconds (default: 100000)", 10},
+    {"power_period_us", 'p', "PERIOD_US", 0, "Sampling period of the power rails, in microseconds; 0 = sample_period_us (default: 0)", 11},
+    {"freq_period_us", 'f', "PERIOD_US", 0, "Sampling period of the CPU/GPU frequencies, in microseconds; 0 = sample_period_us (default: 0)", 12},
+    {"realtime", 'R', "REALTIME", 0, "Real-time sampling with SCHED_FIFO threads and locked memory; REALTIME can be 0 or 1 (default: 0)", 13},
+    {"trace_version", 'T', "VERSION", 0, "Trace file format; VERSION can be 1 (raw samples) or 2 (columnar, delta/varint encoded and compressed blocks) (default: 1)", 16},
+    {"socket", 'S', "SOCKET_PATH", 0, "Unix socket on which to accept profiling jobs; only if mode == 'daemon' (default: " DAEMON_SOCKET_DEFAULT ")", 15},
+    {"campaign", 'C', "CAMPAIGN_FILE", 0, "Expanded manifest (JSON) to run in this process: all CPU frequencies x GPU frequencies x benchmarks, with DVFS set by Voltmeter; replaces --benchmark and --benchmark_args", 14},
+    {"online_model", 'O', "MODEL_FILE", 0, "Fit per operating point power models online (recursive least squares) while profiling, written to MODEL_FILE at the end; only if mode == 'char', 'profile' or 'daemon'", 17},
+    {"model", 'M', "MODEL_FILE", 0, "Coefficient file of the power models (see voltmeter-fit) estimating power from the events profiled, which are those of the model of each operating point; only if mode == 'estimate'", 18},
+    {"estimate_output", 'E', "OUTPUT", 0, "File or FIFO where to append the power estimates (CSV), or '-' for stdout; only if mode == 'estimate' (default: a CSV next to each trace)", 19},
+    {"mux_samples", 'X', "SAMPLES", 0, "Multiplex the CPU event sets in a single pass, each set counting for SAMPLES samples in turn (totals are estimated by scaling); 0 = one pass per set (default: 0)", 20},
+    {"backend", 'B', "BACKEND", 0, "Source of the counters, power and frequencies; BACKEND can be 'hardware' (the platform) or 'synthetic' (deterministic streams from SEED, CPU only) (default: hardware)", 21},
+    {"seed", 'z', "SEED", 0, "Seed of the streams of the synthetic backend (default: 1)", 22},
     {0}
 };
 
 struct arguments {
+  profiler_config_t config;
   enum {NO_EVENTS, ALL_EVENTS, CONFIG, CLI} event_source;
-#if CPU
   char *config_cpu;
   cpu_event_id_t *cli_cpu;
   unsigned int num_cli_cpu;
-#endif
-#if GPU
   char *config_gpu;
   gpu_event_id_t *cli_gpu;
   unsigned int num_cli_gpu;
-#endif
-  enum {NO_MODE, CHARACTERIZATION, PROFILE, NUM_PASSES} mode;
+  enum {NO_MODE, CHARACTERIZATION, PROFILE, NUM_PASSES, DAEMON, ESTIMATE} mode;
   char *trace_dir;
   char *benchmark;
   char **benchmark_args;
   unsigned int num_benchmark_args;
+  char *campaign;
+  char *socket;
+  char *online_model_file;
+  online_model_t *online_model; // NULL if not fitted online
+  char *model_file;
+  char *estimate_output;
+  estimator_t *estimator;     // NULL if mode != ESTIMATE
+  FILE *estimate_file;        // estimate_output, NULL for one CSV per trace
+  char *backend;
+  uint64_t seed;              // synthetic backend
 };
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state);
+static int setup_events(struct arguments *arguments, int *num_pass_cpu, int *num_pass_gpu, FILE *log_file);
+static int setup_model_events(struct arguments *arguments, int *num_pass_cpu, int *num_pass_gpu, FILE *log_file);
+static int profile_benchmark(struct arguments *arguments, benchmark_t *benchmark, int num_pass_cpu, int num_pass_gpu,
+                             uint32_t cpu_freq, uint32_t gpu_freq, FILE *log_file, char *trace_path_job,
+                             unsigned int *trace_first_i, unsigned int *trace_last_i);
+static int plan_passes(int num_pass_cpu, int num_pass_gpu);
+static int pass_set(int pass, int num_pass);
+static char *rename_log(char *trace_dir, char *log_path, char *benchmark_name, uint32_t cpu_freq, uint32_t gpu_freq,
+                        unsigned int trace_first_i, unsigned int trace_last_i);
+static char *rename_log_numbered(char *trace_dir, char *log_path, char *prefix);
+static void run_daemon(struct arguments *arguments, FILE *log_file);
+static const char *job_arguments(daemon_job_t *job, struct arguments *arguments);
 
 static struct argp argp = {options, parse_opt, args_doc, doc};
 
@@ -94,9 +115,9 @@ static struct argp argp = {options, parse_opt, args_doc, doc};
  * ╚═══════════════════════════════════════════════════════╝
  */
 
-#if CPU
 extern cpu_events_freq_config_t cpu_events;
-#endif
+extern gpu_events_freq_config_t gpu_events;
+extern profiler_config_t profiler_config;
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -115,23 +136,37 @@ int main(int argc, char *argv[]) {
  */
 
   struct arguments arguments;
+  arguments.config = profiler_config; // defaults
   arguments.event_source = NO_EVENTS;
-#if CPU
   arguments.config_cpu = NULL;
   arguments.cli_cpu = NULL;
   arguments.num_cli_cpu = 0;
-#endif
-#if GPU
   arguments.config_gpu = NULL;
   arguments.cli_gpu = NULL;
   arguments.num_cli_gpu = 0;
-#endif
   arguments.mode = NO_MODE;
   arguments.trace_dir = NULL;
   arguments.benchmark = NULL;
   arguments.benchmark_args = NULL;
   arguments.num_benchmark_args = 0;
+  arguments.campaign = NULL;
+  arguments.socket = DAEMON_SOCKET_DEFAULT;
+  arguments.online_model_file = NULL;
+  arguments.online_model = NULL;
+  arguments.model_file = NULL;
+  arguments.estimate_output = NULL;
+  arguments.estimator = NULL;
+  arguments.estimate_file = NULL;
+  arguments.backend = DEFAULT_BACKEND;
+  arguments.seed = DEFAULT_SYNTHETIC_SEED;
   argp_parse(&argp, argc, argv, 0, 0, &arguments);
+  // from now on, the profiler configuration is read-only
+  profiler_config = arguments.config;
+  backend_select(arguments.backend, arguments.seed);
+  if (profiler_config.gpu && !backend->has_gpu) {
+    printf("%s:%d: the %s backend has no GPU.\n", __FILE__, __LINE__, backend->name);
+    exit(1);
+  }
 
 /*
  * ┌───────────────────────────────────────────────────────┐
@@ -157,11 +192,21 @@ int main(int argc, char *argv[]) {
   printf_file(log_file, "                                   Voltmeter                                    \n");
   printf_file(log_file, "────────────────────────────────────────────────────────────────────────────────\n");
   printf_file(log_file, " Supported devices: ");
-  if (CPU)
+  if (profiler_config.cpu)
     printf_file(log_file, "CPU ");
-  if (GPU)
+  if (profiler_config.gpu)
     printf_file(log_file, "GPU");
   printf_file(log_file, "\n");
+  printf_file(log_file, " num_run: %u\n", profiler_config.num_run);
+  printf_file(log_file, " sample_period_us: %u\n", profiler_config.sample_period_us);
+  printf_file(log_file, " power_period_us: %u\n", profiler_config.power_period_us);
+  printf_file(log_file, " freq_period_us: %u\n", profiler_config.freq_period_us);
+  printf_file(log_file, " realtime: %d\n", profiler_config.realtime);
+  printf_file(log_file, " trace_version: %u\n", profiler_config.trace_version);
+  if (backend == &backend_synthetic)
+    printf_file(log_file, " backend: %s (seed %lu)\n", backend->name, arguments.seed);
+  if (profiler_config.mux_samples > 0)
+    printf_file(log_file, " mux_samples: %u\n", profiler_config.mux_samples);
   if (arguments.event_source == ALL_EVENTS)
     printf_file(log_file, " event_source: all_events\n");
   else if (arguments.event_source == CONFIG)
@@ -169,25 +214,23 @@ int main(int argc, char *argv[]) {
   else if (arguments.event_source == CLI)
     printf_file(log_file, " event_source: cli\n");
   if (arguments.event_source == CONFIG) {
-#if CPU
-    printf_file(log_file, " config_cpu: %s\n", arguments.config_cpu);
-#endif
-#if GPU
-    printf_file(log_file, " config_gpu: %s\n", arguments.config_gpu);
-#endif
+    if (profiler_config.cpu)
+      printf_file(log_file, " config_cpu: %s\n", arguments.config_cpu);
+    if (profiler_config.gpu)
+      printf_file(log_file, " config_gpu: %s\n", arguments.config_gpu);
   } else if (arguments.event_source == CLI) {
-#if CPU
-    printf_file(log_file, " cli_cpu: ");
-    for (int i = 0; i < arguments.num_cli_cpu; i++)
-      printf_file(log_file, "%u ", arguments.cli_cpu[i]);
-    printf_file(log_file, "\n");
-#endif
-#if GPU
-    printf_file(log_file, " cli_gpu: ");
-    for (int i = 0; i < arguments.num_cli_gpu; i++)
-      printf_file(log_file, "%u ", arguments.cli_gpu[i]);
-    printf_file(log_file, "\n");
-#endif
+    if (profiler_config.cpu) {
+      printf_file(log_file, " cli_cpu: ");
+      for (int i = 0; i < arguments.num_cli_cpu; i++)
+        printf_file(log_file, "%u ", arguments.cli_cpu[i]);
+      printf_file(log_file, "\n");
+    }
+    if (profiler_config.gpu) {
+      printf_file(log_file, " cli_gpu: ");
+      for (int i = 0; i < arguments.num_cli_gpu; i++)
+        printf_file(log_file, "%u ", arguments.cli_gpu[i]);
+      printf_file(log_file, "\n");
+    }
   }
   if (arguments.mode == CHARACTERIZATION)
     printf_file(log_file, " mode: characterization\n");
@@ -195,14 +238,25 @@ int main(int argc, char *argv[]) {
     printf_file(log_file, " mode: profile\n");
   else if (arguments.mode == NUM_PASSES)
     printf_file(log_file, " mode: num_passes\n");
-  if (arguments.mode == CHARACTERIZATION || arguments.mode == PROFILE){
+  else if (arguments.mode == DAEMON)
+    printf_file(log_file, " mode: daemon\n socket: %s\n", arguments.socket);
+  else if (arguments.mode == ESTIMATE)
+    printf_file(log_file, " mode: estimate\n model: %s\n estimate_output: %s\n", arguments.model_file,
+      arguments.estimate_output != NULL ? arguments.estimate_output : "(per trace)");
+  if (arguments.mode == CHARACTERIZATION || arguments.mode == PROFILE || arguments.mode == ESTIMATE){
     printf_file(log_file, " trace_dir: %s\n", arguments.trace_dir);
-    printf_file(log_file, " benchmark: %s\n", arguments.benchmark);
-    printf_file(log_file, " benchmark_args: ");
-    for (int i = 1; i <= arguments.num_benchmark_args; i++)
-      printf_file(log_file, "%s ", arguments.benchmark_args[i]);
-    printf_file(log_file, "\n");
+    if (arguments.campaign != NULL) {
+      printf_file(log_file, " campaign: %s\n", arguments.campaign);
+    } else {
+      printf_file(log_file, " benchmark: %s\n", arguments.benchmark);
+      printf_file(log_file, " benchmark_args: ");
+      for (int i = 1; i <= arguments.num_benchmark_args; i++)
+        printf_file(log_file, "%s ", arguments.benchmark_args[i]);
+      printf_file(log_file, "\n");
+    }
   }
+  if (arguments.online_model_file != NULL)
+    printf_file(log_file, " online_model: %s\n", arguments.online_model_file);
   printf_file(log_file, "════════════════════════════════════════════════════════════════════════════════\n\n");
 
 /*
@@ -211,15 +265,47 @@ int main(int argc, char *argv[]) {
  * └───────────────────────────────────────────────────────┘
 */
 
+  uint32_t cpu_freq = 0;
+  uint32_t gpu_freq = 0;
   setup_platform();
-#if CPU
-  uint32_t cpu_freq = setup_cpu(log_file);
-  printf_file(log_file, "Current CPU frequency: %u Hz\n", cpu_freq);
-#endif
-#if GPU
-  uint32_t gpu_freq = setup_gpu(log_file);
-  printf_file(log_file, "Current GPU frequency: %u Hz\n", gpu_freq);
-#endif
+  if (profiler_config.cpu) {
+    cpu_freq = setup_cpu(log_file);
+    printf_file(log_file, "Current CPU frequency: %u Hz\n", cpu_freq);
+    // free-running PMU counters: the events of a sample are the difference of two reads
+    if (profiler_config.sample_period_us > backend->cpu_max_read_period_us()) {
+      printf("%s:%d: sample_period_us %u is too long, CPU counters may wrap past their previous value (max %lu).\n", __FILE__, __LINE__,
+        profiler_config.sample_period_us, backend->cpu_max_read_period_us());
+      exit(1);
+    }
+  }
+  // CUDA/CUPTI are only initialized if the GPU is profiled
+  if (profiler_config.gpu) {
+    gpu_freq = setup_gpu(log_file);
+    printf_file(log_file, "Current GPU frequency: %u Hz\n", gpu_freq);
+  }
+  if (profiler_config.realtime)
+    setup_realtime(log_file);
+  // power models fitted by the trace consumer, across all the traces profiled
+  online_model_t online_model;
+  if (arguments.online_model_file != NULL) {
+    online_model_init(&online_model);
+    arguments.online_model = &online_model;
+  }
+  // power models estimating the power of every sample
+  estimator_t estimator;
+  if (arguments.mode == ESTIMATE) {
+    estimator_init(&estimator, arguments.model_file);
+    arguments.estimator = &estimator;
+    if (arguments.estimate_output != NULL && !strcmp(arguments.estimate_output, "-")) {
+      arguments.estimate_file = stdout;
+    } else if (arguments.estimate_output != NULL) {
+      arguments.estimate_file = fopen(arguments.estimate_output, "a");
+      if (arguments.estimate_file == NULL) {
+        printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, arguments.estimate_output);
+        exit(1);
+      }
+    }
+  }
 
 /*
  * ┌───────────────────────────────────────────────────────┐
@@ -231,50 +317,11 @@ int main(int argc, char *argv[]) {
   int num_pass_cpu = 1;
   int num_pass_gpu = 1;
 
-  // event_source: all_events
-  if (arguments.event_source == ALL_EVENTS) {
-#if CPU
-    num_pass_cpu = cpu_events_all(log_file);
-#endif
-#if GPU
-    num_pass_gpu = gpu_events_all(log_file);
-#endif
-  }
-  // event_source: config
-  else if (arguments.event_source == CONFIG) {
-#if CPU
-    num_pass_cpu = cpu_events_from_config(arguments.config_cpu, log_file);
-#endif
-#if GPU
-    num_pass_gpu = gpu_events_from_config(arguments.config_gpu, log_file);
-#endif
-  }
-  // event_source: cli
-  else if (arguments.event_source == CLI) {
-#if CPU
-    num_pass_cpu = cpu_events_from_cli(arguments.cli_cpu, arguments.num_cli_cpu, log_file);
-#endif
-#if GPU
-    num_pass_gpu = gpu_events_from_cli(arguments.cli_gpu, arguments.num_cli_gpu, log_file);
-#endif
-  }
-
-#if CPU
-  print_cpu_events(log_file);
-  printf_file(log_file, "Number of CPU event sets (required passes): %u\n", num_pass_cpu);
-#endif
-#if GPU
-  print_gpu_events(log_file);
-  printf_file(log_file, "Number of GPU event sets (required passes): %u\n", num_pass_gpu);
-#endif
-
-  // abort invalid modes pt. 2
-  // check: this is the only difference between 'profile' and 'num_passes' modes
-  // 'characterization' mode with 1 pass is equivalent to 'profile' mode
-  if ((num_pass_cpu > 1 || num_pass_gpu > 1) && arguments.mode == PROFILE) {
-    printf("%s:%d: 'profile' mode cannot have multiple passes.\n", __FILE__, __LINE__);
+  // in a campaign, events from config depend on the frequency: they are selected at each frequency
+  int events_per_freq = arguments.campaign != NULL && (arguments.event_source == CONFIG || arguments.mode == ESTIMATE);
+  // a daemon selects the events of each job
+  if (!events_per_freq && arguments.mode != DAEMON && setup_events(&arguments, &num_pass_cpu, &num_pass_gpu, log_file))
     exit(1);
-  }
 
 /*
  * ┌───────────────────────────────────────────────────────┐
@@ -282,259 +329,136 @@ int main(int argc, char *argv[]) {
  * └───────────────────────────────────────────────────────┘
  */
 
-  if (arguments.mode == CHARACTERIZATION || arguments.mode == PROFILE){
-
-    unsigned int trace_i = 0;
-    unsigned int trace_first_i;
-    int trace_first_i_set = 0;
-    // strip path from arguments.benchmark
-    char *benchmark_path = strdup(arguments.benchmark);
-    char *benchmark_name = path_basename(arguments.benchmark);
-    // prepare benchmark
-    char *error = dlerror();
-    void* benchmark_handle = dlopen(benchmark_path, RTLD_NOW | RTLD_LOCAL);
-    if (!benchmark_handle) {
-        fputs(dlerror(), stdout);
-        printf("\n");
-        printf("%s:%d: benchmark %s cannot be opened.\n", __FILE__, __LINE__, benchmark_path);
-        exit(1);
-    }
-    void (*benchmark)(int argc, char** argv) = dlsym(benchmark_handle, "main");
-    if (!benchmark) {
-        fputs(dlerror(), stdout);
-        printf("\n");
-        printf("%s:%d: benchmark %s cannot be run.\n", __FILE__, __LINE__, benchmark_path);
-        exit(1);
-    }
+  if (arguments.mode == CHARACTERIZATION || arguments.mode == PROFILE || arguments.mode == ESTIMATE){
 
-    // set up benchmark args
-    arguments.benchmark_args[0] = benchmark_path; // assign argv[0]
-    printf_file(log_file, "\n");
-    printf_file(log_file, "Running benchmark '%s' with %d argument(s).\n", benchmark_name, arguments.num_benchmark_args);
-    printf_file(log_file, "Benchmark arguments:\n");
-    for (int i = 0; i < arguments.num_benchmark_args + 2; i++)
-      printf_file(log_file, "  argv[%d] = %s \n", i, arguments.benchmark_args[i]);
-
-    // copy in a buffer to prevent misuse by benchmarks
-    char **argv_bench = (char**) malloc((arguments.num_benchmark_args + 2) * sizeof(char*)); // +2 for argv[0] and NULL
-    if (argv_bench == NULL) {
-      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-      exit(1);
-    }
-    for (int i = 0; i < arguments.num_benchmark_args + 1; i++) {
-      argv_bench[i] = (char*) malloc((strlen(arguments.benchmark_args[i]) + 1) * sizeof(char));
-      if (argv_bench[i] == NULL) {
+    campaign_t campaign;
+    if (arguments.campaign != NULL) {
+      parse_campaign_json(arguments.campaign, &campaign);
+    } else {
+      // a single benchmark, at the current frequencies
+      campaign.num_freqs_cpu = 0;
+      campaign.freqs_cpu = NULL;
+      campaign.num_freqs_gpu = 0;
+      campaign.freqs_gpu = NULL;
+      campaign.num_benchmarks = 1;
+      campaign.benchmarks = (benchmark_t *)malloc(sizeof(benchmark_t));
+      if (campaign.benchmarks == NULL) {
         printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
         exit(1);
       }
+      benchmark_t *benchmark = &campaign.benchmarks[0];
+      benchmark->path = strdup(arguments.benchmark);
+      benchmark->name = strdup(path_basename(arguments.benchmark));
+      benchmark->num_args = arguments.num_benchmark_args;
+      benchmark->args = (char **)malloc((arguments.num_benchmark_args + 2) * sizeof(char *)); // +2 for argv[0] and NULL
+      if (benchmark->args == NULL) {
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      benchmark->args[0] = benchmark->path;
+      for (int i = 1; i <= arguments.num_benchmark_args; i++)
+        benchmark->args[i] = strdup(arguments.benchmark_args[i]);
+      benchmark->args[arguments.num_benchmark_args + 1] = NULL;
+      benchmark->handle = NULL;
+      benchmark->main = NULL;
     }
+    // benchmarks are opened once and stay loaded across all frequencies
+    for (int b = 0; b < campaign.num_benchmarks; b++)
+      if (open_benchmark(&campaign.benchmarks[b]))
+        exit(1);
 
-    //////////////////////////////////
-    // set up profiler and benchmark
-    //////////////////////////////////
-
-    for (int cpu_p = 0; cpu_p < num_pass_cpu; cpu_p++) {
-      for (int gpu_p = 0; gpu_p < num_pass_gpu; gpu_p++) {
-        printf_file(log_file, "\n");
-        printf_file(log_file, "────────────────────────────────────────────────────────────────────────────────\n\n");
-#if CPU
-        print_cpu_events_set(log_file, cpu_p);
-#endif
-#if GPU
-        print_gpu_events_set(log_file, gpu_p);
-#endif
-        // setup traces
-        FILE *trace_file;
-        char *trace_path = NULL;
-
-        // generate trace name
-        char trace_name[150] = {'\0'};
-        do {
-          // this loop creates numbered traces if benchmarks with same name are profiled:
-          // useful when same benchmark is profiled multiple times with different arguments,
-          // or when multiple passes are performed with same configuration but different counters
-          sprintf(trace_name, "%s", benchmark_name);
-#if CPU
-          sprintf(trace_name + strlen(trace_name), "_cpu_%u", cpu_freq);
-#endif
-#if GPU
-          sprintf(trace_name + strlen(trace_name), "_gpu_%u", gpu_freq);
-#endif
-          sprintf(trace_name + strlen(trace_name), "_%u", trace_i);
-          sprintf(trace_name + strlen(trace_name), ".bin");
-          // allocate memory for trace path
-          trace_path = realloc(trace_path, strlen(arguments.trace_dir) + strlen(trace_name) + 10);
-          if (trace_path == NULL){
-            printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-            exit(1);
-          }
-          // join trace_dir and trace_name
-          cat_path(arguments.trace_dir, trace_name, trace_path);
-          trace_i++;
-        } while(access(trace_path, F_OK) != -1);
-        if (!trace_first_i_set) {
-          trace_first_i = trace_i - 1;
-          trace_first_i_set = 1;
-        }
-        printf_file(log_file, "\nTrace path: %s\n", trace_path);
-        // open trace file
-        trace_file = fopen(trace_path, "wb");
-        if (trace_file == NULL){
-        printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, trace_path);
-          exit(1);
-        }
-
-        // setup profiler
-        profiler_args_t *profiler_args = NULL;
-        size_t num_profiler_threads = 0;
-        cpu_set_t cpu_set;
-        pthread_t *profiler_threads;
-        pthread_attr_t pthread_attr;
-        pthread_barrier_t profiler_barrier;
-        int ret = 0;
-        volatile int benchmark_complete = 0;
-
-        // allocate profiler_args
-#if CPU
-        num_profiler_threads = cpu_events.num_cores;
-#else
-        num_profiler_threads = 1;
-#endif
-        profiler_args = malloc(sizeof(profiler_args_t) * num_profiler_threads);
-        if (profiler_args == NULL){
-          printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-          exit(1);
-        }
-        profiler_threads = malloc(sizeof(pthread_t) * num_profiler_threads);
-        if (profiler_threads == NULL){
-          printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-          exit(1);
+    // an empty frequency list keeps the current frequency
+    unsigned int num_freqs_cpu = campaign.num_freqs_cpu > 0 ? campaign.num_freqs_cpu : 1;
+    unsigned int num_freqs_gpu = campaign.num_freqs_gpu > 0 ? campaign.num_freqs_gpu : 1;
+    for (int fc = 0; fc < num_freqs_cpu; fc++) {
+      if (campaign.num_freqs_cpu > 0) {
+        cpu_freq = backend->set_cpu_freq(campaign.freqs_cpu[fc]);
+        printf_file(log_file, "\nCPU frequency set to %u Hz\n", cpu_freq);
+      }
+      for (int fg = 0; fg < num_freqs_gpu; fg++) {
+        if (campaign.num_freqs_gpu > 0) {
+          gpu_freq = backend->set_gpu_freq(campaign.freqs_gpu[fg]);
+          printf_file(log_file, "\nGPU frequency set to %u Hz\n", gpu_freq);
         }
-        // init profiler thread(s) barrier
-        pthread_barrier_init(&profiler_barrier, NULL, num_profiler_threads);
-        // launch profiler thread(s)
-        printf("\n");
-        for (int t = 0; t < num_profiler_threads; t++) {
-          printf("Initializing profiler thread for core %d...\n", t);
-          // setup profiler arguments
-          profiler_args[t].thread_id = t;
-          profiler_args[t].trace_file = trace_file;
-          profiler_args[t].signal = &benchmark_complete;
-          profiler_args[t].barrier = &profiler_barrier;
-          profiler_args[t].set_id_cpu = cpu_p;
-          profiler_args[t].set_id_gpu = gpu_p;
-          // set up pthread
-          pthread_attr_init(&pthread_attr);
-          CPU_ZERO(&cpu_set);
-          CPU_SET(t, &cpu_set);
-          pthread_attr_setaffinity_np(&pthread_attr, sizeof(cpu_set_t), &cpu_set);
-          // create thread c limiting its affinity to only CPU c
-          ret = pthread_create(&profiler_threads[t], &pthread_attr, events_profiler, &profiler_args[t]);
-          if (ret != 0) {
-            perror("pthread_create");
-            printf("%s:%d: failed to create profiler thread.\n", __FILE__, __LINE__);
+        if (events_per_freq) {
+          if (profiler_config.cpu)
+            reset_cpu_events(cpu_freq);
+          if (profiler_config.gpu)
+            reset_gpu_events(gpu_freq);
+          if (setup_events(&arguments, &num_pass_cpu, &num_pass_gpu, log_file))
             exit(1);
-          }
         }
 
-        // run benchmark
-        printf_file(log_file, "\n");
-        printf_file(log_file, "--------------------------------------------------------------------------------\n");
-        for (int r = 0; r < NUM_RUN; r++) {
-          printf_file(log_file, " [");
-#if CPU
-          printf_file(log_file, "CPU pass %d/%d", cpu_p + 1, num_pass_cpu);
-#endif
-#if CPU && GPU
-          printf_file(log_file, " | ");
-#endif
-#if GPU
-          printf_file(log_file, "GPU pass %d/%d", gpu_p + 1, num_pass_gpu);
-#endif
-          printf_file(log_file, "]");
-          printf_file(log_file, " Benchmark pass %d/%d\n", r + 1, NUM_RUN);
-          printf("--------------------------------------------------------------------------------\n");
-          // refresh benchmark arguments in case benchmarks mess with them
-          for (int i = 0; i < arguments.num_benchmark_args + 1; i++){
-            strcpy(argv_bench[i], arguments.benchmark_args[i]);
-            printf("%s ", argv_bench[i]);
+        for (int b = 0; b < campaign.num_benchmarks; b++) {
+          benchmark_t *benchmark = &campaign.benchmarks[b];
+          unsigned int trace_first_i, trace_last_i;
+          if (arguments.campaign == NULL) {
+            profile_benchmark(&arguments, benchmark, num_pass_cpu, num_pass_gpu, cpu_freq, gpu_freq, log_file, NULL, &trace_first_i, &trace_last_i);
+            // manage log file: rename to indicate to which traces it refers to
+            fclose(log_file);
+            char *log_path_rename = rename_log(arguments.trace_dir, log_file_path, benchmark->name, cpu_freq, gpu_freq, trace_first_i, trace_last_i);
+            log_file = fopen(log_path_rename, "a");
+            if (log_file == NULL) {
+              printf("%s:%d: failed to open log file.\n", __FILE__, __LINE__);
+              exit(1);
+            }
+            free(log_path_rename);
+            free(log_file_path);
+            continue;
           }
-          argv_bench[arguments.num_benchmark_args + 1] = NULL; // NULL terminates argv array
-          printf("\n");
-          printf("\n");
-          // reset getopt
-          optind = 1;
-          // benchmarks needs to return with 'return' and not 'exit'
-          benchmark(arguments.num_benchmark_args + 1, argv_bench);
-          printf("\n");
-          printf_file(log_file, "--------------------------------------------------------------------------------\n");
-        }
-        printf("\n");
-        // signal profiler threads to stop
-        benchmark_complete = 1;
-
-        printf("Benchmark '%s' finished.\n\n", benchmark_name);
-        // join profiler threads
-        for (int t = 0; t < num_profiler_threads; t++) {
-          ret = pthread_join(profiler_threads[t], NULL);
-          if (ret != 0) {
-            perror("pthread_join");
-            printf("%s:%d: failed to join profiler thread.\n", __FILE__, __LINE__);
+          // campaign: one log per benchmark and frequency, as if Voltmeter was run for each of them
+          char bench_log_name[] = "log.benchmark.temp";
+          char *bench_log_path = (char*)malloc(strlen(arguments.trace_dir) + strlen(bench_log_name) + 10);
+          if (bench_log_path == NULL){
+            printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
             exit(1);
           }
-          printf("Profiler thread %d has ended.\n", t);
+          cat_path(arguments.trace_dir, bench_log_name, bench_log_path);
+          FILE *bench_log = fopen(bench_log_path, "w");
+          if (bench_log == NULL) {
+            printf("%s:%d: failed to open log file.\n", __FILE__, __LINE__);
+            exit(1);
+          }
+          printf_file(bench_log, "Campaign: %s (benchmark %d/%u)\n", arguments.campaign, b + 1, campaign.num_benchmarks);
+          if (profiler_config.cpu) {
+            printf_file(bench_log, "CPU frequency: %u Hz\n", cpu_freq);
+            print_cpu_events(bench_log);
+            printf_file(bench_log, "Number of CPU event sets (required passes): %u\n", num_pass_cpu);
+          }
+          if (profiler_config.gpu) {
+            printf_file(bench_log, "GPU frequency: %u Hz\n", gpu_freq);
+            print_gpu_events(bench_log);
+            printf_file(bench_log, "Number of GPU event sets (required passes): %u\n", num_pass_gpu);
+          }
+          profile_benchmark(&arguments, benchmark, num_pass_cpu, num_pass_gpu, cpu_freq, gpu_freq, bench_log, NULL, &trace_first_i, &trace_last_i);
+          fclose(bench_log);
+          free(rename_log(arguments.trace_dir, bench_log_path, benchmark->name, cpu_freq, gpu_freq, trace_first_i, trace_last_i));
+          free(bench_log_path);
         }
-        // free profiler_args
-        free(profiler_args);
-        free(profiler_threads);
-        // clean traces variables
-        fclose(trace_file);
-        free(trace_path);
-        // destroy profiler thread(s) barrier
-        pthread_barrier_destroy(&profiler_barrier);
-
-#if GPU
-        // wait for the benchmark on GPU to finish (1 task running on GPU at a time)
-        sync_gpu_slave();
-#endif
       }
     }
-    // close benchmark
-    dlclose(benchmark_handle);
-    // handle dl errors
-    error = dlerror();
-    if (error != NULL) {
-      fputs(error, stdout);
-      printf("\n");
-      printf("%s:%d: benchmark %s cannot be run.\n", __FILE__, __LINE__, benchmark_path);
-      exit(1);
+    // close benchmarks
+    free_campaign(&campaign);
+
+    if (arguments.campaign != NULL) {
+      // manage log file: the campaign log does not refer to a single benchmark
+      fclose(log_file);
+      char *log_path_rename = rename_log_numbered(arguments.trace_dir, log_file_path, "campaign");
+      log_file = fopen(log_path_rename, "a");
+      if (log_file == NULL) {
+        printf("%s:%d: failed to open log file.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      free(log_path_rename);
+      free(log_file_path);
     }
+  }
 
-    // manage log file: rename to indicate to which traces it refers to
+  if (arguments.mode == DAEMON) {
+    run_daemon(&arguments, log_file);
+    // manage log file: the daemon log does not refer to a single benchmark
     fclose(log_file);
-    char log_rename[100] = {'\0'};
-    sprintf(log_rename, "%s", benchmark_name);
-    #if CPU
-    sprintf(log_rename + strlen(log_rename), "_cpu_%u", cpu_freq);
-    #endif
-    #if GPU
-    sprintf(log_rename + strlen(log_rename), "_gpu_%u", gpu_freq);
-    #endif
-    if (--trace_i == trace_first_i)
-      sprintf(log_rename + strlen(log_rename), "_%u.log", trace_first_i); // if only 1 trace
-    else
-      sprintf(log_rename + strlen(log_rename), "_%u-%u.log", trace_first_i, trace_i); // if more than 1 trace
-    char *log_path_rename = malloc(strlen(arguments.trace_dir) + strlen(log_rename) + 10);
-    if (log_path_rename == NULL){
-      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
-      exit(1);
-    }
-    cat_path(arguments.trace_dir, log_rename, log_path_rename);
-    int ret = rename(log_file_path, log_path_rename);
-    if (ret) {
-      printf("%s:%d: failed to rename log file %s.\n", __FILE__, __LINE__, log_file_path);
-      exit(1);
-    }
+    char *log_path_rename = rename_log_numbered(arguments.trace_dir, log_file_path, "daemon");
     log_file = fopen(log_path_rename, "a");
     if (log_file == NULL) {
       printf("%s:%d: failed to open log file.\n", __FILE__, __LINE__);
@@ -550,6 +474,16 @@ int main(int argc, char *argv[]) {
  * └───────────────────────────────────────────────────────┘
  */
 
+  if (arguments.online_model != NULL) {
+    online_model_write(arguments.online_model, arguments.online_model_file, log_file);
+    online_model_free(arguments.online_model);
+  }
+  if (arguments.estimator != NULL) {
+    estimator_free(arguments.estimator);
+    if (arguments.estimate_file != NULL && arguments.estimate_file != stdout)
+      fclose(arguments.estimate_file);
+  }
+
   // print time
   clock_gettime(CLOCK_REALTIME, &timestamp_b);
   double runtime = (double)((timestamp_b.tv_sec - timestamp_a.tv_sec) * 1e9 + (timestamp_b.tv_nsec - timestamp_a.tv_nsec)) / 1e9;
@@ -562,13 +496,12 @@ int main(int argc, char *argv[]) {
 
   // de-init
   deinit_platform();
-#if CPU
-  free(arguments.cli_cpu);
-  deinit_cpu();
-#endif
-#if GPU
-  free(arguments.cli_gpu);
-#endif
+  if (profiler_config.cpu) {
+    free(arguments.cli_cpu);
+    deinit_cpu();
+  }
+  if (profiler_config.gpu)
+    free(arguments.cli_gpu);
 
   if (arguments.mode == NUM_PASSES){
     // remove log_file, not required for NUM_PASSES
@@ -579,13 +512,20 @@ int main(int argc, char *argv[]) {
       exit(1);
     }
     free(log_file_path);
-#if CPU
-    printf("%s:%d: 'num_passes' mode is not supported for CPU.\n", __FILE__, __LINE__);
-    exit(1);
-#endif
-#if GPU
-    return num_pass_gpu;
-#endif
+    // the plan of the passes, CPU and GPU event sets profiled together
+    int num_passes = plan_passes(num_pass_cpu, num_pass_gpu);
+    printf("Passes per benchmark: %d\n", num_passes);
+    for (int p = 0; p < num_passes; p++) {
+      printf("  pass %d:", p + 1);
+      if (profiler_config.cpu)
+        printf(" CPU event set %d/%d", pass_set(p, num_pass_cpu) + 1, num_pass_cpu);
+      if (profiler_config.cpu && profiler_config.gpu)
+        printf(",");
+      if (profiler_config.gpu)
+        printf(" GPU event set %d/%d", pass_set(p, num_pass_gpu) + 1, num_pass_gpu);
+      printf("\n");
+    }
+    return num_passes;
   }
 
   return 0;
@@ -603,6 +543,20 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
   char *token;
   // parse arguments
   switch(key){
+    case 'd':
+      arguments->config.cpu = 0;
+      arguments->config.gpu = 0;
+      token = strtok(arg, ",");
+      while (token != NULL){
+        if (!strcmp(token, "cpu"))
+          arguments->config.cpu = 1;
+        else if (!strcmp(token, "gpu"))
+          arguments->config.gpu = 1;
+        else
+          argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, token);
+        token = strtok(NULL, ",");
+      }
+      break;
     case 'e':
       if (!strcmp(arg, "all_events")){
         arguments->event_source = ALL_EVENTS;
@@ -614,7 +568,6 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
         argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
       }
       break;
-#if CPU
     case 'c':
       arguments->config_cpu = arg;
       break;
@@ -633,8 +586,6 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
         token = strtok(NULL, ",");
       }
       break;
-#endif
-#if GPU
     case 'g':
       arguments->config_gpu = arg;
       break;
@@ -653,7 +604,6 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
         token = strtok(NULL, ",");
       }
       break;
-#endif
     case 'r':
       if (!strcmp(arg, "characterization")){
         arguments->mode = CHARACTERIZATION;
@@ -661,6 +611,10 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
         arguments->mode = PROFILE;
       } else if (!strcmp(arg, "num_passes")) {
         arguments->mode = NUM_PASSES;
+      } else if (!strcmp(arg, "daemon")) {
+        arguments->mode = DAEMON;
+      } else if (!strcmp(arg, "estimate")) {
+        arguments->mode = ESTIMATE;
       } else {
         argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
       }
@@ -697,44 +651,105 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
       }
       arguments->benchmark_args[arguments->num_benchmark_args+1] = NULL; // argv[argc] should be NULL
       break;
+    case 'n':
+      arguments->config.num_run = atoi(arg);
+      if (arguments->config.num_run < 1)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 's':
+      arguments->config.sample_period_us = atoi(arg);
+      if (arguments->config.sample_period_us < 1)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'p':
+      arguments->config.power_period_us = atoi(arg);
+      break;
+    case 'f':
+      arguments->config.freq_period_us = atoi(arg);
+      break;
+    case 'X':
+      if (atoi(arg) < 0)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      arguments->config.mux_samples = atoi(arg);
+      break;
+    case 'B':
+      if (strcmp(arg, BACKEND_HARDWARE) && strcmp(arg, BACKEND_SYNTHETIC))
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      arguments->backend = arg;
+      break;
+    case 'z':
+      arguments->seed = strtoull(arg, NULL, 0);
+      break;
+    case 'C':
+      arguments->campaign = arg;
+      break;
+    case 'S':
+      arguments->socket = arg;
+      break;
+    case 'O':
+      arguments->online_model_file = arg;
+      break;
+    case 'M':
+      arguments->model_file = arg;
+      break;
+    case 'E':
+      arguments->estimate_output = arg;
+      break;
+    case 'R':
+      if (!strcmp(arg, "0") || !strcmp(arg, "1"))
+        arguments->config.realtime = atoi(arg);
+      else
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'T':
+      if (!strcmp(arg, "1") || !strcmp(arg, "2"))
+        arguments->config.trace_version = atoi(arg);
+      else
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
     case ARGP_KEY_END:
+      // check devices argument
+      if (!arguments->config.cpu && !arguments->config.gpu)
+        argp_failure(state, 1, 0, "missing required argument for option --devices. See --help for more information.");
       // check event_source argument
-      if (arguments->event_source == NO_EVENTS)
+      // (the events of mode 'estimate' are those of its power models)
+      if (arguments->event_source == NO_EVENTS && arguments->mode != DAEMON && arguments->mode != ESTIMATE)
         argp_failure(state, 1, 0, "missing required argument for option --events. See --help for more information.");
       if (arguments->event_source == CONFIG){
-#if CPU
-          if (arguments->config_cpu == NULL)
+          if (arguments->config.cpu && arguments->config_cpu == NULL)
             argp_failure(state, 1, 0, "missing required argument for option --config_cpu. See --help for more information.");
-#endif
-#if GPU
-          if (arguments->config_gpu == NULL)
+          if (arguments->config.gpu && arguments->config_gpu == NULL)
             argp_failure(state, 1, 0, "missing required argument for option --config_gpu. See --help for more information.");
-#endif
       }
       if (arguments->event_source == CLI){
-#if CPU
-          if (arguments->cli_cpu == NULL)
+          if (arguments->config.cpu && arguments->cli_cpu == NULL)
             argp_failure(state, 1, 0, "missing required argument for option --cli_cpu. See --help for more information.");
-#endif
-#if GPU
-          if (arguments->cli_gpu == NULL)
+          if (arguments->config.gpu && arguments->cli_gpu == NULL)
             argp_failure(state, 1, 0, "missing required argument for option -cli_gpu. See --help for more information.");
-#endif
       }
       // check mode argument
       if (arguments->mode == NO_MODE)
         argp_failure(state, 1, 0, "missing required argument for option --mode. See --help for more information.");
-      if (arguments->mode == PROFILE && arguments->event_source == ALL_EVENTS)
-        argp_failure(state, 1, 0, "--mode profile cannot be used with event source 'all_events'. See --help for more information.");
-      if (arguments->mode == CHARACTERIZATION)
-        if (CPU && GPU)
-          argp_failure(state, 1, 0, "--mode characterization only supports one device at a time. See --help for more information.");
-      if (arguments->mode == CHARACTERIZATION || arguments->mode == PROFILE){
+      if (arguments->mode == PROFILE && arguments->event_source == ALL_EVENTS && arguments->config.mux_samples == 0)
+        argp_failure(state, 1, 0, "--mode profile cannot be used with event source 'all_events' unless multiplexed (--mux_samples). See --help for more information.");
+      if (arguments->mode == DAEMON && arguments->trace_dir == NULL)
+        argp_failure(state, 1, 0, "missing required argument for option --trace_dir. See --help for more information.");
+      if (arguments->mode == ESTIMATE && arguments->model_file == NULL)
+        argp_failure(state, 1, 0, "missing required argument for option --model. See --help for more information.");
+      if (arguments->mode != ESTIMATE && (arguments->model_file != NULL || arguments->estimate_output != NULL))
+        argp_failure(state, 1, 0, "--model and --estimate_output require --mode estimate. See --help for more information.");
+      if (arguments->mode == CHARACTERIZATION || arguments->mode == PROFILE || arguments->mode == ESTIMATE){
         if (arguments->trace_dir == NULL)
           argp_failure(state, 1, 0, "missing required argument for option --trace_dir. See --help for more information.");
-        if (arguments->benchmark == NULL)
+        if (arguments->benchmark == NULL && arguments->campaign == NULL)
           argp_failure(state, 1, 0, "missing required argument for option --benchmark. See --help for more information.");
       }
+      if (arguments->campaign != NULL) {
+        if (arguments->mode != CHARACTERIZATION && arguments->mode != PROFILE && arguments->mode != ESTIMATE)
+          argp_failure(state, 1, 0, "--campaign requires --mode characterization, profile or estimate. See --help for more information.");
+        if (arguments->benchmark != NULL)
+          argp_failure(state, 1, 0, "--campaign cannot be used with --benchmark. See --help for more information.");
+      }
       // check benchmark arguments
       if (arguments->benchmark_args == NULL) {
         // handle if benchmark has no arguments: for argv[0] and NULL
@@ -751,3 +766,739 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state){
   }
   return 0;
 }
+
+// select the events to profile from the configured source, at the current frequencies;
+// return 0 on success, 1 if the selection is invalid (the reason is printed)
+static int setup_events(struct arguments *arguments, int *num_pass_cpu, int *num_pass_gpu, FILE *log_file){
+  // mode: estimate
+  if (arguments->mode == ESTIMATE) {
+    if (setup_model_events(arguments, num_pass_cpu, num_pass_gpu, log_file))
+      return 1;
+  }
+  // event_source: all_events
+  else if (arguments->event_source == ALL_EVENTS) {
+    if (profiler_config.cpu)
+      *num_pass_cpu = cpu_events_all(log_file);
+    if (profiler_config.gpu)
+      *num_pass_gpu = gpu_events_all(log_file);
+  }
+  // event_source: config
+  else if (arguments->event_source == CONFIG) {
+    if (profiler_config.cpu)
+      *num_pass_cpu = cpu_events_from_config(arguments->config_cpu, log_file);
+    if (profiler_config.gpu)
+      *num_pass_gpu = gpu_events_from_config(arguments->config_gpu, log_file);
+  }
+  // event_source: cli
+  else if (arguments->event_source == CLI) {
+    if (profiler_config.cpu)
+      *num_pass_cpu = cpu_events_from_cli(arguments->cli_cpu, arguments->num_cli_cpu, log_file);
+    if (profiler_config.gpu)
+      *num_pass_gpu = gpu_events_from_cli(arguments->cli_gpu, arguments->num_cli_gpu, log_file);
+  }
+
+  // no event set: invalid events, or not found at the current frequency
+  if ((profiler_config.cpu && *num_pass_cpu == 0) || (profiler_config.gpu && *num_pass_gpu == 0))
+    return 1;
+
+  if (profiler_config.cpu) {
+    print_cpu_events(log_file);
+    printf_file(log_file, "Number of CPU event sets (required passes): %u\n", *num_pass_cpu);
+  }
+  // multiplexing: the CPU event sets rotate on the PMU within a single pass
+  if (profiler_config.cpu && profiler_config.mux_samples > 0 && *num_pass_cpu > 1) {
+    for (int c = 0; c < cpu_events.num_cores; c++) {
+      if (cpu_events.core[c].num_sets != cpu_events.core[0].num_sets) {
+        printf("%s:%d: multiplexing requires the same number of CPU event sets on every core.\n", __FILE__, __LINE__);
+        return 1;
+      }
+      for (int s = 0; s < cpu_events.core[c].num_sets; s++) {
+        if (cpu_events.core[c].counter_set[s].num_counters != cpu_events.core[0].counter_set[0].num_counters) {
+          printf("%s:%d: multiplexing requires CPU event sets of the same size.\n", __FILE__, __LINE__);
+          return 1;
+        }
+      }
+    }
+    printf_file(log_file, "CPU event sets multiplexed in 1 pass, %u samples each (%.1f ms)\n",
+      profiler_config.mux_samples, profiler_config.mux_samples * profiler_config.sample_period_us * 1e-3);
+    *num_pass_cpu = 1;
+  }
+  if (profiler_config.gpu) {
+    print_gpu_events(log_file);
+    printf_file(log_file, "Number of GPU event sets (required passes): %u\n", *num_pass_gpu);
+  }
+  if (profiler_config.cpu && profiler_config.gpu)
+    printf_file(log_file, "Number of passes (CPU and GPU event sets profiled together): %u\n", plan_passes(*num_pass_cpu, *num_pass_gpu));
+
+  // abort invalid modes pt. 2
+  // check: this is the only difference between 'profile' and 'num_passes' modes
+  // 'characterization' mode with 1 pass is equivalent to 'profile' mode
+  if ((*num_pass_cpu > 1 || *num_pass_gpu > 1) && arguments->mode == PROFILE) {
+    printf("%s:%d: 'profile' mode cannot have multiple passes.\n", __FILE__, __LINE__);
+    return 1;
+  }
+  if ((*num_pass_cpu > 1 || *num_pass_gpu > 1) && arguments->mode == ESTIMATE) {
+    printf("%s:%d: the events of the power model cannot be profiled in a single pass.\n", __FILE__, __LINE__);
+    return 1;
+  }
+  return 0;
+}
+
+// select the events of the power model of the current frequencies: only those,
+// so that sampling is as cheap as possible (the CPU counters not needed count cycles);
+// return 0 on success, 1 if the model cannot be profiled
+static int setup_model_events(struct arguments *arguments, int *num_pass_cpu, int *num_pass_gpu, FILE *log_file){
+  uint32_t cpu_freq = profiler_config.cpu ? cpu_events.frequency : 0;
+  uint32_t gpu_freq = profiler_config.gpu ? gpu_events.frequency : 0;
+  power_model_t *model = estimator_select(arguments->estimator, cpu_freq, gpu_freq);
+  if (model == NULL) {
+    printf("%s:%d: no power model for CPU frequency %u, GPU frequency %u in '%s'.\n", __FILE__, __LINE__, cpu_freq, gpu_freq, arguments->model_file);
+    return 1;
+  }
+  printf_file(log_file, "Power model: CPU %u, GPU %u, %u feature(s)\n", model->cpu_freq, model->gpu_freq, model->num_features);
+  cpu_event_id_t events_cpu[NUM_COUNTERS_CPU];
+  unsigned int num_events_cpu = 0;
+  gpu_event_id_t *events_gpu = (gpu_event_id_t *)malloc(sizeof(gpu_event_id_t) * (model->num_features + 1));
+  unsigned int num_events_gpu = 0;
+  if (events_gpu == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  for (unsigned int f = 0; f < model->num_features; f++) {
+    if (model->features[f].kind == MODEL_FEATURE_CPU_EVENT) {
+      if (!profiler_config.cpu || num_events_cpu == NUM_COUNTERS_CPU) {
+        printf("%s:%d: the CPU events of the power model do not fit the %d counters of the enabled devices.\n", __FILE__, __LINE__, profiler_config.cpu ? NUM_COUNTERS_CPU : 0);
+        free(events_gpu);
+        return 1;
+      }
+      events_cpu[num_events_cpu++] = model->features[f].event_id;
+    } else if (model->features[f].kind == MODEL_FEATURE_GPU_EVENT) {
+      if (!profiler_config.gpu) {
+        printf("%s:%d: the power model needs GPU events, but the GPU is not profiled.\n", __FILE__, __LINE__);
+        free(events_gpu);
+        return 1;
+      }
+      events_gpu[num_events_gpu++] = model->features[f].event_id;
+    }
+  }
+  if (profiler_config.cpu) {
+    // same events on every core
+    unsigned int num_cores = get_cpu_num_cores();
+    cpu_event_id_t cli_cpu[num_cores * NUM_COUNTERS_CPU];
+    for (int c = 0; c < num_cores; c++)
+      for (int e = 0; e < NUM_COUNTERS_CPU; e++)
+        cli_cpu[c * NUM_COUNTERS_CPU + e] = e < num_events_cpu ? events_cpu[e] : CPU_EVENT_CYCLES;
+    *num_pass_cpu = cpu_events_from_cli(cli_cpu, num_cores * NUM_COUNTERS_CPU, log_file);
+  }
+  if (profiler_config.gpu) {
+    if (num_events_gpu == 0) {
+      printf("%s:%d: the power model has no GPU event, but the GPU is profiled.\n", __FILE__, __LINE__);
+      free(events_gpu);
+      return 1;
+    }
+    *num_pass_gpu = gpu_events_from_cli(events_gpu, num_events_gpu, log_file);
+  }
+  free(events_gpu);
+  return 0;
+}
+
+// passes of a benchmark: CPU PMUs and GPU counter groups are programmed
+// independently, so CPU pass p runs together with GPU pass p, rather than every
+// CPU pass with every GPU pass
+static int plan_passes(int num_pass_cpu, int num_pass_gpu){
+  return num_pass_cpu > num_pass_gpu ? num_pass_cpu : num_pass_gpu;
+}
+
+// event set of a device in a pass: the device with fewer sets profiles them
+// again from the first one, as the passes of the other device go on
+static int pass_set(int pass, int num_pass){
+  return pass % num_pass;
+}
+
+// profile all passes of an opened benchmark, one trace per pass; return the range of trace indices,
+// and 0, or 1 if a trace of a daemon job cannot be opened (an error of the job: the daemon goes on)
+static int profile_benchmark(struct arguments *arguments, benchmark_t *benchmark, int num_pass_cpu, int num_pass_gpu,
+                             uint32_t cpu_freq, uint32_t gpu_freq, FILE *log_file, char *trace_path_job,
+                             unsigned int *trace_first_i, unsigned int *trace_last_i){
+  unsigned int trace_i = 0;
+  int trace_first_i_set = 0;
+  if (arguments->online_model != NULL)
+    online_model_select(arguments->online_model, cpu_freq, gpu_freq);
+
+  // set up benchmark args
+  printf_file(log_file, "\n");
+  printf_file(log_file, "Running benchmark '%s' with %d argument(s).\n", benchmark->name, benchmark->num_args);
+  printf_file(log_file, "Benchmark arguments:\n");
+  for (int i = 0; i < benchmark->num_args + 2; i++)
+    printf_file(log_file, "  argv[%d] = %s \n", i, benchmark->args[i]);
+
+  // copy in a buffer to prevent misuse by benchmarks
+  char **argv_bench = (char**) malloc((benchmark->num_args + 2) * sizeof(char*)); // +2 for argv[0] and NULL
+  if (argv_bench == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  for (int i = 0; i < benchmark->num_args + 1; i++) {
+    argv_bench[i] = (char*) malloc((strlen(benchmark->args[i]) + 1) * sizeof(char));
+    if (argv_bench[i] == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+
+  //////////////////////////////////
+  // set up profiler and benchmark
+  //////////////////////////////////
+
+  int num_passes = plan_passes(num_pass_cpu, num_pass_gpu);
+  for (int p = 0; p < num_passes; p++) {
+    int cpu_p = pass_set(p, num_pass_cpu);
+    int gpu_p = pass_set(p, num_pass_gpu);
+    printf_file(log_file, "\n");
+    printf_file(log_file, "────────────────────────────────────────────────────────────────────────────────\n\n");
+    if (profiler_config.cpu && profiler_config.mux_samples > 0 && cpu_events.core[0].num_sets > 1)
+      print_cpu_events(log_file);
+    else if (profiler_config.cpu)
+      print_cpu_events_set(log_file, cpu_p);
+    if (profiler_config.gpu)
+      print_gpu_events_set(log_file, gpu_p);
+    // setup traces
+    FILE *trace_file;
+    char *trace_path = NULL;
+
+    // generate trace name
+    char trace_name[150] = {'\0'};
+    if (trace_path_job != NULL) {
+      // trace path given by a daemon job: passes after the first are numbered
+      trace_path = malloc(strlen(trace_path_job) + 20);
+      if (trace_path == NULL){
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      char *ext = strrchr(trace_path_job, '.');
+      int stem = (ext != NULL && strchr(ext, '/') == NULL) ? ext - trace_path_job : strlen(trace_path_job);
+      if (p == 0)
+        strcpy(trace_path, trace_path_job);
+      else
+        sprintf(trace_path, "%.*s_%d%s", stem, trace_path_job, p, trace_path_job + stem);
+      trace_i = p + 1;
+    } else {
+      do {
+        // this loop creates numbered traces if benchmarks with same name are profiled:
+        // useful when same benchmark is profiled multiple times with different arguments,
+        // or when multiple passes are performed with same configuration but different counters
+        sprintf(trace_name, "%s", benchmark->name);
+        if (profiler_config.cpu)
+          sprintf(trace_name + strlen(trace_name), "_cpu_%u", cpu_freq);
+        if (profiler_config.gpu)
+          sprintf(trace_name + strlen(trace_name), "_gpu_%u", gpu_freq);
+        sprintf(trace_name + strlen(trace_name), "_%u", trace_i);
+        sprintf(trace_name + strlen(trace_name), ".bin");
+        // allocate memory for trace path
+        trace_path = realloc(trace_path, strlen(arguments->trace_dir) + strlen(trace_name) + 10);
+        if (trace_path == NULL){
+          printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+          exit(1);
+        }
+        // join trace_dir and trace_name
+        cat_path(arguments->trace_dir, trace_name, trace_path);
+        trace_i++;
+      } while(access(trace_path, F_OK) != -1);
+    }
+    if (!trace_first_i_set) {
+      *trace_first_i = trace_i - 1;
+      trace_first_i_set = 1;
+    }
+    printf_file(log_file, "\nTrace path: %s\n", trace_path);
+    // open trace file
+    trace_file = fopen(trace_path, "wb");
+    if (trace_file == NULL){
+      printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, trace_path);
+      if (trace_path_job == NULL)
+        exit(1);
+      free(trace_path);
+      for (int i = 0; i < benchmark->num_args + 1; i++)
+        free(argv_bench[i]);
+      free(argv_bench);
+      *trace_last_i = trace_i - 1;
+      return 1;
+    }
+    // power estimates of the trace: <trace>.power.csv, unless an output is given
+    FILE *estimate_file = NULL;
+    if (arguments->estimator != NULL) {
+      estimate_file = arguments->estimate_file;
+      if (estimate_file == NULL) {
+        char *estimate_path = malloc(strlen(trace_path) + 20);
+        if (estimate_path == NULL){
+          printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+          exit(1);
+        }
+        char *ext = strrchr(trace_path, '.');
+        int stem = (ext != NULL && strchr(ext, '/') == NULL) ? ext - trace_path : strlen(trace_path);
+        sprintf(estimate_path, "%.*s.power.csv", stem, trace_path);
+        printf_file(log_file, "Power estimates path: %s\n", estimate_path);
+        estimate_file = fopen(estimate_path, "w");
+        if (estimate_file == NULL){
+          printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, estimate_path);
+          exit(1);
+        }
+        free(estimate_path);
+      }
+      arguments->estimator->output = estimate_file;
+    }
+
+    // setup profiler
+    profiler_args_t *profiler_args = NULL;
+    size_t num_profiler_threads = 0;
+    cpu_set_t cpu_set;
+    pthread_t *profiler_threads;
+    pthread_t consumer_thread;
+    pthread_attr_t pthread_attr;
+    pthread_barrier_t profiler_barrier;
+    spsc_ring_t *profiler_rings;
+    profiler_args_t consumer_args;
+    uint64_t profiler_epoch_ns = 0;
+    atomic_uint profiler_num_done;
+    profiler_runs_t profiler_runs;
+    int ret = 0;
+    volatile int benchmark_complete = 0;
+
+    // allocate profiler_args
+    if (profiler_config.cpu)
+      num_profiler_threads = cpu_events.num_cores;
+    else
+      num_profiler_threads = 1;
+    profiler_args = malloc(sizeof(profiler_args_t) * num_profiler_threads);
+    if (profiler_args == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    profiler_threads = malloc(sizeof(pthread_t) * num_profiler_threads);
+    if (profiler_threads == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    // rings are initialized by each profiler thread
+    profiler_rings = malloc(sizeof(spsc_ring_t) * num_profiler_threads);
+    if (profiler_rings == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    atomic_init(&profiler_num_done, 0);
+    profiler_runs_init(&profiler_runs, profiler_config.num_run);
+    // spread the device sensors (GPU, power rails) over the profiler threads
+    assign_device_sensors(num_profiler_threads);
+    print_device_sensors(log_file);
+    // init profiler thread(s) barrier (+1 for the trace consumer)
+    pthread_barrier_init(&profiler_barrier, NULL, num_profiler_threads + 1);
+    // launch profiler thread(s)
+    printf("\n");
+    for (int t = 0; t < num_profiler_threads; t++) {
+      printf("Initializing profiler thread for core %d...\n", t);
+      // setup profiler arguments
+      profiler_args[t].thread_id = t;
+      profiler_args[t].trace_file = trace_file;
+      profiler_args[t].signal = &benchmark_complete;
+      profiler_args[t].barrier = &profiler_barrier;
+      profiler_args[t].set_id_cpu = cpu_p;
+      profiler_args[t].set_id_gpu = gpu_p;
+      profiler_args[t].num_threads = num_profiler_threads;
+      profiler_args[t].rings = profiler_rings;
+      profiler_args[t].epoch_ns = &profiler_epoch_ns;
+      profiler_args[t].num_done = &profiler_num_done;
+      profiler_args[t].runs = &profiler_runs;
+      profiler_args[t].online_model = arguments->online_model;
+      profiler_args[t].estimator = arguments->estimator;
+      profiler_args[t].log_file = log_file;
+      profiler_args[t].overruns = 0;
+      // set up pthread
+      pthread_attr_init(&pthread_attr);
+      CPU_ZERO(&cpu_set);
+      CPU_SET(t, &cpu_set);
+      pthread_attr_setaffinity_np(&pthread_attr, sizeof(cpu_set_t), &cpu_set);
+      if (profiler_config.realtime)
+        set_realtime_attr(&pthread_attr);
+      // create thread c limiting its affinity to only CPU c
+      ret = pthread_create(&profiler_threads[t], &pthread_attr, events_profiler, &profiler_args[t]);
+      if (ret != 0) {
+        perror("pthread_create");
+        printf("%s:%d: failed to create profiler thread.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+    }
+    // launch trace consumer (merges the rings of the profiler threads into the trace)
+    consumer_args = profiler_args[0];
+    consumer_args.thread_id = num_profiler_threads;
+    ret = pthread_create(&consumer_thread, NULL, trace_consumer, &consumer_args);
+    if (ret != 0) {
+      perror("pthread_create");
+      printf("%s:%d: failed to create trace consumer thread.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+
+    // run benchmark
+    printf_file(log_file, "\n");
+    printf_file(log_file, "--------------------------------------------------------------------------------\n");
+    for (int r = 0; r < profiler_config.num_run; r++) {
+      printf_file(log_file, " [Pass %d/%d: ", p + 1, num_passes);
+      if (profiler_config.cpu)
+        printf_file(log_file, "CPU set %d/%d", cpu_p + 1, num_pass_cpu);
+      if (profiler_config.cpu && profiler_config.gpu)
+        printf_file(log_file, " | ");
+      if (profiler_config.gpu)
+        printf_file(log_file, "GPU set %d/%d", gpu_p + 1, num_pass_gpu);
+      printf_file(log_file, "]");
+      printf_file(log_file, " Benchmark pass %d/%d\n", r + 1, profiler_config.num_run);
+      printf("--------------------------------------------------------------------------------\n");
+      // refresh benchmark arguments in case benchmarks mess with them
+      for (int i = 0; i < benchmark->num_args + 1; i++){
+        strcpy(argv_bench[i], benchmark->args[i]);
+        printf("%s ", argv_bench[i]);
+      }
+      argv_bench[benchmark->num_args + 1] = NULL; // NULL terminates argv array
+      printf("\n");
+      printf("\n");
+      // reset getopt
+      optind = 1;
+      // benchmarks needs to return with 'return' and not 'exit'
+      profiler_run_start(&profiler_runs, r);
+      benchmark->main(benchmark->num_args + 1, argv_bench);
+      profiler_run_end(&profiler_runs, r);
+      printf("\n");
+      printf_file(log_file, "--------------------------------------------------------------------------------\n");
+    }
+    printf("\n");
+    // signal profiler threads to stop
+    benchmark_complete = 1;
+
+    printf("Benchmark '%s' finished.\n\n", benchmark->name);
+    // join profiler threads
+    for (int t = 0; t < num_profiler_threads; t++) {
+      ret = pthread_join(profiler_threads[t], NULL);
+      if (ret != 0) {
+        perror("pthread_join");
+        printf("%s:%d: failed to join profiler thread.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      printf("Profiler thread %d has ended.\n", t);
+    }
+    // join trace consumer (it drains the rings once all profiler threads ended)
+    ret = pthread_join(consumer_thread, NULL);
+    if (ret != 0) {
+      perror("pthread_join");
+      printf("%s:%d: failed to join trace consumer thread.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    printf("Trace consumer has ended.\n");
+    if (arguments->estimator != NULL) {
+      estimator_report(arguments->estimator, log_file);
+      if (estimate_file != arguments->estimate_file)
+        fclose(estimate_file);
+    }
+    // free profiler_args
+    for (int t = 0; t < num_profiler_threads; t++)
+      ring_free(&profiler_rings[t]);
+    free(profiler_rings);
+    profiler_runs_free(&profiler_runs);
+    free(profiler_args);
+    free(profiler_threads);
+    // clean traces variables
+    fclose(trace_file);
+    free(trace_path);
+    // destroy profiler thread(s) barrier
+    pthread_barrier_destroy(&profiler_barrier);
+
+    // wait for the benchmark on GPU to finish (1 task running on GPU at a time)
+    if (profiler_config.gpu)
+      sync_gpu_slave();
+  }
+  for (int i = 0; i < benchmark->num_args + 1; i++)
+    free(argv_bench[i]);
+  free(argv_bench);
+  *trace_last_i = trace_i - 1;
+  return 0;
+}
+
+// rename a log to indicate to which traces it refers to; return the new path
+static char *rename_log(char *trace_dir, char *log_path, char *benchmark_name, uint32_t cpu_freq, uint32_t gpu_freq,
+                        unsigned int trace_first_i, unsigned int trace_last_i){
+  char log_rename[100] = {'\0'};
+  sprintf(log_rename, "%s", benchmark_name);
+  if (profiler_config.cpu)
+    sprintf(log_rename + strlen(log_rename), "_cpu_%u", cpu_freq);
+  if (profiler_config.gpu)
+    sprintf(log_rename + strlen(log_rename), "_gpu_%u", gpu_freq);
+  if (trace_last_i == trace_first_i)
+    sprintf(log_rename + strlen(log_rename), "_%u.log", trace_first_i); // if only 1 trace
+  else
+    sprintf(log_rename + strlen(log_rename), "_%u-%u.log", trace_first_i, trace_last_i); // if more than 1 trace
+  char *log_path_rename = malloc(strlen(trace_dir) + strlen(log_rename) + 10);
+  if (log_path_rename == NULL){
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  cat_path(trace_dir, log_rename, log_path_rename);
+  int ret = rename(log_path, log_path_rename);
+  if (ret) {
+    printf("%s:%d: failed to rename log file %s.\n", __FILE__, __LINE__, log_path);
+    exit(1);
+  }
+  return log_path_rename;
+}
+
+// rename a log not referring to a single benchmark to <prefix>_<N>.log; return the new path
+static char *rename_log_numbered(char *trace_dir, char *log_path, char *prefix){
+  char *log_path_rename = NULL;
+  char log_rename[100];
+  unsigned int log_i = 0;
+  do {
+    sprintf(log_rename, "%s_%u.log", prefix, log_i++);
+    log_path_rename = realloc(log_path_rename, strlen(trace_dir) + strlen(log_rename) + 10);
+    if (log_path_rename == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    cat_path(trace_dir, log_rename, log_path_rename);
+  } while (access(log_path_rename, F_OK) != -1);
+  int ret = rename(log_path, log_path_rename);
+  if (ret) {
+    printf("%s:%d: failed to rename log file %s.\n", __FILE__, __LINE__, log_path);
+    exit(1);
+  }
+  return log_path_rename;
+}
+
+// serve profiling jobs from a Unix socket, one at a time: devices stay set up, events are
+// reselected only when a job needs different ones, benchmarks stay loaded after their first job
+static void run_daemon(struct arguments *arguments, FILE *log_file){
+  daemon_t daemon;
+  // benchmarks loaded so far
+  campaign_t loaded = {0, NULL, 0, NULL, 0, NULL};
+  // events currently selected, as "<source> <config/cli cpu> <config/cli gpu> <cpu freq> <gpu freq>"
+  char *events_key = NULL;
+  int num_pass_cpu = 1;
+  int num_pass_gpu = 1;
+
+  daemon_start(&daemon, arguments->socket);
+  printf_file(log_file, "Waiting for jobs on socket '%s'\n", arguments->socket);
+  daemon_job_t *job;
+  while ((job = daemon_next_job(&daemon)) != NULL) {
+    printf_file(log_file, "\nJob %u: %s -> %s\n", job->id, job->benchmark, job->trace);
+    struct arguments job_args = *arguments;
+    const char *error = job_arguments(job, &job_args);
+    if (error != NULL) {
+      printf_file(log_file, "Job %u rejected: %s\n", job->id, error);
+      daemon_reply(job, "error %s\n", error);
+      daemon_free_job(job);
+      continue;
+    }
+
+    // frequencies may have been changed by someone else since the last job
+    uint32_t cpu_freq = profiler_config.cpu ? backend->clip_cpu_freq(backend->get_cpu_freq()) : 0;
+    uint32_t gpu_freq = profiler_config.gpu ? backend->clip_gpu_freq(backend->get_gpu_freq()) : 0;
+    char *source = job_args.event_source == ALL_EVENTS ? "all_events" : job_args.event_source == CONFIG ? "config" : "cli";
+    char *events_cpu = NULL;
+    char *events_gpu = NULL;
+    if (job_args.event_source == CONFIG) {
+      events_cpu = job_args.config_cpu;
+      events_gpu = job_args.config_gpu;
+    } else if (job_args.event_source == CLI) {
+      events_cpu = job->cli_cpu != NULL ? job->cli_cpu : "default";
+      events_gpu = job->cli_gpu != NULL ? job->cli_gpu : "default";
+    }
+    size_t key_len = strlen(source) + (events_cpu ? strlen(events_cpu) : 0) + (events_gpu ? strlen(events_gpu) : 0) + 40;
+    char *key = malloc(key_len);
+    if (key == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    snprintf(key, key_len, "%s %s %s %u %u", source, events_cpu ? events_cpu : "-", events_gpu ? events_gpu : "-", cpu_freq, gpu_freq);
+    if (events_key == NULL || strcmp(key, events_key)) {
+      if (profiler_config.cpu)
+        reset_cpu_events(cpu_freq);
+      if (profiler_config.gpu)
+        reset_gpu_events(gpu_freq);
+      free(events_key);
+      events_key = NULL;
+      // invalid events are an error of the job: the next job selects its own
+      if (setup_events(&job_args, &num_pass_cpu, &num_pass_gpu, log_file)) {
+        printf_file(log_file, "Job %u rejected: invalid events\n", job->id);
+        daemon_reply(job, "error invalid events\n");
+        free(key);
+        if (job->cli_cpu != NULL)
+          free(job_args.cli_cpu);
+        if (job->cli_gpu != NULL)
+          free(job_args.cli_gpu);
+        daemon_free_job(job);
+        continue;
+      }
+      events_key = key;
+    } else {
+      printf_file(log_file, "Events already selected\n");
+      free(key);
+    }
+    if (job->cli_cpu != NULL)
+      free(job_args.cli_cpu);
+    if (job->cli_gpu != NULL)
+      free(job_args.cli_gpu);
+
+    // open the benchmark at its first job
+    int b = 0;
+    while (b < loaded.num_benchmarks && strcmp(loaded.benchmarks[b].path, job->benchmark))
+      b++;
+    if (b == loaded.num_benchmarks) {
+      loaded.benchmarks = realloc(loaded.benchmarks, (loaded.num_benchmarks + 1) * sizeof(benchmark_t));
+      if (loaded.benchmarks == NULL){
+        printf("%s:%d: realloc failed.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      benchmark_t *benchmark = &loaded.benchmarks[loaded.num_benchmarks++];
+      benchmark->path = strdup(job->benchmark);
+      char *path = strdup(job->benchmark);
+      benchmark->name = strdup(path_basename(path));
+      free(path);
+      benchmark->num_args = 0;
+      benchmark->args = malloc(2 * sizeof(char *));
+      if (benchmark->args == NULL){
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      benchmark->handle = NULL;
+      benchmark->main = NULL;
+      // not a benchmark library: an error of the job, it is not kept loaded
+      if (open_benchmark(benchmark)) {
+        printf_file(log_file, "Job %u rejected: cannot open benchmark\n", job->id);
+        daemon_reply(job, "error cannot open benchmark\n");
+        loaded.num_benchmarks--;
+        free(benchmark->args);
+        free(benchmark->name);
+        free(benchmark->path);
+        daemon_free_job(job);
+        continue;
+      }
+    }
+    // same library, arguments of the job
+    benchmark_t run = loaded.benchmarks[b];
+    run.num_args = job->num_args;
+    run.args = job->args;
+    run.args[0] = run.path;
+
+    // job log next to its trace
+    char *job_log_path = malloc(strlen(job->trace) + 10);
+    if (job_log_path == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    sprintf(job_log_path, "%s.log", job->trace);
+    FILE *job_log = fopen(job_log_path, "w");
+    // e.g., the directory of the trace was removed after the job was checked
+    if (job_log == NULL) {
+      printf_file(log_file, "Job %u rejected: cannot open log file '%s'\n", job->id, job_log_path);
+      daemon_reply(job, "error cannot open trace\n");
+      free(job_log_path);
+      daemon_free_job(job);
+      continue;
+    }
+    printf_file(job_log, "Daemon job %u, events: %s\n", job->id, events_key);
+    unsigned int trace_first_i, trace_last_i;
+    int failed = profile_benchmark(&job_args, &run, num_pass_cpu, num_pass_gpu, cpu_freq, gpu_freq, job_log, job->trace, &trace_first_i, &trace_last_i);
+    fclose(job_log);
+    free(job_log_path);
+    if (failed) {
+      printf_file(log_file, "Job %u failed: cannot open trace\n", job->id);
+      daemon_reply(job, "error cannot open trace\n");
+      daemon_free_job(job);
+      continue;
+    }
+    printf_file(log_file, "Job %u done (%u trace(s))\n", job->id, trace_last_i + 1);
+    daemon_reply(job, "done %u %u\n", job->id, trace_last_i + 1);
+    daemon_free_job(job);
+  }
+  daemon_stop(&daemon);
+  printf_file(log_file, "Daemon shut down after %u job(s)\n", daemon.num_jobs);
+  free(events_key);
+  free_campaign(&loaded);
+}
+
+// apply the event source of a job over the daemon defaults; return an error message if invalid
+static const char *job_arguments(daemon_job_t *job, struct arguments *arguments){
+  char *token;
+  if (job->events != NULL) {
+    if (!strcmp(job->events, "all_events"))
+      arguments->event_source = ALL_EVENTS;
+    else if (!strcmp(job->events, "config"))
+      arguments->event_source = CONFIG;
+    else if (!strcmp(job->events, "cli"))
+      arguments->event_source = CLI;
+    else
+      return "invalid events";
+  }
+  if (arguments->event_source == NO_EVENTS)
+    return "missing events";
+  if (job->config_cpu != NULL)
+    arguments->config_cpu = job->config_cpu;
+  if (job->config_gpu != NULL)
+    arguments->config_gpu = job->config_gpu;
+  if (arguments->event_source == CONFIG) {
+    if (profiler_config.cpu && (arguments->config_cpu == NULL || access(arguments->config_cpu, R_OK)))
+      return "cannot read config_cpu";
+    if (profiler_config.gpu && (arguments->config_gpu == NULL || access(arguments->config_gpu, R_OK)))
+      return "cannot read config_gpu";
+  }
+  if (arguments->event_source == CLI) {
+    if (profiler_config.cpu && job->cli_cpu == NULL && arguments->cli_cpu == NULL)
+      return "missing cli_cpu";
+    if (profiler_config.gpu && job->cli_gpu == NULL && arguments->cli_gpu == NULL)
+      return "missing cli_gpu";
+  }
+  if (access(job->benchmark, R_OK))
+    return "cannot read benchmark";
+  // the traces and the log of the job are written in the directory of its trace
+  char *trace_dir = malloc(strlen(job->trace) + 2);
+  if (trace_dir == NULL){
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  strcpy(trace_dir, job->trace);
+  char *slash = strrchr(trace_dir, '/');
+  if (slash == NULL)
+    strcpy(trace_dir, ".");
+  else if (slash == trace_dir)
+    trace_dir[1] = '\0';
+  else
+    *slash = '\0';
+  int trace_writable = !access(trace_dir, W_OK | X_OK);
+  free(trace_dir);
+  if (!trace_writable)
+    return "cannot open trace";
+  // event lists are parsed from copies: the job strings identify the selected events
+  if (job->cli_cpu != NULL) {
+    char *list = strdup(job->cli_cpu);
+    arguments->cli_cpu = (cpu_event_id_t*)malloc(sizeof(cpu_event_id_t) * (strlen(list) / 2 + 1));
+    if (arguments->cli_cpu == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    arguments->num_cli_cpu = 0;
+    for (token = strtok(list, ","); token != NULL; token = strtok(NULL, ","))
+      arguments->cli_cpu[arguments->num_cli_cpu++] = atoi(token);
+    free(list);
+    if (profiler_config.cpu && arguments->num_cli_cpu != get_cpu_num_cores() * NUM_COUNTERS_CPU) {
+      free(arguments->cli_cpu);
+      return "unexpected number of cli_cpu events";
+    }
+  }
+  if (job->cli_gpu != NULL) {
+    char *list = strdup(job->cli_gpu);
+    arguments->cli_gpu = (gpu_event_id_t*)malloc(sizeof(gpu_event_id_t) * (strlen(list) / 2 + 1));
+    if (arguments->cli_gpu == NULL){
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    arguments->num_cli_gpu = 0;
+    for (token = strtok(list, ","); token != NULL; token = strtok(NULL, ","))
+      arguments->cli_gpu[arguments->num_cli_gpu++] = atoi(token);
+    free(list);
+  }
+  return NULL;
+}
@@ -0,0 +1,625 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+// third-party libraries
+#include <jsmn.h>
+// voltmeter libraries
+#include <helper.h>
+#include <model.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static int json_key_is(const char *str_json, jsmntok_t *tok, const char *key);
+static int parse_model(const char *str_json, jsmntok_t *t, int i, power_model_t *model);
+static void gram_flush(gram_t *gram);
+static int solve_subset(const gram_t *gram, double ridge, const int *passive, double *w);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                   Coefficient file                    │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// {"target": "power" | "power<rail>", "models": [{"cpu_freq": ..., "gpu_freq": ...,
+//  "intercept": ..., "features": [...], "coefficients": [...], ...}, ...]}
+void parse_model_json(char *model_file, model_set_t *set){
+  jsmn_parser p;
+  jsmntok_t *t;
+  int ret;
+
+  FILE *fp = fopen(model_file, "rb");
+  if (fp == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, model_file);
+    exit(1);
+  }
+  fseek(fp, 0L, SEEK_END);
+  size_t sz = ftell(fp);
+  rewind(fp);
+  char *str_json = (char *)malloc_or_exit(sz + 1);
+  fread(str_json, sz, 1, fp);
+  str_json[sz] = '\0';
+  fclose(fp);
+
+  jsmn_init(&p);
+  ret = jsmn_parse(&p, str_json, sz, NULL, 0);
+  if (ret < 0) {
+    printf("%s:%d: failed to parse JSON '%s' (error %d).\n", __FILE__, __LINE__, model_file, ret);
+    exit(1);
+  }
+  t = (jsmntok_t *)malloc_or_exit(ret * sizeof(jsmntok_t));
+  jsmn_init(&p);
+  ret = jsmn_parse(&p, str_json, sz, t, ret);
+  if (ret < 0) {
+    printf("%s:%d: failed to parse JSON '%s' (error %d).\n", __FILE__, __LINE__, model_file, ret);
+    exit(1);
+  }
+
+  set->target = MODEL_TARGET_TOTAL;
+  set->num_models = 0;
+  set->models = NULL;
+  int i = 0;
+  if (t[i].type != JSMN_OBJECT) {
+    printf("%s:%d: unexpected token type %d (expected JSMN_OBJECT).\n", __FILE__, __LINE__, t[i].type);
+    exit(1);
+  }
+  int num_keys = t[i].size;
+  for (int k = 0; k < num_keys; k++) {
+    if (t[++i].type != JSMN_STRING) {
+      printf("%s:%d: unexpected token type %d (expected JSMN_STRING).\n", __FILE__, __LINE__, t[i].type);
+      exit(1);
+    }
+    if (json_key_is(str_json, &t[i], "target")) {
+      i++;
+      if (!json_key_is(str_json, &t[i], "power") && jsmn_parse_token(str_json, &t[i], "power%d", &set->target) != 1) {
+        printf("%s:%d: unexpected target '%.*s' in '%s'.\n", __FILE__, __LINE__, t[i].end - t[i].start, str_json + t[i].start, model_file);
+        exit(1);
+      }
+    } else if (json_key_is(str_json, &t[i], "models")) {
+      if (t[++i].type != JSMN_ARRAY) {
+        printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
+        exit(1);
+      }
+      set->num_models = t[i].size;
+      set->models = (power_model_t *)malloc_or_exit((set->num_models > 0 ? set->num_models : 1) * sizeof(power_model_t));
+      for (unsigned int m = 0; m < set->num_models; m++)
+        i = parse_model(str_json, t, i + 1, &set->models[m]);
+    } else {
+      printf("%s:%d: unexpected key '%.*s' in '%s'.\n", __FILE__, __LINE__, t[i].end - t[i].start, str_json + t[i].start, model_file);
+      exit(1);
+    }
+  }
+  if (set->num_models == 0) {
+    printf("%s:%d: no models in '%s'.\n", __FILE__, __LINE__, model_file);
+    exit(1);
+  }
+  free(t);
+  free(str_json);
+}
+
+void write_model_json(FILE *file, model_set_t *set){
+  char name[MODEL_FEATURE_NAME_LEN];
+  if (set->target == MODEL_TARGET_TOTAL)
+    fprintf(file, "{\n  \"target\": \"power\",\n  \"models\": [");
+  else
+    fprintf(file, "{\n  \"target\": \"power%d\",\n  \"models\": [", set->target);
+  for (unsigned int m = 0; m < set->num_models; m++) {
+    power_model_t *model = &set->models[m];
+    fprintf(file, "%s\n    {\n", m > 0 ? "," : "");
+    fprintf(file, "      \"cpu_freq\": %u,\n      \"gpu_freq\": %u,\n", model->cpu_freq, model->gpu_freq);
+    fprintf(file, "      \"samples\": %lu,\n      \"benchmarks\": %u,\n", model->num_samples, model->num_benchmarks);
+    fprintf(file, "      \"rmse_mw\": %.6g,\n      \"cv_error\": %.6g,\n", model->rmse_mw, model->cv_error);
+    if (model->online_error >= 0)
+      fprintf(file, "      \"online_error\": %.6g,\n", model->online_error);
+    fprintf(file, "      \"intercept\": %.17g,\n      \"features\": [", model->intercept);
+    for (unsigned int f = 0; f < model->num_features; f++) {
+      model_feature_name(&model->features[f], name);
+      fprintf(file, "%s\"%s\"", f > 0 ? ", " : "", name);
+    }
+    fprintf(file, "],\n      \"coefficients\": [");
+    for (unsigned int f = 0; f < model->num_features; f++)
+      fprintf(file, "%s%.17g", f > 0 ? ", " : "", model->coefficients[f]);
+    fprintf(file, "]\n    }");
+  }
+  fprintf(file, "\n  ]\n}\n");
+}
+
+void free_model_set(model_set_t *set){
+  for (unsigned int m = 0; m < set->num_models; m++) {
+    free(set->models[m].features);
+    free(set->models[m].coefficients);
+  }
+  free(set->models);
+  set->models = NULL;
+  set->num_models = 0;
+}
+
+// model of the operating point; a model with frequency 0 is valid at any
+// frequency, exact matches are preferred; NULL if none
+power_model_t *find_model(model_set_t *set, uint32_t cpu_freq, uint32_t gpu_freq){
+  power_model_t *best = NULL;
+  int best_matches = -1;
+  for (unsigned int m = 0; m < set->num_models; m++) {
+    power_model_t *model = &set->models[m];
+    if ((model->cpu_freq != 0 && model->cpu_freq != cpu_freq) || (model->gpu_freq != 0 && model->gpu_freq != gpu_freq))
+      continue;
+    int matches = (model->cpu_freq != 0) + (model->gpu_freq != 0);
+    if (matches > best_matches) {
+      best = model;
+      best_matches = matches;
+    }
+  }
+  return best;
+}
+
+// name must hold MODEL_FEATURE_NAME_LEN characters
+int model_feature_name(const model_feature_t *feature, char *name){
+  switch (feature->kind) {
+    case MODEL_FEATURE_CPU_CLK:
+      return snprintf(name, MODEL_FEATURE_NAME_LEN, "cpu.clk");
+    case MODEL_FEATURE_CPU_EVENT:
+      return snprintf(name, MODEL_FEATURE_NAME_LEN, "cpu.0x%02x", feature->event_id);
+    case MODEL_FEATURE_GPU_EVENT:
+      return snprintf(name, MODEL_FEATURE_NAME_LEN, "gpu.%u", feature->event_id);
+  }
+  return -1;
+}
+
+// return 1 if the name is not a feature
+int parse_model_feature(const char *name, model_feature_t *feature){
+  int end = 0;
+  if (!strcmp(name, "cpu.clk")) {
+    feature->kind = MODEL_FEATURE_CPU_CLK;
+    feature->event_id = 0;
+    return 0;
+  }
+  if (sscanf(name, "cpu.%x%n", &feature->event_id, &end) == 1 && name[end] == '\0') {
+    feature->kind = MODEL_FEATURE_CPU_EVENT;
+    return 0;
+  }
+  if (sscanf(name, "gpu.%u%n", &feature->event_id, &end) == 1 && name[end] == '\0') {
+    feature->kind = MODEL_FEATURE_GPU_EVENT;
+    return 0;
+  }
+  return 1;
+}
+
+// feature counted by a column of a trace schema ("cpu<c>.clk", "cpu<c>.0x<id>",
+// "gpu.g<g>.i<i>.<id>"); return 1 if the column is not a counter
+int model_feature_of_column(const char *column, model_feature_t *feature){
+  unsigned int core, group, instance;
+  int end = 0;
+  if (sscanf(column, "cpu%u.clk%n", &core, &end) == 1 && column[end] == '\0') {
+    feature->kind = MODEL_FEATURE_CPU_CLK;
+    feature->event_id = 0;
+    return 0;
+  }
+  end = 0;
+  if (sscanf(column, "cpu%u.0x%x%n", &core, &feature->event_id, &end) == 2 && column[end] == '\0') {
+    feature->kind = MODEL_FEATURE_CPU_EVENT;
+    return 0;
+  }
+  end = 0;
+  if (sscanf(column, "gpu.g%u.i%u.%u%n", &group, &instance, &feature->event_id, &end) == 3 && column[end] == '\0') {
+    feature->kind = MODEL_FEATURE_GPU_EVENT;
+    return 0;
+  }
+  return 1;
+}
+
+// power in mW, features in the order of the model
+double model_estimate(const power_model_t *model, const double *features){
+  double power = model->intercept;
+  for (unsigned int f = 0; f < model->num_features; f++)
+    power += model->coefficients[f] * features[f];
+  return power;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                   Normal equations                    │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+void gram_init(gram_t *gram, unsigned int num_features){
+  unsigned int dim = num_features + 1;
+  gram->dim = dim;
+  gram->xtx = (double *)calloc(dim * dim, sizeof(double));
+  gram->xty = (double *)calloc(dim, sizeof(double));
+  gram->block = (double *)malloc(sizeof(double) * GRAM_BLOCK_ROWS * dim);
+  gram->block_y = (double *)malloc(sizeof(double) * GRAM_BLOCK_ROWS);
+  if (gram->xtx == NULL || gram->xty == NULL || gram->block == NULL || gram->block_y == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  gram->yty = 0;
+  gram->num_samples = 0;
+  gram->block_rows = 0;
+}
+
+void gram_free(gram_t *gram){
+  free(gram->xtx);
+  free(gram->xty);
+  free(gram->block);
+  free(gram->block_y);
+}
+
+// add a sample: features (without the intercept) and target
+void gram_add(gram_t *gram, const double *features, double y){
+  double *row = gram->block + gram->block_rows * gram->dim;
+  row[0] = 1;
+  memcpy(row + 1, features, sizeof(double) * (gram->dim - 1));
+  gram->block_y[gram->block_rows] = y;
+  if (++gram->block_rows == GRAM_BLOCK_ROWS)
+    gram_flush(gram);
+}
+
+// accumulate the pending rows and fill xtx below the diagonal; no sample can be
+// added afterwards
+void gram_finish(gram_t *gram){
+  gram_flush(gram);
+  for (unsigned int i = 0; i < gram->dim; i++)
+    for (unsigned int j = 0; j < i; j++)
+      gram->xtx[i * gram->dim + j] = gram->xtx[j * gram->dim + i];
+}
+
+// both finished, same features
+void gram_merge(gram_t *dst, const gram_t *src){
+  for (unsigned int i = 0; i < dst->dim * dst->dim; i++)
+    dst->xtx[i] += src->xtx[i];
+  for (unsigned int i = 0; i < dst->dim; i++)
+    dst->xty[i] += src->xty[i];
+  dst->yty += src->yty;
+  dst->num_samples += src->num_samples;
+}
+
+// sum of squared residuals of the samples with weights w = [intercept, coefficients]
+double gram_sse(const gram_t *gram, const double *w){
+  double sse = gram->yty;
+  for (unsigned int i = 0; i < gram->dim; i++) {
+    double gw = 0;
+    for (unsigned int j = 0; j < gram->dim; j++)
+      gw += gram->xtx[i * gram->dim + j] * w[j];
+    sse += w[i] * (gw - 2 * gram->xty[i]);
+  }
+  return sse > 0 ? sse : 0;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Solvers                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// least squares with a ridge on the coefficients (not the intercept), relative
+// to the scale of each feature
+int solve_ls(const gram_t *gram, double ridge, double *w){
+  int *passive = (int *)malloc_or_exit(sizeof(int) * gram->dim);
+  for (unsigned int i = 0; i < gram->dim; i++)
+    passive[i] = 1;
+  int ret = solve_subset(gram, ridge, passive, w);
+  free(passive);
+  return ret;
+}
+
+// least squares with non-negative coefficients (the intercept is free):
+// Lawson-Hanson active set method on the normal equations
+int solve_nnls(const gram_t *gram, double ridge, double *w){
+  unsigned int dim = gram->dim;
+  int *passive = (int *)malloc_or_exit(sizeof(int) * dim);
+  double *z = (double *)malloc_or_exit(sizeof(double) * dim);
+  double tolerance = 1e-10 * sqrt(gram->yty);
+  int ret = 0;
+  memset(passive, 0, sizeof(int) * dim);
+  passive[0] = 1;
+  ret = solve_subset(gram, ridge, passive, w);
+  for (unsigned int iter = 0; iter < 3 * dim && ret == 0; iter++) {
+    // the feature whose coefficient most decreases the residual enters the passive set;
+    // gradients are compared in the scale of the features
+    int entering = -1;
+    double max_gradient = tolerance;
+    for (unsigned int j = 1; j < dim; j++) {
+      double diag = gram->xtx[j * dim + j];
+      if (passive[j] || diag <= 0)
+        continue;
+      double gradient = gram->xty[j];
+      for (unsigned int k = 0; k < dim; k++)
+        gradient -= gram->xtx[j * dim + k] * w[k];
+      gradient /= sqrt(diag);
+      if (gradient > max_gradient) {
+        max_gradient = gradient;
+        entering = j;
+      }
+    }
+    if (entering < 0)
+      break;
+    passive[entering] = 1;
+    // move towards the unconstrained solution of the passive set until it is feasible
+    for (unsigned int inner = 0; inner < dim; inner++) {
+      if ((ret = solve_subset(gram, ridge, passive, z)))
+        break;
+      double alpha = 1;
+      for (unsigned int j = 1; j < dim; j++) {
+        if (passive[j] && z[j] <= 0 && w[j] - z[j] > 0 && w[j] / (w[j] - z[j]) < alpha)
+          alpha = w[j] / (w[j] - z[j]);
+      }
+      for (unsigned int j = 0; j < dim; j++)
+        w[j] += alpha * (z[j] - w[j]);
+      if (alpha == 1)
+        break;
+      for (unsigned int j = 1; j < dim; j++) {
+        if (passive[j] && w[j] <= 0) {
+          passive[j] = 0;
+          w[j] = 0;
+        }
+      }
+    }
+  }
+  free(passive);
+  free(z);
+  return ret;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │               Recursive least squares                 │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+void rls_init(rls_t *rls, unsigned int num_features, double forgetting){
+  unsigned int dim = num_features + 1;
+  rls->dim = dim;
+  rls->forgetting = forgetting;
+  rls->w = (double *)calloc(dim, sizeof(double));
+  rls->p = (double *)calloc(dim * dim, sizeof(double));
+  rls->x = (double *)malloc(sizeof(double) * dim);
+  rls->px = (double *)malloc(sizeof(double) * dim);
+  if (rls->w == NULL || rls->p == NULL || rls->x == NULL || rls->px == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  for (unsigned int i = 0; i < dim; i++)
+    rls->p[i * dim + i] = RLS_INIT_P;
+  rls->num_samples = 0;
+  rls->sum_y = 0;
+  rls->sse_prior = 0;
+  rls->sse_post = 0;
+}
+
+void rls_free(rls_t *rls){
+  free(rls->w);
+  free(rls->p);
+  free(rls->x);
+  free(rls->px);
+}
+
+// O(dim^2) update with a sample: features (without the intercept) and target
+void rls_update(rls_t *rls, const double *features, double y){
+  unsigned int dim = rls->dim;
+  double *x = rls->x;
+  double *px = rls->px;
+  x[0] = 1;
+  for (unsigned int i = 1; i < dim; i++)
+    x[i] = features[i - 1] * RLS_FEATURE_SCALE;
+  double estimate = 0;
+  double xpx = 0;
+  for (unsigned int i = 0; i < dim; i++) {
+    const double *p = rls->p + i * dim;
+    double sum = 0;
+    for (unsigned int j = 0; j < dim; j++)
+      sum += p[j] * x[j];
+    px[i] = sum;
+    xpx += x[i] * sum;
+    estimate += rls->w[i] * x[i];
+  }
+  // gain px / (forgetting + x^T p x); p is symmetric, only its upper triangle is
+  // updated and then mirrored, so that it stays symmetric
+  double error = y - estimate;
+  double gain = 1 / (rls->forgetting + xpx);
+  for (unsigned int i = 0; i < dim; i++) {
+    double *p = rls->p + i * dim;
+    double kg = px[i] * gain;
+    rls->w[i] += kg * error;
+    for (unsigned int j = i; j < dim; j++)
+      p[j] = (p[j] - kg * px[j]) / rls->forgetting;
+  }
+  for (unsigned int i = 1; i < dim; i++)
+    for (unsigned int j = 0; j < i; j++)
+      rls->p[i * dim + j] = rls->p[j * dim + i];
+  double posterior = y;
+  for (unsigned int i = 0; i < dim; i++)
+    posterior -= rls->w[i] * x[i];
+  rls->num_samples++;
+  rls->sum_y += y;
+  rls->sse_prior += error * error;
+  rls->sse_post += posterior * posterior;
+}
+
+// coefficients of the unscaled features
+void rls_coefficients(const rls_t *rls, double *intercept, double *coefficients){
+  *intercept = rls->w[0];
+  for (unsigned int i = 1; i < rls->dim; i++)
+    coefficients[i - 1] = rls->w[i] * RLS_FEATURE_SCALE;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static int json_key_is(const char *str_json, jsmntok_t *tok, const char *key) {
+  return (int)strlen(key) == tok->end - tok->start && !strncmp(str_json + tok->start, key, tok->end - tok->start);
+}
+
+// parse a model object starting at token i; return the index of its last token
+static int parse_model(const char *str_json, jsmntok_t *t, int i, power_model_t *model) {
+  char name[MODEL_FEATURE_NAME_LEN];
+  if (t[i].type != JSMN_OBJECT) {
+    printf("%s:%d: unexpected token type %d (expected JSMN_OBJECT).\n", __FILE__, __LINE__, t[i].type);
+    exit(1);
+  }
+  memset(model, 0, sizeof(power_model_t));
+  model->cv_error = -1;
+  model->online_error = -1;
+  int num_coefficients = -1;
+  int num_keys = t[i].size;
+  for (int k = 0; k < num_keys; k++) {
+    i++;
+    if (json_key_is(str_json, &t[i], "cpu_freq")) {
+      jsmn_parse_token(str_json, &t[++i], "%u", &model->cpu_freq);
+    } else if (json_key_is(str_json, &t[i], "gpu_freq")) {
+      jsmn_parse_token(str_json, &t[++i], "%u", &model->gpu_freq);
+    } else if (json_key_is(str_json, &t[i], "samples")) {
+      jsmn_parse_token(str_json, &t[++i], "%lu", &model->num_samples);
+    } else if (json_key_is(str_json, &t[i], "benchmarks")) {
+      jsmn_parse_token(str_json, &t[++i], "%u", &model->num_benchmarks);
+    } else if (json_key_is(str_json, &t[i], "rmse_mw")) {
+      jsmn_parse_token(str_json, &t[++i], "%lf", &model->rmse_mw);
+    } else if (json_key_is(str_json, &t[i], "cv_error")) {
+      jsmn_parse_token(str_json, &t[++i], "%lf", &model->cv_error);
+    } else if (json_key_is(str_json, &t[i], "online_error")) {
+      jsmn_parse_token(str_json, &t[++i], "%lf", &model->online_error);
+    } else if (json_key_is(str_json, &t[i], "intercept")) {
+      jsmn_parse_token(str_json, &t[++i], "%lf", &model->intercept);
+    } else if (json_key_is(str_json, &t[i], "features")) {
+      if (t[++i].type != JSMN_ARRAY) {
+        printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
+        exit(1);
+      }
+      model->num_features = t[i].size;
+      model->features = (model_feature_t *)malloc_or_exit((model->num_features > 0 ? model->num_features : 1) * sizeof(model_feature_t));
+      for (unsigned int f = 0; f < model->num_features; f++) {
+        i++;
+        snprintf(name, MODEL_FEATURE_NAME_LEN, "%.*s", t[i].end - t[i].start, str_json + t[i].start);
+        if (t[i].type != JSMN_STRING || parse_model_feature(name, &model->features[f])) {
+          printf("%s:%d: unexpected model feature '%s'.\n", __FILE__, __LINE__, name);
+          exit(1);
+        }
+      }
+    } else if (json_key_is(str_json, &t[i], "coefficients")) {
+      if (t[++i].type != JSMN_ARRAY) {
+        printf("%s:%d: unexpected token type %d (expected JSMN_ARRAY).\n", __FILE__, __LINE__, t[i].type);
+        exit(1);
+      }
+      num_coefficients = t[i].size;
+      model->coefficients = (double *)malloc_or_exit((num_coefficients > 0 ? num_coefficients : 1) * sizeof(double));
+      for (int c = 0; c < num_coefficients; c++)
+        jsmn_parse_token(str_json, &t[++i], "%lf", &model->coefficients[c]);
+    } else {
+      printf("%s:%d: unexpected model key '%.*s'.\n", __FILE__, __LINE__, t[i].end - t[i].start, str_json + t[i].start);
+      exit(1);
+    }
+  }
+  if (model->features == NULL || num_coefficients != (int)model->num_features) {
+    printf("%s:%d: model without as many coefficients as features.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  return i;
+}
+
+// rank-GRAM_BLOCK_ROWS update of the upper triangle: each row of xtx is updated
+// by the whole block while it is in cache, and the innermost loop is contiguous
+// in both operands, hence it vectorizes
+static void gram_flush(gram_t *gram) {
+  unsigned int dim = gram->dim;
+  unsigned int rows = gram->block_rows;
+  for (unsigned int i = 0; i < dim; i++) {
+    double *xtx = gram->xtx + i * dim;
+    double xty = 0;
+    for (unsigned int r = 0; r < rows; r++) {
+      const double *row = gram->block + r * dim;
+      double xi = row[i];
+      for (unsigned int j = i; j < dim; j++)
+        xtx[j] += xi * row[j];
+      xty += xi * gram->block_y[r];
+    }
+    gram->xty[i] += xty;
+  }
+  for (unsigned int r = 0; r < rows; r++)
+    gram->yty += gram->block_y[r] * gram->block_y[r];
+  gram->num_samples += rows;
+  gram->block_rows = 0;
+}
+
+// solve the normal equations restricted to the passive features (the others
+// are 0), scaled to a unit diagonal, by Cholesky decomposition
+static int solve_subset(const gram_t *gram, double ridge, const int *passive, double *w) {
+  unsigned int dim = gram->dim;
+  unsigned int *index = (unsigned int *)malloc_or_exit(sizeof(unsigned int) * dim);
+  double *scale = (double *)malloc_or_exit(sizeof(double) * dim);
+  double *l = (double *)malloc_or_exit(sizeof(double) * dim * dim);
+  double *z = (double *)malloc_or_exit(sizeof(double) * dim);
+  unsigned int n = 0;
+  int ret = 0;
+  for (unsigned int i = 0; i < dim; i++) {
+    w[i] = 0;
+    if (passive[i])
+      index[n++] = i;
+  }
+  for (unsigned int a = 0; a < n; a++) {
+    double diag = gram->xtx[index[a] * dim + index[a]];
+    scale[a] = diag > 0 ? 1 / sqrt(diag) : 1;
+  }
+  // l = D G D + ridge, lower triangle
+  for (unsigned int a = 0; a < n; a++) {
+    for (unsigned int b = 0; b <= a; b++)
+      l[a * n + b] = gram->xtx[index[a] * dim + index[b]] * scale[a] * scale[b];
+    if (index[a] != 0)
+      l[a * n + a] += ridge;
+  }
+  for (unsigned int a = 0; a < n && ret == 0; a++) {
+    for (unsigned int b = 0; b <= a; b++) {
+      double sum = l[a * n + b];
+      for (unsigned int k = 0; k < b; k++)
+        sum -= l[a * n + k] * l[b * n + k];
+      if (b < a) {
+        l[a * n + b] = sum / l[b * n + b];
+      } else if (sum <= 1e-14) {
+        ret = 1;
+      } else {
+        l[a * n + a] = sqrt(sum);
+      }
+    }
+  }
+  if (ret == 0) {
+    // L z = D xty, then L^T u = z, w = D u
+    for (unsigned int a = 0; a < n; a++) {
+      double sum = gram->xty[index[a]] * scale[a];
+      for (unsigned int k = 0; k < a; k++)
+        sum -= l[a * n + k] * z[k];
+      z[a] = sum / l[a * n + a];
+    }
+    for (int a = n - 1; a >= 0; a--) {
+      double sum = z[a];
+      for (unsigned int k = a + 1; k < n; k++)
+        sum -= l[k * n + a] * z[k];
+      z[a] = sum / l[a * n + a];
+    }
+    for (unsigned int a = 0; a < n; a++)
+      w[index[a]] = z[a] * scale[a];
+  }
+  free(index);
+  free(scale);
+  free(l);
+  free(z);
+  return ret;
+}
@@ -0,0 +1,285 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+// voltmeter libraries
+#include <helper.h>
+#include <model.h>
+#include <online.h>
+#include <profiler.h>
+#include <trace.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static unsigned int add_feature(model_feature_t **features, unsigned int *num_features, model_feature_kind_t kind, uint32_t event_id);
+static int same_features(online_point_t *point, model_feature_t *features, unsigned int num_features);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void online_model_init(online_model_t *online) {
+  memset(online, 0, sizeof(online_model_t));
+}
+
+void online_model_free(online_model_t *online) {
+  for (unsigned int p = 0; p < online->num_points; p++) {
+    free(online->points[p].features);
+    rls_free(&online->points[p].rls);
+  }
+  free(online->points);
+  online->points = NULL;
+  online->num_points = 0;
+}
+
+// called by main before profiling at an operating point
+void online_model_select(online_model_t *online, uint32_t cpu_freq, uint32_t gpu_freq) {
+  online->cpu_freq = cpu_freq;
+  online->gpu_freq = gpu_freq;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                    Trace consumer                     │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// map the columns of the merged samples of a trace to the features of its operating
+// point (created with the first trace profiled at it); the model features are
+// those of voltmeter-fit: the clock cycles and the events of all the cores, the
+// events of all the GPU domain instances
+void online_model_start(online_model_t *online, trace_schema_t *schema, uint32_t sample_period_us) {
+  model_feature_t *features = NULL;
+  model_feature_t feature;
+  unsigned int num_features = 0;
+  int multiplexed = 0;
+  online->num_inputs = 0;
+  online->inputs = (online_input_t *)malloc_or_exit(sizeof(online_input_t) * (schema->num_columns > 0 ? schema->num_columns : 1));
+  online->num_power = 0;
+  online->power_offsets = (size_t *)malloc_or_exit(sizeof(size_t) * (schema->num_columns > 0 ? schema->num_columns : 1));
+  for (unsigned int c = 0; c < schema->num_columns; c++) {
+    trace_column_t *column = &schema->columns[c];
+    if (!model_feature_of_column(column->name, &feature)) {
+      online_input_t *input = &online->inputs[online->num_inputs++];
+      input->offset = column->offset;
+      input->size = column->size;
+      input->feature = add_feature(&features, &num_features, feature.kind, feature.event_id);
+      input->fresh = feature.kind == MODEL_FEATURE_GPU_EVENT ? FRESH_GPU_COUNTERS : FRESH_CPU_COUNTERS;
+    } else if (!strncmp(column->name, "power", 5)) {
+      online->power_offsets[online->num_power++] = column->offset;
+    } else if (!strcmp(column->name, "deadline_ns")) {
+      online->deadline_offset = column->offset;
+    } else if (!strcmp(column->name, "fresh")) {
+      online->fresh_offset = column->offset;
+    } else if (!strcmp(column->name, "cpu0.set")) {
+      multiplexed = 1;
+    }
+  }
+
+  // the model of the operating point
+  online->point = NULL;
+  for (unsigned int p = 0; p < online->num_points && online->point == NULL; p++) {
+    if (online->points[p].cpu_freq == online->cpu_freq && online->points[p].gpu_freq == online->gpu_freq)
+      online->point = &online->points[p];
+  }
+  if (multiplexed) {
+    // each event is counted in a few of the power reads only
+    printf("Online model: the CPU events of the trace are multiplexed, not modeled.\n");
+    online->point = NULL;
+    online->num_skipped++;
+    free(features);
+  } else if (online->point == NULL) {
+    online->points = (online_point_t *)realloc(online->points, sizeof(online_point_t) * (online->num_points + 1));
+    if (online->points == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    online->point = &online->points[online->num_points++];
+    online->point->cpu_freq = online->cpu_freq;
+    online->point->gpu_freq = online->gpu_freq;
+    online->point->num_features = num_features;
+    online->point->features = features;
+    online->point->num_traces = 0;
+    rls_init(&online->point->rls, num_features, ONLINE_FORGETTING);
+  } else if (!same_features(online->point, features, num_features)) {
+    // e.g., another pass of a characterization run
+    printf("Online model: the events of the trace differ from those of its operating point, not modeled.\n");
+    online->point = NULL;
+    online->num_skipped++;
+    free(features);
+  } else {
+    free(features);
+  }
+  if (online->point != NULL)
+    online->point->num_traces++;
+  online->counts = (double *)calloc(num_features > 0 ? num_features : 1, sizeof(double));
+  online->rates = (double *)malloc_or_exit(sizeof(double) * (num_features > 0 ? num_features : 1));
+  if (online->counts == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  online->sample_period_ns = sample_period_us * 1e3;
+  online->has_prev = 0;
+  online->window_samples = 0;
+}
+
+// merged sample, in v1 layout: counters read since the previous power read are
+// accumulated (stale ones repeat the last read, hence are skipped); a power read
+// updates the model with the rates of the events over the time since the previous one
+void online_model_add(online_model_t *online, const uint8_t *sample) {
+  online_point_t *point = online->point;
+  uint32_t fresh;
+  uint64_t deadline, value;
+  if (point == NULL)
+    return;
+  memcpy(&fresh, sample + online->fresh_offset, sizeof(uint32_t));
+  online->window_samples++;
+  for (unsigned int i = 0; i < online->num_inputs; i++) {
+    online_input_t *input = &online->inputs[i];
+    if (!(fresh & input->fresh))
+      continue;
+    if (input->size == sizeof(uint32_t)) {
+      uint32_t value32;
+      memcpy(&value32, sample + input->offset, sizeof(uint32_t));
+      value = value32;
+    } else {
+      memcpy(&value, sample + input->offset, sizeof(uint64_t));
+    }
+    online->counts[input->feature] += value;
+  }
+  if (!(fresh & FRESH_POWER))
+    return;
+  memcpy(&deadline, sample + online->deadline_offset, sizeof(uint64_t));
+  // the first window of a trace lasts its sampling periods
+  double interval_ns = online->has_prev ? (double)(deadline - online->prev_deadline) : online->window_samples * online->sample_period_ns;
+  if (interval_ns > 0) {
+    double power = 0;
+    for (unsigned int p = 0; p < online->num_power; p++) {
+      power_t rail;
+      memcpy(&rail, sample + online->power_offsets[p], sizeof(power_t));
+      power += rail;
+    }
+    for (unsigned int f = 0; f < point->num_features; f++)
+      online->rates[f] = online->counts[f] * 1e9 / interval_ns;
+    rls_update(&point->rls, online->rates, power);
+  }
+  online->prev_deadline = deadline;
+  online->has_prev = 1;
+  online->window_samples = 0;
+  memset(online->counts, 0, sizeof(double) * point->num_features);
+}
+
+void online_model_stop(online_model_t *online) {
+  free(online->inputs);
+  free(online->power_offsets);
+  free(online->counts);
+  free(online->rates);
+  online->inputs = NULL;
+  online->power_offsets = NULL;
+  online->counts = NULL;
+  online->rates = NULL;
+  online->point = NULL;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Results                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// coefficients and residuals of every operating point, as a coefficient file
+// (see model.h); rmse_mw is that of the estimates after each update, online_error
+// that of the estimates before each update (i.e., on samples not seen yet)
+void online_model_write(online_model_t *online, char *model_file, FILE *log_file) {
+  model_set_t set;
+  set.target = MODEL_TARGET_TOTAL;
+  set.num_models = 0;
+  set.models = (power_model_t *)malloc_or_exit(sizeof(power_model_t) * (online->num_points > 0 ? online->num_points : 1));
+  printf_file(log_file, "\nOnline power models (recursive least squares):\n");
+  for (unsigned int p = 0; p < online->num_points; p++) {
+    online_point_t *point = &online->points[p];
+    rls_t *rls = &point->rls;
+    printf_file(log_file, "  CPU %u, GPU %u: ", point->cpu_freq, point->gpu_freq);
+    if (rls->num_samples == 0) {
+      printf_file(log_file, "no power read\n");
+      continue;
+    }
+    power_model_t *model = &set.models[set.num_models++];
+    double mean = rls->sum_y / rls->num_samples;
+    memset(model, 0, sizeof(power_model_t));
+    model->cpu_freq = point->cpu_freq;
+    model->gpu_freq = point->gpu_freq;
+    model->num_features = point->num_features;
+    model->features = point->features;
+    model->coefficients = (double *)malloc_or_exit(sizeof(double) * (point->num_features > 0 ? point->num_features : 1));
+    rls_coefficients(rls, &model->intercept, model->coefficients);
+    model->num_samples = rls->num_samples;
+    model->num_benchmarks = point->num_traces;
+    model->rmse_mw = sqrt(rls->sse_post / rls->num_samples);
+    model->cv_error = -1;
+    model->online_error = mean != 0 ? sqrt(rls->sse_prior / rls->num_samples) / mean : -1;
+    printf_file(log_file, "%lu power reads of %u trace(s), RMSE %.1f mW, online error %.2f%% of %.1f mW\n",
+      model->num_samples, point->num_traces, model->rmse_mw, 100 * model->online_error, mean);
+  }
+  if (online->num_skipped > 0)
+    printf_file(log_file, "  %u trace(s) not modeled: events multiplexed, or different from those of their operating point\n", online->num_skipped);
+
+  FILE *file = fopen(model_file, "w");
+  if (file == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, model_file);
+    exit(1);
+  }
+  write_model_json(file, &set);
+  fclose(file);
+  printf_file(log_file, "  %u model(s) written to %s\n", set.num_models, model_file);
+  // features belong to the operating points
+  for (unsigned int m = 0; m < set.num_models; m++)
+    free(set.models[m].coefficients);
+  free(set.models);
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// index of the feature, added if new
+static unsigned int add_feature(model_feature_t **features, unsigned int *num_features, model_feature_kind_t kind, uint32_t event_id) {
+  for (unsigned int f = 0; f < *num_features; f++) {
+    if ((*features)[f].kind == kind && (*features)[f].event_id == event_id)
+      return f;
+  }
+  *features = (model_feature_t *)realloc(*features, sizeof(model_feature_t) * (*num_features + 1));
+  if (*features == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  (*features)[*num_features].kind = kind;
+  (*features)[*num_features].event_id = event_id;
+  return (*num_features)++;
+}
+
+static int same_features(online_point_t *point, model_feature_t *features, unsigned int num_features) {
+  if (point->num_features != num_features)
+    return 0;
+  for (unsigned int f = 0; f < num_features; f++) {
+    if (point->features[f].kind != features[f].kind || point->features[f].event_id != features[f].event_id)
+      return 0;
+  }
+  return 1;
+}
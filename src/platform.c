@@ -10,6 +10,9 @@
 #include <stdlib.h>
 // voltmeter libraries
 #include <platform.h>
+#include <sensor.h>
+#include <backend.h>
+
 /*
  * ╔═══════════════════════════════════════════════════════╗
  * ║                        Globals                        ║
@@ -18,6 +21,20 @@
 
 platform_power_t platform_power;
 
+#ifdef __JETSON_AGX_XAVIER
+// Jetson built-in INA3221 power monitors, in the order of platform_power.power_measures
+static const char *power_rail_files[NUM_POWER_RAILS] = {
+  INA_0x40_POWER_CH0_FILE, // I2C address 0x40, channel 0: GPU
+  INA_0x40_POWER_CH1_FILE, // I2C address 0x40, channel 1: CPU
+  INA_0x40_POWER_CH2_FILE, // I2C address 0x40, channel 2: SOC
+  INA_0x41_POWER_CH0_FILE, // I2C address 0x41, channel 0: CV
+  INA_0x41_POWER_CH1_FILE, // I2C address 0x41, channel 1: VDDRQ
+  INA_0x41_POWER_CH2_FILE  // I2C address 0x41, channel 2: SYS5V
+};
+// persistent handles of the power rail files
+static sensor_t power_rail_sensors[NUM_POWER_RAILS];
+#endif
+
 /*
  * ╔═══════════════════════════════════════════════════════╗
  * ║                       Functions                       ║
@@ -31,20 +48,12 @@ platform_power_t platform_power;
  */
 
 uint32_t setup_platform() {
-#ifdef __JETSON_AGX_XAVIER
-  platform_power.num_power_rails = NUM_POWER_RAILS;
-#else
-#error "Platform not supported."
-#endif
+  platform_power.num_power_rails = backend->open_power_rails();
   return 0;
 }
 
 void deinit_platform(){
-#ifdef __JETSON_AGX_XAVIER
-  // nothing to do
-#else
-#error "Platform not supported."
-#endif
+  backend->close_power_rails();
 }
 
 /*
@@ -54,57 +63,48 @@ void deinit_platform(){
  */
 
 void read_platform_power() {
+  for (unsigned int r = 0; r < platform_power.num_power_rails; r++)
+    platform_power.power_measures[r] = backend->read_power_rail(r);
+}
+
+// read a single power rail, so that rails can be sampled by different threads
+void read_platform_power_rail(unsigned int rail) {
+  platform_power.power_measures[rail] = backend->read_power_rail(rail);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                   Hardware backend                    │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+unsigned int open_power_rails() {
+#ifdef __JETSON_AGX_XAVIER
+  // open power sensors once, they are read at every sample
+  for (int r = 0; r < NUM_POWER_RAILS; r++)
+    sensor_open(&power_rail_sensors[r], power_rail_files[r]);
+#elif !defined(__LINUX_GENERIC) // no power rails
+#error "Platform not supported."
+#endif
+  return NUM_POWER_RAILS;
+}
+
+void close_power_rails() {
+#ifdef __JETSON_AGX_XAVIER
+  for (int r = 0; r < NUM_POWER_RAILS; r++)
+    sensor_close(&power_rail_sensors[r]);
+#elif !defined(__LINUX_GENERIC) // no power rails
+#error "Platform not supported."
+#endif
+}
+
+power_t read_power_rail(unsigned int rail) {
 #ifdef __JETSON_AGX_XAVIER
   // Jetson built-in INA3221 power monitors (milliwatts, mW)
-  FILE *ina;
-  // I2C address 0x40, channel 0: GPU
-  ina = fopen(INA_0x40_POWER_CH0_FILE, "r");
-  if (ina == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, INA_0x40_POWER_CH0_FILE);
-    exit(1);
-  }
-  fscanf(ina, "%u", &platform_power.power_measures[0]);
-  fclose(ina);
-  // I2C address 0x40, channel 1: CPU
-  ina = fopen(INA_0x40_POWER_CH1_FILE, "r");
-  if (ina == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, INA_0x40_POWER_CH0_FILE);
-    exit(1);
-  }
-  fscanf(ina, "%u", &platform_power.power_measures[1]);
-  fclose(ina);
-  // I2C address 0x40, channel 2: SOC
-  ina = fopen(INA_0x40_POWER_CH2_FILE, "r");
-  if (ina == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, INA_0x40_POWER_CH0_FILE);
-    exit(1);
-  }
-  fscanf(ina, "%u", &platform_power.power_measures[2]);
-  fclose(ina);
-  // I2C address 0x40, channel 0: CV
-  ina = fopen(INA_0x41_POWER_CH0_FILE, "r");
-  if (ina == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, INA_0x40_POWER_CH0_FILE);
-    exit(1);
-  }
-  fscanf(ina, "%u", &platform_power.power_measures[3]);
-  fclose(ina);
-  // I2C address 0x40, channel 1: VDDRQ
-  ina = fopen(INA_0x41_POWER_CH1_FILE, "r");
-  if (ina == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, INA_0x40_POWER_CH0_FILE);
-    exit(1);
-  }
-  fscanf(ina, "%u", &platform_power.power_measures[4]);
-  fclose(ina);
-  // I2C address 0x40, channel 2: SYS5V
-  ina = fopen(INA_0x41_POWER_CH2_FILE, "r");
-  if (ina == NULL) {
-    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, INA_0x40_POWER_CH0_FILE);
-    exit(1);
-  }
-  fscanf(ina, "%u", &platform_power.power_measures[5]);
-  fclose(ina);
+  return sensor_read_u32(&power_rail_sensors[rail]);
+#elif defined(__LINUX_GENERIC)
+  // no power rails
+  return 0;
 #else
 #error "Platform not supported."
 #endif
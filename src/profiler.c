@@ -6,19 +6,22 @@
 
 // standard includes
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <pthread.h>
-#include <unistd.h>
+#include <stdatomic.h>
 #include <time.h>
 // voltmeter libraries
 #include <profiler.h>
 #include <platform.h>
-#if CPU
+#include <scheduler.h>
+#include <ring.h>
+#include <writer.h>
+#include <helper.h>
 #include <cpu.h>
-#endif
-#if GPU
 #include <gpu.h>
-#endif
+#include <backend.h>
 
 /*
  * ╔═══════════════════════════════════════════════════════╗
@@ -26,150 +29,740 @@
  * ╚═══════════════════════════════════════════════════════╝
  */
 
-#if CPU
 extern cpu_events_freq_config_t cpu_events;
-#endif
-#if GPU
 extern gpu_events_freq_config_t gpu_events;
-#endif
 extern platform_power_t platform_power;
 
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Globals                        ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// runtime configuration of the profiler (devices, runs, sampling periods)
+profiler_config_t profiler_config = {
+  .cpu = 0,
+  .gpu = 0,
+  .num_run = DEFAULT_NUM_RUN,
+  .sample_period_us = DEFAULT_SAMPLE_PERIOD_US,
+  .power_period_us = 0,
+  .freq_period_us = 0,
+  .realtime = 0,
+  .trace_version = DEFAULT_TRACE_VERSION,
+  .mux_samples = 0
+};
+
+// device sensors in trace order, each assigned to one sampler thread
+static device_sensor_t device_sensors[MAX_DEVICE_SENSORS];
+static unsigned int num_device_sensors = 0;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static int cpu_mux(void);
+static unsigned int mux_set(uint64_t seq);
+static unsigned int core_num_counters(unsigned int core_id, unsigned int set_id_cpu);
+static size_t core_record_bytes(unsigned int set_id_cpu);
+static size_t device_sensor_bytes(device_sensor_t *sensor, unsigned int set_id_gpu);
+static uint32_t read_device_sensors(unsigned int thread_id, unsigned int set_id_gpu, uint64_t seq, int power_due, int freq_due);
+static int stream_due(stream_rate_t *rate, uint64_t seq);
+static size_t device_record_bytes(unsigned int thread_id, unsigned int set_id_gpu);
+static size_t serialize_core(uint8_t *dst, unsigned int core_id, unsigned int set_id_cpu);
+static size_t serialize_devices(uint8_t *dst, unsigned int thread_id, unsigned int set_id_gpu);
+static size_t merged_sample_bytes(profiler_args_t *thread_args);
+static void build_trace_schema(profiler_args_t *thread_args, trace_schema_t *schema);
+static void write_trace_header(profiler_args_t *thread_args, trace_output_t *output);
+static void init_trace_footer(profiler_args_t *thread_args, trace_output_t *output);
+static void write_trace_footer(profiler_args_t *thread_args, trace_output_t *output);
+static size_t serialize_sample(profiler_args_t *thread_args, uint8_t *dst, sample_header_t **records);
+static uint64_t merge_rings(profiler_args_t *thread_args, trace_output_t *output);
+
+
 /*
  * ╔═══════════════════════════════════════════════════════╗
  * ║                       Functions                       ║
  * ╚═══════════════════════════════════════════════════════╝
  */
 
-// events profiler function, to be called through phtread
+void profiler_runs_init(profiler_runs_t *runs, unsigned int num_run) {
+  runs->num_run = num_run;
+  atomic_init(&runs->current, 0);
+  atomic_init(&runs->num_ended, 0);
+  runs->start_ns = (uint64_t *)calloc(num_run, sizeof(uint64_t));
+  runs->end_ns = (uint64_t *)calloc(num_run, sizeof(uint64_t));
+  if (runs->start_ns == NULL || runs->end_ns == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+}
+
+// called by main right before each run: samples taken from now on are tagged with it
+void profiler_run_start(profiler_runs_t *runs, unsigned int run) {
+  runs->start_ns[run] = monotonic_ns();
+  atomic_store(&runs->current, run);
+}
+
+// called by main right after each run
+void profiler_run_end(profiler_runs_t *runs, unsigned int run) {
+  runs->end_ns[run] = monotonic_ns();
+  atomic_store(&runs->num_ended, run + 1);
+}
+
+void profiler_runs_free(profiler_runs_t *runs) {
+  free(runs->start_ns);
+  free(runs->end_ns);
+}
+
+// capacity of each sampler ring: holds at least 4 consumer periods of samples
+size_t sampler_ring_capacity() {
+  uint32_t sample_period_us = profiler_config.sample_period_us;
+  size_t samples_per_consumer_period = (CONSUMER_PERIOD_US + sample_period_us - 1) / sample_period_us;
+  size_t capacity = 4 * samples_per_consumer_period;
+  return capacity < RING_MIN_SAMPLES ? RING_MIN_SAMPLES : capacity;
+}
+
+// base sampling periods between two reads of a stream (at least 1)
+unsigned int stream_divider(uint32_t period_us) {
+  uint32_t sample_period_us = profiler_config.sample_period_us;
+  if (period_us <= sample_period_us)
+    return 1;
+  // round to the closest multiple of the base sampling period
+  return (period_us + sample_period_us / 2) / sample_period_us;
+}
+
+// assign the device sensors to the sampler threads: the GPU counters stay on the
+// GPU host thread, every other sensor (e.g., I2C power monitors, which may take
+// hundreds of us each) is spread round-robin over the remaining threads, so that
+// the latency of a sample is bound by the slowest sensor rather than by their sum
+void assign_device_sensors(unsigned int num_threads) {
+  unsigned int next_thread = 0;
+  num_device_sensors = 0;
+  if (profiler_config.gpu) {
+    device_sensors[num_device_sensors++] = (device_sensor_t){SENSOR_GPU_FREQ, 0, 0, 0};
+    device_sensors[num_device_sensors++] = (device_sensor_t){SENSOR_GPU_COUNTERS, 0, GPU_HOST_THREAD, 0};
+  }
+  for (unsigned int r = 0; r < platform_power.num_power_rails; r++)
+    device_sensors[num_device_sensors++] = (device_sensor_t){SENSOR_POWER_RAIL, r, 0, 0};
+  for (unsigned int s = 0; s < num_device_sensors; s++) {
+    if (device_sensors[s].kind == SENSOR_GPU_COUNTERS)
+      continue;
+    if (num_threads > 1) {
+      // skip the GPU host thread
+      if (profiler_config.gpu && next_thread % num_threads == GPU_HOST_THREAD)
+        next_thread++;
+      device_sensors[s].thread_id = next_thread++ % num_threads;
+    } else {
+      device_sensors[s].thread_id = 0;
+    }
+  }
+}
+
+void print_device_sensors(FILE *log_file) {
+  printf_file(log_file, "Device sensors per sampler thread:\n");
+  for (unsigned int s = 0; s < num_device_sensors; s++) {
+    if (device_sensors[s].kind == SENSOR_GPU_FREQ)
+      printf_file(log_file, "  GPU frequency -> thread %u\n", device_sensors[s].thread_id);
+    else if (device_sensors[s].kind == SENSOR_GPU_COUNTERS)
+      printf_file(log_file, "  GPU counters -> thread %u\n", device_sensors[s].thread_id);
+    else
+      printf_file(log_file, "  power rail %u -> thread %u\n", device_sensors[s].index, device_sensors[s].thread_id);
+  }
+}
+
+// events profiler function, to be called through phtread (one per core); each
+// thread samples at the common absolute deadlines and pushes its record into its
+// own ring, without synchronizing with the other sampler threads
 void *events_profiler(void *args) {
   profiler_args_t *thread_args = (profiler_args_t*)args;
-  struct timespec timestamp_a, timestamp_b;
-  uint32_t sampling_period_us = SAMPLE_PERIOD_US;
-  uint64_t sampling_time;
+  spsc_ring_t *ring = &thread_args->rings[thread_args->thread_id];
+  size_t core_bytes, device_bytes;
+  // absolute deadline of the current sample and actual wake time (CLOCK_MONOTONIC, ns)
+  sampler_clock_t sampler_clock;
+  uint64_t deadline_ns = 0;
+  uint64_t wake_ns = 0;
+  // multi-rate sampling: PMU counters at every sample, power and frequencies every divider samples
+  stream_rate_t power_rate = {stream_divider(profiler_config.power_period_us), 0};
+  stream_rate_t freq_rate = {stream_divider(profiler_config.freq_period_us), 0};
+  int power_due, freq_due;
+  uint64_t seq;
+  uint32_t fresh;
+  // multiplexing: CPU event set counted since the previous sample
+  unsigned int set_id_cpu = cpu_mux() ? mux_set(0) : thread_args->set_id_cpu;
+
+  // map the stack before sampling (memory is locked by main)
+  if (profiler_config.realtime)
+    prefault_stack();
 
-#if CPU
   // enable CPU PMU
-  enable_pmu_cpu_core(thread_args->thread_id, thread_args->set_id_cpu);
-#endif
-#if GPU
-  // enable GPU PMU (only CPU thread 0 is the GPU host)
+  if (profiler_config.cpu)
+    backend->enable_pmu_cpu_core(thread_args->thread_id, set_id_cpu);
+  // enable GPU PMU (only one CPU thread is the GPU host)
+  if (profiler_config.gpu && thread_args->thread_id == GPU_HOST_THREAD)
+    backend->enable_pmu_gpu(thread_args->set_id_gpu);
+
+  // allocate the ring of this thread (record size is known once the PMUs are enabled)
+  core_bytes = core_record_bytes(thread_args->set_id_cpu);
+  device_bytes = device_record_bytes(thread_args->thread_id, thread_args->set_id_gpu);
+  ring_init(ring, sampler_ring_capacity(), sizeof(sample_header_t) + core_bytes + device_bytes);
+
+  // common epoch for all sampler threads, published by the start barrier
   if (thread_args->thread_id == 0)
-    enable_pmu_gpu(thread_args->set_id_gpu);
-#endif
+    *thread_args->epoch_ns = monotonic_ns();
 
-  // write trace header (only CPU thread 0 opens the trace file)
-  if (thread_args->thread_id == 0) {
-#if CPU
-    fwrite(&cpu_events.num_cores, sizeof(uint32_t), 1, thread_args->trace_file);
-    for (int c = 0; c < cpu_events.num_cores; c++) {
-      fwrite(&cpu_events.core[c].counter_set[thread_args->set_id_cpu].num_counters, sizeof(uint32_t), 1, thread_args->trace_file);
-      fwrite(cpu_events.core[c].counter_set[thread_args->set_id_cpu].event_id, sizeof(cpu_event_id_t) * cpu_events.core[c].counter_set[thread_args->set_id_cpu].num_counters, 1, thread_args->trace_file);
+  // wait for all cores and the consumer
+  pthread_barrier_wait(thread_args->barrier);
+
+  // first sample is due immediately
+  sampler_clock_init(&sampler_clock, *thread_args->epoch_ns, (uint64_t)profiler_config.sample_period_us * 1000);
+
+  //////////////////////////////////
+  // start profiler sampling period
+  //////////////////////////////////
+
+  while(1) {
+    // sleep until the absolute deadline of the next sample
+    wake_ns = sampler_clock_wait(&sampler_clock, &deadline_ns);
+    if (*thread_args->signal)
+      break;
+    seq = sampler_clock.seq - 1;
+    power_due = stream_due(&power_rate, seq);
+    freq_due = stream_due(&freq_rate, seq);
+    fresh = 0;
+
+    if (profiler_config.cpu) {
+      // sample CPU counters
+      backend->read_counters_cpu_core(thread_args->thread_id, set_id_cpu);
+      fresh |= FRESH_CPU_COUNTERS;
+      // multiplexing: program the set of the next sample
+      if (cpu_mux() && mux_set(seq + 1) != set_id_cpu)
+        backend->program_pmu_cpu_core(thread_args->thread_id, mux_set(seq + 1));
+      // sample current CPU frequency (fresh only if changed, or first read)
+      if (freq_due) {
+        uint32_t freq_prev = cpu_events.core[thread_args->thread_id].freq_read;
+        read_cpu_core_freq(thread_args->thread_id);
+        if (seq == 0 || cpu_events.core[thread_args->thread_id].freq_read != freq_prev)
+          fresh |= FRESH_CPU_FREQ;
+      }
     }
-#endif
-#if GPU
-#ifdef __JETSON_AGX_XAVIER
-    fwrite(&gpu_events.event_group_sets->sets[thread_args->set_id_gpu].numEventGroups, sizeof(uint32_t), 1, thread_args->trace_file);
-    for (int g = 0; g < gpu_events.event_group_sets->sets[thread_args->set_id_gpu].numEventGroups; g++) {
-      fwrite(&gpu_events.num_events_group[g], sizeof(uint32_t), 1, thread_args->trace_file);
-      fwrite(&gpu_events.num_instances_group[g], sizeof(uint32_t), 1, thread_args->trace_file);
-      fwrite(gpu_events.event_ids_buffer[g], sizeof(gpu_event_id_t), gpu_events.num_events_group[g], thread_args->trace_file);
+    // sample the device sensors assigned to this thread (GPU, power rails)
+    fresh |= read_device_sensors(thread_args->thread_id, thread_args->set_id_gpu, seq, power_due, freq_due);
+
+    // push record into the ring (dropped if the consumer lags behind)
+    sample_header_t *record = (sample_header_t *)ring_reserve(ring);
+    if (record != NULL) {
+      uint8_t *payload = (uint8_t *)(record + 1);
+      record->seq = seq;
+      record->deadline_ns = deadline_ns;
+      record->wake_ns = wake_ns;
+      record->fresh = fresh;
+      record->run = atomic_load_explicit(&thread_args->runs->current, memory_order_relaxed);
+      record->set_cpu = set_id_cpu;
+      record->core_bytes = serialize_core(payload, thread_args->thread_id, set_id_cpu);
+      record->device_bytes = serialize_devices(payload + core_bytes, thread_args->thread_id, thread_args->set_id_gpu);
+      record->end_ns = monotonic_ns();
+      ring_commit(ring);
     }
-#else
-#error "Platform not supported."
-#endif
-#endif
-    fwrite(&platform_power.num_power_rails, sizeof(uint32_t), 1, thread_args->trace_file);
-    fwrite(&sampling_period_us, sizeof(uint32_t), 1, thread_args->trace_file);
+    if (cpu_mux())
+      set_id_cpu = mux_set(seq + 1);
   }
 
-  // wait for all cores
+  thread_args->overruns = sampler_clock.overruns;
+  if (thread_args->log_file != NULL && sampler_clock.overruns > 0)
+    printf_file(thread_args->log_file, "Profiler thread %u missed %lu sampling deadline(s).\n", thread_args->thread_id, sampler_clock.overruns);
+  if (thread_args->log_file != NULL && ring->dropped > 0)
+    printf_file(thread_args->log_file, "Profiler thread %u dropped %lu sample(s) on full ring.\n", thread_args->thread_id, ring->dropped);
+
+  // de-init CPU PMU
+  if (profiler_config.cpu)
+    backend->disable_pmu_cpu_core(thread_args->thread_id);
+  // de-init GPU PMU
+  if (profiler_config.gpu && thread_args->thread_id == GPU_HOST_THREAD)
+    backend->disable_pmu_gpu(thread_args->set_id_gpu);
+
+  // notify the consumer
+  atomic_fetch_add(thread_args->num_done, 1);
+  return (void *)NULL;
+}
+
+// trace consumer function, to be called through pthread; it merges the records
+// of all sampler rings by sequence number and hands them to the trace writer
+// (through the columnar encoder for trace version 2)
+void *trace_consumer(void *args) {
+  profiler_args_t *thread_args = (profiler_args_t*)args;
+  sampler_clock_t consumer_clock;
+  trace_output_t output;
+  uint64_t deadline_ns;
+  uint64_t num_incomplete = 0;
+
+  // file writes happen in a dedicated thread, in large sequential blocks
+  trace_writer_start(&output.writer, thread_args->trace_file);
+
+  // wait for all sampler threads to have enabled their PMUs and rings
   pthread_barrier_wait(thread_args->barrier);
 
-  //////////////////////////////////
-  // start profiler sampling period
-  //////////////////////////////////
+  // record sizes are known only after the barrier
+  build_trace_schema(thread_args, &output.schema);
+  if (output.schema.sample_bytes != merged_sample_bytes(thread_args)) {
+    printf("%s:%d: trace schema of %lu bytes does not match a sample of %lu bytes.\n", __FILE__, __LINE__, output.schema.sample_bytes, merged_sample_bytes(thread_args));
+    exit(1);
+  }
+  output.sample = (uint8_t *)malloc(output.schema.sample_bytes);
+  if (output.sample == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  if (profiler_config.trace_version == TRACE_VERSION_COLUMNAR)
+    trace_encoder_init(&output.encoder, &output.schema);
+  write_trace_header(thread_args, &output);
+  init_trace_footer(thread_args, &output);
+  if (thread_args->online_model != NULL)
+    online_model_start(thread_args->online_model, &output.schema, profiler_config.sample_period_us);
+  if (thread_args->estimator != NULL)
+    estimator_start(thread_args->estimator, &output.schema, profiler_config.sample_period_us);
+
+  sampler_clock_init(&consumer_clock, *thread_args->epoch_ns, (uint64_t)CONSUMER_PERIOD_US * 1000);
+  while (1) {
+    // check before draining, so that the last records are merged
+    int done = atomic_load(thread_args->num_done) == thread_args->num_threads;
+    num_incomplete += merge_rings(thread_args, &output);
+    if (thread_args->estimator != NULL)
+      estimator_flush(thread_args->estimator);
+    if (done)
+      break;
+    sampler_clock_wait(&consumer_clock, &deadline_ns);
+  }
+  if (profiler_config.trace_version == TRACE_VERSION_COLUMNAR)
+    trace_encoder_flush(&output.encoder, &output.writer);
+  write_trace_footer(thread_args, &output);
+  trace_writer_stop(&output.writer);
+  if (thread_args->online_model != NULL)
+    online_model_stop(thread_args->online_model);
+  if (thread_args->estimator != NULL)
+    estimator_stop(thread_args->estimator);
+
+  FILE *log_file = thread_args->log_file;
+  if (log_file != NULL && num_incomplete > 0)
+    printf_file(log_file, "Trace consumer discarded %lu incomplete sample record(s).\n", num_incomplete);
+  if (log_file != NULL)
+    printf_file(log_file, "Trace writer: %lu bytes written, %lu backpressure event(s).\n", output.writer.bytes, output.writer.backpressure);
+  if (profiler_config.trace_version == TRACE_VERSION_COLUMNAR) {
+    if (log_file != NULL)
+      printf_file(log_file, "Trace encoder: %lu block(s), %lu raw bytes encoded to %lu bytes (%.1fx).\n",
+        output.encoder.num_blocks, output.encoder.raw_bytes, output.encoder.encoded_bytes,
+        output.encoder.encoded_bytes > 0 ? (double)output.encoder.raw_bytes / output.encoder.encoded_bytes : 0.0);
+    trace_encoder_free(&output.encoder);
+  }
+  trace_schema_free(&output.schema);
+  free(output.sample);
+  return (void *)NULL;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// whether the CPU event sets are multiplexed within the pass (sets of equal size,
+// the same number on all cores, checked by main)
+static int cpu_mux(void) {
+  return profiler_config.cpu && profiler_config.mux_samples > 0 && cpu_events.core[0].num_sets > 1;
+}
+
+// CPU event set scheduled at sample seq: the same on all cores, since all threads
+// share the sequence numbers (a set is counted late after an overrun)
+static unsigned int mux_set(uint64_t seq) {
+  return (seq / profiler_config.mux_samples) % cpu_events.core[0].num_sets;
+}
+
+// counters of a core in each sample: those of its set, or of all its sets if multiplexed
+static unsigned int core_num_counters(unsigned int core_id, unsigned int set_id_cpu) {
+  unsigned int num_counters = 0;
+  if (!cpu_mux())
+    return cpu_events.core[core_id].counter_set[set_id_cpu].num_counters;
+  for (int s = 0; s < cpu_events.core[core_id].num_sets; s++)
+    num_counters += cpu_events.core[core_id].counter_set[s].num_counters;
+  return num_counters;
+}
+
+// trace bytes of one core in each sample
+static size_t core_record_bytes(unsigned int set_id_cpu) {
+  size_t bytes = 0;
+  if (!profiler_config.cpu)
+    return 0;
+  bytes += sizeof(uint32_t);
+  bytes += sizeof(cpu_counter_t) * core_num_counters(0, set_id_cpu);
+  bytes += sizeof(uint64_t);
+  return bytes;
+}
+
+// trace bytes of a device sensor in each sample
+static size_t device_sensor_bytes(device_sensor_t *sensor, unsigned int set_id_gpu) {
+  size_t bytes = 0;
+  switch (sensor->kind) {
+    case SENSOR_GPU_FREQ:
+      bytes = sizeof(uint32_t);
+      break;
+    case SENSOR_GPU_COUNTERS:
+      bytes = trace_bytes_gpu(set_id_gpu);
+      break;
+    case SENSOR_POWER_RAIL:
+      bytes = sizeof(power_t);
+      break;
+    default:
+      break;
+  }
+  return bytes;
+}
+
+// trace bytes of the devices sampled by a thread in each sample; the size of each
+// sensor is stored for the consumer, which reads it after the start barrier
+static size_t device_record_bytes(unsigned int thread_id, unsigned int set_id_gpu) {
+  size_t bytes = 0;
+  for (unsigned int s = 0; s < num_device_sensors; s++) {
+    if (device_sensors[s].thread_id != thread_id)
+      continue;
+    device_sensors[s].bytes = device_sensor_bytes(&device_sensors[s], set_id_gpu);
+    bytes += device_sensors[s].bytes;
+  }
+  return bytes;
+}
+
+// read the device sensors assigned to a thread, if due; return the FRESH_* flags
+// of the streams refreshed (frequency only if changed, or at the first sample)
+static uint32_t read_device_sensors(unsigned int thread_id, unsigned int set_id_gpu, uint64_t seq, int power_due, int freq_due) {
+  uint32_t fresh = 0;
+  for (unsigned int s = 0; s < num_device_sensors; s++) {
+    if (device_sensors[s].thread_id != thread_id)
+      continue;
+    switch (device_sensors[s].kind) {
+      case SENSOR_GPU_FREQ:
+        // sample current GPU frequency
+        if (freq_due) {
+          uint32_t freq_prev = gpu_events.freq_read;
+          read_gpu_freq();
+          if (seq == 0 || gpu_events.freq_read != freq_prev)
+            fresh |= FRESH_GPU_FREQ;
+        }
+        break;
+      case SENSOR_GPU_COUNTERS:
+        // sample GPU counters (reset on read)
+        backend->read_counters_gpu(set_id_gpu);
+        fresh |= FRESH_GPU_COUNTERS;
+        break;
+      case SENSOR_POWER_RAIL:
+        // fetch power measure
+        if (power_due) {
+          read_platform_power_rail(device_sensors[s].index);
+          fresh |= FRESH_POWER;
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  return fresh;
+}
+
+// whether a stream is due at sample seq; deadlines skipped by overruns do not
+// delay the stream, which is read at the first sample past its due one
+static int stream_due(stream_rate_t *rate, uint64_t seq) {
+  if (seq < rate->next_seq)
+    return 0;
+  rate->next_seq = (seq / rate->divider + 1) * rate->divider;
+  return 1;
+}
+
+// per each core: CPU freq, CPU counter values (if multiplexed, those of all the
+// sets, the ones of the sets not counted being 0)
+static size_t serialize_core(uint8_t *dst, unsigned int core_id, unsigned int set_id_cpu) {
+  uint8_t *ptr = dst;
+  if (!profiler_config.cpu)
+    return 0;
+  memcpy(ptr, &cpu_events.core[core_id].freq_read, sizeof(uint32_t));
+  ptr += sizeof(uint32_t);
+  for (int s = 0; s < cpu_events.core[core_id].num_sets; s++) {
+    cpu_counter_set_t *counter_set = &cpu_events.core[core_id].counter_set[s];
+    if (s == set_id_cpu)
+      memcpy(ptr, counter_set->counter, sizeof(cpu_counter_t) * counter_set->num_counters);
+    else if (cpu_mux())
+      memset(ptr, 0, sizeof(cpu_counter_t) * counter_set->num_counters);
+    else
+      continue;
+    ptr += sizeof(cpu_counter_t) * counter_set->num_counters;
+  }
+  memcpy(ptr, &cpu_events.core[core_id].counter_clk, sizeof(uint64_t));
+  ptr += sizeof(uint64_t);
+  return ptr - dst;
+}
 
-  while(!(*thread_args->signal)) {
-    // start overhead measurement
-    if (thread_args->thread_id == 0)
-      clock_gettime(CLOCK_REALTIME, &timestamp_a);
-
-#if CPU
-    // sample CPU counters
-    read_counters_cpu_core(thread_args->thread_id, thread_args->set_id_cpu);
-    reset_counters_cpu_core();
-    // sample current CPU frequency
-    read_cpu_core_freq(thread_args->thread_id);
-#endif
-#if GPU
-    if (thread_args->thread_id == 0) {
-      // sample GPU counters (reset on read)
-      read_counters_gpu(thread_args->set_id_gpu);
-      // sample current GPU frequency
-      read_gpu_freq();
+// device sensors assigned to a thread, in trace order: GPU freq; per each group:
+// per each instance: GPU counter values; power measures
+static size_t serialize_devices(uint8_t *dst, unsigned int thread_id, unsigned int set_id_gpu) {
+  uint8_t *ptr = dst;
+  for (unsigned int s = 0; s < num_device_sensors; s++) {
+    if (device_sensors[s].thread_id != thread_id)
+      continue;
+    switch (device_sensors[s].kind) {
+      case SENSOR_GPU_FREQ:
+        memcpy(ptr, &gpu_events.freq_read, sizeof(uint32_t));
+        ptr += sizeof(uint32_t);
+        break;
+      case SENSOR_GPU_COUNTERS:
+        ptr += serialize_counters_gpu(ptr, set_id_gpu);
+        break;
+      case SENSOR_POWER_RAIL:
+        memcpy(ptr, &platform_power.power_measures[device_sensors[s].index], sizeof(power_t));
+        ptr += sizeof(power_t);
+        break;
+      default:
+        break;
     }
-#endif
-
-    // fetch power measures
-    if (thread_args->thread_id == 0)
-      read_platform_power();
-
-    // wait for all cores to have sampled CPU counters
-    pthread_barrier_wait(thread_args->barrier);
-
-    // write trace: GPU freq, GPU ids+counters, power
-    if (thread_args->thread_id == 0) {
-#if CPU
-      // per each core: CPU freq, CPU counter values
-      for(int c = 0; c < cpu_events.num_cores; c++) {
-        fwrite(&cpu_events.core[c].freq_read, sizeof(uint32_t), 1, thread_args->trace_file);
-        fwrite(cpu_events.core[c].counter_set[thread_args->set_id_cpu].counter, sizeof(cpu_counter_t), cpu_events.core[c].counter_set[thread_args->set_id_cpu].num_counters, thread_args->trace_file);
-#ifdef __JETSON_AGX_XAVIER
-        fwrite(&cpu_events.core[c].counter_clk, sizeof(uint64_t), 1, thread_args->trace_file);
-#endif
+  }
+  return ptr - dst;
+}
+
+// bytes of a sample merged by serialize_sample
+static size_t merged_sample_bytes(profiler_args_t *thread_args) {
+  size_t bytes = core_record_bytes(thread_args->set_id_cpu) * thread_args->num_threads;
+  for (unsigned int s = 0; s < num_device_sensors; s++)
+    bytes += device_sensors[s].bytes;
+  // live set of each core, if multiplexed
+  if (cpu_mux())
+    bytes += sizeof(uint32_t) * thread_args->num_threads;
+  // sampling time, deadline, wake time, fresh flags
+  return bytes + 3 * sizeof(uint64_t) + sizeof(uint32_t);
+}
+
+// fields of a merged sample, in the order of serialize_sample; counters hold the
+// events since the previous read (differences of the free-running PMU counters,
+// GPU counters reset on read) and are stored as plain varints, slowly varying
+// values (e.g., frequencies, power, timestamps) as deltas
+static void build_trace_schema(profiler_args_t *thread_args, trace_schema_t *schema) {
+  char name[TRACE_COLUMN_NAME_LEN];
+  trace_schema_init(schema);
+  if (profiler_config.cpu) {
+    for (int c = 0; c < cpu_events.num_cores; c++) {
+      sprintf(name, "cpu%d.freq", c);
+      trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+      for (int s = 0; s < cpu_events.core[c].num_sets; s++) {
+        cpu_counter_set_t *counter_set = &cpu_events.core[c].counter_set[s];
+        if (s != thread_args->set_id_cpu && !cpu_mux())
+          continue;
+        for (int e = 0; e < counter_set->num_counters; e++) {
+          sprintf(name, "cpu%d.0x%02x", c, counter_set->event_id[e]);
+          trace_schema_add(schema, name, sizeof(cpu_counter_t), TRACE_ENCODING_VARINT);
+        }
       }
-#endif
-#if GPU
-#ifdef __JETSON_AGX_XAVIER
-      // GPU freq, per each group: per each instance: GPU counter values
-      fwrite(&gpu_events.freq_read, sizeof(uint32_t), 1, thread_args->trace_file);
-      for (int g = 0; g < gpu_events.event_group_sets->sets[thread_args->set_id_gpu].numEventGroups; g++)
-        fwrite(gpu_events.counters_buffer[g], sizeof(gpu_counter_t), gpu_events.num_events_group[g] * gpu_events.num_instances_group[g], thread_args->trace_file);
-#else
-#error "Platform not supported."
-#endif
-#endif
-      // power measures
-      fwrite(platform_power.power_measures, sizeof(power_t), platform_power.num_power_rails, thread_args->trace_file);
+      sprintf(name, "cpu%d.clk", c);
+      trace_schema_add(schema, name, sizeof(uint64_t), TRACE_ENCODING_VARINT);
+    }
+  }
+  for (unsigned int s = 0; s < num_device_sensors; s++) {
+    switch (device_sensors[s].kind) {
+      case SENSOR_GPU_FREQ:
+        trace_schema_add(schema, "gpu.freq", sizeof(uint32_t), TRACE_ENCODING_DELTA);
+        break;
+      case SENSOR_GPU_COUNTERS:
+        trace_columns_gpu(schema, thread_args->set_id_gpu);
+        break;
+      case SENSOR_POWER_RAIL:
+        sprintf(name, "power%u", device_sensors[s].index);
+        trace_schema_add(schema, name, sizeof(power_t), TRACE_ENCODING_DELTA);
+        break;
+      default:
+        break;
     }
+  }
+  trace_schema_add(schema, "sampling_time", sizeof(uint64_t), TRACE_ENCODING_VARINT);
+  trace_schema_add(schema, "deadline_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "wake_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "fresh", sizeof(uint32_t), TRACE_ENCODING_VARINT);
+  for (int c = 0; c < cpu_events.num_cores && cpu_mux(); c++) {
+    sprintf(name, "cpu%d.set", c);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+  }
+}
 
-    // sync before measuring time
-    pthread_barrier_wait(thread_args->barrier);
-
-    if (thread_args->thread_id == 0) {
-      // stop overhead measurement
-      clock_gettime(CLOCK_REALTIME, &timestamp_b);
-      sampling_time = (timestamp_b.tv_sec - timestamp_a.tv_sec) * 1e9 + (timestamp_b.tv_nsec - timestamp_a.tv_nsec);
-      // dump overhead measurement to trace file
-      fwrite(&sampling_time, sizeof(uint64_t), 1, thread_args->trace_file); // nanoseconds, ns
-      // count remaining time to sampling period and sleep
-      if (sampling_time / 1000 < SAMPLE_PERIOD_US)
-        usleep(SAMPLE_PERIOD_US - sampling_time / 1000);
+// v1 header: event ids and sampling periods; trace version 2 embeds it in its own header
+static void write_trace_header(profiler_args_t *thread_args, trace_output_t *output) {
+  uint32_t sampling_period_us = profiler_config.sample_period_us;
+  uint32_t power_period_us = sampling_period_us * stream_divider(profiler_config.power_period_us);
+  uint32_t freq_period_us = sampling_period_us * stream_divider(profiler_config.freq_period_us);
+  char *header;
+  size_t header_bytes;
+  FILE *stream = open_memstream(&header, &header_bytes);
+  if (stream == NULL) {
+    perror("open_memstream");
+    printf("%s:%d: failed to open trace header stream.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  if (profiler_config.cpu) {
+    fwrite(&cpu_events.num_cores, sizeof(uint32_t), 1, stream);
+    for (int c = 0; c < cpu_events.num_cores; c++) {
+      uint32_t num_counters = core_num_counters(c, thread_args->set_id_cpu);
+      fwrite(&num_counters, sizeof(uint32_t), 1, stream);
+      // if multiplexed, the events of all the sets, set after set
+      for (int s = 0; s < cpu_events.core[c].num_sets; s++)
+        if (s == thread_args->set_id_cpu || cpu_mux())
+          fwrite(cpu_events.core[c].counter_set[s].event_id, sizeof(cpu_event_id_t) * cpu_events.core[c].counter_set[s].num_counters, 1, stream);
     }
+  }
+  if (profiler_config.gpu)
+    trace_header_gpu(stream, thread_args->set_id_gpu);
+  fwrite(&platform_power.num_power_rails, sizeof(uint32_t), 1, stream);
+  fwrite(&sampling_period_us, sizeof(uint32_t), 1, stream);
+  // effective periods of power rails and frequencies (multiples of the sampling period)
+  fwrite(&power_period_us, sizeof(uint32_t), 1, stream);
+  fwrite(&freq_period_us, sizeof(uint32_t), 1, stream);
+  fclose(stream);
+  if (profiler_config.trace_version == TRACE_VERSION_COLUMNAR)
+    trace_write_header_v2(&output->writer, &output->schema, header, header_bytes);
+  else
+    trace_write_header_v1(&output->writer, header, header_bytes);
+  free(header);
+}
+
+// footer of the trace: the first sample of each run is set while merging the samples
+static void init_trace_footer(profiler_args_t *thread_args, trace_output_t *output) {
+  trace_footer_t *footer = &output->footer;
+  footer->trace_version = profiler_config.trace_version;
+  footer->devices = (profiler_config.cpu ? TRACE_DEVICE_CPU : 0) | (profiler_config.gpu ? TRACE_DEVICE_GPU : 0);
+  footer->flags = cpu_mux() ? TRACE_FLAG_CPU_MUX : 0;
+  if (profiler_config.cpu && sizeof(cpu_counter_t) == sizeof(uint64_t))
+    footer->flags |= TRACE_FLAG_CPU_COUNTERS_64;
+  footer->mux_samples = cpu_mux() ? profiler_config.mux_samples : 0;
+  footer->mux_set_counters = cpu_mux() ? cpu_events.core[0].counter_set[0].num_counters : 0;
+  footer->num_runs = thread_args->runs->num_run;
+  footer->num_samples = 0;
+  footer->sample_bytes = output->schema.sample_bytes;
+  footer->data_offset = output->writer.offset;
+  footer->runs = (trace_run_t *)calloc(footer->num_runs, sizeof(trace_run_t));
+  if (footer->runs == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  footer->num_blocks = 0;
+  footer->block_offsets = NULL;
+  output->next_run = 0;
+}
 
-    // sync before new iteration
-    pthread_barrier_wait(thread_args->barrier);
+// complete the footer with the run times set by main, and write it
+static void write_trace_footer(profiler_args_t *thread_args, trace_output_t *output) {
+  profiler_runs_t *runs = thread_args->runs;
+  trace_footer_t *footer = &output->footer;
+  unsigned int num_ended = atomic_load(&runs->num_ended);
+  // runs with no sample start at the end of the trace
+  while (output->next_run < footer->num_runs)
+    footer->runs[output->next_run++].first_sample = footer->num_samples;
+  for (unsigned int r = 0; r < footer->num_runs; r++) {
+    footer->runs[r].start_ns = r < num_ended ? runs->start_ns[r] : 0;
+    footer->runs[r].wall_ns = r < num_ended ? runs->end_ns[r] - runs->start_ns[r] : 0;
   }
+  if (profiler_config.trace_version == TRACE_VERSION_COLUMNAR) {
+    footer->num_blocks = output->encoder.num_blocks;
+    footer->block_offsets = output->encoder.block_offsets;
+  }
+  trace_write_footer(&output->writer, footer);
+  free(footer->runs);
+}
 
-#if CPU
-  // de-init CPU PMU
-  disable_pmu_cpu_core();
-#endif
-#if GPU
-  if (thread_args->thread_id == 0) {
-    // de-init GPU PMU
-    disable_pmu_gpu(thread_args->set_id_gpu);
-  }
-#endif
-  return (void *)NULL;
+// serialize one sample merged from the records of all sampler threads (same seq),
+// in v1 layout; return its size
+static size_t serialize_sample(profiler_args_t *thread_args, uint8_t *dst, sample_header_t **records) {
+  uint8_t *ptr = dst;
+  uint64_t wake_ns = records[0]->wake_ns;
+  uint64_t end_ns = records[0]->end_ns;
+  uint64_t sampling_time;
+  size_t device_offset[thread_args->num_threads];
+  uint32_t fresh = 0;
+  // per each core: CPU freq, CPU counter values
+  for (int t = 0; t < thread_args->num_threads; t++) {
+    memcpy(ptr, records[t] + 1, records[t]->core_bytes);
+    ptr += records[t]->core_bytes;
+    if (records[t]->wake_ns < wake_ns)
+      wake_ns = records[t]->wake_ns;
+    if (records[t]->end_ns > end_ns)
+      end_ns = records[t]->end_ns;
+    fresh |= records[t]->fresh;
+  }
+  // GPU freq, GPU counters, power: gather each device sensor, in trace order,
+  // from the record of the thread that read it
+  for (int t = 0; t < thread_args->num_threads; t++)
+    device_offset[t] = records[t]->core_bytes;
+  for (unsigned int s = 0; s < num_device_sensors; s++) {
+    unsigned int t = device_sensors[s].thread_id;
+    memcpy(ptr, (uint8_t *)(records[t] + 1) + device_offset[t], device_sensors[s].bytes);
+    ptr += device_sensors[s].bytes;
+    device_offset[t] += device_sensors[s].bytes;
+  }
+  // overhead measurement: from first wake-up to last end of sampling among threads
+  sampling_time = end_ns - wake_ns;
+  memcpy(ptr, &sampling_time, sizeof(uint64_t)); // nanoseconds, ns
+  ptr += sizeof(uint64_t);
+  // scheduled deadline and actual (earliest) wake time of this sample
+  memcpy(ptr, &records[0]->deadline_ns, sizeof(uint64_t)); // CLOCK_MONOTONIC, ns
+  ptr += sizeof(uint64_t);
+  memcpy(ptr, &wake_ns, sizeof(uint64_t)); // CLOCK_MONOTONIC, ns
+  ptr += sizeof(uint64_t);
+  // streams refreshed in this sample: the timestamp of a fresh value is the sample deadline
+  memcpy(ptr, &fresh, sizeof(uint32_t)); // FRESH_* flags
+  ptr += sizeof(uint32_t);
+  // event set counted by each core, if multiplexed
+  for (int t = 0; t < thread_args->num_threads && cpu_mux(); t++) {
+    memcpy(ptr, &records[t]->set_cpu, sizeof(uint32_t));
+    ptr += sizeof(uint32_t);
+  }
+  return ptr - dst;
+}
+
+// merge all the records available in every ring, aligned by sequence number;
+// records whose sequence number is missing in some ring (e.g., dropped or skipped
+// by a late thread) are discarded; return the number of discarded records
+static uint64_t merge_rings(profiler_args_t *thread_args, trace_output_t *output) {
+  sample_header_t *records[thread_args->num_threads];
+  uint64_t num_discarded = 0;
+  while (1) {
+    uint64_t max_seq = 0;
+    int aligned = 1;
+    for (int t = 0; t < thread_args->num_threads; t++) {
+      records[t] = (sample_header_t *)ring_front(&thread_args->rings[t]);
+      if (records[t] == NULL)
+        return num_discarded;
+      if (records[t]->seq > max_seq)
+        max_seq = records[t]->seq;
+    }
+    for (int t = 0; t < thread_args->num_threads; t++) {
+      if (records[t]->seq < max_seq) {
+        ring_pop(&thread_args->rings[t]);
+        num_discarded++;
+        aligned = 0;
+      }
+    }
+    if (!aligned)
+      continue;
+    size_t sample_bytes = serialize_sample(thread_args, output->sample, records);
+    if (thread_args->online_model != NULL)
+      online_model_add(thread_args->online_model, output->sample);
+    if (thread_args->estimator != NULL)
+      estimator_add(thread_args->estimator, output->sample);
+    // the sample opens every run started since the previous sample (threads may
+    // disagree on the run at its boundary: the latest one wins)
+    uint32_t run = 0;
+    for (int t = 0; t < thread_args->num_threads; t++)
+      if (records[t]->run > run)
+        run = records[t]->run;
+    while (output->next_run <= run && output->next_run < output->footer.num_runs)
+      output->footer.runs[output->next_run++].first_sample = output->footer.num_samples;
+    output->footer.num_samples++;
+    if (profiler_config.trace_version == TRACE_VERSION_COLUMNAR)
+      trace_encoder_add(&output->encoder, &output->writer, output->sample);
+    else
+      trace_writer_write(&output->writer, output->sample, sample_bytes);
+    for (int t = 0; t < thread_args->num_threads; t++)
+      ring_pop(&thread_args->rings[t]);
+  }
 }
@@ -0,0 +1,76 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+// voltmeter libraries
+#include <ring.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void ring_init(spsc_ring_t *ring, size_t capacity, size_t elem_size) {
+  // round capacity up to a power of 2, element size up to 8 bytes
+  size_t cap = 1;
+  while (cap < capacity)
+    cap <<= 1;
+  ring->capacity = cap;
+  ring->elem_size = (elem_size + 7) & ~(size_t)7;
+  ring->dropped = 0;
+  ring->buffer = (uint8_t *)aligned_alloc(RING_CACHE_LINE, (ring->capacity * ring->elem_size + RING_CACHE_LINE - 1) & ~(size_t)(RING_CACHE_LINE - 1));
+  if (ring->buffer == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  // prefault ring memory before sampling
+  memset(ring->buffer, 0, ring->capacity * ring->elem_size);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->head, 0);
+}
+
+void ring_free(spsc_ring_t *ring) {
+  free(ring->buffer);
+  ring->buffer = NULL;
+}
+
+// get the next free slot to fill, or NULL if the ring is full (never blocks)
+void *ring_reserve(spsc_ring_t *ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head == ring->capacity) {
+    ring->dropped++;
+    return NULL;
+  }
+  return ring->buffer + (tail & (ring->capacity - 1)) * ring->elem_size;
+}
+
+// publish the slot obtained with ring_reserve
+void ring_commit(spsc_ring_t *ring) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+// get the oldest element, or NULL if the ring is empty
+void *ring_front(spsc_ring_t *ring) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head == tail)
+    return NULL;
+  return ring->buffer + (head & (ring->capacity - 1)) * ring->elem_size;
+}
+
+// release the element obtained with ring_front
+void ring_pop(spsc_ring_t *ring) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
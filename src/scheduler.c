@@ -0,0 +1,102 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+// voltmeter libraries
+#include <helper.h>
+#include <scheduler.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                     Sampler clock                     │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// current time of the monotonic clock (nanoseconds)
+uint64_t monotonic_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void sampler_clock_init(sampler_clock_t *clock, uint64_t epoch_ns, uint64_t period_ns) {
+  clock->epoch_ns = epoch_ns;
+  clock->period_ns = period_ns;
+  clock->seq = 0;
+  clock->overruns = 0;
+}
+
+// sleep until the next absolute deadline (epoch + seq * period); deadlines are
+// never computed from the previous wake time, so sleep overshoot and sampling
+// time do not accumulate into period drift; return the actual wake time
+uint64_t sampler_clock_wait(sampler_clock_t *clock, uint64_t *deadline_ns) {
+  uint64_t deadline = clock->epoch_ns + clock->seq * clock->period_ns;
+  uint64_t now = monotonic_ns();
+  // skip deadlines elapsed by more than a period, to keep the sampling phase
+  if (now > deadline + clock->period_ns) {
+    uint64_t skip = (now - deadline) / clock->period_ns;
+    clock->seq += skip;
+    clock->overruns += skip;
+    deadline += skip * clock->period_ns;
+  }
+  if (now < deadline) {
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+    now = monotonic_ns();
+  }
+  clock->seq++;
+  *deadline_ns = deadline;
+  return now;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                    Real-time setup                    │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// lock current and future memory of the process to prevent page faults while sampling
+void setup_realtime(FILE *log_file) {
+  if (mlockall(MCL_CURRENT | MCL_FUTURE)) {
+    perror("mlockall");
+    printf("%s:%d: failed to lock memory for real-time sampling.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  printf_file(log_file, "Real-time sampling: SCHED_FIFO priority %d, memory locked\n", SAMPLER_RT_PRIORITY);
+}
+
+// set SCHED_FIFO policy in the attributes of a profiler thread
+void set_realtime_attr(pthread_attr_t *attr) {
+  struct sched_param param;
+  memset(&param, 0, sizeof(param));
+  param.sched_priority = SAMPLER_RT_PRIORITY;
+  pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+  pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+  pthread_attr_setschedparam(attr, &param);
+}
+
+// touch the stack of the calling thread so that it is mapped before sampling
+void __attribute__((noinline)) prefault_stack() {
+  volatile unsigned char stack[SAMPLER_PREFAULT_STACK];
+  memset((unsigned char *)stack, 0, SAMPLER_PREFAULT_STACK);
+}
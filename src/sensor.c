@@ -0,0 +1,176 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+// voltmeter libraries
+#include <sensor.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Globals                        ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static const char *sysfs_root = NULL;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                      Sysfs root                       │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// override the root prepended to all sysfs paths
+void sensor_set_root(const char *root) {
+  sysfs_root = root;
+}
+
+// sysfs root: set with sensor_set_root, or from SENSOR_ROOT_ENV, or empty
+const char *sensor_root() {
+  if (sysfs_root == NULL) {
+    sysfs_root = getenv(SENSOR_ROOT_ENV);
+    if (sysfs_root == NULL)
+      sysfs_root = "";
+  }
+  return sysfs_root;
+}
+
+// prepend the sysfs root to an absolute sysfs path
+char *sensor_path(const char *path, char *full_path) {
+  int len = snprintf(full_path, SENSOR_PATH_LEN, "%s%s", sensor_root(), path);
+  if (len >= SENSOR_PATH_LEN) {
+    printf("%s:%d: sensor path too long '%s%s'.\n", __FILE__, __LINE__, sensor_root(), path);
+    exit(1);
+  }
+  return full_path;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                    Sensor handles                     │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+void sensor_open(sensor_t *sensor, const char *path) {
+  sensor_path(path, sensor->path);
+  sensor->fd = open(sensor->path, O_RDONLY | O_CLOEXEC);
+  if (sensor->fd < 0) {
+    perror("open");
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, sensor->path);
+    exit(1);
+  }
+}
+
+// open the sensor if its node exists (e.g., an optional driver); return 0 if
+// opened, 1 otherwise, with the handle closed
+int sensor_try_open(sensor_t *sensor, const char *path) {
+  sensor_path(path, sensor->path);
+  sensor->fd = open(sensor->path, O_RDONLY | O_CLOEXEC);
+  return sensor->fd < 0;
+}
+
+void sensor_close(sensor_t *sensor) {
+  if (sensor->fd >= 0)
+    close(sensor->fd);
+  sensor->fd = -1;
+}
+
+// read an unsigned integer from the sensor: a single pread at offset 0, no stdio
+uint32_t sensor_read_u32(sensor_t *sensor) {
+  uint32_t value;
+  ssize_t len = pread(sensor->fd, sensor->buf, SENSOR_BUF_LEN, 0);
+  if (len < 0) {
+    perror("pread");
+    printf("%s:%d: failed to read file '%s'.\n", __FILE__, __LINE__, sensor->path);
+    exit(1);
+  }
+  if (sensor_parse_u32(sensor->buf, len, &value)) {
+    printf("%s:%d: failed to parse file '%s'.\n", __FILE__, __LINE__, sensor->path);
+    exit(1);
+  }
+  return value;
+}
+
+// parse a decimal unsigned integer (leading whitespace allowed); return 0 on success
+int sensor_parse_u32(const char *buf, size_t len, uint32_t *value) {
+  size_t i = 0;
+  uint32_t v = 0;
+  while (i < len && (buf[i] == ' ' || buf[i] == '\t'))
+    i++;
+  if (i == len || buf[i] < '0' || buf[i] > '9')
+    return 1;
+  while (i < len && buf[i] >= '0' && buf[i] <= '9') {
+    v = v * 10 + (uint32_t)(buf[i] - '0');
+    i++;
+  }
+  *value = v;
+  return 0;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                      Sysfs knobs                      │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// write a string to a sysfs node (e.g., a DVFS knob); knobs are written rarely, not kept open
+void sensor_write(const char *path, const char *value) {
+  char full_path[SENSOR_PATH_LEN];
+  sensor_path(path, full_path);
+  int fd = open(full_path, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    perror("open");
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, full_path);
+    exit(1);
+  }
+  ssize_t len = write(fd, value, strlen(value));
+  if (len != (ssize_t)strlen(value)) {
+    perror("write");
+    printf("%s:%d: failed to write '%s' to file '%s'.\n", __FILE__, __LINE__, value, full_path);
+    exit(1);
+  }
+  close(fd);
+}
+
+void sensor_write_u32(const char *path, uint32_t value) {
+  char buf[SENSOR_BUF_LEN];
+  sprintf(buf, "%u", value);
+  sensor_write(path, buf);
+}
+
+// largest integer of a whitespace-separated list (e.g., available_frequencies)
+uint32_t sensor_read_max_u32(const char *path) {
+  char full_path[SENSOR_PATH_LEN];
+  uint32_t value, max_value = 0;
+  int num_values = 0;
+  FILE *fp = fopen(sensor_path(path, full_path), "r");
+  if (fp == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, full_path);
+    exit(1);
+  }
+  while (fscanf(fp, "%u", &value) == 1) {
+    if (value > max_value)
+      max_value = value;
+    num_values++;
+  }
+  fclose(fp);
+  if (num_values == 0) {
+    printf("%s:%d: no values in file '%s'.\n", __FILE__, __LINE__, full_path);
+    exit(1);
+  }
+  return max_value;
+}
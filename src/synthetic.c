@@ -0,0 +1,279 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Synthetic backend: a workload of phases of SYNTHETIC_PHASE_SAMPLES sampling
+// periods, each with its own activity, drives the clock cycles of all the cores,
+// the rate of every event and the power of every rail. A value is a hash of the
+// seed, of the stream (e.g., core and event), and of the index of the read since
+// the counters were enabled: the counters and power of a trace do not depend on
+// the timing of the sampler threads, nor on the machine.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+// voltmeter libraries
+#include <backend.h>
+#include <platform.h>
+#include <profiler.h>
+#include <cpu.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// streams of the hash
+#define STREAM_PHASE      1
+#define STREAM_CLK        2
+#define STREAM_EVENT_RATE 3
+#define STREAM_EVENT      4
+#define STREAM_RAIL_BASE  5
+#define STREAM_RAIL_DYN   6
+#define STREAM_RAIL       7
+
+// relative noise of every read
+#define SYNTHETIC_NOISE 0.02
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Extern                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+extern cpu_events_freq_config_t cpu_events;
+extern profiler_config_t profiler_config;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static void synthetic_probe_pmu_cpu(cpu_pmu_t *pmu);
+static void synthetic_enable_pmu_cpu_core(unsigned int core_id, unsigned int set_id);
+static void synthetic_program_pmu_cpu_core(unsigned int core_id, unsigned int set_id);
+static void synthetic_disable_pmu_cpu_core(unsigned int core_id);
+static void synthetic_read_counters_cpu_core(unsigned int core_id, unsigned int set_id);
+static uint64_t synthetic_cpu_max_read_period_us();
+static unsigned int synthetic_open_power_rails();
+static void synthetic_close_power_rails();
+static power_t synthetic_read_power_rail(unsigned int rail);
+static void synthetic_open_cpu_freq();
+static void synthetic_close_cpu_freq();
+static uint32_t synthetic_get_cpu_freq();
+static uint32_t synthetic_get_cpu_core_freq(unsigned int core_id);
+static uint32_t synthetic_set_cpu_freq(uint32_t freq);
+static uint32_t synthetic_clip_cpu_freq(uint32_t freq);
+static uint64_t mix(uint64_t x);
+static double uniform(uint64_t stream, uint64_t a, uint64_t b);
+static double noise(uint64_t stream, uint64_t a, uint64_t b);
+static double activity(uint64_t sample);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Globals                        ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// no GPU: its event groups are defined by CUPTI
+const backend_t backend_synthetic = {
+  .name = BACKEND_SYNTHETIC,
+  .has_gpu = 0,
+  // CPU counters
+  .probe_pmu_cpu = synthetic_probe_pmu_cpu,
+  .enable_pmu_cpu_core = synthetic_enable_pmu_cpu_core,
+  .program_pmu_cpu_core = synthetic_program_pmu_cpu_core,
+  .disable_pmu_cpu_core = synthetic_disable_pmu_cpu_core,
+  .read_counters_cpu_core = synthetic_read_counters_cpu_core,
+  .cpu_max_read_period_us = synthetic_cpu_max_read_period_us,
+  // power rails
+  .open_power_rails = synthetic_open_power_rails,
+  .close_power_rails = synthetic_close_power_rails,
+  .read_power_rail = synthetic_read_power_rail,
+  // frequency sources
+  .open_cpu_freq = synthetic_open_cpu_freq,
+  .close_cpu_freq = synthetic_close_cpu_freq,
+  .get_cpu_freq = synthetic_get_cpu_freq,
+  .get_cpu_core_freq = synthetic_get_cpu_core_freq,
+  .set_cpu_freq = synthetic_set_cpu_freq,
+  .clip_cpu_freq = synthetic_clip_cpu_freq
+};
+
+static uint64_t synthetic_seed = DEFAULT_SYNTHETIC_SEED;
+// frequency set, the same for all cores (Hz)
+static uint32_t synthetic_cpu_freq = SYNTHETIC_MAX_CPU_FREQ * 1000U;
+// reads since the counters were enabled, each written by one sampler thread only
+static uint64_t *core_reads = NULL;
+static uint64_t rail_reads[SYNTHETIC_NUM_POWER_RAILS];
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+void synthetic_init(uint64_t seed) {
+  synthetic_seed = seed;
+  synthetic_cpu_freq = SYNTHETIC_MAX_CPU_FREQ * 1000U;
+  free(core_reads);
+  core_reads = (uint64_t *)calloc(get_cpu_num_cores(), sizeof(uint64_t));
+  if (core_reads == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  memset(rail_reads, 0, sizeof(rail_reads));
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                     CPU counters                      │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// as many counters as the platform profiles per set, all the common events
+static void synthetic_probe_pmu_cpu(cpu_pmu_t *pmu) {
+  pmu->num_counters = NUM_COUNTERS_CPU;
+  pmu->common_events = ~0ULL;
+}
+
+// a trace starts when the counters are enabled: core 0 also restarts the power
+// rails, which are read by the sampler threads only after the start barrier
+static void synthetic_enable_pmu_cpu_core(unsigned int core_id, unsigned int set_id) {
+  core_reads[core_id] = 0;
+  if (core_id == 0)
+    memset(rail_reads, 0, sizeof(rail_reads));
+}
+
+static void synthetic_program_pmu_cpu_core(unsigned int core_id, unsigned int set_id) {
+}
+
+static void synthetic_disable_pmu_cpu_core(unsigned int core_id) {
+}
+
+// the clock cycles of a period at the activity of its phase; each event counts at
+// its own rate per cycle, scaled by its intensity in the phase (cycles events
+// count the clock cycles)
+static void synthetic_read_counters_cpu_core(unsigned int core_id, unsigned int set_id) {
+  cpu_core_events_t *core = &cpu_events.core[core_id];
+  cpu_counter_set_t *counter_set = &core->counter_set[set_id];
+  uint64_t read = core_reads[core_id]++;
+  uint64_t phase = read / SYNTHETIC_PHASE_SAMPLES;
+  double period_s = profiler_config.sample_period_us * 1e-6;
+  double clk = synthetic_cpu_freq * period_s * activity(read) * noise(STREAM_CLK, core_id, read);
+  core->counter_clk = (uint64_t)clk;
+  for (int i = 0; i < counter_set->num_counters; i++) {
+    cpu_event_id_t event = counter_set->event_id[i];
+    if (event == CPU_EVENT_CYCLES) {
+      counter_set->counter[i] = core->counter_clk;
+      continue;
+    }
+    double rate = uniform(STREAM_EVENT_RATE, event, 0) * 2 * uniform(STREAM_EVENT_RATE, event, 1 + phase);
+    counter_set->counter[i] = (cpu_counter_t)(clk * rate * noise(STREAM_EVENT, ((uint64_t)core_id << 32) | event, read));
+  }
+}
+
+static uint64_t synthetic_cpu_max_read_period_us() {
+  return UINT64_MAX;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                      Power rails                      │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+static unsigned int synthetic_open_power_rails() {
+  memset(rail_reads, 0, sizeof(rail_reads));
+  return SYNTHETIC_NUM_POWER_RAILS;
+}
+
+static void synthetic_close_power_rails() {
+}
+
+// static power, plus dynamic power proportional to the clock cycles of the period
+// of the read (power is read every stream_divider periods), in mW
+static power_t synthetic_read_power_rail(unsigned int rail) {
+  uint64_t read = rail_reads[rail]++;
+  uint64_t sample = read * stream_divider(profiler_config.power_period_us);
+  double base_mw = 300 + 700 * uniform(STREAM_RAIL_BASE, rail, 0);
+  double dynamic_mw = 3000 * uniform(STREAM_RAIL_DYN, rail, 0);
+  double freq_ratio = (double)synthetic_cpu_freq / (SYNTHETIC_MAX_CPU_FREQ * 1000.0);
+  return (power_t)((base_mw + dynamic_mw * activity(sample) * freq_ratio) * noise(STREAM_RAIL, rail, read));
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                   Frequency sources                   │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+static void synthetic_open_cpu_freq() {
+}
+
+static void synthetic_close_cpu_freq() {
+}
+
+static uint32_t synthetic_get_cpu_freq() {
+  return synthetic_cpu_freq;
+}
+
+static uint32_t synthetic_get_cpu_core_freq(unsigned int core_id) {
+  return synthetic_cpu_freq;
+}
+
+// kHz, 0 selects the max; return the frequency set, in Hz
+static uint32_t synthetic_set_cpu_freq(uint32_t freq) {
+  if (freq == 0 || freq > SYNTHETIC_MAX_CPU_FREQ)
+    freq = SYNTHETIC_MAX_CPU_FREQ;
+  synthetic_cpu_freq = freq * 1000;
+  return synthetic_cpu_freq;
+}
+
+// any frequency is available
+static uint32_t synthetic_clip_cpu_freq(uint32_t freq) {
+  return freq;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Streams                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// splitmix64 finalizer
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+// in [0, 1), the same for the same seed, stream and indices
+static double uniform(uint64_t stream, uint64_t a, uint64_t b) {
+  uint64_t x = mix(synthetic_seed ^ mix(stream ^ mix(a ^ mix(b))));
+  return (x >> 11) * 0x1.0p-53;
+}
+
+// multiplicative noise of a read, around 1
+static double noise(uint64_t stream, uint64_t a, uint64_t b) {
+  return 1 + SYNTHETIC_NOISE * (2 * uniform(stream, a, b) - 1);
+}
+
+// fraction of the cycles the cores are busy in the phase of a sample
+static double activity(uint64_t sample) {
+  return 0.1 + 0.9 * uniform(STREAM_PHASE, sample / SYNTHETIC_PHASE_SAMPLES, 0);
+}
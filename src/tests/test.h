@@ -0,0 +1,46 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+#ifndef _TEST_H
+#define _TEST_H
+
+#include <stdio.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// check a condition of a unit test, counting the failures in test_failures
+#define TEST_CHECK(cond) do { \
+    if (!(cond)) { \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+// check two unsigned integers for equality, printing both if they differ
+#define TEST_CHECK_EQ(a, b) do { \
+    unsigned long long _a = (unsigned long long)(a), _b = (unsigned long long)(b); \
+    if (_a != _b) { \
+      printf("%s:%d: check failed: %s == %s (0x%llx != 0x%llx)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+      test_failures++; \
+    } \
+  } while (0)
+
+// exit status of a unit test
+#define TEST_RESULT(name) (printf("%s: %s (%d failed checks)\n", name, test_failures ? "FAIL" : "ok", test_failures), test_failures ? 1 : 0)
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Globals                        ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static int test_failures = 0;
+
+#endif
@@ -0,0 +1,121 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Unit test: deltas of the free-running CPU counters between two reads (32-bit
+// event counters, 64-bit clock counter, across their wrap), their sum over long
+// sequences of reads against the true count, and scaling of the counts of
+// multiplexed counters by their enabled and running times.
+
+// standard includes
+#include <stdio.h>
+#include <stdint.h>
+// voltmeter libraries
+#include <cpu.h>
+#include <test.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// reads of the simulated sequences
+#define NUM_READS 100000
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// xorshift: deterministic events between two reads
+static uint64_t rng_state = 88172645463325252ULL;
+static uint64_t next_random() {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static void test_delta() {
+  // no wrap
+  TEST_CHECK_EQ(cpu_counter_delta(100, 350), 250);
+  // no event since the previous read
+  TEST_CHECK_EQ(cpu_counter_delta(0, 0), 0);
+  TEST_CHECK_EQ(cpu_counter_delta(0xdeadbeef, 0xdeadbeef), 0);
+  // a single wrap of the 32-bit counter
+  TEST_CHECK_EQ(cpu_counter_delta(0xFFFFFF00, 0x100), 0x200);
+  TEST_CHECK_EQ(cpu_counter_delta(0xFFFFFFFF, 0), 1);
+  // the largest delta a read can tell: one less than 2^32
+  TEST_CHECK_EQ(cpu_counter_delta(1, 0), 0xFFFFFFFF);
+}
+
+// a 32-bit counter read NUM_READS times while the true 64-bit count grows by up
+// to 2^32 - 1 events between reads, wrapping thousands of times: the sum of the
+// deltas is the true count
+static void test_delta_sequence() {
+  uint64_t total = 0, sum = 0;
+  uint32_t prev = 0;
+  for (unsigned int r = 0; r < NUM_READS; r++) {
+    // a read in 16 at the largest delta a read can tell
+    uint64_t events = r % 16 == 0 ? 0xFFFFFFFFULL : next_random() & 0xFFFFFFFFULL;
+    total += events;
+    uint32_t cur = (uint32_t)total;
+    sum += cpu_counter_delta(prev, cur);
+    prev = cur;
+  }
+  TEST_CHECK(total >> 32 > 1000);
+  TEST_CHECK_EQ(sum, total);
+}
+
+static void test_clk_delta() {
+  // beyond 32 bits: the clock counter is 64-bit
+  TEST_CHECK_EQ(cpu_counter_clk_delta(0x00000000FFFFFF00ULL, 0x0000000500000100ULL), 0x0000000400000200ULL);
+  TEST_CHECK_EQ(cpu_counter_clk_delta(0x123456789ULL, 0x123456789ULL), 0);
+  // wrap of the 64-bit counter
+  TEST_CHECK_EQ(cpu_counter_clk_delta(UINT64_MAX - 9, 10), 20);
+}
+
+// the 64-bit clock counter, from just before its wrap, read NUM_READS times
+// while it counts up to 2^40 - 1 cycles between reads (crossing 32-bit
+// boundaries at every read): the sum of the deltas is the true count
+static void test_clk_delta_sequence() {
+  uint64_t start = UINT64_MAX - (1ULL << 45);
+  uint64_t total = 0, sum = 0;
+  uint64_t prev = start;
+  for (unsigned int r = 0; r < NUM_READS; r++) {
+    total += next_random() & ((1ULL << 40) - 1);
+    uint64_t cur = start + total;
+    sum += cpu_counter_clk_delta(prev, cur);
+    prev = cur;
+  }
+  // the counter wrapped
+  TEST_CHECK(prev < start);
+  TEST_CHECK_EQ(sum, total);
+}
+
+static void test_scale() {
+  // never running: no estimate
+  TEST_CHECK_EQ(cpu_counter_scale(1000, 4000000, 0), 0);
+  TEST_CHECK_EQ(cpu_counter_scale(0, 0, 0), 0);
+  // running a quarter of the time enabled: 4 times the count
+  TEST_CHECK_EQ(cpu_counter_scale(1000, 4000000, 1000000), 4000);
+  TEST_CHECK_EQ(cpu_counter_scale(3, 3000, 1000), 9);
+  // always running (or running reported past enabled): the count itself
+  TEST_CHECK_EQ(cpu_counter_scale(1000, 4000000, 4000000), 1000);
+  TEST_CHECK_EQ(cpu_counter_scale(1000, 4000000, 4000001), 1000);
+  // large counts are scaled without overflow
+  TEST_CHECK_EQ(cpu_counter_scale(0xFFFFFFFFULL, 2000, 1000), 0x1FFFFFFFEULL);
+}
+
+int main(int argc, char **argv) {
+  test_delta();
+  test_delta_sequence();
+  test_clk_delta();
+  test_clk_delta_sequence();
+  test_scale();
+  return TEST_RESULT("test_cpu_counters");
+}
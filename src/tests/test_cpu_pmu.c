@@ -0,0 +1,135 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Unit test: discovery of the PMU capabilities from synthetic values of its
+// identification registers (PMCR_EL0, PMCEID0_EL0, PMCEID1_EL0), and packing of
+// the implemented events into sets of counters.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+// voltmeter libraries
+#include <cpu.h>
+#include <test.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// PMCR_EL0 of a Cortex-A57-like core: IMP 0x41, IDCODE 0x03, N counters, E set
+#define PMCR(n) ((0x41ULL << 24) | (0x03ULL << 16) | ((uint64_t)(n) << ARMV8_PMCR_N_SHIFT) | 0x1)
+
+#define MAX_EVENT_ID 0x45
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static void free_sets(cpu_counter_set_t *sets, unsigned int num_sets) {
+  for (int s = 0; s < num_sets; s++) {
+    free(sets[s].counter);
+    free(sets[s].event_id);
+  }
+  free(sets);
+}
+
+static void test_discover() {
+  cpu_pmu_t pmu;
+  // N=6; PMCEID bits 63:32 (events from 0x4000) must be ignored
+  cpu_pmu_discover(&pmu, PMCR(6), 0xFFFFFFFF00000005ULL, 0xFFFFFFFF80000001ULL);
+  TEST_CHECK_EQ(pmu.num_counters, 6);
+  TEST_CHECK_EQ(pmu.common_events, 0x8000000100000005ULL);
+  // N=0, no common event
+  cpu_pmu_discover(&pmu, PMCR(0), 0, 0);
+  TEST_CHECK_EQ(pmu.num_counters, 0);
+  TEST_CHECK_EQ(pmu.common_events, 0);
+  // N is 5 bits wide: the largest value is taken, the bits above are not
+  cpu_pmu_discover(&pmu, PMCR(ARMV8_MAX_COUNTERS) | (1ULL << (ARMV8_PMCR_N_SHIFT + 5)), 0xFFFFFFFF, 0xFFFFFFFF);
+  TEST_CHECK_EQ(pmu.num_counters, ARMV8_MAX_COUNTERS);
+  TEST_CHECK_EQ(pmu.common_events, UINT64_MAX);
+}
+
+static void test_implemented() {
+  cpu_pmu_t pmu;
+  cpu_pmu_discover(&pmu, PMCR(6), 0xFFFFFFFF00000005ULL, 0xFFFFFFFF80000001ULL);
+  // common events: PMCEID0 bits 0 and 2, PMCEID1 bits 0 and 31
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x00), 1);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x01), 0);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x02), 1);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x1f), 0);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x20), 1);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x21), 0);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x3f), 1);
+  // implementation defined events are assumed implemented, even with no common one
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, ARMV8_NUM_COMMON_EVENTS), 1);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0xff), 1);
+  cpu_pmu_discover(&pmu, PMCR(0), 0, 0);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, 0x11), 0);
+  TEST_CHECK_EQ(cpu_pmu_event_implemented(&pmu, ARMV8_NUM_COMMON_EVENTS), 1);
+}
+
+static void test_events() {
+  cpu_pmu_t pmu;
+  cpu_event_id_t events[MAX_EVENT_ID + 1];
+  cpu_pmu_discover(&pmu, PMCR(6), 0xFFFFFFFF00000005ULL, 0xFFFFFFFF80000001ULL);
+  // 0x00, 0x02, 0x20, 0x3f, then 0x40-0x45
+  unsigned int num_events = cpu_pmu_events(&pmu, MAX_EVENT_ID, events);
+  TEST_CHECK_EQ(num_events, 10);
+  TEST_CHECK_EQ(events[0], 0x00);
+  TEST_CHECK_EQ(events[1], 0x02);
+  TEST_CHECK_EQ(events[2], 0x20);
+  TEST_CHECK_EQ(events[3], 0x3f);
+  TEST_CHECK_EQ(events[4], 0x40);
+  TEST_CHECK_EQ(events[9], MAX_EVENT_ID);
+  // only the common events, none implemented
+  cpu_pmu_discover(&pmu, PMCR(0), 0, 0);
+  TEST_CHECK_EQ(cpu_pmu_events(&pmu, ARMV8_NUM_COMMON_EVENTS - 1, events), 0);
+}
+
+static void test_pack() {
+  cpu_event_id_t events[10] = {0x00, 0x02, 0x20, 0x3f, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45};
+  cpu_counter_set_t *sets;
+  unsigned int num_sets;
+  // 10 events on 6 counters: 2 sets, the last one padded with 2 clock cycles
+  num_sets = cpu_pmu_pack(10, events, 6, &sets);
+  TEST_CHECK_EQ(num_sets, 2);
+  for (int s = 0; s < num_sets; s++)
+    TEST_CHECK_EQ(sets[s].num_counters, 6);
+  for (int e = 0; e < 6; e++)
+    TEST_CHECK_EQ(sets[0].event_id[e], events[e]);
+  for (int e = 0; e < 4; e++)
+    TEST_CHECK_EQ(sets[1].event_id[e], events[6 + e]);
+  TEST_CHECK_EQ(sets[1].event_id[4], CPU_EVENT_CYCLES);
+  TEST_CHECK_EQ(sets[1].event_id[5], CPU_EVENT_CYCLES);
+  free_sets(sets, num_sets);
+  // as many events as counters: a single set, no padding
+  num_sets = cpu_pmu_pack(6, events, 6, &sets);
+  TEST_CHECK_EQ(num_sets, 1);
+  TEST_CHECK_EQ(sets[0].event_id[5], events[5]);
+  free_sets(sets, num_sets);
+  // a single counter: one set per event
+  num_sets = cpu_pmu_pack(10, events, 1, &sets);
+  TEST_CHECK_EQ(num_sets, 10);
+  TEST_CHECK_EQ(sets[9].event_id[0], events[9]);
+  free_sets(sets, num_sets);
+  // no event: no set
+  num_sets = cpu_pmu_pack(0, events, 6, &sets);
+  TEST_CHECK_EQ(num_sets, 0);
+  free_sets(sets, num_sets);
+}
+
+int main(int argc, char **argv) {
+  test_discover();
+  test_implemented();
+  test_events();
+  test_pack();
+  return TEST_RESULT("test_cpu_pmu");
+}
@@ -0,0 +1,200 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Check that Voltmeter traces are well formed: header, footer and block index
+// are consistent, every sample (v2: every block) decodes, sample deadlines are
+// increasing within each run and runs are ordered. Prints a summary of each trace.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <argp.h>
+// voltmeter libraries
+#include <scheduler.h>
+#include <trace.h>
+#include <trace_reader.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                  Argp configuration                   ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+const char *argp_program_version = "voltmeter-check 1.0";
+const char *argp_program_bug_address = "<smazzola@iis.ee.ethz.ch>";
+static char doc[] = "Check that Voltmeter traces are well formed and summarize them.";
+static char args_doc[] = "TRACE...";
+static struct argp_option options[] = {
+    {"devices", 'd', "DEVICES", 0, "Devices profiled in v1 traces without footer, separated by commas; DEVICES can contain 'cpu' and 'gpu'", 0},
+    {"quiet", 'q', 0, 0, "Only print the traces that are not well formed", 1},
+    {0}
+};
+
+struct arguments {
+  uint32_t devices;
+  int quiet;
+  char **traces;
+  int num_traces;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state);
+static int check_trace(const char *path, struct arguments *arguments);
+static void print_summary(trace_reader_t *reader, const char *path, uint64_t *run_samples, double seconds);
+
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Main                          ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+int main(int argc, char *argv[]) {
+  struct arguments arguments;
+  memset(&arguments, 0, sizeof(arguments));
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+  int num_bad = 0;
+  for (int i = 0; i < arguments.num_traces; i++)
+    num_bad += check_trace(arguments.traces[i], &arguments);
+  if (num_bad > 0)
+    printf("%d of %d trace(s) not well formed.\n", num_bad, arguments.num_traces);
+  return num_bad > 0 ? 1 : 0;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments *arguments = state->input;
+  switch (key) {
+    case 'd': {
+      char *devices = strdup(arg);
+      for (char *device = strtok(devices, ","); device != NULL; device = strtok(NULL, ",")) {
+        if (!strcmp(device, "cpu"))
+          arguments->devices |= TRACE_DEVICE_CPU;
+        else if (!strcmp(device, "gpu"))
+          arguments->devices |= TRACE_DEVICE_GPU;
+        else
+          argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      }
+      free(devices);
+      break;
+    }
+    case 'q':
+      arguments->quiet = 1;
+      break;
+    case ARGP_KEY_ARGS:
+      arguments->traces = state->argv + state->next;
+      arguments->num_traces = state->argc - state->next;
+      break;
+    case ARGP_KEY_NO_ARGS:
+      argp_usage(state);
+      break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+// return 1 if the trace is not well formed
+static int check_trace(const char *path, struct arguments *arguments) {
+  trace_reader_t reader;
+  trace_iter_t iter;
+  int ret;
+  if (trace_reader_open(&reader, path, arguments->devices)) {
+    printf("%s: %s\n", path, reader.error);
+    trace_reader_close(&reader);
+    return 1;
+  }
+  uint64_t *run_samples = (uint64_t *)calloc(reader.num_runs, sizeof(uint64_t));
+  if (run_samples == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+
+  // walk all the samples, run by run
+  uint64_t start = monotonic_ns();
+  uint64_t prev_deadline = 0;
+  uint64_t index = 0;
+  int bad = 0;
+  for (unsigned int r = 0; r < reader.num_runs && !bad; r++) {
+    // runs of merged traces come from different executions
+    trace_iter_run(&iter, &reader, r);
+    while ((ret = trace_iter_next(&iter)) > 0) {
+      uint64_t deadline = trace_deadline_ns(&reader, iter.sample);
+      if (run_samples[r] > 0 && deadline <= prev_deadline) {
+        snprintf(reader.error, TRACE_READER_ERROR_LEN, "deadline of sample %lu not after the previous one", index);
+        bad = 1;
+        break;
+      }
+      for (unsigned int c = 0; c < reader.num_cores && (reader.flags & TRACE_FLAG_CPU_MUX); c++) {
+        if (trace_mux_set(&reader, iter.sample, c) >= reader.mux_num_sets) {
+          snprintf(reader.error, TRACE_READER_ERROR_LEN, "live set %u of core %u in sample %lu out of %u sets", trace_mux_set(&reader, iter.sample, c), c, index, reader.mux_num_sets);
+          bad = 1;
+        }
+      }
+      if (bad)
+        break;
+      prev_deadline = deadline;
+      run_samples[r]++;
+      index++;
+    }
+    if (ret < 0)
+      bad = 1;
+    trace_iter_free(&iter);
+  }
+  double seconds = (monotonic_ns() - start) * 1e-9;
+  if (!bad && index != reader.num_samples) {
+    snprintf(reader.error, TRACE_READER_ERROR_LEN, "runs cover %lu of %lu samples", index, reader.num_samples);
+    bad = 1;
+  }
+
+  if (bad)
+    printf("%s: %s\n", path, reader.error);
+  else if (!arguments->quiet)
+    print_summary(&reader, path, run_samples, seconds);
+  free(run_samples);
+  trace_reader_close(&reader);
+  return bad;
+}
+
+static void print_summary(trace_reader_t *reader, const char *path, uint64_t *run_samples, double seconds) {
+  printf("%s: ok\n", path);
+  printf("  version %u%s, %lu bytes, %lu samples of %lu bytes", reader->version,
+    reader->legacy ? " (legacy, no footer)" : reader->has_footer ? "" : " (no footer)", reader->size, reader->num_samples, reader->sample_bytes);
+  if (reader->version == TRACE_VERSION_COLUMNAR)
+    printf(" in %lu blocks (%.1fx smaller than v1)", reader->num_blocks,
+      (double)(reader->num_samples * reader->sample_bytes) / (reader->data_end - reader->data_offset));
+  printf("\n");
+  printf("  periods: sampling %u us, power %u us, frequencies %u us\n", reader->sample_period_us, reader->power_period_us, reader->freq_period_us);
+  if (reader->devices & TRACE_DEVICE_CPU) {
+    printf("  CPU: %u cores, %u-bit counters, events", reader->num_cores, 8 * reader->counter_bytes);
+    for (unsigned int e = 0; reader->num_cores > 0 && e < reader->cores[0].num_counters; e++)
+      printf(" 0x%02x", reader->cores[0].event_ids[e]);
+    printf("\n");
+    if (reader->flags & TRACE_FLAG_CPU_MUX)
+      printf("  CPU events multiplexed: %u sets of %u, %u samples each\n", reader->mux_num_sets, reader->mux_set_counters, reader->mux_samples);
+  }
+  if (reader->devices & TRACE_DEVICE_GPU) {
+    printf("  GPU: %u groups\n", reader->num_gpu_groups);
+    for (unsigned int g = 0; g < reader->num_gpu_groups; g++)
+      printf("    group %u: %u events x %u instances\n", g, reader->gpu_groups[g].num_events, reader->gpu_groups[g].num_instances);
+  }
+  printf("  power rails: %u\n", reader->num_power_rails);
+  for (unsigned int r = 0; r < reader->num_runs; r++) {
+    printf("  run %u: %lu samples from sample %lu", r, run_samples[r], reader->runs[r].first_sample);
+    if (reader->has_footer)
+      printf(", wall time %.3f s", reader->runs[r].wall_ns * 1e-9);
+    printf("\n");
+  }
+  printf("  checked in %.3f s (%.2f GB/s of v1 samples)\n", seconds,
+    seconds > 0 ? reader->num_samples * reader->sample_bytes / seconds * 1e-9 : 0.0);
+}
@@ -0,0 +1,204 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Client of the Voltmeter daemon (voltmeter --mode=daemon): submits a profiling job on the
+// daemon socket and waits for it to be done.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <argp.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+// voltmeter libraries
+#include <daemon.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                  Argp configuration                   ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+const char *argp_program_version = "voltmeter-client 1.0";
+const char *argp_program_bug_address = "<smazzola@iis.ee.ethz.ch>";
+static char doc[] = "Submit a profiling job to a Voltmeter daemon and wait for it to be done.";
+static char args_doc[] = "";
+static struct argp_option options[] = {
+    {"socket", 'S', "SOCKET_PATH", 0, "Unix socket of the daemon (default: " DAEMON_SOCKET_DEFAULT ")", 0},
+    {"benchmark", 'b', "BENCHMARK_PATH", 0, "Path of benchmark compiled as a dynamic library", 1},
+    {"benchmark_args", 'a', "BENCHMARK_ARGS", 0, "Comma-separated arguments to be passed to the benchmark, in the same order", 2},
+    {"events", 'e', "EVENTS_SOURCE", 0, "Source of events to profile; EVENTS_SOURCE can be 'all_events', 'config', or 'cli' (default: the daemon's)", 3},
+    {"config_cpu", 'c', "CONFIG_FILE_CPU", 0, "Path to the event configuration file for the CPU profiling", 4},
+    {"config_gpu", 'g', "CONFIG_FILE_GPU", 0, "Path to the event configuration file for the GPU profiling", 5},
+    {"cli_cpu", 'l', "CLI_EVENTS_CPU", 0, "List of CPU events to profile, separated by commas", 6},
+    {"cli_gpu", 'm', "CLI_EVENTS_GPU", 0, "List of GPU events to profile, separated by commas", 7},
+    {"trace", 't', "TRACE_PATH", 0, "Path of the trace file to write; more passes are numbered", 8},
+    {"shutdown", 'x', 0, 0, "Stop the daemon once its queued jobs are done", 9},
+    {0}
+};
+
+struct arguments {
+  char *socket;
+  char *benchmark;
+  char *benchmark_args;
+  char *events;
+  char *config_cpu;
+  char *config_gpu;
+  char *cli_cpu;
+  char *cli_gpu;
+  char *trace;
+  int shutdown;
+};
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state);
+static void send_path(FILE *fp, const char *key, const char *path);
+
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Main                          ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+int main(int argc, char *argv[]) {
+  struct arguments arguments;
+  memset(&arguments, 0, sizeof(arguments));
+  arguments.socket = DAEMON_SOCKET_DEFAULT;
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+  // connect to the daemon
+  struct sockaddr_un addr;
+  if (strlen(arguments.socket) >= sizeof(addr.sun_path)) {
+    printf("%s:%d: socket path too long '%s'.\n", __FILE__, __LINE__, arguments.socket);
+    exit(1);
+  }
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    printf("%s:%d: failed to create socket.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, arguments.socket);
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    perror("connect");
+    printf("%s:%d: failed to connect to daemon socket '%s'.\n", __FILE__, __LINE__, arguments.socket);
+    exit(1);
+  }
+  FILE *fp = fdopen(fd, "r+");
+  if (fp == NULL) {
+    perror("fdopen");
+    exit(1);
+  }
+
+  // send the job: the daemon runs in another directory, so paths are made absolute
+  if (arguments.shutdown) {
+    fprintf(fp, "%s\n", DAEMON_KEY_SHUTDOWN);
+  } else {
+    send_path(fp, DAEMON_KEY_BENCHMARK, arguments.benchmark);
+    if (arguments.benchmark_args != NULL) {
+      for (char *token = strtok(arguments.benchmark_args, ","); token != NULL; token = strtok(NULL, ","))
+        fprintf(fp, "%s %s\n", DAEMON_KEY_ARG, token);
+    }
+    if (arguments.events != NULL)
+      fprintf(fp, "%s %s\n", DAEMON_KEY_EVENTS, arguments.events);
+    send_path(fp, DAEMON_KEY_CONFIG_CPU, arguments.config_cpu);
+    send_path(fp, DAEMON_KEY_CONFIG_GPU, arguments.config_gpu);
+    if (arguments.cli_cpu != NULL)
+      fprintf(fp, "%s %s\n", DAEMON_KEY_CLI_CPU, arguments.cli_cpu);
+    if (arguments.cli_gpu != NULL)
+      fprintf(fp, "%s %s\n", DAEMON_KEY_CLI_GPU, arguments.cli_gpu);
+    send_path(fp, DAEMON_KEY_TRACE, arguments.trace);
+  }
+  fprintf(fp, "\n");
+  fflush(fp);
+
+  // print replies until the daemon closes the connection
+  int ret = 1;
+  char *line = NULL;
+  size_t line_size = 0;
+  while (getline(&line, &line_size, fp) > 0) {
+    printf("%s", line);
+    if (!strncmp(line, "done", 4) || !strncmp(line, "shutdown", 8))
+      ret = 0;
+  }
+  free(line);
+  fclose(fp);
+  return ret;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static void send_path(FILE *fp, const char *key, const char *path) {
+  if (path == NULL)
+    return;
+  if (path[0] == '/') {
+    fprintf(fp, "%s %s\n", key, path);
+  } else {
+    char *cwd = getcwd(NULL, 0);
+    if (cwd == NULL) {
+      perror("getcwd");
+      exit(1);
+    }
+    fprintf(fp, "%s %s/%s\n", key, cwd, path);
+    free(cwd);
+  }
+}
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state){
+  struct arguments *arguments = state->input;
+  switch(key){
+    case 'S':
+      arguments->socket = arg;
+      break;
+    case 'b':
+      arguments->benchmark = arg;
+      break;
+    case 'a':
+      arguments->benchmark_args = arg;
+      break;
+    case 'e':
+      arguments->events = arg;
+      break;
+    case 'c':
+      arguments->config_cpu = arg;
+      break;
+    case 'g':
+      arguments->config_gpu = arg;
+      break;
+    case 'l':
+      arguments->cli_cpu = arg;
+      break;
+    case 'm':
+      arguments->cli_gpu = arg;
+      break;
+    case 't':
+      arguments->trace = arg;
+      break;
+    case 'x':
+      arguments->shutdown = 1;
+      break;
+    case ARGP_KEY_END:
+      if (!arguments->shutdown) {
+        if (arguments->benchmark == NULL)
+          argp_failure(state, 1, 0, "missing required argument for option --benchmark. See --help for more information.");
+        if (arguments->trace == NULL)
+          argp_failure(state, 1, 0, "missing required argument for option --trace. See --help for more information.");
+      }
+      break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
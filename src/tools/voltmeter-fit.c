@@ -0,0 +1,729 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Fit per operating point linear models of power against the counters of
+// Voltmeter traces, with leave-one-benchmark-out cross-validation:
+// - every trace (or all the .bin traces of input directories) is reduced in
+//   parallel to the normal equations of its samples; the features of a sample
+//   are the rates of the events (all the cores or domain instances together)
+//   since the previous power read, the target the power read (of a rail, or total)
+// - traces are grouped by the frequencies set for them (from the trace name),
+//   and within an operating point by benchmark
+// - per operating point, the model of all the benchmarks and the models leaving
+//   out each benchmark are solved in parallel (least squares, or non-negative
+//   least squares), the left out benchmark is the validation set
+// The coefficient file can be loaded with parse_model_json (see model.h).
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <argp.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+// voltmeter libraries
+#include <model.h>
+#include <profiler.h>
+#include <scheduler.h>
+#include <trace.h>
+#include <trace_reader.h>
+#include <helper.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// ridge on the coefficients, relative to the scale of each feature: only keeps
+// collinear features (e.g., clock cycles at a fixed frequency) from blowing up
+#define DEFAULT_RIDGE 1e-6
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+typedef enum {
+  METHOD_NNLS = 0,
+  METHOD_LS
+} method_t;
+
+// one input trace, reduced to the normal equations of its samples
+typedef struct {
+  char *path;
+  char *benchmark;            // from the trace name
+  uint32_t cpu_freq;          // frequency set for the run, 0 if none
+  uint32_t gpu_freq;
+  unsigned int num_features;
+  model_feature_t *features;
+  gram_t gram;
+  char *report;
+  size_t report_size;
+  int failed;
+} job_t;
+
+// traces of an operating point, with the same features
+typedef struct {
+  uint32_t cpu_freq;
+  uint32_t gpu_freq;
+  unsigned int num_features;
+  model_feature_t *features;
+  unsigned int num_benchmarks;
+  char **benchmarks;
+  gram_t *grams;              // per benchmark
+  gram_t total;
+  double *weights;            // model of all the benchmarks: [intercept, coefficients]
+  double *cv_sse;             // per benchmark: residual of the model leaving it out, -1 if singular
+  int singular;
+} operating_point_t;
+
+// solve of an operating point, leaving out a benchmark or none (-1)
+typedef struct {
+  unsigned int point;
+  int left_out;
+} fit_task_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                  Argp configuration                   ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+const char *argp_program_version = "voltmeter-fit 1.0";
+const char *argp_program_bug_address = "<smazzola@iis.ee.ethz.ch>";
+static char doc[] = "Fit per operating point linear power models to the counters of Voltmeter traces, "
+                    "with leave-one-benchmark-out cross-validation. Traces are named "
+                    "<benchmark>[_cpu_<freq>][_gpu_<freq>]_<i>.bin, as written by Voltmeter; "
+                    "a directory stands for all the .bin traces it contains.";
+static char args_doc[] = "TRACE...";
+static struct argp_option options[] = {
+    {"output", 'o', "MODEL_FILE", 0, "Coefficient file to write (JSON)", 0},
+    {"method", 'm', "METHOD", 0, "Solver; METHOD can be 'nnls' (non-negative coefficients) or 'ls' (default: nnls)", 1},
+    {"target", 't', "TARGET", 0, "Power to model; TARGET can be 'total' or the index of a power rail (default: total)", 2},
+    {"ridge", 'r', "LAMBDA", 0, "Ridge on the coefficients, relative to the scale of each feature (default: 1e-6)", 3},
+    {"jobs", 'j', "NUM_JOBS", 0, "Number of threads (default: number of online CPUs)", 4},
+    {"devices", 'd', "DEVICES", 0, "Devices profiled in v1 traces without footer, separated by commas; DEVICES can contain 'cpu' and 'gpu'", 5},
+    {0}
+};
+
+struct arguments {
+  char *output;
+  method_t method;
+  int target;
+  double ridge;
+  unsigned int num_jobs;
+  uint32_t devices;
+  char **inputs;
+  int num_inputs;
+};
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Globals                        ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static struct arguments arguments;
+static job_t *jobs = NULL;
+static unsigned int num_jobs = 0;
+static operating_point_t *points = NULL;
+static unsigned int num_points = 0;
+static fit_task_t *tasks = NULL;
+static unsigned int num_tasks = 0;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state);
+static void add_input(const char *path);
+static int filter_trace(const struct dirent *entry);
+static void parse_trace_name(const char *path, job_t *job);
+// reduction of the traces
+static void reduce_job(unsigned int j);
+static int reduce_trace(trace_reader_t *reader, job_t *job, FILE *report);
+static unsigned int add_feature(job_t *job, model_feature_kind_t kind, uint32_t event_id);
+// fit
+static void group_jobs(void);
+static int same_features(const operating_point_t *point, const job_t *job);
+static void fit_task(unsigned int t);
+static void print_fit(operating_point_t *point);
+static void write_models(void);
+static void free_point(operating_point_t *point);
+
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Main                          ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+int main(int argc, char *argv[]) {
+  memset(&arguments, 0, sizeof(arguments));
+  arguments.target = MODEL_TARGET_TOTAL;
+  arguments.ridge = DEFAULT_RIDGE;
+  long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  arguments.num_jobs = online_cpus > 0 ? online_cpus : 1;
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+  for (int i = 0; i < arguments.num_inputs; i++)
+    add_input(arguments.inputs[i]);
+  if (num_jobs == 0) {
+    printf("No trace to fit.\n");
+    return 1;
+  }
+
+  // normal equations of each trace
+  uint64_t start = monotonic_ns();
+  int num_failed = 0;
+  run_pool(reduce_job, num_jobs, arguments.num_jobs);
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    fwrite(jobs[j].report, 1, jobs[j].report_size, stdout);
+    num_failed += jobs[j].failed;
+    free(jobs[j].report);
+  }
+  uint64_t reduced = monotonic_ns();
+
+  // models of each operating point, and leaving out each benchmark
+  group_jobs();
+  if (num_points == 0) {
+    printf("No samples to fit.\n");
+    return 1;
+  }
+  run_pool(fit_task, num_tasks, arguments.num_jobs);
+  for (unsigned int p = 0; p < num_points; p++)
+    print_fit(&points[p]);
+  write_models();
+  fprintf(stderr, "%u trace(s) reduced in %.2f s, %d failed; %u model(s) fitted in %.3f s.\n",
+    num_jobs, (reduced - start) * 1e-9, num_failed, num_points, (monotonic_ns() - reduced) * 1e-9);
+
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    free(jobs[j].path);
+    free(jobs[j].benchmark);
+    free(jobs[j].features);
+    if (jobs[j].gram.xtx != NULL)
+      gram_free(&jobs[j].gram);
+  }
+  free(jobs);
+  for (unsigned int p = 0; p < num_points; p++)
+    free_point(&points[p]);
+  free(points);
+  free(tasks);
+  return num_failed > 0 ? 1 : 0;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments *arguments = state->input;
+  char *end;
+  switch (key) {
+    case 'o':
+      arguments->output = arg;
+      break;
+    case 'm':
+      if (!strcmp(arg, "nnls"))
+        arguments->method = METHOD_NNLS;
+      else if (!strcmp(arg, "ls"))
+        arguments->method = METHOD_LS;
+      else
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 't':
+      if (!strcmp(arg, "total")) {
+        arguments->target = MODEL_TARGET_TOTAL;
+      } else {
+        arguments->target = strtol(arg, &end, 10);
+        if (end == arg || *end != '\0' || arguments->target < 0)
+          argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      }
+      break;
+    case 'r':
+      arguments->ridge = strtod(arg, &end);
+      if (end == arg || *end != '\0' || arguments->ridge < 0)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'j':
+      arguments->num_jobs = atoi(arg);
+      if (arguments->num_jobs == 0)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'd': {
+      char *devices = strdup(arg);
+      for (char *device = strtok(devices, ","); device != NULL; device = strtok(NULL, ",")) {
+        if (!strcmp(device, "cpu"))
+          arguments->devices |= TRACE_DEVICE_CPU;
+        else if (!strcmp(device, "gpu"))
+          arguments->devices |= TRACE_DEVICE_GPU;
+        else
+          argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      }
+      free(devices);
+      break;
+    }
+    case ARGP_KEY_ARGS:
+      arguments->inputs = state->argv + state->next;
+      arguments->num_inputs = state->argc - state->next;
+      break;
+    case ARGP_KEY_NO_ARGS:
+      argp_usage(state);
+      break;
+    case ARGP_KEY_END:
+      if (arguments->output == NULL)
+        argp_failure(state, 1, 0, "missing required argument for option --output. See --help for more information.");
+      break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+// a trace, or all the traces of a directory (in name order)
+static void add_input(const char *path) {
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    struct dirent **entries;
+    int num_entries = scandir(path, &entries, filter_trace, alphasort);
+    if (num_entries < 0) {
+      printf("%s:%d: failed to read directory '%s'.\n", __FILE__, __LINE__, path);
+      exit(1);
+    }
+    for (int i = 0; i < num_entries; i++) {
+      char *trace = (char *)malloc_or_exit(strlen(path) + strlen(entries[i]->d_name) + 2);
+      sprintf(trace, "%s/%s", path, entries[i]->d_name);
+      add_input(trace);
+      free(trace);
+      free(entries[i]);
+    }
+    free(entries);
+    return;
+  }
+  jobs = (job_t *)realloc(jobs, sizeof(job_t) * (num_jobs + 1));
+  if (jobs == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  memset(&jobs[num_jobs], 0, sizeof(job_t));
+  jobs[num_jobs].path = strdup(path);
+  parse_trace_name(path, &jobs[num_jobs]);
+  num_jobs++;
+}
+
+static int filter_trace(const struct dirent *entry) {
+  size_t len = strlen(entry->d_name);
+  return len > 4 && !strcmp(entry->d_name + len - 4, ".bin");
+}
+
+// <benchmark>[_cpu_<freq>][_gpu_<freq>]_<i>.bin, as named by Voltmeter
+static void parse_trace_name(const char *path, job_t *job) {
+  const char *name = strrchr(path, '/');
+  name = name != NULL ? name + 1 : path;
+  size_t stem = strlen(name);
+  if (stem > 4 && !strcmp(name + stem - 4, ".bin"))
+    stem -= 4;
+  size_t bench = stem;
+  for (const char *label = name; (label = strstr(label, "_cpu_")) != NULL && (size_t)(label - name) < stem; label++) {
+    job->cpu_freq = strtoul(label + 5, NULL, 10);
+    bench = label - name;
+  }
+  for (const char *label = name; (label = strstr(label, "_gpu_")) != NULL && (size_t)(label - name) < stem; label++) {
+    job->gpu_freq = strtoul(label + 5, NULL, 10);
+    if ((size_t)(label - name) < bench || job->cpu_freq == 0)
+      bench = label - name;
+  }
+  if (bench == stem) {
+    // no frequency in the name: drop the trace number
+    while (bench > 0 && name[bench - 1] >= '0' && name[bench - 1] <= '9')
+      bench--;
+    if (bench > 0 && bench < stem && name[bench - 1] == '_')
+      bench--;
+    else
+      bench = stem;
+  }
+  job->benchmark = strndup(name, bench);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                 Reduction of the traces               │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+static void reduce_job(unsigned int j) {
+  job_t *job = &jobs[j];
+  trace_reader_t reader;
+  FILE *report = open_memstream(&job->report, &job->report_size);
+  if (report == NULL) {
+    printf("%s:%d: failed to open memory stream.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  if (trace_reader_open(&reader, job->path, arguments.devices)) {
+    fprintf(report, "%s: %s\n", job->path, reader.error);
+    job->failed = 1;
+  } else {
+    job->failed = reduce_trace(&reader, job, report);
+  }
+  trace_reader_close(&reader);
+  fclose(report);
+}
+
+// a sample of the normal equations per power read: the counters read since the
+// previous power read (stale reads repeat the last values, hence are skipped),
+// over the time since it; return 1 on failure, with the reason in the report
+static int reduce_trace(trace_reader_t *reader, job_t *job, FILE *report) {
+  if (arguments.target != MODEL_TARGET_TOTAL && (uint32_t)arguments.target >= reader->num_power_rails) {
+    fprintf(report, "%s: no power rail %d (%u rails)\n", job->path, arguments.target, reader->num_power_rails);
+    return 1;
+  }
+  // each multiplexed event is counted in a few of the power reads only
+  if (reader->flags & TRACE_FLAG_CPU_MUX) {
+    fprintf(report, "%s: multiplexed CPU events, not fitted (profile the events of the model in passes)\n", job->path);
+    return 1;
+  }
+  // features of the trace, and where the counters of each core and GPU group go
+  unsigned int clk_feature = 0;
+  unsigned int **core_features = (unsigned int **)malloc_or_exit(sizeof(unsigned int *) * (reader->num_cores > 0 ? reader->num_cores : 1));
+  unsigned int **gpu_features = (unsigned int **)malloc_or_exit(sizeof(unsigned int *) * (reader->num_gpu_groups > 0 ? reader->num_gpu_groups : 1));
+  if (reader->num_cores > 0)
+    clk_feature = add_feature(job, MODEL_FEATURE_CPU_CLK, 0);
+  for (unsigned int c = 0; c < reader->num_cores; c++) {
+    core_features[c] = (unsigned int *)malloc_or_exit(sizeof(unsigned int) * (reader->cores[c].num_counters + 1));
+    for (unsigned int e = 0; e < reader->cores[c].num_counters; e++)
+      core_features[c][e] = add_feature(job, MODEL_FEATURE_CPU_EVENT, reader->cores[c].event_ids[e]);
+  }
+  for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+    gpu_features[g] = (unsigned int *)malloc_or_exit(sizeof(unsigned int) * (reader->gpu_groups[g].num_events + 1));
+    for (unsigned int e = 0; e < reader->gpu_groups[g].num_events; e++)
+      gpu_features[g][e] = add_feature(job, MODEL_FEATURE_GPU_EVENT, reader->gpu_groups[g].event_ids[e]);
+  }
+  gram_init(&job->gram, job->num_features);
+  double *counts = (double *)malloc_or_exit(sizeof(double) * (job->num_features > 0 ? job->num_features : 1));
+  double *rates = (double *)malloc_or_exit(sizeof(double) * (job->num_features > 0 ? job->num_features : 1));
+
+  uint32_t cpu_fresh = reader->num_cores > 0 ? FRESH_CPU_COUNTERS : 0;
+  uint32_t gpu_fresh = reader->num_gpu_groups > 0 ? FRESH_GPU_COUNTERS : 0;
+  trace_iter_t iter;
+  int ret = 0;
+  for (uint32_t r = 0; r < reader->num_runs && ret == 0; r++) {
+    uint64_t prev_deadline = 0;
+    int has_prev = 0;
+    unsigned int window_samples = 0;
+    memset(counts, 0, sizeof(double) * job->num_features);
+    trace_iter_run(&iter, reader, r);
+    while ((ret = trace_iter_next(&iter)) > 0) {
+      const uint8_t *sample = iter.sample;
+      uint32_t fresh = trace_fresh(reader, sample);
+      window_samples++;
+      if (fresh & cpu_fresh) {
+        for (unsigned int c = 0; c < reader->num_cores; c++) {
+          counts[clk_feature] += trace_core_clk(reader, sample, c);
+          for (unsigned int e = 0; e < reader->cores[c].num_counters; e++)
+            counts[core_features[c][e]] += trace_core_counter(reader, sample, c, e);
+        }
+      }
+      if (fresh & gpu_fresh) {
+        for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+          for (unsigned int i = 0; i < reader->gpu_groups[g].num_instances; i++)
+            for (unsigned int e = 0; e < reader->gpu_groups[g].num_events; e++)
+              counts[gpu_features[g][e]] += trace_gpu_counter(reader, sample, g, i, e);
+        }
+      }
+      if (!(fresh & FRESH_POWER))
+        continue;
+      // the first window of a run lasts its sampling periods
+      uint64_t deadline = trace_deadline_ns(reader, sample);
+      double interval_ns = has_prev ? (double)(deadline - prev_deadline) : window_samples * reader->sample_period_us * 1e3;
+      if (interval_ns > 0) {
+        const uint32_t *power = trace_power(reader, sample);
+        double y = 0;
+        if (arguments.target == MODEL_TARGET_TOTAL) {
+          for (unsigned int p = 0; p < reader->num_power_rails; p++)
+            y += power[p];
+        } else {
+          y = power[arguments.target];
+        }
+        for (unsigned int f = 0; f < job->num_features; f++)
+          rates[f] = counts[f] * 1e9 / interval_ns;
+        gram_add(&job->gram, rates, y);
+      }
+      prev_deadline = deadline;
+      has_prev = 1;
+      window_samples = 0;
+      memset(counts, 0, sizeof(double) * job->num_features);
+    }
+    trace_iter_free(&iter);
+  }
+  gram_finish(&job->gram);
+  if (ret < 0) {
+    fprintf(report, "%s: %s\n", job->path, reader->error);
+  } else if (job->gram.num_samples == 0) {
+    fprintf(report, "%s: no power read\n", job->path);
+    ret = -1;
+  } else {
+    fprintf(report, "%s: %lu power reads of %s", job->path, job->gram.num_samples, job->benchmark);
+    if (job->cpu_freq != 0)
+      fprintf(report, ", CPU at %u", job->cpu_freq);
+    if (job->gpu_freq != 0)
+      fprintf(report, ", GPU at %u", job->gpu_freq);
+    fprintf(report, ", %u features\n", job->num_features);
+  }
+  for (unsigned int c = 0; c < reader->num_cores; c++)
+    free(core_features[c]);
+  for (unsigned int g = 0; g < reader->num_gpu_groups; g++)
+    free(gpu_features[g]);
+  free(core_features);
+  free(gpu_features);
+  free(counts);
+  free(rates);
+  return ret < 0 ? 1 : 0;
+}
+
+// index of the feature in the job, added if new
+static unsigned int add_feature(job_t *job, model_feature_kind_t kind, uint32_t event_id) {
+  for (unsigned int f = 0; f < job->num_features; f++) {
+    if (job->features[f].kind == kind && job->features[f].event_id == event_id)
+      return f;
+  }
+  job->features = (model_feature_t *)realloc(job->features, sizeof(model_feature_t) * (job->num_features + 1));
+  if (job->features == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  job->features[job->num_features].kind = kind;
+  job->features[job->num_features].event_id = event_id;
+  return job->num_features++;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                          Fit                          │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// operating points in order of first trace; the traces of an operating point
+// must have its features (those of its first trace), the others are left out
+static void group_jobs(void) {
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    job_t *job = &jobs[j];
+    if (job->failed)
+      continue;
+    operating_point_t *point = NULL;
+    for (unsigned int p = 0; p < num_points && point == NULL; p++) {
+      if (points[p].cpu_freq == job->cpu_freq && points[p].gpu_freq == job->gpu_freq)
+        point = &points[p];
+    }
+    if (point == NULL) {
+      points = (operating_point_t *)realloc(points, sizeof(operating_point_t) * (num_points + 1));
+      if (points == NULL) {
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      point = &points[num_points++];
+      memset(point, 0, sizeof(operating_point_t));
+      point->cpu_freq = job->cpu_freq;
+      point->gpu_freq = job->gpu_freq;
+      point->num_features = job->num_features;
+      point->features = (model_feature_t *)malloc_or_exit(sizeof(model_feature_t) * (job->num_features > 0 ? job->num_features : 1));
+      memcpy(point->features, job->features, sizeof(model_feature_t) * job->num_features);
+      gram_init(&point->total, point->num_features);
+      gram_finish(&point->total);
+    } else if (!same_features(point, job)) {
+      printf("%s: left out, its events differ from those of the other traces at its frequencies\n", job->path);
+      continue;
+    }
+    unsigned int b = 0;
+    while (b < point->num_benchmarks && strcmp(point->benchmarks[b], job->benchmark))
+      b++;
+    if (b == point->num_benchmarks) {
+      point->benchmarks = (char **)realloc(point->benchmarks, sizeof(char *) * (b + 1));
+      point->grams = (gram_t *)realloc(point->grams, sizeof(gram_t) * (b + 1));
+      if (point->benchmarks == NULL || point->grams == NULL) {
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      point->benchmarks[b] = strdup(job->benchmark);
+      gram_init(&point->grams[b], point->num_features);
+      gram_finish(&point->grams[b]);
+      point->num_benchmarks++;
+    }
+    gram_merge(&point->grams[b], &job->gram);
+    gram_merge(&point->total, &job->gram);
+  }
+  // a task for the model of each operating point, one per left out benchmark
+  for (unsigned int p = 0; p < num_points; p++) {
+    operating_point_t *point = &points[p];
+    point->weights = (double *)calloc(point->total.dim, sizeof(double));
+    point->cv_sse = (double *)calloc(point->num_benchmarks, sizeof(double));
+    tasks = (fit_task_t *)realloc(tasks, sizeof(fit_task_t) * (num_tasks + 1 + point->num_benchmarks));
+    if (point->weights == NULL || point->cv_sse == NULL || tasks == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    tasks[num_tasks].point = p;
+    tasks[num_tasks++].left_out = -1;
+    for (unsigned int b = 0; b < point->num_benchmarks && point->num_benchmarks > 1; b++) {
+      tasks[num_tasks].point = p;
+      tasks[num_tasks++].left_out = b;
+    }
+  }
+}
+
+static int same_features(const operating_point_t *point, const job_t *job) {
+  if (point->num_features != job->num_features)
+    return 0;
+  for (unsigned int f = 0; f < job->num_features; f++) {
+    if (point->features[f].kind != job->features[f].kind || point->features[f].event_id != job->features[f].event_id)
+      return 0;
+  }
+  return 1;
+}
+
+// the normal equations leaving out a benchmark are those of the other benchmarks:
+// no trace is read again
+static void fit_task(unsigned int t) {
+  operating_point_t *point = &points[tasks[t].point];
+  int left_out = tasks[t].left_out;
+  int singular;
+  if (left_out < 0) {
+    if (arguments.method == METHOD_NNLS)
+      singular = solve_nnls(&point->total, arguments.ridge, point->weights);
+    else
+      singular = solve_ls(&point->total, arguments.ridge, point->weights);
+    point->singular = singular;
+    return;
+  }
+  gram_t train;
+  double *weights = (double *)malloc_or_exit(sizeof(double) * point->total.dim);
+  gram_init(&train, point->num_features);
+  gram_finish(&train);
+  for (unsigned int b = 0; b < point->num_benchmarks; b++) {
+    if (b != (unsigned int)left_out)
+      gram_merge(&train, &point->grams[b]);
+  }
+  if (arguments.method == METHOD_NNLS)
+    singular = solve_nnls(&train, arguments.ridge, weights);
+  else
+    singular = solve_ls(&train, arguments.ridge, weights);
+  point->cv_sse[left_out] = singular ? -1 : gram_sse(&point->grams[left_out], weights);
+  gram_free(&train);
+  free(weights);
+}
+
+// training error, and error of each left out benchmark relative to its mean power
+static void print_fit(operating_point_t *point) {
+  gram_t *total = &point->total;
+  printf("CPU %s", point->cpu_freq != 0 ? "at " : "any");
+  if (point->cpu_freq != 0)
+    printf("%u", point->cpu_freq);
+  printf(", GPU %s", point->gpu_freq != 0 ? "at " : "any");
+  if (point->gpu_freq != 0)
+    printf("%u", point->gpu_freq);
+  printf(": %lu power reads of %u benchmark(s), %u features\n", total->num_samples, point->num_benchmarks, point->num_features);
+  if (point->singular) {
+    printf("  singular normal equations, no model (use a larger --ridge)\n");
+    return;
+  }
+  double mean = total->xty[0] / total->num_samples;
+  double rmse = sqrt(gram_sse(total, point->weights) / total->num_samples);
+  printf("  training RMSE %.1f mW (%.2f%% of %.1f mW)\n", rmse, mean != 0 ? 100 * rmse / mean : 0.0, mean);
+  if (point->num_benchmarks < 2)
+    return;
+  double cv_sse = 0;
+  uint64_t cv_samples = 0;
+  for (unsigned int b = 0; b < point->num_benchmarks; b++) {
+    gram_t *gram = &point->grams[b];
+    if (point->cv_sse[b] < 0) {
+      printf("  %s left out: singular normal equations\n", point->benchmarks[b]);
+      continue;
+    }
+    double b_mean = gram->xty[0] / gram->num_samples;
+    double b_rmse = sqrt(point->cv_sse[b] / gram->num_samples);
+    printf("  %s left out: RMSE %.1f mW (%.2f%% of %.1f mW)\n", point->benchmarks[b], b_rmse, b_mean != 0 ? 100 * b_rmse / b_mean : 0.0, b_mean);
+    cv_sse += point->cv_sse[b];
+    cv_samples += gram->num_samples;
+  }
+  if (cv_samples > 0) {
+    double cv_rmse = sqrt(cv_sse / cv_samples);
+    printf("  leave-one-benchmark-out RMSE %.1f mW (%.2f%%)\n", cv_rmse, mean != 0 ? 100 * cv_rmse / mean : 0.0);
+  }
+}
+
+// models of the operating points with a solution, written aside then renamed
+static void write_models(void) {
+  model_set_t set;
+  set.target = arguments.target;
+  set.num_models = 0;
+  set.models = (power_model_t *)malloc_or_exit(sizeof(power_model_t) * num_points);
+  for (unsigned int p = 0; p < num_points; p++) {
+    operating_point_t *point = &points[p];
+    if (point->singular)
+      continue;
+    power_model_t *model = &set.models[set.num_models++];
+    gram_t *total = &point->total;
+    double mean = total->xty[0] / total->num_samples;
+    model->cpu_freq = point->cpu_freq;
+    model->gpu_freq = point->gpu_freq;
+    model->num_features = point->num_features;
+    model->features = point->features;
+    model->intercept = point->weights[0];
+    model->coefficients = point->weights + 1;
+    model->num_samples = total->num_samples;
+    model->num_benchmarks = point->num_benchmarks;
+    model->rmse_mw = sqrt(gram_sse(total, point->weights) / total->num_samples);
+    model->cv_error = -1;
+    model->online_error = -1;
+    double cv_sse = 0;
+    uint64_t cv_samples = 0;
+    for (unsigned int b = 0; b < point->num_benchmarks && point->num_benchmarks > 1; b++) {
+      if (point->cv_sse[b] >= 0) {
+        cv_sse += point->cv_sse[b];
+        cv_samples += point->grams[b].num_samples;
+      }
+    }
+    if (cv_samples > 0 && mean != 0)
+      model->cv_error = sqrt(cv_sse / cv_samples) / mean;
+  }
+  char *tmp_path = (char *)malloc_or_exit(strlen(arguments.output) + 5);
+  sprintf(tmp_path, "%s.tmp", arguments.output);
+  FILE *file = fopen(tmp_path, "w");
+  if (file == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, tmp_path);
+    exit(1);
+  }
+  write_model_json(file, &set);
+  if (fclose(file) != 0 || rename(tmp_path, arguments.output) != 0) {
+    printf("%s:%d: failed to write file '%s'.\n", __FILE__, __LINE__, arguments.output);
+    exit(1);
+  }
+  printf("%u model(s) written to %s\n", set.num_models, arguments.output);
+  // features and coefficients belong to the operating points
+  free(set.models);
+  free(tmp_path);
+}
+
+static void free_point(operating_point_t *point) {
+  for (unsigned int b = 0; b < point->num_benchmarks; b++) {
+    free(point->benchmarks[b]);
+    gram_free(&point->grams[b]);
+  }
+  free(point->benchmarks);
+  free(point->grams);
+  gram_free(&point->total);
+  free(point->features);
+  free(point->weights);
+  free(point->cv_sse);
+}
@@ -0,0 +1,1685 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Batch processing of Voltmeter traces:
+// - summarize: per run, energy and mean power of each rail, totals of each counter
+// - slice: keep a run and/or a time window of a trace
+// - merge: concatenate the runs of traces with the same header
+// - convert: write the samples as CSV or as a NumPy structured array (.npy)
+// - align: merge the passes of a characterization run (one trace per event set)
+//   into one matrix with all the events, per window of the runs
+// - dataset: per-sample features for power modeling (normalized counters,
+//   frequency and power labels), one .npy shard per trace, built incrementally
+// Input traces (or all the .bin traces of input directories) are processed in
+// parallel on a pool of threads; reports are printed in input order.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <argp.h>
+#include <dirent.h>
+#include <glob.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <sys/stat.h>
+// voltmeter libraries
+#include <campaign.h>
+#include <scheduler.h>
+#include <writer.h>
+#include <trace.h>
+#include <trace_reader.h>
+#include <helper.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Macros                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// stdio buffer of the converted files
+#define CONVERT_BUFFER_BYTES (1 << 20)
+// npy headers are padded to a multiple of this
+#define NPY_HEADER_ALIGN 64
+// dataset manifest, in the dataset directory
+#define DATASET_MANIFEST "manifest.tsv"
+// align defaults
+#define DEFAULT_ALIGN_BINS 100
+#define DEFAULT_ALIGN_BIN_MS 10
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+typedef enum {
+  COMMAND_NONE = 0,
+  COMMAND_SUMMARIZE,
+  COMMAND_SLICE,
+  COMMAND_MERGE,
+  COMMAND_CONVERT,
+  COMMAND_ALIGN,
+  COMMAND_DATASET
+} command_t;
+
+typedef enum {
+  FORMAT_CSV = 0,
+  FORMAT_NPY
+} format_t;
+
+// how a column of the passes is reduced over a window of the aligned matrix
+typedef enum {
+  ALIGN_SKIP = 0,             // timing of the samples
+  ALIGN_SUM,                  // counters: total of the window (from the first pass having them)
+  ALIGN_MEAN                  // frequencies and power: mean of the window (over all passes)
+} align_kind_t;
+
+// trace of a dataset and its shard
+typedef struct {
+  char *shard;                // file name in the dataset directory
+  char *trace;                // absolute path
+  uint64_t size;              // size and modification time of the trace when processed
+  uint64_t mtime_ns;
+  char *benchmark;            // labels, from the trace name
+  uint32_t cpu_freq;          // frequency set for the run, 0 if none
+  uint32_t gpu_freq;
+  uint64_t rows;
+} dataset_entry_t;
+
+// one input trace (align: the passes of a run); its report is printed once all
+// the jobs are done
+typedef struct {
+  char *path;
+  char **passes;              // align only, in pass order
+  unsigned int num_passes;
+  dataset_entry_t *entry;     // dataset only
+  char *report;
+  size_t report_size;
+  int failed;
+} job_t;
+
+// pass of a characterization run, named <prefix>_<index>.bin
+typedef struct {
+  char *path;
+  char *prefix;               // with its directory
+  unsigned int index;
+  int has_log;                // 1 if the log of the run is found
+  unsigned int first;         // range of the run, from its log
+  unsigned int last;
+} pass_t;
+
+// column of the aligned matrix
+typedef struct {
+  char name[TRACE_COLUMN_NAME_LEN];
+  align_kind_t kind;
+  double *sum;                // per window
+  uint64_t *count;            // per window
+} align_column_t;
+
+// trace written with the header (and version) of the trace its samples are read from
+typedef struct {
+  trace_reader_t *reader;
+  FILE *file;
+  trace_writer_t writer;
+  trace_encoder_t encoder;
+  trace_footer_t footer;
+  uint32_t runs_capacity;
+} output_trace_t;
+
+// per event totals of a run; a multiplexed event is counted in live of its samples only
+typedef struct {
+  uint32_t id;
+  uint64_t total;
+  uint64_t samples;
+  uint64_t live;
+} event_total_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                  Argp configuration                   ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+const char *argp_program_version = "voltmeter-trace 1.0";
+const char *argp_program_bug_address = "<smazzola@iis.ee.ethz.ch>";
+static char doc[] = "Process Voltmeter traces. COMMAND can be:\n"
+                    "  summarize  per run, energy and mean power of each rail, totals of each counter\n"
+                    "  slice      keep a run (--run) and/or a time window (--window) of each trace\n"
+                    "  merge      concatenate the runs of traces with the same header into --output\n"
+                    "  convert    write the samples of each trace as CSV or NumPy .npy (--format)\n"
+                    "  align      merge the passes of each characterization run into one matrix of\n"
+                    "             all the events per window of the runs, as CSV or NumPy .npy (--format)\n"
+                    "  dataset    write the normalized counters with frequency and power labels of each\n"
+                    "             trace to a dataset directory (--output), skipping the traces already there\n"
+                    "A directory stands for all the .bin traces it contains.";
+static char args_doc[] = "COMMAND TRACE...";
+static struct argp_option options[] = {
+    {"jobs", 'j', "NUM_JOBS", 0, "Number of traces processed in parallel (default: number of online CPUs)", 0},
+    {"output", 'o', "PATH", 0, "Output directory (slice, convert; default: the directory of each trace) or output trace (merge)", 1},
+    {"run", 'r', "RUN", 0, "Slice: index of the run to keep", 2},
+    {"window", 'w', "START_MS,END_MS", 0, "Slice: time window to keep, in ms from the first sample kept (of the run, with --run); END_MS can be omitted", 3},
+    {"format", 'f', "FORMAT", 0, "Convert: output format; FORMAT can be 'csv' or 'npy' (default: csv)", 4},
+    {"devices", 'd', "DEVICES", 0, "Devices profiled in v1 traces without footer, separated by commas; DEVICES can contain 'cpu' and 'gpu'", 5},
+    {"align", 'a', "ALIGNMENT", 0, "Align: how the runs of the passes are windowed; ALIGNMENT can be 'progress' (--bins windows of each run) or 'time' (windows of --bin_ms from the start of each run) (default: progress)", 6},
+    {"bins", 'b', "NUM_BINS", 0, "Align: number of windows per run with --align=progress (default: 100)", 7},
+    {"campaign", 'c', "CAMPAIGN_FILE", 0, "Dataset: only the traces of the benchmarks and frequencies of the expanded manifest (see utils/parse_config)", 9},
+    {"bin_ms", 'm', "BIN_MS", 0, "Align: window length in ms with --align=time (default: 10)", 8},
+    {0}
+};
+
+struct arguments {
+  command_t command;
+  unsigned int num_jobs;
+  char *output;
+  int run;                    // -1 if none
+  int window;                 // 1 if a window is given
+  double window_start_ms;
+  double window_end_ms;
+  format_t format;
+  uint32_t devices;
+  int align_time;             // 1: windows of bin_ms, 0: num_bins windows per run
+  unsigned int num_bins;
+  double bin_ms;
+  char *campaign;
+  char **inputs;
+  int num_inputs;
+};
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                        Globals                        ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static struct arguments arguments;
+static job_t *jobs = NULL;
+static unsigned int num_jobs = 0;
+// dataset manifest
+static dataset_entry_t *manifest = NULL;
+static unsigned int num_manifest = 0;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state);
+static void add_input(const char *path);
+static int filter_trace(const struct dirent *entry);
+static void group_passes(void);
+static int compare_passes(const void *a, const void *b);
+static void process_job(unsigned int j);
+static int run_job(job_t *job, FILE *report);
+// commands
+static int summarize(trace_reader_t *reader, const char *path, FILE *report);
+static int slice(trace_reader_t *reader, const char *path, FILE *report);
+static int merge(FILE *report);
+static int convert(trace_reader_t *reader, const char *path, FILE *report);
+static int convert_csv(trace_reader_t *reader, FILE *file);
+static int convert_npy(trace_reader_t *reader, FILE *file);
+static int align(job_t *job, FILE *report);
+static align_kind_t align_kind(const char *name);
+static int sample_deadline(trace_reader_t *reader, uint64_t index, uint64_t *deadline);
+static int dataset_shard(trace_reader_t *reader, job_t *job, FILE *report);
+// dataset manifest
+static void dataset_prepare(void);
+static void dataset_finish(void);
+static void parse_trace_name(const char *path, dataset_entry_t *entry);
+static int campaign_has(campaign_t *campaign, dataset_entry_t *entry);
+static void load_manifest(const char *path);
+static void write_manifest(const char *path);
+static int compare_entries(const void *a, const void *b);
+static void free_entry(dataset_entry_t *entry);
+// output traces
+static int output_open(output_trace_t *output, const char *path, trace_reader_t *reader, FILE *report);
+static void output_run(output_trace_t *output, const trace_run_t *run);
+static void output_sample(output_trace_t *output, const uint8_t *sample);
+static void output_close(output_trace_t *output);
+// helpers
+static char *output_path(const char *path, const char *suffix);
+static void write_npy_header(FILE *file, const char *fields, uint64_t num_rows);
+static void add_event_total(event_total_t *totals, unsigned int *num_totals, uint32_t id, uint64_t value, int live);
+static char *put_u64(char *dst, uint64_t value);
+
+static struct argp argp = {options, parse_opt, args_doc, doc};
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Main                          ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+int main(int argc, char *argv[]) {
+  memset(&arguments, 0, sizeof(arguments));
+  arguments.run = -1;
+  long online_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  arguments.num_jobs = online_cpus > 0 ? online_cpus : 1;
+  arguments.num_bins = DEFAULT_ALIGN_BINS;
+  arguments.bin_ms = DEFAULT_ALIGN_BIN_MS;
+  argp_parse(&argp, argc, argv, 0, 0, &arguments);
+  for (int i = 0; i < arguments.num_inputs; i++)
+    add_input(arguments.inputs[i]);
+  if (arguments.command == COMMAND_ALIGN)
+    group_passes();
+  if (arguments.command == COMMAND_DATASET)
+    dataset_prepare();
+  if (num_jobs == 0) {
+    printf("No trace to process.\n");
+    return arguments.command == COMMAND_DATASET ? 0 : 1;
+  }
+
+  uint64_t start = monotonic_ns();
+  int num_failed = 0;
+  if (arguments.command == COMMAND_MERGE) {
+    // a single output: the inputs are read in order
+    num_failed = merge(stdout);
+  } else {
+    run_pool(process_job, num_jobs, arguments.num_jobs);
+    for (unsigned int j = 0; j < num_jobs; j++) {
+      fwrite(jobs[j].report, 1, jobs[j].report_size, stdout);
+      num_failed += jobs[j].failed;
+      free(jobs[j].report);
+    }
+  }
+  if (arguments.command == COMMAND_DATASET)
+    dataset_finish();
+  fprintf(stderr, "%u job(s) processed in %.2f s, %d failed.\n", num_jobs, (monotonic_ns() - start) * 1e-9, num_failed);
+
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    for (unsigned int p = 0; p < jobs[j].num_passes; p++)
+      free(jobs[j].passes[p]);
+    free(jobs[j].passes);
+    free(jobs[j].path);
+    if (jobs[j].entry != NULL) {
+      free_entry(jobs[j].entry);
+      free(jobs[j].entry);
+    }
+  }
+  free(jobs);
+  for (unsigned int m = 0; m < num_manifest; m++)
+    free_entry(&manifest[m]);
+  free(manifest);
+  return num_failed > 0 ? 1 : 0;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static error_t parse_opt(int key, char *arg, struct argp_state *state) {
+  struct arguments *arguments = state->input;
+  switch (key) {
+    case 'j':
+      arguments->num_jobs = atoi(arg);
+      if (arguments->num_jobs == 0)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'o':
+      arguments->output = arg;
+      break;
+    case 'r':
+      arguments->run = atoi(arg);
+      if (arguments->run < 0)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'w': {
+      char *end;
+      arguments->window = 1;
+      arguments->window_start_ms = strtod(arg, &end);
+      arguments->window_end_ms = -1;
+      if (*end == ',' && *(end + 1) != '\0')
+        arguments->window_end_ms = strtod(end + 1, &end);
+      else if (*end == ',')
+        end++;
+      if (end == arg || *end != '\0' || arguments->window_start_ms < 0 ||
+          (arguments->window_end_ms >= 0 && arguments->window_end_ms <= arguments->window_start_ms))
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    }
+    case 'f':
+      if (!strcmp(arg, "csv"))
+        arguments->format = FORMAT_CSV;
+      else if (!strcmp(arg, "npy"))
+        arguments->format = FORMAT_NPY;
+      else
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'd': {
+      char *devices = strdup(arg);
+      for (char *device = strtok(devices, ","); device != NULL; device = strtok(NULL, ",")) {
+        if (!strcmp(device, "cpu"))
+          arguments->devices |= TRACE_DEVICE_CPU;
+        else if (!strcmp(device, "gpu"))
+          arguments->devices |= TRACE_DEVICE_GPU;
+        else
+          argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      }
+      free(devices);
+      break;
+    }
+    case 'a':
+      if (!strcmp(arg, "progress"))
+        arguments->align_time = 0;
+      else if (!strcmp(arg, "time"))
+        arguments->align_time = 1;
+      else
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'b':
+      arguments->num_bins = atoi(arg);
+      if (arguments->num_bins == 0)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case 'c':
+      arguments->campaign = arg;
+      break;
+    case 'm':
+      arguments->bin_ms = atof(arg);
+      if (arguments->bin_ms <= 0)
+        argp_failure(state, 1, 0, "invalid argument for option %c: %s. See --help for more information.", key, arg);
+      break;
+    case ARGP_KEY_ARG:
+      // the first argument is the command, the others the traces
+      if (state->arg_num > 0)
+        return ARGP_ERR_UNKNOWN;
+      if (!strcmp(arg, "summarize"))
+        arguments->command = COMMAND_SUMMARIZE;
+      else if (!strcmp(arg, "slice"))
+        arguments->command = COMMAND_SLICE;
+      else if (!strcmp(arg, "merge"))
+        arguments->command = COMMAND_MERGE;
+      else if (!strcmp(arg, "convert"))
+        arguments->command = COMMAND_CONVERT;
+      else if (!strcmp(arg, "align"))
+        arguments->command = COMMAND_ALIGN;
+      else if (!strcmp(arg, "dataset"))
+        arguments->command = COMMAND_DATASET;
+      else
+        argp_failure(state, 1, 0, "unknown command: %s. See --help for more information.", arg);
+      break;
+    case ARGP_KEY_ARGS:
+      arguments->inputs = state->argv + state->next;
+      arguments->num_inputs = state->argc - state->next;
+      break;
+    case ARGP_KEY_END:
+      if (arguments->command == COMMAND_NONE || arguments->num_inputs == 0)
+        argp_usage(state);
+      if (arguments->command == COMMAND_SLICE && arguments->run < 0 && !arguments->window)
+        argp_failure(state, 1, 0, "slice needs --run and/or --window. See --help for more information.");
+      if ((arguments->command == COMMAND_MERGE || arguments->command == COMMAND_DATASET) && arguments->output == NULL)
+        argp_failure(state, 1, 0, "missing required argument for option --output. See --help for more information.");
+      break;
+    default:
+      return ARGP_ERR_UNKNOWN;
+  }
+  return 0;
+}
+
+// a trace, or all the traces of a directory (in name order)
+static void add_input(const char *path) {
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+    struct dirent **entries;
+    int num_entries = scandir(path, &entries, filter_trace, alphasort);
+    if (num_entries < 0) {
+      printf("%s:%d: failed to read directory '%s'.\n", __FILE__, __LINE__, path);
+      exit(1);
+    }
+    for (int i = 0; i < num_entries; i++) {
+      char *trace = (char *)malloc_or_exit(strlen(path) + strlen(entries[i]->d_name) + 2);
+      sprintf(trace, "%s/%s", path, entries[i]->d_name);
+      add_input(trace);
+      free(trace);
+      free(entries[i]);
+    }
+    free(entries);
+    return;
+  }
+  jobs = (job_t *)realloc(jobs, sizeof(job_t) * (num_jobs + 1));
+  if (jobs == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  memset(&jobs[num_jobs], 0, sizeof(job_t));
+  jobs[num_jobs].path = strdup(path);
+  num_jobs++;
+}
+
+static int filter_trace(const struct dirent *entry) {
+  size_t len = strlen(entry->d_name);
+  return len > 4 && !strcmp(entry->d_name + len - 4, ".bin");
+}
+
+// align: the traces are passes of characterization runs, named <prefix>_<index>.bin;
+// the log <prefix>_<first>-<last>.log of a run tells which passes belong to it,
+// without logs all the traces of a prefix are passes of the same run
+static void group_passes(void) {
+  pass_t *passes = (pass_t *)malloc_or_exit(sizeof(pass_t) * num_jobs);
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    pass_t *pass = &passes[j];
+    char *path = jobs[j].path;
+    const char *name = strrchr(path, '/');
+    name = name != NULL ? name + 1 : path;
+    size_t len = strlen(path);
+    if (len > 4 && !strcmp(path + len - 4, ".bin"))
+      len -= 4;
+    size_t digits = len;
+    while (digits > 0 && path[digits - 1] >= '0' && path[digits - 1] <= '9')
+      digits--;
+    memset(pass, 0, sizeof(pass_t));
+    pass->path = path;
+    if (digits < len && path + digits - 1 > name && path[digits - 1] == '_') {
+      pass->prefix = strndup(path, digits - 1);
+      pass->index = atoi(path + digits);
+    } else {
+      pass->prefix = strndup(path, len);
+    }
+    // run of the pass, from the logs
+    glob_t logs;
+    char *pattern = (char *)malloc_or_exit(strlen(pass->prefix) + 8);
+    sprintf(pattern, "%s_*.log", pass->prefix);
+    if (glob(pattern, 0, NULL, &logs) == 0) {
+      for (size_t l = 0; l < logs.gl_pathc && !pass->has_log; l++) {
+        const char *range = logs.gl_pathv[l] + strlen(pass->prefix) + 1;
+        unsigned int first, last;
+        int end = 0;
+        if (sscanf(range, "%u-%u%n", &first, &last, &end) == 2 && !strcmp(range + end, ".log"))
+          ;
+        else if (sscanf(range, "%u%n", &first, &end) == 1 && !strcmp(range + end, ".log"))
+          last = first;
+        else
+          continue;
+        if (first <= pass->index && pass->index <= last) {
+          pass->has_log = 1;
+          pass->first = first;
+          pass->last = last;
+        }
+      }
+      globfree(&logs);
+    }
+    free(pattern);
+  }
+  qsort(passes, num_jobs, sizeof(pass_t), compare_passes);
+
+  // one job per run
+  job_t *runs = (job_t *)malloc_or_exit(sizeof(job_t) * num_jobs);
+  unsigned int num_runs = 0;
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    pass_t *pass = &passes[j];
+    pass_t *prev = j > 0 ? &passes[j - 1] : NULL;
+    if (prev == NULL || strcmp(pass->prefix, prev->prefix) || pass->has_log != prev->has_log || pass->first != prev->first) {
+      job_t *run = &runs[num_runs++];
+      memset(run, 0, sizeof(job_t));
+      run->path = (char *)malloc_or_exit(strlen(pass->prefix) + 24);
+      if (pass->has_log)
+        sprintf(run->path, "%s_%u-%u", pass->prefix, pass->first, pass->last);
+      else
+        strcpy(run->path, pass->prefix);
+      run->passes = (char **)malloc_or_exit(sizeof(char *) * num_jobs);
+    }
+    runs[num_runs - 1].passes[runs[num_runs - 1].num_passes++] = pass->path;
+  }
+  for (unsigned int j = 0; j < num_jobs; j++)
+    free(passes[j].prefix);
+  free(passes);
+  free(jobs);
+  jobs = runs;
+  num_jobs = num_runs;
+}
+
+// by run (prefix, then range from the log), then by pass index
+static int compare_passes(const void *a, const void *b) {
+  const pass_t *pass_a = (const pass_t *)a;
+  const pass_t *pass_b = (const pass_t *)b;
+  int cmp = strcmp(pass_a->prefix, pass_b->prefix);
+  if (cmp != 0)
+    return cmp;
+  if (pass_a->has_log != pass_b->has_log)
+    return pass_a->has_log - pass_b->has_log;
+  if (pass_a->first != pass_b->first)
+    return pass_a->first < pass_b->first ? -1 : 1;
+  if (pass_a->index != pass_b->index)
+    return pass_a->index < pass_b->index ? -1 : 1;
+  return 0;
+}
+
+// run a job of the pool, with its report in memory
+static void process_job(unsigned int j) {
+  FILE *report = open_memstream(&jobs[j].report, &jobs[j].report_size);
+  if (report == NULL) {
+    printf("%s:%d: failed to open memory stream.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  jobs[j].failed = run_job(&jobs[j], report);
+  fclose(report);
+}
+
+// return 1 on failure, with the reason in the report
+static int run_job(job_t *job, FILE *report) {
+  trace_reader_t reader;
+  int ret = 1;
+  if (arguments.command == COMMAND_ALIGN)
+    return align(job, report);
+  if (trace_reader_open(&reader, job->path, arguments.devices)) {
+    fprintf(report, "%s: %s\n", job->path, reader.error);
+    trace_reader_close(&reader);
+    return 1;
+  }
+  switch (arguments.command) {
+    case COMMAND_SUMMARIZE:
+      ret = summarize(&reader, job->path, report);
+      break;
+    case COMMAND_SLICE:
+      ret = slice(&reader, job->path, report);
+      break;
+    case COMMAND_CONVERT:
+      ret = convert(&reader, job->path, report);
+      break;
+    case COMMAND_DATASET:
+      ret = dataset_shard(&reader, job, report);
+      break;
+    default:
+      break;
+  }
+  trace_reader_close(&reader);
+  return ret;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                       Commands                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// power is sampled and held: each sample weighs until the deadline of the next one
+// of the run (the last one for a sampling period)
+static int summarize(trace_reader_t *reader, const char *path, FILE *report) {
+  trace_iter_t iter;
+  unsigned int num_rails = reader->num_power_rails;
+  double *energy = (double *)malloc_or_exit(sizeof(double) * (num_rails > 0 ? num_rails : 1));  // mW x ns
+  uint32_t *power = (uint32_t *)malloc_or_exit(sizeof(uint32_t) * (num_rails > 0 ? num_rails : 1));
+  unsigned int max_cpu_events = 0;
+  for (unsigned int c = 0; c < reader->num_cores; c++)
+    max_cpu_events += reader->cores[c].num_counters;
+  event_total_t *cpu_totals = (event_total_t *)malloc_or_exit(sizeof(event_total_t) * (max_cpu_events > 0 ? max_cpu_events : 1));
+  uint64_t **gpu_totals = (uint64_t **)malloc_or_exit(sizeof(uint64_t *) * (reader->num_gpu_groups > 0 ? reader->num_gpu_groups : 1));
+  for (unsigned int g = 0; g < reader->num_gpu_groups; g++)
+    gpu_totals[g] = (uint64_t *)malloc_or_exit(sizeof(uint64_t) * (reader->gpu_groups[g].num_events > 0 ? reader->gpu_groups[g].num_events : 1));
+  uint64_t period_ns = (uint64_t)reader->sample_period_us * 1000;
+  int ret = 0;
+
+  fprintf(report, "%s: version %u, %lu samples, %u run(s)\n", path, reader->version, reader->num_samples, reader->num_runs);
+  for (unsigned int r = 0; r < reader->num_runs && ret == 0; r++) {
+    uint64_t num_samples = 0, span_ns = 0, prev_deadline = 0;
+    unsigned int num_cpu_totals = 0;
+    memset(energy, 0, sizeof(double) * num_rails);
+    for (unsigned int g = 0; g < reader->num_gpu_groups; g++)
+      memset(gpu_totals[g], 0, sizeof(uint64_t) * reader->gpu_groups[g].num_events);
+
+    trace_iter_run(&iter, reader, r);
+    while ((ret = trace_iter_next(&iter)) > 0) {
+      const uint8_t *sample = iter.sample;
+      uint64_t deadline = trace_deadline_ns(reader, sample);
+      if (num_samples > 0) {
+        uint64_t dt = deadline > prev_deadline ? deadline - prev_deadline : 0;
+        span_ns += dt;
+        for (unsigned int p = 0; p < num_rails; p++)
+          energy[p] += (double)power[p] * dt;
+      }
+      memcpy(power, trace_power(reader, sample), sizeof(uint32_t) * num_rails);
+      prev_deadline = deadline;
+      for (unsigned int c = 0; c < reader->num_cores; c++) {
+        for (unsigned int e = 0; e < reader->cores[c].num_counters; e++)
+          add_event_total(cpu_totals, &num_cpu_totals, reader->cores[c].event_ids[e], trace_core_counter(reader, sample, c, e), trace_core_counter_live(reader, sample, c, e));
+      }
+      for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+        for (unsigned int i = 0; i < reader->gpu_groups[g].num_instances; i++)
+          for (unsigned int e = 0; e < reader->gpu_groups[g].num_events; e++)
+            gpu_totals[g][e] += trace_gpu_counter(reader, sample, g, i, e);
+      }
+      num_samples++;
+    }
+    trace_iter_free(&iter);
+    if (ret < 0) {
+      fprintf(report, "%s: %s\n", path, reader->error);
+      ret = 1;
+      break;
+    }
+    if (num_samples > 0) {
+      span_ns += period_ns;
+      for (unsigned int p = 0; p < num_rails; p++)
+        energy[p] += (double)power[p] * period_ns;
+    }
+
+    double total_energy = 0;
+    for (unsigned int p = 0; p < num_rails; p++)
+      total_energy += energy[p];
+    fprintf(report, "  run %u: %lu samples, %.3f s", r, num_samples, span_ns * 1e-9);
+    if (reader->runs[r].wall_ns > 0)
+      fprintf(report, " (wall time %.3f s)", reader->runs[r].wall_ns * 1e-9);
+    fprintf(report, ", energy %.4f J\n", total_energy * 1e-12);
+    if (num_rails > 0) {
+      fprintf(report, "    energy [J]:      ");
+      for (unsigned int p = 0; p < num_rails; p++)
+        fprintf(report, " power%u %.4f", p, energy[p] * 1e-12);
+      fprintf(report, "\n    mean power [mW]: ");
+      for (unsigned int p = 0; p < num_rails; p++)
+        fprintf(report, " power%u %.1f", p, span_ns > 0 ? energy[p] / span_ns : 0.0);
+      fprintf(report, "\n");
+    }
+    if (num_cpu_totals > 0 && (reader->flags & TRACE_FLAG_CPU_MUX)) {
+      // standard scaling of the multiplexed events, over the samples of the run
+      fprintf(report, "    CPU events (%u sets multiplexed every %u samples, scaled):\n     ", reader->mux_num_sets, reader->mux_samples);
+      for (unsigned int e = 0; e < num_cpu_totals; e++)
+        fprintf(report, " 0x%02x %.0f", cpu_totals[e].id, trace_mux_scale(cpu_totals[e].total, cpu_totals[e].live, cpu_totals[e].samples));
+      fprintf(report, "\n");
+    } else if (num_cpu_totals > 0) {
+      fprintf(report, "    CPU events:     ");
+      for (unsigned int e = 0; e < num_cpu_totals; e++)
+        fprintf(report, " 0x%02x %lu", cpu_totals[e].id, cpu_totals[e].total);
+      fprintf(report, "\n");
+    }
+    for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+      fprintf(report, "    GPU group %u:    ", g);
+      for (unsigned int e = 0; e < reader->gpu_groups[g].num_events; e++)
+        fprintf(report, " %u %lu", reader->gpu_groups[g].event_ids[e], gpu_totals[g][e]);
+      fprintf(report, "\n");
+    }
+  }
+
+  free(energy);
+  free(power);
+  free(cpu_totals);
+  for (unsigned int g = 0; g < reader->num_gpu_groups; g++)
+    free(gpu_totals[g]);
+  free(gpu_totals);
+  return ret;
+}
+
+// the runs kept are those with at least one sample in the slice; a run partially
+// kept starts at its first sample kept and lasts its samples times the sampling period
+static int slice(trace_reader_t *reader, const char *path, FILE *report) {
+  if (arguments.run >= 0 && (unsigned int)arguments.run >= reader->num_runs) {
+    fprintf(report, "%s: no run %d (%u runs)\n", path, arguments.run, reader->num_runs);
+    return 1;
+  }
+  unsigned int first_run = arguments.run >= 0 ? arguments.run : 0;
+  unsigned int end_run = arguments.run >= 0 ? (unsigned int)arguments.run + 1 : reader->num_runs;
+  char suffix[64] = "";
+  if (arguments.run >= 0)
+    sprintf(suffix, "_run%d", arguments.run);
+  if (arguments.window && arguments.window_end_ms >= 0)
+    sprintf(suffix + strlen(suffix), "_%g-%gms", arguments.window_start_ms, arguments.window_end_ms);
+  else if (arguments.window)
+    sprintf(suffix + strlen(suffix), "_from%gms", arguments.window_start_ms);
+  strcat(suffix, ".bin");
+  char *out_path = output_path(path, suffix);
+  output_trace_t output;
+  if (output_open(&output, out_path, reader, report)) {
+    free(out_path);
+    return 1;
+  }
+
+  trace_iter_t iter;
+  int ret = 0;
+  int started = 0;
+  uint64_t window_start = 0;
+  for (unsigned int r = first_run; r < end_run && ret == 0; r++) {
+    uint64_t run_samples = reader->runs[r].first_sample;
+    run_samples = (r + 1 < reader->num_runs ? reader->runs[r + 1].first_sample : reader->num_samples) - run_samples;
+    uint64_t kept = 0;
+    trace_iter_run(&iter, reader, r);
+    while ((ret = trace_iter_next(&iter)) > 0) {
+      uint64_t deadline = trace_deadline_ns(reader, iter.sample);
+      if (!started) {
+        window_start = deadline;
+        started = 1;
+      }
+      if (arguments.window) {
+        double t_ms = (deadline < window_start ? 0 : deadline - window_start) * 1e-6;
+        if (t_ms < arguments.window_start_ms || (arguments.window_end_ms >= 0 && t_ms >= arguments.window_end_ms))
+          continue;
+      }
+      if (kept == 0) {
+        trace_run_t run = reader->runs[r];
+        if (iter.next - 1 != run.first_sample)
+          run.start_ns = deadline;
+        output_run(&output, &run);
+      }
+      output_sample(&output, iter.sample);
+      kept++;
+    }
+    trace_iter_free(&iter);
+    if (kept > 0 && kept < run_samples)
+      output.footer.runs[output.footer.num_runs - 1].wall_ns = kept * reader->sample_period_us * 1000ULL;
+  }
+  if (ret < 0) {
+    fprintf(report, "%s: %s\n", path, reader->error);
+    ret = 1;
+  } else {
+    fprintf(report, "%s: %lu samples in %u run(s) written to %s\n", path, output.footer.num_samples, output.footer.num_runs, out_path);
+  }
+  output_close(&output);
+  free(out_path);
+  return ret;
+}
+
+// all the inputs must have the same v1 header (devices, events, rails, periods);
+// the output has the version of the first one
+static int merge(FILE *report) {
+  trace_reader_t *readers = (trace_reader_t *)malloc_or_exit(sizeof(trace_reader_t) * num_jobs);
+  output_trace_t output;
+  trace_iter_t iter;
+  unsigned int num_open = 0;
+  int ret = 0;
+  for (; num_open < num_jobs; num_open++) {
+    trace_reader_t *reader = &readers[num_open];
+    if (trace_reader_open(reader, jobs[num_open].path, arguments.devices)) {
+      fprintf(report, "%s: %s\n", jobs[num_open].path, reader->error);
+      trace_reader_close(reader);
+      ret = 1;
+      break;
+    }
+    if (num_open > 0 && (reader->devices != readers[0].devices || reader->flags != readers[0].flags ||
+                         reader->mux_samples != readers[0].mux_samples || reader->header_v1_bytes != readers[0].header_v1_bytes ||
+                         memcmp(reader->header_v1, readers[0].header_v1, reader->header_v1_bytes))) {
+      fprintf(report, "%s: header differs from the one of %s\n", jobs[num_open].path, jobs[0].path);
+      trace_reader_close(reader);
+      ret = 1;
+      break;
+    }
+  }
+  if (ret == 0 && output_open(&output, arguments.output, &readers[0], report) == 0) {
+    for (unsigned int t = 0; t < num_open && ret == 0; t++) {
+      trace_reader_t *reader = &readers[t];
+      for (unsigned int r = 0; r < reader->num_runs && ret == 0; r++) {
+        output_run(&output, &reader->runs[r]);
+        trace_iter_run(&iter, reader, r);
+        while ((ret = trace_iter_next(&iter)) > 0)
+          output_sample(&output, iter.sample);
+        trace_iter_free(&iter);
+        if (ret < 0) {
+          fprintf(report, "%s: %s\n", jobs[t].path, reader->error);
+          ret = 1;
+        }
+      }
+    }
+    if (ret == 0)
+      fprintf(report, "%u trace(s) merged into %s: %lu samples in %u run(s)\n", num_open, arguments.output, output.footer.num_samples, output.footer.num_runs);
+    output_close(&output);
+  } else {
+    ret = 1;
+  }
+  for (unsigned int t = 0; t < num_open; t++)
+    trace_reader_close(&readers[t]);
+  free(readers);
+  return ret;
+}
+
+static int convert(trace_reader_t *reader, const char *path, FILE *report) {
+  char *out_path = output_path(path, arguments.format == FORMAT_CSV ? ".csv" : ".npy");
+  FILE *file = fopen(out_path, "wb");
+  if (file == NULL) {
+    fprintf(report, "%s: failed to open '%s'\n", path, out_path);
+    free(out_path);
+    return 1;
+  }
+  setvbuf(file, NULL, _IOFBF, CONVERT_BUFFER_BYTES);
+  int ret = arguments.format == FORMAT_CSV ? convert_csv(reader, file) : convert_npy(reader, file);
+  if (fclose(file) != 0 && ret == 0) {
+    snprintf(reader->error, TRACE_READER_ERROR_LEN, "failed to write '%s'", out_path);
+    ret = 1;
+  }
+  if (ret)
+    fprintf(report, "%s: %s\n", path, reader->error);
+  else
+    fprintf(report, "%s: %lu samples written to %s\n", path, reader->num_samples, out_path);
+  free(out_path);
+  return ret;
+}
+
+// one row per sample: run index, then all the columns of the trace
+static int convert_csv(trace_reader_t *reader, FILE *file) {
+  trace_schema_t *schema = &reader->schema;
+  trace_iter_t iter;
+  int ret = 0;
+  char *line = (char *)malloc_or_exit((size_t)(schema->num_columns + 1) * 21 + 1);
+  fprintf(file, "run");
+  for (unsigned int i = 0; i < schema->num_columns; i++)
+    fprintf(file, ",%s", schema->columns[i].name);
+  fprintf(file, "\n");
+  for (unsigned int r = 0; r < reader->num_runs && ret == 0; r++) {
+    trace_iter_run(&iter, reader, r);
+    while ((ret = trace_iter_next(&iter)) > 0) {
+      char *ptr = put_u64(line, r);
+      for (unsigned int i = 0; i < schema->num_columns; i++) {
+        *ptr++ = ',';
+        ptr = put_u64(ptr, trace_column_value(reader, iter.sample, i));
+      }
+      *ptr++ = '\n';
+      fwrite(line, 1, ptr - line, file);
+    }
+    trace_iter_free(&iter);
+  }
+  free(line);
+  return ret < 0 ? 1 : 0;
+}
+
+// 1-D structured array: one record per sample, a u32 run index followed by the
+// raw sample (the fields are packed as in the trace)
+static int convert_npy(trace_reader_t *reader, FILE *file) {
+  trace_schema_t *schema = &reader->schema;
+  trace_iter_t iter;
+  int ret = 0;
+  char *fields;
+  size_t fields_len;
+  FILE *stream = open_memstream(&fields, &fields_len);
+  if (stream == NULL) {
+    printf("%s:%d: failed to open memory stream.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  fprintf(stream, "('run', '<u4')");
+  for (unsigned int i = 0; i < schema->num_columns; i++)
+    fprintf(stream, ", ('%s', '<u%u')", schema->columns[i].name, schema->columns[i].size);
+  fclose(stream);
+  write_npy_header(file, fields, reader->num_samples);
+  free(fields);
+
+  for (uint32_t r = 0; r < reader->num_runs && ret == 0; r++) {
+    trace_iter_run(&iter, reader, r);
+    while ((ret = trace_iter_next(&iter)) > 0) {
+      fwrite(&r, sizeof(uint32_t), 1, file);
+      fwrite(iter.sample, 1, reader->sample_bytes, file);
+    }
+    trace_iter_free(&iter);
+  }
+  return ret < 0 ? 1 : 0;
+}
+
+// runs with the same index are aligned across passes; each run is cut in windows,
+// by progress (the same number of windows in every pass, whatever its duration)
+// or by time from its first sample (as many windows as fit in the shortest pass),
+// at most one window per sample of the shortest pass.
+// Passes are streamed one at a time: only the windows of the run are in memory
+static int align(job_t *job, FILE *report) {
+  unsigned int num_passes = job->num_passes;
+  trace_reader_t *readers = (trace_reader_t *)malloc_or_exit(sizeof(trace_reader_t) * num_passes);
+  int **maps = (int **)malloc_or_exit(sizeof(int *) * num_passes);
+  align_column_t *columns = NULL;
+  unsigned int num_columns = 0;
+  unsigned int num_open = 0;
+  uint32_t num_runs = UINT32_MAX;
+  int ret = 0;
+
+  // columns of the matrix: all the columns of the passes, once
+  for (; num_open < num_passes; num_open++) {
+    trace_reader_t *reader = &readers[num_open];
+    if (trace_reader_open(reader, job->passes[num_open], arguments.devices)) {
+      fprintf(report, "%s: %s\n", job->passes[num_open], reader->error);
+      trace_reader_close(reader);
+      ret = 1;
+      break;
+    }
+    if (reader->num_runs < num_runs)
+      num_runs = reader->num_runs;
+    maps[num_open] = (int *)malloc_or_exit(sizeof(int) * (reader->schema.num_columns > 0 ? reader->schema.num_columns : 1));
+    for (unsigned int c = 0; c < reader->schema.num_columns; c++) {
+      const char *name = reader->schema.columns[c].name;
+      align_kind_t kind = align_kind(name);
+      int k = -1;
+      if (kind != ALIGN_SKIP) {
+        for (unsigned int i = 0; i < num_columns && k < 0; i++)
+          if (!strcmp(columns[i].name, name))
+            k = i;
+        if (k < 0) {
+          columns = (align_column_t *)realloc(columns, sizeof(align_column_t) * (num_columns + 1));
+          if (columns == NULL) {
+            printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+            exit(1);
+          }
+          memset(&columns[num_columns], 0, sizeof(align_column_t));
+          strcpy(columns[num_columns].name, name);
+          columns[num_columns].kind = kind;
+          k = num_columns++;
+        } else if (kind == ALIGN_SUM) {
+          // counted in an earlier pass
+          k = -1;
+        }
+      }
+      maps[num_open][c] = k;
+    }
+  }
+
+  // windows of each run: first deadline and duration of the run in each pass
+  uint64_t *t0 = NULL, *span = NULL;
+  unsigned int *run_bins = NULL, max_bins = 0;
+  uint64_t num_rows = 0;
+  uint64_t bin_ns = (uint64_t)(arguments.bin_ms * 1e6);
+  if (ret == 0) {
+    size_t num_spans = num_runs > 0 ? (size_t)num_runs * num_passes : 1;
+    t0 = (uint64_t *)malloc_or_exit(sizeof(uint64_t) * num_spans);
+    span = (uint64_t *)malloc_or_exit(sizeof(uint64_t) * num_spans);
+    run_bins = (unsigned int *)malloc_or_exit(sizeof(unsigned int) * (num_runs > 0 ? num_runs : 1));
+  }
+  for (unsigned int r = 0; r < num_runs && ret == 0; r++) {
+    uint64_t min_span = UINT64_MAX, min_samples = UINT64_MAX;
+    for (unsigned int p = 0; p < num_passes && ret == 0; p++) {
+      trace_reader_t *reader = &readers[p];
+      uint64_t first = reader->runs[r].first_sample;
+      uint64_t end = r + 1 < reader->num_runs ? reader->runs[r + 1].first_sample : reader->num_samples;
+      uint64_t last;
+      unsigned int i = r * num_passes + p;
+      if (first >= end) {
+        min_span = 0;
+        continue;
+      }
+      if (end - first < min_samples)
+        min_samples = end - first;
+      if (sample_deadline(reader, first, &t0[i]) || sample_deadline(reader, end - 1, &last)) {
+        fprintf(report, "%s: %s\n", job->passes[p], reader->error);
+        ret = 1;
+        break;
+      }
+      span[i] = (last > t0[i] ? last - t0[i] : 0) + (uint64_t)reader->sample_period_us * 1000;
+      if (span[i] < min_span)
+        min_span = span[i];
+    }
+    if (min_span == 0 || min_span == UINT64_MAX)
+      run_bins[r] = 0;
+    else if (arguments.align_time)
+      run_bins[r] = min_span / bin_ns > 0 ? min_span / bin_ns : 1;
+    else
+      run_bins[r] = arguments.num_bins;
+    // not more windows than samples, most would be empty
+    if (run_bins[r] > min_samples)
+      run_bins[r] = min_samples;
+    if (run_bins[r] == 0)
+      fprintf(report, "%s: run %u skipped, empty in some pass\n", job->path, r);
+    if (run_bins[r] > max_bins)
+      max_bins = run_bins[r];
+    num_rows += run_bins[r];
+  }
+
+  // stream the passes run by run
+  char *out_path = NULL;
+  FILE *file = NULL;
+  if (ret == 0) {
+    out_path = output_path(job->path, arguments.format == FORMAT_CSV ? ".aligned.csv" : ".aligned.npy");
+    file = fopen(out_path, "wb");
+    if (file == NULL) {
+      fprintf(report, "%s: failed to open '%s'\n", job->path, out_path);
+      ret = 1;
+    }
+  }
+  if (ret == 0) {
+    setvbuf(file, NULL, _IOFBF, CONVERT_BUFFER_BYTES);
+    for (unsigned int k = 0; k < num_columns; k++) {
+      columns[k].sum = (double *)malloc_or_exit(sizeof(double) * (max_bins > 0 ? max_bins : 1));
+      columns[k].count = (uint64_t *)malloc_or_exit(sizeof(uint64_t) * (max_bins > 0 ? max_bins : 1));
+    }
+    if (arguments.format == FORMAT_CSV) {
+      fprintf(file, "run,bin");
+      for (unsigned int k = 0; k < num_columns; k++)
+        fprintf(file, ",%s", columns[k].name);
+      fprintf(file, "\n");
+    } else {
+      char *fields;
+      size_t fields_len;
+      FILE *stream = open_memstream(&fields, &fields_len);
+      if (stream == NULL) {
+        printf("%s:%d: failed to open memory stream.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      fprintf(stream, "('run', '<u4'), ('bin', '<u4')");
+      for (unsigned int k = 0; k < num_columns; k++)
+        fprintf(stream, ", ('%s', '<f8')", columns[k].name);
+      fclose(stream);
+      write_npy_header(file, fields, num_rows);
+      free(fields);
+    }
+  }
+  for (uint32_t r = 0; r < num_runs && ret == 0; r++) {
+    unsigned int bins = run_bins[r];
+    if (bins == 0)
+      continue;
+    for (unsigned int k = 0; k < num_columns; k++) {
+      memset(columns[k].sum, 0, sizeof(double) * bins);
+      memset(columns[k].count, 0, sizeof(uint64_t) * bins);
+    }
+    for (unsigned int p = 0; p < num_passes && ret == 0; p++) {
+      trace_reader_t *reader = &readers[p];
+      trace_iter_t iter;
+      unsigned int i = r * num_passes + p;
+      trace_iter_run(&iter, reader, r);
+      while ((ret = trace_iter_next(&iter)) > 0) {
+        uint64_t deadline = trace_deadline_ns(reader, iter.sample);
+        uint64_t offset = deadline > t0[i] ? deadline - t0[i] : 0;
+        uint64_t bin = arguments.align_time ? offset / bin_ns : offset * bins / span[i];
+        if (bin >= bins)
+          continue;
+        for (unsigned int c = 0; c < reader->schema.num_columns; c++) {
+          int k = maps[p][c];
+          if (k < 0)
+            continue;
+          columns[k].sum[bin] += trace_column_value(reader, iter.sample, c);
+          columns[k].count[bin]++;
+        }
+      }
+      trace_iter_free(&iter);
+      if (ret < 0) {
+        fprintf(report, "%s: %s\n", job->passes[p], reader->error);
+        ret = 1;
+      }
+    }
+    for (uint32_t b = 0; b < bins && ret == 0; b++) {
+      if (arguments.format == FORMAT_CSV)
+        fprintf(file, "%u,%u", r, b);
+      else {
+        fwrite(&r, sizeof(uint32_t), 1, file);
+        fwrite(&b, sizeof(uint32_t), 1, file);
+      }
+      for (unsigned int k = 0; k < num_columns; k++) {
+        // a window without samples has no value, whatever the column
+        double value = columns[k].count[b] == 0 ? NAN : columns[k].sum[b];
+        if (columns[k].kind == ALIGN_MEAN)
+          value /= columns[k].count[b];
+        if (arguments.format == FORMAT_CSV)
+          fprintf(file, ",%.10g", value);
+        else
+          fwrite(&value, sizeof(double), 1, file);
+      }
+      if (arguments.format == FORMAT_CSV)
+        fprintf(file, "\n");
+    }
+  }
+  if (file != NULL && fclose(file) != 0 && ret == 0) {
+    fprintf(report, "%s: failed to write '%s'\n", job->path, out_path);
+    ret = 1;
+  }
+  if (ret == 0)
+    fprintf(report, "%s: %u pass(es), %lu windows x %u columns written to %s\n", job->path, num_passes, num_rows, num_columns, out_path);
+
+  for (unsigned int k = 0; k < num_columns; k++) {
+    free(columns[k].sum);
+    free(columns[k].count);
+  }
+  free(columns);
+  for (unsigned int p = 0; p < num_open; p++) {
+    free(maps[p]);
+    trace_reader_close(&readers[p]);
+  }
+  free(maps);
+  free(readers);
+  free(t0);
+  free(span);
+  free(run_bins);
+  free(out_path);
+  return ret;
+}
+
+// samples timing is dropped, counters are summed, frequencies and power averaged
+static align_kind_t align_kind(const char *name) {
+  size_t len = strlen(name);
+  if (!strcmp(name, "sampling_time") || !strcmp(name, "deadline_ns") || !strcmp(name, "wake_ns") || !strcmp(name, "fresh"))
+    return ALIGN_SKIP;
+  if (!strncmp(name, "power", 5) || (len > 5 && !strcmp(name + len - 5, ".freq")))
+    return ALIGN_MEAN;
+  return ALIGN_SUM;
+}
+
+static int sample_deadline(trace_reader_t *reader, uint64_t index, uint64_t *deadline) {
+  trace_iter_t iter;
+  trace_iter_init(&iter, reader, index, index + 1);
+  int ret = trace_iter_next(&iter);
+  if (ret > 0)
+    *deadline = trace_deadline_ns(reader, iter.sample);
+  trace_iter_free(&iter);
+  return ret > 0 ? 0 : 1;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Dataset                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// one row per sample: run, fresh flags, sample interval (from the deadline of the
+// previous sample of the run; the sampling period for the first one), labels
+// (frequencies set for the run and measured, power), then the counters normalized
+// by the clock cycles of their core (CPU only) and by the sample interval (NaN
+// for the multiplexed CPU events not counted in the sample)
+static int dataset_shard(trace_reader_t *reader, job_t *job, FILE *report) {
+  dataset_entry_t *entry = job->entry;
+  unsigned int num_values = 0;
+  char *fields;
+  size_t fields_len;
+  FILE *stream = open_memstream(&fields, &fields_len);
+  if (stream == NULL) {
+    printf("%s:%d: failed to open memory stream.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  fprintf(stream, "('run', '<u4'), ('fresh', '<u4'), ('interval_ns', '<f8')");
+  num_values++;
+  if (reader->devices & TRACE_DEVICE_CPU) {
+    fprintf(stream, ", ('cpu_freq_set', '<f8')");
+    num_values++;
+  }
+  if (reader->devices & TRACE_DEVICE_GPU) {
+    fprintf(stream, ", ('gpu_freq_set', '<f8')");
+    num_values++;
+  }
+  for (unsigned int c = 0; c < reader->num_cores; c++) {
+    fprintf(stream, ", ('cpu%u.freq', '<f8'), ('cpu%u.clk/s', '<f8')", c, c);
+    num_values += 2;
+    for (unsigned int e = 0; e < reader->cores[c].num_counters; e++) {
+      uint32_t id = reader->cores[c].event_ids[e];
+      fprintf(stream, ", ('cpu%u.0x%02x/clk', '<f8'), ('cpu%u.0x%02x/s', '<f8')", c, id, c, id);
+      num_values += 2;
+    }
+  }
+  if (reader->devices & TRACE_DEVICE_GPU) {
+    fprintf(stream, ", ('gpu.freq', '<f8')");
+    num_values++;
+  }
+  for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+    trace_gpu_group_layout_t *group = &reader->gpu_groups[g];
+    for (unsigned int i = 0; i < group->num_instances; i++) {
+      for (unsigned int e = 0; e < group->num_events; e++)
+        fprintf(stream, ", ('gpu.g%u.i%u.%u/s', '<f8')", g, i, group->event_ids[e]);
+    }
+    num_values += group->num_instances * group->num_events;
+  }
+  for (unsigned int p = 0; p < reader->num_power_rails; p++)
+    fprintf(stream, ", ('power%u', '<f8')", p);
+  fprintf(stream, ", ('power', '<f8')");
+  num_values += reader->num_power_rails + 1;
+  fclose(stream);
+
+  // shards are written aside, then renamed: the manifest never points to a partial one
+  char *shard_path = (char *)malloc_or_exit(strlen(arguments.output) + strlen(entry->shard) + 8);
+  char *tmp_path = (char *)malloc_or_exit(strlen(arguments.output) + strlen(entry->shard) + 8);
+  sprintf(shard_path, "%s/%s", arguments.output, entry->shard);
+  sprintf(tmp_path, "%s.tmp", shard_path);
+  FILE *file = fopen(tmp_path, "wb");
+  if (file == NULL) {
+    fprintf(report, "%s: failed to open '%s'\n", job->path, tmp_path);
+    free(fields);
+    free(shard_path);
+    free(tmp_path);
+    return 1;
+  }
+  setvbuf(file, NULL, _IOFBF, CONVERT_BUFFER_BYTES);
+  write_npy_header(file, fields, reader->num_samples);
+  free(fields);
+
+  size_t row_bytes = 2 * sizeof(uint32_t) + sizeof(double) * num_values;
+  uint8_t *row = (uint8_t *)malloc_or_exit(row_bytes);
+  double *values = (double *)malloc_or_exit(sizeof(double) * num_values);
+  double period_ns = reader->sample_period_us * 1e3;
+  trace_iter_t iter;
+  int ret = 0;
+  for (uint32_t r = 0; r < reader->num_runs && ret == 0; r++) {
+    uint64_t prev_deadline = 0;
+    int first = 1;
+    trace_iter_run(&iter, reader, r);
+    while ((ret = trace_iter_next(&iter)) > 0) {
+      const uint8_t *sample = iter.sample;
+      uint64_t deadline = trace_deadline_ns(reader, sample);
+      double interval_ns = first || deadline <= prev_deadline ? period_ns : (double)(deadline - prev_deadline);
+      double per_s = 1e9 / interval_ns;
+      uint32_t fresh = trace_fresh(reader, sample);
+      double *value = values;
+      prev_deadline = deadline;
+      first = 0;
+      *value++ = interval_ns;
+      if (reader->devices & TRACE_DEVICE_CPU)
+        *value++ = entry->cpu_freq;
+      if (reader->devices & TRACE_DEVICE_GPU)
+        *value++ = entry->gpu_freq;
+      for (unsigned int c = 0; c < reader->num_cores; c++) {
+        double clk = trace_core_clk(reader, sample, c);
+        *value++ = trace_core_freq(reader, sample, c);
+        *value++ = clk * per_s;
+        for (unsigned int e = 0; e < reader->cores[c].num_counters; e++) {
+          int live = trace_core_counter_live(reader, sample, c, e);
+          double counter = trace_core_counter(reader, sample, c, e);
+          *value++ = !live ? NAN : clk > 0 ? counter / clk : 0;
+          *value++ = live ? counter * per_s : NAN;
+        }
+      }
+      if (reader->devices & TRACE_DEVICE_GPU)
+        *value++ = trace_gpu_freq(reader, sample);
+      for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+        for (unsigned int i = 0; i < reader->gpu_groups[g].num_instances; i++)
+          for (unsigned int e = 0; e < reader->gpu_groups[g].num_events; e++)
+            *value++ = trace_gpu_counter(reader, sample, g, i, e) * per_s;
+      }
+      const uint32_t *power = trace_power(reader, sample);
+      double total_power = 0;
+      for (unsigned int p = 0; p < reader->num_power_rails; p++) {
+        *value++ = power[p];
+        total_power += power[p];
+      }
+      *value++ = total_power;
+      memcpy(row, &r, sizeof(uint32_t));
+      memcpy(row + sizeof(uint32_t), &fresh, sizeof(uint32_t));
+      memcpy(row + 2 * sizeof(uint32_t), values, sizeof(double) * num_values);
+      fwrite(row, 1, row_bytes, file);
+    }
+    trace_iter_free(&iter);
+  }
+  if (ret < 0)
+    fprintf(report, "%s: %s\n", job->path, reader->error);
+  if (fclose(file) != 0 && ret == 0) {
+    fprintf(report, "%s: failed to write '%s'\n", job->path, tmp_path);
+    ret = -1;
+  }
+  if (ret == 0 && rename(tmp_path, shard_path) != 0) {
+    fprintf(report, "%s: failed to rename '%s'\n", job->path, tmp_path);
+    ret = -1;
+  }
+  if (ret == 0) {
+    entry->rows = reader->num_samples;
+    fprintf(report, "%s: %lu rows x %u features written to %s\n", job->path, reader->num_samples, num_values, shard_path);
+  } else {
+    remove(tmp_path);
+  }
+  free(row);
+  free(values);
+  free(shard_path);
+  free(tmp_path);
+  return ret < 0 ? 1 : 0;
+}
+
+// keep the traces to process: out of the campaign (if any) or already in the
+// manifest with the same size and modification time are dropped
+static void dataset_prepare(void) {
+  if (mkdir(arguments.output, 0755) != 0 && errno != EEXIST) {
+    printf("%s:%d: failed to create directory '%s'.\n", __FILE__, __LINE__, arguments.output);
+    exit(1);
+  }
+  char *manifest_path = (char *)malloc_or_exit(strlen(arguments.output) + strlen(DATASET_MANIFEST) + 2);
+  sprintf(manifest_path, "%s/%s", arguments.output, DATASET_MANIFEST);
+  load_manifest(manifest_path);
+  free(manifest_path);
+  campaign_t campaign;
+  if (arguments.campaign != NULL)
+    parse_campaign_json(arguments.campaign, &campaign);
+
+  unsigned int num_kept = 0, num_up_to_date = 0, num_out = 0;
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    job_t *job = &jobs[j];
+    dataset_entry_t entry;
+    char resolved[PATH_MAX];
+    struct stat st;
+    memset(&entry, 0, sizeof(dataset_entry_t));
+    if (realpath(job->path, resolved) != NULL && stat(resolved, &st) == 0) {
+      entry.trace = strdup(resolved);
+      entry.size = st.st_size;
+      entry.mtime_ns = (uint64_t)st.st_mtim.tv_sec * 1000000000ULL + st.st_mtim.tv_nsec;
+    } else {
+      entry.trace = strdup(job->path);
+    }
+    parse_trace_name(job->path, &entry);
+    int drop = 0;
+    if (arguments.campaign != NULL && !campaign_has(&campaign, &entry)) {
+      num_out++;
+      drop = 1;
+    }
+    for (unsigned int m = 0; m < num_manifest && !drop; m++) {
+      if (strcmp(manifest[m].shard, entry.shard))
+        continue;
+      if (strcmp(manifest[m].trace, entry.trace)) {
+        printf("%s: shard %s already holds %s, skipped\n", job->path, entry.shard, manifest[m].trace);
+        drop = 1;
+      } else if (manifest[m].size == entry.size && manifest[m].mtime_ns == entry.mtime_ns) {
+        char *shard_path = (char *)malloc_or_exit(strlen(arguments.output) + strlen(entry.shard) + 2);
+        sprintf(shard_path, "%s/%s", arguments.output, entry.shard);
+        if (access(shard_path, F_OK) == 0) {
+          num_up_to_date++;
+          drop = 1;
+        }
+        free(shard_path);
+      }
+    }
+    for (unsigned int k = 0; k < num_kept && !drop; k++) {
+      if (!strcmp(jobs[k].entry->shard, entry.shard)) {
+        printf("%s: shard %s already holds %s, skipped\n", job->path, entry.shard, jobs[k].path);
+        drop = 1;
+      }
+    }
+    if (drop) {
+      free_entry(&entry);
+      free(job->path);
+      continue;
+    }
+    job->entry = (dataset_entry_t *)malloc_or_exit(sizeof(dataset_entry_t));
+    *job->entry = entry;
+    jobs[num_kept++] = *job;
+  }
+  num_jobs = num_kept;
+  if (arguments.campaign != NULL)
+    free_campaign(&campaign);
+  printf("Dataset %s: %u trace(s) to process, %u up to date, %u out of the campaign.\n", arguments.output, num_kept, num_up_to_date, num_out);
+}
+
+// the entries of the traces processed now replace the old ones
+static void dataset_finish(void) {
+  for (unsigned int j = 0; j < num_jobs; j++) {
+    if (jobs[j].failed || jobs[j].entry == NULL)
+      continue;
+    unsigned int m = 0;
+    while (m < num_manifest && strcmp(manifest[m].shard, jobs[j].entry->shard))
+      m++;
+    if (m == num_manifest) {
+      manifest = (dataset_entry_t *)realloc(manifest, sizeof(dataset_entry_t) * (num_manifest + 1));
+      if (manifest == NULL) {
+        printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+        exit(1);
+      }
+      num_manifest++;
+    } else {
+      free_entry(&manifest[m]);
+    }
+    manifest[m] = *jobs[j].entry;
+    free(jobs[j].entry);
+    jobs[j].entry = NULL;
+  }
+  qsort(manifest, num_manifest, sizeof(dataset_entry_t), compare_entries);
+  char *manifest_path = (char *)malloc_or_exit(strlen(arguments.output) + strlen(DATASET_MANIFEST) + 2);
+  sprintf(manifest_path, "%s/%s", arguments.output, DATASET_MANIFEST);
+  write_manifest(manifest_path);
+  free(manifest_path);
+  uint64_t num_rows = 0;
+  for (unsigned int m = 0; m < num_manifest; m++)
+    num_rows += manifest[m].rows;
+  printf("Dataset %s: %u shard(s), %lu rows.\n", arguments.output, num_manifest, num_rows);
+}
+
+// <benchmark>[_cpu_<freq>][_gpu_<freq>]_<i>.bin, as named by Voltmeter
+static void parse_trace_name(const char *path, dataset_entry_t *entry) {
+  const char *name = strrchr(path, '/');
+  name = name != NULL ? name + 1 : path;
+  size_t stem = strlen(name);
+  if (stem > 4 && !strcmp(name + stem - 4, ".bin"))
+    stem -= 4;
+  entry->shard = (char *)malloc_or_exit(stem + 5);
+  sprintf(entry->shard, "%.*s.npy", (int)stem, name);
+  size_t bench = stem;
+  for (const char *label = name; (label = strstr(label, "_cpu_")) != NULL && (size_t)(label - name) < stem; label++) {
+    entry->cpu_freq = strtoul(label + 5, NULL, 10);
+    bench = label - name;
+  }
+  for (const char *label = name; (label = strstr(label, "_gpu_")) != NULL && (size_t)(label - name) < stem; label++) {
+    entry->gpu_freq = strtoul(label + 5, NULL, 10);
+    if ((size_t)(label - name) < bench || entry->cpu_freq == 0)
+      bench = label - name;
+  }
+  if (bench == stem) {
+    // no frequency in the name: drop the trace number
+    while (bench > 0 && name[bench - 1] >= '0' && name[bench - 1] <= '9')
+      bench--;
+    if (bench > 0 && bench < stem && name[bench - 1] == '_')
+      bench--;
+    else
+      bench = stem;
+  }
+  entry->benchmark = strndup(name, bench);
+}
+
+// benchmark and frequencies of the trace are in the campaign (0 = any frequency)
+static int campaign_has(campaign_t *campaign, dataset_entry_t *entry) {
+  int found = 0;
+  for (unsigned int b = 0; b < campaign->num_benchmarks && !found; b++)
+    found = !strcmp(campaign->benchmarks[b].name, entry->benchmark);
+  if (!found)
+    return 0;
+  if (entry->cpu_freq != 0 && campaign->num_freqs_cpu > 0) {
+    found = 0;
+    for (unsigned int f = 0; f < campaign->num_freqs_cpu && !found; f++)
+      found = campaign->freqs_cpu[f] == 0 || campaign->freqs_cpu[f] == entry->cpu_freq;
+    if (!found)
+      return 0;
+  }
+  if (entry->gpu_freq != 0 && campaign->num_freqs_gpu > 0) {
+    found = 0;
+    for (unsigned int f = 0; f < campaign->num_freqs_gpu && !found; f++)
+      found = campaign->freqs_gpu[f] == 0 || campaign->freqs_gpu[f] == entry->gpu_freq;
+  }
+  return found;
+}
+
+// tab-separated, one shard per line, lines starting with '#' are comments
+static void load_manifest(const char *path) {
+  FILE *fp = fopen(path, "r");
+  if (fp == NULL)
+    return;
+  char *line = NULL;
+  size_t line_size = 0;
+  ssize_t len;
+  while ((len = getline(&line, &line_size, fp)) > 0) {
+    if (line[0] == '#' || line[0] == '\n')
+      continue;
+    if (line[len - 1] == '\n')
+      line[len - 1] = '\0';
+    char *fields[8];
+    char *rest = line;
+    unsigned int num_fields = 0;
+    while (num_fields < 8 && (fields[num_fields] = strsep(&rest, "\t")) != NULL)
+      num_fields++;
+    if (num_fields != 8) {
+      printf("%s:%d: malformed line in '%s'.\n", __FILE__, __LINE__, path);
+      exit(1);
+    }
+    manifest = (dataset_entry_t *)realloc(manifest, sizeof(dataset_entry_t) * (num_manifest + 1));
+    if (manifest == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    dataset_entry_t *entry = &manifest[num_manifest++];
+    entry->shard = strdup(fields[0]);
+    entry->trace = strdup(fields[1]);
+    entry->size = strtoull(fields[2], NULL, 10);
+    entry->mtime_ns = strtoull(fields[3], NULL, 10);
+    entry->benchmark = strdup(fields[4]);
+    entry->cpu_freq = strtoul(fields[5], NULL, 10);
+    entry->gpu_freq = strtoul(fields[6], NULL, 10);
+    entry->rows = strtoull(fields[7], NULL, 10);
+  }
+  free(line);
+  fclose(fp);
+}
+
+// written aside, then renamed
+static void write_manifest(const char *path) {
+  char *tmp_path = (char *)malloc_or_exit(strlen(path) + 5);
+  sprintf(tmp_path, "%s.tmp", path);
+  FILE *fp = fopen(tmp_path, "w");
+  if (fp == NULL) {
+    printf("%s:%d: failed to open file '%s'.\n", __FILE__, __LINE__, tmp_path);
+    exit(1);
+  }
+  fprintf(fp, "# shard\ttrace\tsize\tmtime_ns\tbenchmark\tcpu_freq\tgpu_freq\trows\n");
+  for (unsigned int m = 0; m < num_manifest; m++) {
+    dataset_entry_t *entry = &manifest[m];
+    fprintf(fp, "%s\t%s\t%lu\t%lu\t%s\t%u\t%u\t%lu\n", entry->shard, entry->trace, entry->size, entry->mtime_ns,
+      entry->benchmark, entry->cpu_freq, entry->gpu_freq, entry->rows);
+  }
+  if (fclose(fp) != 0 || rename(tmp_path, path) != 0) {
+    printf("%s:%d: failed to write file '%s'.\n", __FILE__, __LINE__, path);
+    exit(1);
+  }
+  free(tmp_path);
+}
+
+static int compare_entries(const void *a, const void *b) {
+  return strcmp(((const dataset_entry_t *)a)->shard, ((const dataset_entry_t *)b)->shard);
+}
+
+static void free_entry(dataset_entry_t *entry) {
+  free(entry->shard);
+  free(entry->trace);
+  free(entry->benchmark);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                     Output traces                     │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+static int output_open(output_trace_t *output, const char *path, trace_reader_t *reader, FILE *report) {
+  memset(output, 0, sizeof(output_trace_t));
+  output->reader = reader;
+  output->file = fopen(path, "wb");
+  if (output->file == NULL) {
+    fprintf(report, "%s: failed to open for writing\n", path);
+    return 1;
+  }
+  trace_writer_start(&output->writer, output->file);
+  if (reader->version == TRACE_VERSION_COLUMNAR) {
+    trace_encoder_init(&output->encoder, &reader->schema);
+    trace_write_header_v2(&output->writer, &reader->schema, reader->header_v1, reader->header_v1_bytes);
+  } else {
+    trace_write_header_v1(&output->writer, reader->header_v1, reader->header_v1_bytes);
+  }
+  output->footer.trace_version = reader->version;
+  output->footer.devices = reader->devices;
+  output->footer.flags = reader->flags;
+  output->footer.mux_samples = reader->mux_samples;
+  output->footer.mux_set_counters = reader->mux_set_counters;
+  output->footer.sample_bytes = reader->sample_bytes;
+  output->footer.data_offset = output->writer.offset;
+  return 0;
+}
+
+// start a run at the next sample; its start and wall time are those given
+static void output_run(output_trace_t *output, const trace_run_t *run) {
+  trace_footer_t *footer = &output->footer;
+  if (footer->num_runs == output->runs_capacity) {
+    output->runs_capacity = output->runs_capacity > 0 ? 2 * output->runs_capacity : 16;
+    footer->runs = (trace_run_t *)realloc(footer->runs, sizeof(trace_run_t) * output->runs_capacity);
+    if (footer->runs == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+  footer->runs[footer->num_runs] = *run;
+  footer->runs[footer->num_runs].first_sample = footer->num_samples;
+  footer->num_runs++;
+}
+
+static void output_sample(output_trace_t *output, const uint8_t *sample) {
+  if (output->reader->version == TRACE_VERSION_COLUMNAR)
+    trace_encoder_add(&output->encoder, &output->writer, sample);
+  else
+    trace_writer_write(&output->writer, sample, output->reader->sample_bytes);
+  output->footer.num_samples++;
+}
+
+static void output_close(output_trace_t *output) {
+  if (output->reader->version == TRACE_VERSION_COLUMNAR) {
+    trace_encoder_flush(&output->encoder, &output->writer);
+    output->footer.num_blocks = output->encoder.num_blocks;
+    output->footer.block_offsets = output->encoder.block_offsets;
+  }
+  trace_write_footer(&output->writer, &output->footer);
+  trace_writer_stop(&output->writer);
+  fclose(output->file);
+  if (output->reader->version == TRACE_VERSION_COLUMNAR)
+    trace_encoder_free(&output->encoder);
+  free(output->footer.runs);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Helpers                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// output directory (or the one of the trace), trace name without .bin, suffix
+static char *output_path(const char *path, const char *suffix) {
+  const char *name = strrchr(path, '/');
+  name = name != NULL ? name + 1 : path;
+  size_t stem = strlen(name);
+  if (stem > 4 && !strcmp(name + stem - 4, ".bin"))
+    stem -= 4;
+  const char *dir = arguments.output;
+  int dir_len = dir != NULL ? (int)strlen(dir) : (int)(name - path);
+  if (dir == NULL)
+    dir = path;
+  char *out = (char *)malloc_or_exit(dir_len + stem + strlen(suffix) + 2);
+  if (dir_len > 0 && dir[dir_len - 1] != '/')
+    sprintf(out, "%.*s/%.*s%s", dir_len, dir, (int)stem, name, suffix);
+  else
+    sprintf(out, "%.*s%.*s%s", dir_len, dir, (int)stem, name, suffix);
+  return out;
+}
+
+// npy header of a 1-D structured array; fields is the list of (name, type) tuples
+static void write_npy_header(FILE *file, const char *fields, uint64_t num_rows) {
+  char *dict;
+  size_t dict_len;
+  FILE *stream = open_memstream(&dict, &dict_len);
+  if (stream == NULL) {
+    printf("%s:%d: failed to open memory stream.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  fprintf(stream, "{'descr': [%s], 'fortran_order': False, 'shape': (%lu,), }", fields, num_rows);
+  fclose(stream);
+  // the header length field is 2 bytes in npy 1.0, 4 bytes in npy 2.0
+  int npy_v2 = dict_len + 1 + 12 > UINT16_MAX;
+  size_t preamble = npy_v2 ? 12 : 10;
+  size_t header_len = (preamble + dict_len + 1 + NPY_HEADER_ALIGN - 1) / NPY_HEADER_ALIGN * NPY_HEADER_ALIGN - preamble;
+  uint8_t version[2] = {npy_v2 ? 2 : 1, 0};
+  fwrite("\x93NUMPY", 1, 6, file);
+  fwrite(version, 1, 2, file);
+  if (npy_v2) {
+    uint32_t len = header_len;
+    fwrite(&len, sizeof(uint32_t), 1, file);
+  } else {
+    uint16_t len = header_len;
+    fwrite(&len, sizeof(uint16_t), 1, file);
+  }
+  fwrite(dict, 1, dict_len, file);
+  for (size_t i = dict_len; i < header_len - 1; i++)
+    fputc(' ', file);
+  fputc('\n', file);
+  free(dict);
+}
+
+static void add_event_total(event_total_t *totals, unsigned int *num_totals, uint32_t id, uint64_t value, int live) {
+  for (unsigned int i = 0; i < *num_totals; i++) {
+    if (totals[i].id == id) {
+      totals[i].total += live ? value : 0;
+      totals[i].samples++;
+      totals[i].live += live ? 1 : 0;
+      return;
+    }
+  }
+  totals[*num_totals] = (event_total_t){id, live ? value : 0, 1, live ? 1 : 0};
+  (*num_totals)++;
+}
+
+// decimal digits of value, return the end
+static char *put_u64(char *dst, uint64_t value) {
+  char digits[20];
+  int n = 0;
+  do {
+    digits[n++] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
+  while (n > 0)
+    *dst++ = digits[--n];
+  return dst;
+}
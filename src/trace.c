@@ -0,0 +1,382 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Trace version 1: magic TRACE_MAGIC, version, v1 header, raw samples.
+// v1 header (all integers are little-endian u32):
+//   CPU: num cores, per core: num counters, event ids,
+//   GPU: num event groups, per group: num events, num instances, event ids,
+//   num power rails, sampling period, power period, frequency period (us)
+// Raw sample:
+//   CPU, per core: u32 frequency, counters (u64, or u32 without
+//     TRACE_FLAG_CPU_COUNTERS_64), u64 clock cycles,
+//   GPU: u32 frequency, per group, per instance, per event: u64 counter,
+//   per rail: u32 power, u64 sampling time, deadline, wake time, u32 fresh flags,
+//   if multiplexed: per core: u32 live set
+// Legacy v1 traces, written before the layout was versioned, have no magic and no
+// footer: their header ends at the sampling period, their samples at the sampling
+// time, and their CPU counters are u32.
+//
+// Trace version 2: the raw samples of version 1 are buffered into blocks of
+// TRACE_BLOCK_SAMPLES samples, and each block is written column by column.
+// Each column is encoded as LEB128 varints (of the value, or of the zigzag delta
+// from the previous value of the block), then compressed with zlib on its own,
+// so that a reader only inflates the columns it needs.
+//
+// Header (all integers are little-endian u32):
+//   magic TRACE_MAGIC, version, samples per block,
+//   size of the v1 header, v1 header (event ids, sampling periods),
+//   num columns, per column: value size, encoding, name length, name
+// Block:
+//   magic TRACE_BLOCK_MAGIC, num samples,
+//   per column: compressed bytes, varint bytes (equal if stored uncompressed),
+//   per column: payload
+//
+// Footer, at the end of both v1 and v2 traces (u32 and u64, little-endian):
+//   u32 magic TRACE_FOOTER_MAGIC, footer version, trace version, devices, flags, num runs,
+//   u64 num samples, raw sample bytes, offset of the first sample (v1) or block (v2),
+//   per run: u64 first sample, offset of the first sample (v1) or of its block (v2),
+//            start time (CLOCK_MONOTONIC, ns), wall time (ns),
+//   u64 num blocks, per block: u64 offset (v2 only, 0 blocks in v1),
+//   if flags has TRACE_FLAG_CPU_MUX: u32 samples a set stays live, counters of each set,
+//   trailer: u64 footer bytes (trailer included), u32 magic TRACE_FOOTER_MAGIC
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+// voltmeter libraries
+#include <trace.h>
+#include <writer.h>
+#include <helper.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static size_t deflate_column(trace_encoder_t *encoder, const uint8_t *src, size_t len, const char *name);
+static uint64_t load_value(const uint8_t *src, uint32_t size);
+static void *prefaulted_malloc(size_t size);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Schema                         │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+void trace_schema_init(trace_schema_t *schema) {
+  schema->num_columns = 0;
+  schema->columns = NULL;
+  schema->sample_bytes = 0;
+}
+
+// append a field to the raw sample layout
+void trace_schema_add(trace_schema_t *schema, const char *name, uint32_t size, trace_encoding_t encoding) {
+  if (size != sizeof(uint32_t) && size != sizeof(uint64_t)) {
+    printf("%s:%d: unsupported size %u of trace column '%s'.\n", __FILE__, __LINE__, size, name);
+    exit(1);
+  }
+  schema->columns = (trace_column_t *)realloc(schema->columns, sizeof(trace_column_t) * (schema->num_columns + 1));
+  if (schema->columns == NULL) {
+    printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  trace_column_t *column = &schema->columns[schema->num_columns];
+  snprintf(column->name, TRACE_COLUMN_NAME_LEN, "%s", name);
+  column->size = size;
+  column->encoding = encoding;
+  column->offset = schema->sample_bytes;
+  schema->sample_bytes += size;
+  schema->num_columns++;
+}
+
+void trace_schema_free(trace_schema_t *schema) {
+  free(schema->columns);
+  trace_schema_init(schema);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Headers                        │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// the raw samples follow the header
+void trace_write_header_v1(trace_writer_t *writer, const void *header_v1, uint32_t header_v1_bytes) {
+  uint32_t magic = TRACE_MAGIC;
+  uint32_t version = TRACE_VERSION_RAW;
+  trace_writer_write(writer, &magic, sizeof(uint32_t));
+  trace_writer_write(writer, &version, sizeof(uint32_t));
+  trace_writer_write(writer, header_v1, header_v1_bytes);
+}
+
+// self-describing header: the v1 header is embedded as is, followed by the columns
+void trace_write_header_v2(trace_writer_t *writer, trace_schema_t *schema, const void *header_v1, uint32_t header_v1_bytes) {
+  uint32_t magic = TRACE_MAGIC;
+  uint32_t version = TRACE_VERSION_COLUMNAR;
+  uint32_t block_samples = TRACE_BLOCK_SAMPLES;
+  trace_writer_write(writer, &magic, sizeof(uint32_t));
+  trace_writer_write(writer, &version, sizeof(uint32_t));
+  trace_writer_write(writer, &block_samples, sizeof(uint32_t));
+  trace_writer_write(writer, &header_v1_bytes, sizeof(uint32_t));
+  trace_writer_write(writer, header_v1, header_v1_bytes);
+  trace_writer_write(writer, &schema->num_columns, sizeof(uint32_t));
+  for (unsigned int i = 0; i < schema->num_columns; i++) {
+    uint32_t encoding = schema->columns[i].encoding;
+    uint32_t name_len = strlen(schema->columns[i].name);
+    trace_writer_write(writer, &schema->columns[i].size, sizeof(uint32_t));
+    trace_writer_write(writer, &encoding, sizeof(uint32_t));
+    trace_writer_write(writer, &name_len, sizeof(uint32_t));
+    trace_writer_write(writer, schema->columns[i].name, name_len);
+  }
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                      v2 encoder                       │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// allocate all block buffers up front: nothing is allocated while sampling
+void trace_encoder_init(trace_encoder_t *encoder, trace_schema_t *schema) {
+  encoder->schema = schema;
+  encoder->num_samples = 0;
+  encoder->encoded_capacity = (size_t)TRACE_BLOCK_SAMPLES * TRACE_VARINT_MAX_BYTES;
+  encoder->compressed_capacity = compressBound(encoder->encoded_capacity);
+  encoder->samples = (uint8_t *)prefaulted_malloc(TRACE_BLOCK_SAMPLES * schema->sample_bytes);
+  encoder->encoded = (uint8_t *)prefaulted_malloc(encoder->encoded_capacity);
+  encoder->compressed = (uint8_t *)prefaulted_malloc(encoder->compressed_capacity);
+  encoder->block = (uint8_t *)prefaulted_malloc(encoder->compressed_capacity * schema->num_columns);
+  encoder->sizes = (uint32_t *)prefaulted_malloc(sizeof(uint32_t) * 2 * schema->num_columns);
+  encoder->block_offsets_capacity = 64;
+  encoder->block_offsets = (uint64_t *)prefaulted_malloc(sizeof(uint64_t) * encoder->block_offsets_capacity);
+  // one deflate state for all columns: deflateInit allocates and clears ~256 KiB
+  memset(&encoder->stream, 0, sizeof(z_stream));
+  int ret = deflateInit2(&encoder->stream, TRACE_ZLIB_LEVEL, Z_DEFLATED, MAX_WBITS, 8, TRACE_ZLIB_STRATEGY);
+  if (ret != Z_OK) {
+    printf("%s:%d: failed to initialize zlib (error %d).\n", __FILE__, __LINE__, ret);
+    exit(1);
+  }
+  encoder->num_blocks = 0;
+  encoder->raw_bytes = 0;
+  encoder->encoded_bytes = 0;
+}
+
+// buffer a raw sample; a full block is encoded and handed to the writer
+void trace_encoder_add(trace_encoder_t *encoder, trace_writer_t *writer, const uint8_t *sample) {
+  memcpy(encoder->samples + encoder->num_samples * encoder->schema->sample_bytes, sample, encoder->schema->sample_bytes);
+  encoder->num_samples++;
+  if (encoder->num_samples == TRACE_BLOCK_SAMPLES)
+    trace_encoder_flush(encoder, writer);
+}
+
+// encode the buffered samples (if any) as one block
+void trace_encoder_flush(trace_encoder_t *encoder, trace_writer_t *writer) {
+  trace_schema_t *schema = encoder->schema;
+  uint32_t header[2] = {TRACE_BLOCK_MAGIC, encoder->num_samples};
+  size_t block_bytes = 0;
+  if (encoder->num_samples == 0)
+    return;
+  for (unsigned int i = 0; i < schema->num_columns; i++) {
+    size_t encoded_bytes = trace_encode_column(encoder->encoded, encoder->samples, encoder->num_samples, schema->sample_bytes, &schema->columns[i]);
+    size_t compressed_bytes = deflate_column(encoder, encoder->encoded, encoded_bytes, schema->columns[i].name);
+    // incompressible columns are stored as varints
+    if (compressed_bytes >= encoded_bytes) {
+      memcpy(encoder->block + block_bytes, encoder->encoded, encoded_bytes);
+      compressed_bytes = encoded_bytes;
+    } else {
+      memcpy(encoder->block + block_bytes, encoder->compressed, compressed_bytes);
+    }
+    encoder->sizes[2 * i] = compressed_bytes;
+    encoder->sizes[2 * i + 1] = encoded_bytes;
+    block_bytes += compressed_bytes;
+  }
+  // block index of the footer (grows geometrically, rarely)
+  if (encoder->num_blocks == encoder->block_offsets_capacity) {
+    encoder->block_offsets_capacity *= 2;
+    encoder->block_offsets = (uint64_t *)realloc(encoder->block_offsets, sizeof(uint64_t) * encoder->block_offsets_capacity);
+    if (encoder->block_offsets == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+  }
+  encoder->block_offsets[encoder->num_blocks] = writer->offset;
+  trace_writer_write(writer, header, sizeof(header));
+  trace_writer_write(writer, encoder->sizes, sizeof(uint32_t) * 2 * schema->num_columns);
+  trace_writer_write(writer, encoder->block, block_bytes);
+  encoder->num_blocks++;
+  encoder->raw_bytes += encoder->num_samples * schema->sample_bytes;
+  encoder->encoded_bytes += sizeof(header) + sizeof(uint32_t) * 2 * schema->num_columns + block_bytes;
+  encoder->num_samples = 0;
+}
+
+void trace_encoder_free(trace_encoder_t *encoder) {
+  deflateEnd(&encoder->stream);
+  free(encoder->samples);
+  free(encoder->encoded);
+  free(encoder->compressed);
+  free(encoder->block);
+  free(encoder->sizes);
+  free(encoder->block_offsets);
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Footer                         │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// write the footer as the last bytes of the trace; the offsets of the runs are
+// derived from their first sample
+void trace_write_footer(trace_writer_t *writer, trace_footer_t *footer) {
+  uint64_t footer_offset = writer->offset;
+  uint32_t header[6] = {
+    TRACE_FOOTER_MAGIC, TRACE_FOOTER_VERSION, footer->trace_version,
+    footer->devices, footer->flags, footer->num_runs
+  };
+  uint32_t magic = TRACE_FOOTER_MAGIC;
+  trace_writer_write(writer, header, sizeof(header));
+  trace_writer_write(writer, &footer->num_samples, sizeof(uint64_t));
+  trace_writer_write(writer, &footer->sample_bytes, sizeof(uint64_t));
+  trace_writer_write(writer, &footer->data_offset, sizeof(uint64_t));
+  for (unsigned int r = 0; r < footer->num_runs; r++) {
+    trace_run_t *run = &footer->runs[r];
+    if (run->first_sample >= footer->num_samples)
+      run->offset = footer_offset; // no samples in the run
+    else if (footer->num_blocks > 0)
+      run->offset = footer->block_offsets[run->first_sample / TRACE_BLOCK_SAMPLES];
+    else
+      run->offset = footer->data_offset + run->first_sample * footer->sample_bytes;
+    trace_writer_write(writer, run, sizeof(trace_run_t));
+  }
+  trace_writer_write(writer, &footer->num_blocks, sizeof(uint64_t));
+  trace_writer_write(writer, footer->block_offsets, sizeof(uint64_t) * footer->num_blocks);
+  if (footer->flags & TRACE_FLAG_CPU_MUX) {
+    trace_writer_write(writer, &footer->mux_samples, sizeof(uint32_t));
+    trace_writer_write(writer, &footer->mux_set_counters, sizeof(uint32_t));
+  }
+  uint64_t footer_bytes = writer->offset - footer_offset + TRACE_FOOTER_TRAILER_BYTES;
+  trace_writer_write(writer, &footer_bytes, sizeof(uint64_t));
+  trace_writer_write(writer, &magic, sizeof(uint32_t));
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                     Column codec                      │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// LEB128: 7 bits per byte, least significant first, MSB set on all but the last byte
+size_t trace_varint_put(uint8_t *dst, uint64_t value) {
+  size_t len = 0;
+  while (value >= 0x80) {
+    dst[len++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  dst[len++] = (uint8_t)value;
+  return len;
+}
+
+// decode one LEB128 value; return the bytes consumed, 0 if truncated or too long
+size_t trace_varint_get(const uint8_t *src, size_t len, uint64_t *value) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < len && i < TRACE_VARINT_MAX_BYTES; i++) {
+    v |= (uint64_t)(src[i] & 0x7f) << (7 * i);
+    if (!(src[i] & 0x80)) {
+      *value = v;
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+// varint bytes of a column of num_samples raw samples; deltas restart at every
+// block (from 0), so that each block decodes on its own
+size_t trace_encode_column(uint8_t *dst, const uint8_t *samples, unsigned int num_samples, size_t sample_bytes, const trace_column_t *column) {
+  const uint8_t *src = samples + column->offset;
+  uint64_t prev = 0;
+  size_t len = 0;
+  for (unsigned int n = 0; n < num_samples; n++, src += sample_bytes) {
+    uint64_t value = load_value(src, column->size);
+    if (column->encoding == TRACE_ENCODING_DELTA) {
+      int64_t delta = (int64_t)(value - prev);
+      prev = value;
+      // zigzag: small negative deltas become small unsigned values
+      value = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    }
+    len += trace_varint_put(dst + len, value);
+  }
+  return len;
+}
+
+// decode the varint bytes of a column; return 0 on success
+int trace_decode_column(uint64_t *values, unsigned int num_samples, const uint8_t *src, size_t len, const trace_column_t *column) {
+  uint64_t mask = column->size == sizeof(uint64_t) ? UINT64_MAX : UINT32_MAX;
+  uint64_t prev = 0;
+  size_t pos = 0;
+  for (unsigned int n = 0; n < num_samples; n++) {
+    uint64_t value;
+    size_t consumed = trace_varint_get(src + pos, len - pos, &value);
+    if (consumed == 0)
+      return 1;
+    pos += consumed;
+    if (column->encoding == TRACE_ENCODING_DELTA) {
+      int64_t delta = (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+      value = prev + (uint64_t)delta;
+      prev = value;
+    }
+    values[n] = value & mask;
+  }
+  return pos == len ? 0 : 1;
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// compress one column into the compressed buffer (zlib format); return its size
+static size_t deflate_column(trace_encoder_t *encoder, const uint8_t *src, size_t len, const char *name) {
+  z_stream *stream = &encoder->stream;
+  deflateReset(stream);
+  stream->next_in = (Bytef *)src;
+  stream->avail_in = len;
+  stream->next_out = encoder->compressed;
+  stream->avail_out = encoder->compressed_capacity;
+  int ret = deflate(stream, Z_FINISH);
+  if (ret != Z_STREAM_END) {
+    printf("%s:%d: failed to compress trace column '%s' (zlib error %d).\n", __FILE__, __LINE__, name, ret);
+    exit(1);
+  }
+  return stream->total_out;
+}
+
+static uint64_t load_value(const uint8_t *src, uint32_t size) {
+  if (size == sizeof(uint32_t)) {
+    uint32_t value;
+    memcpy(&value, src, sizeof(uint32_t));
+    return value;
+  }
+  uint64_t value;
+  memcpy(&value, src, sizeof(uint64_t));
+  return value;
+}
+
+// allocate and prefault before sampling
+static void *prefaulted_malloc(size_t size) {
+  void *ptr = malloc_or_exit(size);
+  memset(ptr, 0, size);
+  return ptr;
+}
@@ -0,0 +1,671 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// Reader of the traces written by the profiler (layouts in trace.c). The file
+// is mapped read-only: v1 samples are accessed in place, legacy v1 samples are
+// upgraded to the v1 layout and v2 blocks are decoded one at a time by the iterators. Malformed files are reported through the
+// return value and reader->error, never by exiting, so that tools can check them;
+// so are the allocations that fail.
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+// voltmeter libraries
+#include <trace.h>
+#include <trace_reader.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                         Types                         ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// bounded cursor over the mapped file
+typedef struct {
+  const uint8_t *base;
+  size_t pos;
+  size_t end;
+} cursor_t;
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static int reader_error(trace_reader_t *reader, const char *format, ...);
+static int cursor_u32(cursor_t *cursor, uint32_t *value);
+static int cursor_u64(cursor_t *cursor, uint64_t *value);
+static const uint32_t *cursor_u32_array(cursor_t *cursor, uint32_t num);
+static int read_footer(trace_reader_t *reader);
+static int read_header_v2(trace_reader_t *reader, cursor_t *cursor, cursor_t *header_v1);
+static int read_header_v1(trace_reader_t *reader, cursor_t *header_v1, size_t max_sample_bytes);
+static int layout_add(size_t *offset, uint64_t count, size_t unit, size_t max_bytes);
+static void build_schema_v1(trace_reader_t *reader);
+static int index_blocks(trace_reader_t *reader);
+static int decode_block(trace_iter_t *iter, uint64_t block);
+static void upgrade_legacy_sample(trace_iter_t *iter);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                        Reader                         │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// map a trace and decode its header, footer and (v2) block index; devices are
+// the TRACE_DEVICE_* of v1 traces without footer (e.g., legacy ones), ignored
+// otherwise (0 = unknown);
+// return 0 on success, otherwise the reason is in reader->error
+int trace_reader_open(trace_reader_t *reader, const char *path, uint32_t devices) {
+  struct stat st;
+  memset(reader, 0, sizeof(trace_reader_t));
+  reader->fd = -1;
+  trace_schema_init(&reader->schema);
+  reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (reader->fd < 0)
+    return reader_error(reader, "failed to open '%s'", path);
+  if (fstat(reader->fd, &st) != 0)
+    return reader_error(reader, "failed to stat '%s'", path);
+  reader->size = st.st_size;
+  if (reader->size < sizeof(uint32_t))
+    return reader_error(reader, "file too short (%lu bytes)", reader->size);
+  reader->map = (const uint8_t *)mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+  if (reader->map == MAP_FAILED) {
+    reader->map = NULL;
+    return reader_error(reader, "failed to map '%s'", path);
+  }
+
+  // the footer (if any) gives the devices, hence the layout of the v1 header
+  reader->data_end = reader->size;
+  if (read_footer(reader))
+    return 1;
+  if (reader->has_footer)
+    devices = reader->devices;
+  reader->devices = devices;
+
+  cursor_t cursor = {reader->map, 0, reader->data_end};
+  uint32_t footer_version = reader->version;
+  size_t footer_data_offset = reader->data_offset;
+  uint32_t magic = 0, version = TRACE_VERSION_RAW;
+  cursor_u32(&cursor, &magic);
+  if (magic == TRACE_MAGIC) {
+    if (cursor_u32(&cursor, &version))
+      return reader_error(reader, "truncated header");
+  } else {
+    cursor.pos = 0;
+    reader->legacy = 1;
+  }
+  if (version == TRACE_VERSION_COLUMNAR) {
+    cursor_t header_v1;
+    if (read_header_v2(reader, &cursor, &header_v1))
+      return 1;
+    reader->header_v1 = reader->map + header_v1.pos;
+    reader->header_v1_bytes = header_v1.end - header_v1.pos;
+    // the columns bound the sample of the v1 header
+    if (read_header_v1(reader, &header_v1, reader->schema.sample_bytes))
+      return 1;
+    if (header_v1.pos != header_v1.end)
+      return reader_error(reader, "v1 header has %lu trailing bytes", header_v1.end - header_v1.pos);
+    if (reader->schema.sample_bytes != reader->sample_bytes)
+      return reader_error(reader, "columns of %lu bytes do not match a sample of %lu bytes", reader->schema.sample_bytes, reader->sample_bytes);
+    reader->data_offset = cursor.pos;
+    if (index_blocks(reader))
+      return 1;
+  } else if (version == TRACE_VERSION_RAW) {
+    reader->version = TRACE_VERSION_RAW;
+    // legacy traces were written before the footer
+    if (reader->legacy && reader->has_footer)
+      return reader_error(reader, "footer of a v1 trace without magic");
+    if (reader->devices == 0)
+      return reader_error(reader, "v1 trace without footer: profiled devices unknown");
+    // the samples follow the header: a sample is not larger than the file
+    size_t max_sample_bytes = reader->data_end > TRACE_READER_MAX_SAMPLE_BYTES ? reader->data_end : TRACE_READER_MAX_SAMPLE_BYTES;
+    size_t header_offset = cursor.pos;
+    if (read_header_v1(reader, &cursor, max_sample_bytes))
+      return 1;
+    reader->header_v1 = reader->map + header_offset;
+    reader->header_v1_bytes = cursor.pos - header_offset;
+    reader->data_offset = cursor.pos;
+    if (reader->legacy) {
+      // the header of the upgraded samples, e.g., for slices of the trace
+      uint32_t periods[2] = {reader->power_period_us, reader->freq_period_us};
+      reader->legacy_header = (uint8_t *)malloc(reader->header_v1_bytes + sizeof(periods));
+      if (reader->legacy_header == NULL)
+        return reader_error(reader, "failed to allocate memory");
+      memcpy(reader->legacy_header, reader->header_v1, reader->header_v1_bytes);
+      memcpy(reader->legacy_header + reader->header_v1_bytes, periods, sizeof(periods));
+      reader->header_v1 = reader->legacy_header;
+      reader->header_v1_bytes += sizeof(periods);
+    }
+    size_t data_bytes = reader->data_end - reader->data_offset;
+    if (data_bytes > 0 && reader->file_sample_bytes > data_bytes)
+      return reader_error(reader, "sample of %lu bytes exceeds the %lu bytes of samples", reader->file_sample_bytes, data_bytes);
+    if (data_bytes % reader->file_sample_bytes != 0)
+      return reader_error(reader, "%lu bytes of samples are not a multiple of the %lu-byte sample", data_bytes, reader->file_sample_bytes);
+    build_schema_v1(reader);
+    reader->num_samples = data_bytes / reader->file_sample_bytes;
+  } else {
+    return reader_error(reader, "unsupported trace version %u", version);
+  }
+
+  // consistency with the footer
+  if (reader->has_footer) {
+    if (footer_version != reader->version)
+      return reader_error(reader, "footer of a v%u trace, header of a v%u trace", footer_version, reader->version);
+    if (footer_data_offset != reader->data_offset)
+      return reader_error(reader, "footer data offset %lu, header ends at %lu", footer_data_offset, reader->data_offset);
+    uint64_t footer_samples = reader->num_samples;
+    uint64_t footer_sample_bytes = 0;
+    cursor_t footer = {reader->map, reader->data_end + 6 * sizeof(uint32_t), reader->size};
+    cursor_u64(&footer, &footer_samples);
+    cursor_u64(&footer, &footer_sample_bytes);
+    if (footer_samples != reader->num_samples)
+      return reader_error(reader, "footer counts %lu samples, data holds %lu", footer_samples, reader->num_samples);
+    if (footer_sample_bytes != reader->sample_bytes)
+      return reader_error(reader, "footer sample of %lu bytes, header sample of %lu bytes", footer_sample_bytes, reader->sample_bytes);
+    for (unsigned int r = 0; r < reader->num_runs; r++) {
+      if (reader->runs[r].first_sample > reader->num_samples || (r > 0 && reader->runs[r].first_sample < reader->runs[r - 1].first_sample))
+        return reader_error(reader, "invalid first sample %lu of run %u", reader->runs[r].first_sample, r);
+    }
+  } else {
+    // a single run covering the whole trace
+    reader->num_runs = 1;
+    reader->runs = (trace_run_t *)malloc(sizeof(trace_run_t));
+    if (reader->runs == NULL)
+      return reader_error(reader, "failed to allocate memory");
+    reader->runs[0] = (trace_run_t){0, reader->data_offset, 0, 0};
+  }
+  return 0;
+}
+
+void trace_reader_close(trace_reader_t *reader) {
+  if (reader->map != NULL)
+    munmap((void *)reader->map, reader->size);
+  if (reader->fd >= 0)
+    close(reader->fd);
+  free(reader->cores);
+  free(reader->gpu_groups);
+  free(reader->block_offsets);
+  free(reader->runs);
+  free(reader->legacy_header);
+  trace_schema_free(&reader->schema);
+  reader->map = NULL;
+  reader->fd = -1;
+}
+
+// index of a column by name, -1 if none
+int trace_reader_column(trace_reader_t *reader, const char *name) {
+  for (unsigned int i = 0; i < reader->schema.num_columns; i++)
+    if (!strcmp(reader->schema.columns[i].name, name))
+      return i;
+  return -1;
+}
+
+/*
+ * ┌───────────────────────────────────────────────────────┐
+ * │                       Iterators                       │
+ * └───────────────────────────────────────────────────────┘
+ */
+
+// iterate over samples [first, end) of the trace
+void trace_iter_init(trace_iter_t *iter, trace_reader_t *reader, uint64_t first, uint64_t end) {
+  memset(iter, 0, sizeof(trace_iter_t));
+  iter->reader = reader;
+  iter->next = first;
+  iter->end = end < reader->num_samples ? end : reader->num_samples;
+  iter->block = UINT64_MAX;
+  if (reader->version == TRACE_VERSION_RAW) {
+    // let the kernel read ahead aggressively
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = (reader->data_offset + first * reader->file_sample_bytes) / page * page;
+    if (start < reader->size)
+      madvise((void *)(reader->map + start), reader->size - start, MADV_SEQUENTIAL);
+    if (reader->legacy && (iter->rows = (uint8_t *)malloc(reader->sample_bytes)) == NULL)
+      iter->failed = reader_error(reader, "failed to allocate memory");
+  } else {
+    iter->rows = (uint8_t *)malloc(reader->sample_bytes * reader->block_samples);
+    iter->values = (uint64_t *)malloc(sizeof(uint64_t) * reader->block_samples);
+    iter->inflated_capacity = (size_t)reader->block_samples * TRACE_VARINT_MAX_BYTES;
+    iter->inflated = (uint8_t *)malloc(iter->inflated_capacity);
+    if (iter->rows == NULL || iter->values == NULL || iter->inflated == NULL)
+      iter->failed = reader_error(reader, "failed to allocate memory");
+    else if (inflateInit(&iter->stream) != Z_OK)
+      iter->failed = reader_error(reader, "failed to initialize zlib");
+  }
+}
+
+// iterate over the samples of a run
+void trace_iter_run(trace_iter_t *iter, trace_reader_t *reader, unsigned int run) {
+  uint64_t end = run + 1 < reader->num_runs ? reader->runs[run + 1].first_sample : reader->num_samples;
+  trace_iter_init(iter, reader, reader->runs[run].first_sample, end);
+}
+
+// move to the next sample; return 1 if any, 0 at the end, -1 on a malformed block
+// or if the iterator could not be initialized
+int trace_iter_next(trace_iter_t *iter) {
+  trace_reader_t *reader = iter->reader;
+  if (iter->failed)
+    return -1;
+  if (iter->next >= iter->end)
+    return 0;
+  if (reader->version == TRACE_VERSION_RAW) {
+    iter->sample = reader->map + reader->data_offset + iter->next * reader->file_sample_bytes;
+    if (reader->legacy)
+      upgrade_legacy_sample(iter);
+  } else {
+    uint64_t block = iter->next / reader->block_samples;
+    if (block != iter->block && decode_block(iter, block))
+      return -1;
+    iter->sample = iter->rows + (iter->next % reader->block_samples) * reader->sample_bytes;
+  }
+  iter->next++;
+  return 1;
+}
+
+void trace_iter_free(trace_iter_t *iter) {
+  if (iter->reader->version == TRACE_VERSION_COLUMNAR && !iter->failed)
+    inflateEnd(&iter->stream);
+  free(iter->rows);
+  free(iter->values);
+  free(iter->inflated);
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static int reader_error(trace_reader_t *reader, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  vsnprintf(reader->error, TRACE_READER_ERROR_LEN, format, args);
+  va_end(args);
+  return 1;
+}
+
+static int cursor_u32(cursor_t *cursor, uint32_t *value) {
+  if (cursor->end - cursor->pos < sizeof(uint32_t))
+    return 1;
+  memcpy(value, cursor->base + cursor->pos, sizeof(uint32_t));
+  cursor->pos += sizeof(uint32_t);
+  return 0;
+}
+
+static int cursor_u64(cursor_t *cursor, uint64_t *value) {
+  if (cursor->end - cursor->pos < sizeof(uint64_t))
+    return 1;
+  memcpy(value, cursor->base + cursor->pos, sizeof(uint64_t));
+  cursor->pos += sizeof(uint64_t);
+  return 0;
+}
+
+// array of u32 in place (the cursor is 4-byte aligned in all headers); NULL if truncated
+static const uint32_t *cursor_u32_array(cursor_t *cursor, uint32_t num) {
+  const uint32_t *array = (const uint32_t *)(cursor->base + cursor->pos);
+  if ((cursor->end - cursor->pos) / sizeof(uint32_t) < num)
+    return NULL;
+  cursor->pos += sizeof(uint32_t) * num;
+  return array;
+}
+
+// footer at the end of the file, if any (traces written before it have none)
+static int read_footer(trace_reader_t *reader) {
+  uint64_t footer_bytes;
+  uint32_t magic = 0, footer_version = 0, num_runs = 0;
+  if (reader->size < TRACE_FOOTER_TRAILER_BYTES)
+    return 0;
+  cursor_t trailer = {reader->map, reader->size - TRACE_FOOTER_TRAILER_BYTES, reader->size};
+  cursor_u64(&trailer, &footer_bytes);
+  cursor_u32(&trailer, &magic);
+  if (magic != TRACE_FOOTER_MAGIC)
+    return 0;
+  if (footer_bytes > reader->size || footer_bytes < TRACE_FOOTER_TRAILER_BYTES + 6 * sizeof(uint32_t))
+    return reader_error(reader, "invalid footer size %lu", footer_bytes);
+  cursor_t footer = {reader->map, reader->size - footer_bytes, reader->size - TRACE_FOOTER_TRAILER_BYTES};
+  cursor_u32(&footer, &magic);
+  if (magic != TRACE_FOOTER_MAGIC)
+    return reader_error(reader, "footer magic not found at offset %lu", footer.pos - sizeof(uint32_t));
+  cursor_u32(&footer, &footer_version);
+  if (footer_version != TRACE_FOOTER_VERSION)
+    return reader_error(reader, "unsupported footer version %u", footer_version);
+  uint32_t trace_version;
+  uint64_t num_samples, sample_bytes, data_offset;
+  if (cursor_u32(&footer, &trace_version) || cursor_u32(&footer, &reader->devices) ||
+      cursor_u32(&footer, &reader->flags) || cursor_u32(&footer, &num_runs) ||
+      cursor_u64(&footer, &num_samples) || cursor_u64(&footer, &sample_bytes) || cursor_u64(&footer, &data_offset))
+    return reader_error(reader, "truncated footer");
+  if ((footer.end - footer.pos) / sizeof(trace_run_t) < num_runs)
+    return reader_error(reader, "truncated footer runs");
+  reader->num_runs = num_runs;
+  reader->runs = (trace_run_t *)malloc(sizeof(trace_run_t) * (num_runs > 0 ? num_runs : 1));
+  if (reader->runs == NULL)
+    return reader_error(reader, "failed to allocate memory");
+  memcpy(reader->runs, reader->map + footer.pos, sizeof(trace_run_t) * num_runs);
+  footer.pos += sizeof(trace_run_t) * num_runs;
+  size_t mux_bytes = reader->flags & TRACE_FLAG_CPU_MUX ? 2 * sizeof(uint32_t) : 0;
+  if (cursor_u64(&footer, &reader->num_blocks) || footer.end - footer.pos < mux_bytes ||
+      (footer.end - footer.pos - mux_bytes) / sizeof(uint64_t) != reader->num_blocks)
+    return reader_error(reader, "truncated footer block index");
+  reader->block_offsets = (uint64_t *)malloc(sizeof(uint64_t) * (reader->num_blocks > 0 ? reader->num_blocks : 1));
+  if (reader->block_offsets == NULL)
+    return reader_error(reader, "failed to allocate memory");
+  memcpy(reader->block_offsets, reader->map + footer.pos, sizeof(uint64_t) * reader->num_blocks);
+  footer.pos += sizeof(uint64_t) * reader->num_blocks;
+  if (reader->flags & TRACE_FLAG_CPU_MUX) {
+    cursor_u32(&footer, &reader->mux_samples);
+    cursor_u32(&footer, &reader->mux_set_counters);
+    if (reader->mux_samples == 0 || reader->mux_set_counters == 0)
+      return reader_error(reader, "invalid multiplexing of %u counters every %u samples", reader->mux_set_counters, reader->mux_samples);
+  }
+  reader->has_footer = 1;
+  reader->version = trace_version;
+  reader->num_samples = num_samples;
+  reader->data_offset = data_offset;
+  reader->data_end = reader->size - footer_bytes;
+  return 0;
+}
+
+// v2 header after its magic and version: columns; the cursor is moved past the
+// header, header_v1 is set over the embedded v1 header
+static int read_header_v2(trace_reader_t *reader, cursor_t *cursor, cursor_t *header_v1) {
+  uint32_t header_v1_bytes, num_columns;
+  if (cursor_u32(cursor, &reader->block_samples) || cursor_u32(cursor, &header_v1_bytes))
+    return reader_error(reader, "truncated v2 header");
+  // the iterators allocate a block: not more than the writer buffers
+  if (reader->block_samples == 0 || reader->block_samples > TRACE_BLOCK_SAMPLES)
+    return reader_error(reader, "invalid block size of %u samples", reader->block_samples);
+  if (header_v1_bytes % sizeof(uint32_t) != 0 || cursor->end - cursor->pos < header_v1_bytes)
+    return reader_error(reader, "invalid v1 header size %u", header_v1_bytes);
+  *header_v1 = (cursor_t){reader->map, cursor->pos, cursor->pos + header_v1_bytes};
+  cursor->pos += header_v1_bytes;
+  if (cursor_u32(cursor, &num_columns))
+    return reader_error(reader, "truncated v2 header");
+  uint32_t devices = 0, flags = 0;
+  for (unsigned int i = 0; i < num_columns; i++) {
+    uint32_t size, encoding, name_len;
+    char name[TRACE_COLUMN_NAME_LEN];
+    if (cursor_u32(cursor, &size) || cursor_u32(cursor, &encoding) || cursor_u32(cursor, &name_len))
+      return reader_error(reader, "truncated column %u", i);
+    if (name_len >= TRACE_COLUMN_NAME_LEN || cursor->end - cursor->pos < name_len)
+      return reader_error(reader, "invalid name of column %u", i);
+    if ((size != sizeof(uint32_t) && size != sizeof(uint64_t)) || (encoding != TRACE_ENCODING_VARINT && encoding != TRACE_ENCODING_DELTA))
+      return reader_error(reader, "invalid size %u or encoding %u of column %u", size, encoding, i);
+    memcpy(name, reader->map + cursor->pos, name_len);
+    name[name_len] = '\0';
+    cursor->pos += name_len;
+    trace_schema_add(&reader->schema, name, size, (trace_encoding_t)encoding);
+    // devices are also implied by the column names, 64-bit CPU counters by their size
+    if (!strncmp(name, "cpu", 3))
+      devices |= TRACE_DEVICE_CPU;
+    else if (!strncmp(name, "gpu.", 4))
+      devices |= TRACE_DEVICE_GPU;
+    if (!strncmp(name, "cpu", 3) && strstr(name, ".0x") != NULL && size == sizeof(uint64_t))
+      flags |= TRACE_FLAG_CPU_COUNTERS_64;
+  }
+  if (!reader->has_footer) {
+    reader->devices = devices;
+    reader->flags = flags;
+  }
+  reader->version = TRACE_VERSION_COLUMNAR;
+  return 0;
+}
+
+// v1 header and sample layout (Jetson AGX Xavier: each core has a clock counter);
+// counts are bounded by the header bytes left and by max_sample_bytes before any
+// allocation, so that a corrupted header is rejected; legacy headers end at the
+// sampling period, and their samples at the sampling time
+static int read_header_v1(trace_reader_t *reader, cursor_t *header_v1, size_t max_sample_bytes) {
+  size_t offset = 0;
+  reader->counter_bytes = reader->flags & TRACE_FLAG_CPU_COUNTERS_64 ? sizeof(uint64_t) : sizeof(uint32_t);
+  if (reader->devices & TRACE_DEVICE_CPU) {
+    if (cursor_u32(header_v1, &reader->num_cores))
+      return reader_error(reader, "truncated CPU header");
+    // each core has at least its number of counters in the header
+    if (reader->num_cores > (header_v1->end - header_v1->pos) / sizeof(uint32_t))
+      return reader_error(reader, "%u cores exceed the header", reader->num_cores);
+    reader->cores = (trace_core_layout_t *)malloc(sizeof(trace_core_layout_t) * (reader->num_cores > 0 ? reader->num_cores : 1));
+    if (reader->cores == NULL)
+      return reader_error(reader, "failed to allocate memory");
+    for (unsigned int c = 0; c < reader->num_cores; c++) {
+      trace_core_layout_t *core = &reader->cores[c];
+      if (cursor_u32(header_v1, &core->num_counters) || (core->event_ids = cursor_u32_array(header_v1, core->num_counters)) == NULL)
+        return reader_error(reader, "truncated CPU header of core %u", c);
+      core->offset = offset;
+      if (layout_add(&offset, 1, sizeof(uint32_t) + sizeof(uint64_t), max_sample_bytes) ||
+          layout_add(&offset, core->num_counters, reader->counter_bytes, max_sample_bytes))
+        return reader_error(reader, "sample exceeds %lu bytes at core %u", max_sample_bytes, c);
+    }
+    if (reader->flags & TRACE_FLAG_CPU_MUX) {
+      reader->mux_num_sets = reader->num_cores > 0 ? reader->cores[0].num_counters / reader->mux_set_counters : 0;
+      for (unsigned int c = 0; c < reader->num_cores; c++)
+        if (reader->cores[c].num_counters != reader->mux_num_sets * reader->mux_set_counters)
+          return reader_error(reader, "%u counters of core %u are not %u sets of %u", reader->cores[c].num_counters, c, reader->mux_num_sets, reader->mux_set_counters);
+    }
+  }
+  if (reader->devices & TRACE_DEVICE_GPU) {
+    if (cursor_u32(header_v1, &reader->num_gpu_groups))
+      return reader_error(reader, "truncated GPU header");
+    // each group has at least its numbers of events and instances in the header
+    if (reader->num_gpu_groups > (header_v1->end - header_v1->pos) / (2 * sizeof(uint32_t)))
+      return reader_error(reader, "%u GPU groups exceed the header", reader->num_gpu_groups);
+    reader->gpu_freq_offset = offset;
+    if (layout_add(&offset, 1, sizeof(uint32_t), max_sample_bytes))
+      return reader_error(reader, "sample exceeds %lu bytes at the GPU frequency", max_sample_bytes);
+    reader->gpu_groups = (trace_gpu_group_layout_t *)malloc(sizeof(trace_gpu_group_layout_t) * (reader->num_gpu_groups > 0 ? reader->num_gpu_groups : 1));
+    if (reader->gpu_groups == NULL)
+      return reader_error(reader, "failed to allocate memory");
+    for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+      trace_gpu_group_layout_t *group = &reader->gpu_groups[g];
+      if (cursor_u32(header_v1, &group->num_events) || cursor_u32(header_v1, &group->num_instances) ||
+          (group->event_ids = cursor_u32_array(header_v1, group->num_events)) == NULL)
+        return reader_error(reader, "truncated GPU header of group %u", g);
+      group->offset = offset;
+      if (layout_add(&offset, (uint64_t)group->num_events * group->num_instances, sizeof(uint64_t), max_sample_bytes))
+        return reader_error(reader, "sample exceeds %lu bytes at GPU group %u", max_sample_bytes, g);
+    }
+  }
+  if (cursor_u32(header_v1, &reader->num_power_rails) || cursor_u32(header_v1, &reader->sample_period_us))
+    return reader_error(reader, "truncated header");
+  if (reader->legacy) {
+    // all the streams were read at every sample
+    reader->power_period_us = reader->sample_period_us;
+    reader->freq_period_us = reader->sample_period_us;
+  } else if (cursor_u32(header_v1, &reader->power_period_us) || cursor_u32(header_v1, &reader->freq_period_us)) {
+    return reader_error(reader, "truncated header");
+  }
+  reader->power_offset = offset;
+  if (layout_add(&offset, reader->num_power_rails, sizeof(uint32_t), max_sample_bytes))
+    return reader_error(reader, "sample exceeds %lu bytes at %u power rails", max_sample_bytes, reader->num_power_rails);
+  reader->time_offset = offset;
+  if (layout_add(&offset, 1, 3 * sizeof(uint64_t) + sizeof(uint32_t), max_sample_bytes))
+    return reader_error(reader, "sample exceeds %lu bytes", max_sample_bytes);
+  if (reader->flags & TRACE_FLAG_CPU_MUX) {
+    reader->mux_set_offset = offset;
+    if (layout_add(&offset, reader->num_cores, sizeof(uint32_t), max_sample_bytes))
+      return reader_error(reader, "sample exceeds %lu bytes", max_sample_bytes);
+  }
+  reader->sample_bytes = offset;
+  reader->file_sample_bytes = reader->legacy ? reader->time_offset + sizeof(uint64_t) : offset;
+  return 0;
+}
+
+// add count fields of unit bytes to a sample layout; 1 if it exceeds max_bytes
+static int layout_add(size_t *offset, uint64_t count, size_t unit, size_t max_bytes) {
+  if (count > (max_bytes - *offset) / unit)
+    return 1;
+  *offset += count * unit;
+  return 0;
+}
+
+// columns of a v1 sample, named as in the v2 header written by the profiler
+static void build_schema_v1(trace_reader_t *reader) {
+  char name[TRACE_COLUMN_NAME_LEN];
+  trace_schema_t *schema = &reader->schema;
+  for (unsigned int c = 0; c < reader->num_cores; c++) {
+    sprintf(name, "cpu%u.freq", c);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+    for (unsigned int e = 0; e < reader->cores[c].num_counters; e++) {
+      sprintf(name, "cpu%u.0x%02x", c, reader->cores[c].event_ids[e]);
+      trace_schema_add(schema, name, reader->counter_bytes, TRACE_ENCODING_VARINT);
+    }
+    sprintf(name, "cpu%u.clk", c);
+    trace_schema_add(schema, name, sizeof(uint64_t), TRACE_ENCODING_VARINT);
+  }
+  if (reader->devices & TRACE_DEVICE_GPU) {
+    trace_schema_add(schema, "gpu.freq", sizeof(uint32_t), TRACE_ENCODING_DELTA);
+    for (unsigned int g = 0; g < reader->num_gpu_groups; g++) {
+      for (unsigned int i = 0; i < reader->gpu_groups[g].num_instances; i++) {
+        for (unsigned int e = 0; e < reader->gpu_groups[g].num_events; e++) {
+          sprintf(name, "gpu.g%u.i%u.%u", g, i, reader->gpu_groups[g].event_ids[e]);
+          trace_schema_add(schema, name, sizeof(uint64_t), TRACE_ENCODING_VARINT);
+        }
+      }
+    }
+  }
+  for (unsigned int r = 0; r < reader->num_power_rails; r++) {
+    sprintf(name, "power%u", r);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+  }
+  trace_schema_add(schema, "sampling_time", sizeof(uint64_t), TRACE_ENCODING_VARINT);
+  trace_schema_add(schema, "deadline_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "wake_ns", sizeof(uint64_t), TRACE_ENCODING_DELTA);
+  trace_schema_add(schema, "fresh", sizeof(uint32_t), TRACE_ENCODING_VARINT);
+  for (unsigned int c = 0; c < reader->num_cores && (reader->flags & TRACE_FLAG_CPU_MUX); c++) {
+    sprintf(name, "cpu%u.set", c);
+    trace_schema_add(schema, name, sizeof(uint32_t), TRACE_ENCODING_DELTA);
+  }
+}
+
+// v2 block index: from the footer, or by walking the block headers
+static int index_blocks(trace_reader_t *reader) {
+  size_t index_bytes = sizeof(uint32_t) * 2 * reader->schema.num_columns;
+  if (reader->has_footer) {
+    uint64_t expected = (reader->num_samples + reader->block_samples - 1) / reader->block_samples;
+    if (reader->num_blocks != expected)
+      return reader_error(reader, "footer indexes %lu blocks, %lu expected", reader->num_blocks, expected);
+    for (uint64_t b = 0; b < reader->num_blocks; b++)
+      if (reader->block_offsets[b] < reader->data_offset || reader->block_offsets[b] + 2 * sizeof(uint32_t) + index_bytes > reader->data_end)
+        return reader_error(reader, "offset %lu of block %lu out of the data", reader->block_offsets[b], b);
+    return 0;
+  }
+  uint64_t capacity = 64;
+  reader->block_offsets = (uint64_t *)malloc(sizeof(uint64_t) * capacity);
+  if (reader->block_offsets == NULL)
+    return reader_error(reader, "failed to allocate memory");
+  cursor_t cursor = {reader->map, reader->data_offset, reader->data_end};
+  while (cursor.pos < cursor.end) {
+    uint32_t magic, num_samples, size;
+    size_t block_offset = cursor.pos;
+    if (cursor_u32(&cursor, &magic) || cursor_u32(&cursor, &num_samples) || magic != TRACE_BLOCK_MAGIC)
+      return reader_error(reader, "block %lu not found at offset %lu", reader->num_blocks, block_offset);
+    if (num_samples == 0 || num_samples > reader->block_samples)
+      return reader_error(reader, "block %lu holds %u samples", reader->num_blocks, num_samples);
+    // only the last block may be short
+    if (reader->num_samples % reader->block_samples != 0)
+      return reader_error(reader, "short block before block %lu", reader->num_blocks);
+    size_t payload_bytes = 0;
+    for (unsigned int i = 0; i < reader->schema.num_columns; i++) {
+      if (cursor_u32(&cursor, &size))
+        return reader_error(reader, "truncated block %lu", reader->num_blocks);
+      payload_bytes += size;
+      cursor.pos += sizeof(uint32_t);
+    }
+    if (cursor.pos > cursor.end || cursor.end - cursor.pos < payload_bytes)
+      return reader_error(reader, "truncated block %lu", reader->num_blocks);
+    cursor.pos += payload_bytes;
+    if (reader->num_blocks == capacity) {
+      capacity *= 2;
+      uint64_t *block_offsets = (uint64_t *)realloc(reader->block_offsets, sizeof(uint64_t) * capacity);
+      if (block_offsets == NULL)
+        return reader_error(reader, "failed to allocate memory");
+      reader->block_offsets = block_offsets;
+    }
+    reader->block_offsets[reader->num_blocks++] = block_offset;
+    reader->num_samples += num_samples;
+  }
+  return 0;
+}
+
+// inflate and decode all the columns of a block into raw samples
+static int decode_block(trace_iter_t *iter, uint64_t block) {
+  trace_reader_t *reader = iter->reader;
+  trace_schema_t *schema = &reader->schema;
+  uint64_t first = block * reader->block_samples;
+  uint32_t num_samples = reader->num_samples - first < reader->block_samples ? reader->num_samples - first : reader->block_samples;
+  uint32_t magic = 0, block_samples = 0;
+  cursor_t cursor = {reader->map, reader->block_offsets[block], reader->data_end};
+  cursor_u32(&cursor, &magic);
+  cursor_u32(&cursor, &block_samples);
+  if (magic != TRACE_BLOCK_MAGIC || block_samples != num_samples)
+    return reader_error(reader, "block %lu: bad magic or %u samples instead of %u", block, block_samples, num_samples);
+  const uint8_t *sizes = reader->map + cursor.pos;
+  size_t payload = cursor.pos + sizeof(uint32_t) * 2 * schema->num_columns;
+  for (unsigned int i = 0; i < schema->num_columns; i++) {
+    trace_column_t *column = &schema->columns[i];
+    uint32_t compressed_bytes, encoded_bytes;
+    memcpy(&compressed_bytes, sizes + sizeof(uint32_t) * 2 * i, sizeof(uint32_t));
+    memcpy(&encoded_bytes, sizes + sizeof(uint32_t) * (2 * i + 1), sizeof(uint32_t));
+    if (reader->data_end - payload < compressed_bytes || encoded_bytes > iter->inflated_capacity)
+      return reader_error(reader, "block %lu: column '%s' out of bounds", block, column->name);
+    const uint8_t *encoded = reader->map + payload;
+    if (compressed_bytes != encoded_bytes) {
+      z_stream *stream = &iter->stream;
+      inflateReset(stream);
+      stream->next_in = (Bytef *)(reader->map + payload);
+      stream->avail_in = compressed_bytes;
+      stream->next_out = iter->inflated;
+      stream->avail_out = encoded_bytes;
+      if (inflate(stream, Z_FINISH) != Z_STREAM_END || stream->total_out != encoded_bytes)
+        return reader_error(reader, "block %lu: failed to inflate column '%s'", block, column->name);
+      encoded = iter->inflated;
+    }
+    if (trace_decode_column(iter->values, num_samples, encoded, encoded_bytes, column))
+      return reader_error(reader, "block %lu: failed to decode column '%s'", block, column->name);
+    // scatter into the rows
+    uint8_t *dst = iter->rows + column->offset;
+    if (column->size == sizeof(uint32_t)) {
+      for (uint32_t n = 0; n < num_samples; n++, dst += reader->sample_bytes)
+        *(uint32_t *)dst = (uint32_t)iter->values[n];
+    } else {
+      for (uint32_t n = 0; n < num_samples; n++, dst += reader->sample_bytes)
+        memcpy(dst, &iter->values[n], sizeof(uint64_t));
+    }
+    payload += compressed_bytes;
+  }
+  iter->block = block;
+  return 0;
+}
+
+// legacy v1 sample in the v1 layout: deadline and wake time are those of a
+// sampler without jitter from the start of the trace, and all the streams are fresh
+static void upgrade_legacy_sample(trace_iter_t *iter) {
+  trace_reader_t *reader = iter->reader;
+  uint64_t deadline_ns = iter->next * reader->sample_period_us * 1000UL;
+  uint32_t fresh = FRESH_POWER;
+  if (reader->devices & TRACE_DEVICE_CPU)
+    fresh |= FRESH_CPU_COUNTERS | FRESH_CPU_FREQ;
+  if (reader->devices & TRACE_DEVICE_GPU)
+    fresh |= FRESH_GPU_COUNTERS | FRESH_GPU_FREQ;
+  memcpy(iter->rows, iter->sample, reader->file_sample_bytes);
+  memcpy(iter->rows + reader->time_offset + sizeof(uint64_t), &deadline_ns, sizeof(uint64_t));
+  memcpy(iter->rows + reader->time_offset + 2 * sizeof(uint64_t), &deadline_ns, sizeof(uint64_t));
+  memcpy(iter->rows + reader->time_offset + 3 * sizeof(uint64_t), &fresh, sizeof(uint32_t));
+  iter->sample = iter->rows;
+}
@@ -0,0 +1,150 @@
+// Copyright 2023 ETH Zurich and University of Bologna.
+// Licensed under the Apache License, Version 2.0, see LICENSE for details.
+// SPDX-License-Identifier: Apache-2.0
+//
+// Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+// standard includes
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+// voltmeter libraries
+#include <writer.h>
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                      Prototypes                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+static void *trace_writer_thread(void *args);
+static void submit_block(trace_writer_t *writer);
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                       Functions                       ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// start the writer thread; from now on, the file must only be written through the writer
+void trace_writer_start(trace_writer_t *writer, FILE *file) {
+  writer->file = file;
+  writer->submitted = 0;
+  writer->written = 0;
+  writer->stop = 0;
+  writer->offset = 0;
+  writer->bytes = 0;
+  writer->backpressure = 0;
+  for (int b = 0; b < TRACE_WRITER_NUM_BUFFERS; b++) {
+    writer->buffer[b] = (uint8_t *)malloc(TRACE_WRITER_BLOCK_SIZE);
+    if (writer->buffer[b] == NULL) {
+      printf("%s:%d: failed to allocate memory.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    // prefault block memory before sampling
+    memset(writer->buffer[b], 0, TRACE_WRITER_BLOCK_SIZE);
+    writer->fill[b] = 0;
+  }
+  // blocks are already large: bypass stdio buffering
+  setvbuf(file, NULL, _IONBF, 0);
+  pthread_mutex_init(&writer->lock, NULL);
+  pthread_cond_init(&writer->cond, NULL);
+  int ret = pthread_create(&writer->thread, NULL, trace_writer_thread, writer);
+  if (ret != 0) {
+    perror("pthread_create");
+    printf("%s:%d: failed to create trace writer thread.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+}
+
+// append data to the current block; full blocks are handed to the writer thread
+void trace_writer_write(trace_writer_t *writer, const void *data, size_t size) {
+  const uint8_t *src = (const uint8_t *)data;
+  writer->offset += size;
+  while (size > 0) {
+    unsigned int b = writer->submitted % TRACE_WRITER_NUM_BUFFERS;
+    size_t chunk = TRACE_WRITER_BLOCK_SIZE - writer->fill[b];
+    if (chunk > size)
+      chunk = size;
+    memcpy(writer->buffer[b] + writer->fill[b], src, chunk);
+    writer->fill[b] += chunk;
+    src += chunk;
+    size -= chunk;
+    if (writer->fill[b] == TRACE_WRITER_BLOCK_SIZE)
+      submit_block(writer);
+  }
+}
+
+// flush the last partial block, wait for all blocks to be written and stop the thread
+void trace_writer_stop(trace_writer_t *writer) {
+  unsigned int b = writer->submitted % TRACE_WRITER_NUM_BUFFERS;
+  if (writer->fill[b] > 0)
+    submit_block(writer);
+  pthread_mutex_lock(&writer->lock);
+  writer->stop = 1;
+  pthread_cond_broadcast(&writer->cond);
+  pthread_mutex_unlock(&writer->lock);
+  int ret = pthread_join(writer->thread, NULL);
+  if (ret != 0) {
+    perror("pthread_join");
+    printf("%s:%d: failed to join trace writer thread.\n", __FILE__, __LINE__);
+    exit(1);
+  }
+  fflush(writer->file);
+  pthread_mutex_destroy(&writer->lock);
+  pthread_cond_destroy(&writer->cond);
+  for (int b = 0; b < TRACE_WRITER_NUM_BUFFERS; b++)
+    free(writer->buffer[b]);
+}
+
+/*
+ * ╔═══════════════════════════════════════════════════════╗
+ * ║                   Static functions                    ║
+ * ╚═══════════════════════════════════════════════════════╝
+ */
+
+// hand the current block to the writer thread and wait for a free one
+static void submit_block(trace_writer_t *writer) {
+  pthread_mutex_lock(&writer->lock);
+  writer->submitted++;
+  pthread_cond_broadcast(&writer->cond);
+  if (writer->submitted - writer->written >= TRACE_WRITER_NUM_BUFFERS) {
+    // all blocks in flight: storage is slower than sampling
+    writer->backpressure++;
+    while (writer->submitted - writer->written >= TRACE_WRITER_NUM_BUFFERS)
+      pthread_cond_wait(&writer->cond, &writer->lock);
+  }
+  pthread_mutex_unlock(&writer->lock);
+  writer->fill[writer->submitted % TRACE_WRITER_NUM_BUFFERS] = 0;
+}
+
+// write submitted blocks in order, one sequential write per block
+static void *trace_writer_thread(void *args) {
+  trace_writer_t *writer = (trace_writer_t *)args;
+  while (1) {
+    pthread_mutex_lock(&writer->lock);
+    while (writer->written == writer->submitted && !writer->stop)
+      pthread_cond_wait(&writer->cond, &writer->lock);
+    if (writer->written == writer->submitted) {
+      pthread_mutex_unlock(&writer->lock);
+      break;
+    }
+    unsigned int b = writer->written % TRACE_WRITER_NUM_BUFFERS;
+    pthread_mutex_unlock(&writer->lock);
+
+    if (fwrite(writer->buffer[b], 1, writer->fill[b], writer->file) != writer->fill[b]) {
+      perror("fwrite");
+      printf("%s:%d: failed to write trace block.\n", __FILE__, __LINE__);
+      exit(1);
+    }
+    writer->bytes += writer->fill[b];
+
+    pthread_mutex_lock(&writer->lock);
+    writer->written++;
+    pthread_cond_broadcast(&writer->cond);
+    pthread_mutex_unlock(&writer->lock);
+  }
+  return (void *)NULL;
+}
@@ -0,0 +1,31 @@
+#!/usr/bin/env bash
+
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+#
+# Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+# $1 can be:
+# - a frequency (in kHz), e.g. from `cat /sys/devices/system/cpu/cpufreq/policy0/scaling_available_frequencies`
+# - 'min', to pick the min frequency of the CPU (cpuinfo_min_freq)
+# - 'max', to pick the max frequency of the CPU (cpuinfo_max_freq)
+# the frequency is set on all cpufreq policies, with the userspace governor (e.g., acpi-cpufreq)
+
+policy0=/sys/devices/system/cpu/cpufreq/policy0
+if [ "$1" = "min" ]; then
+  set_freq=`cat $policy0/cpuinfo_min_freq`
+elif [ "$1" = "max" ]; then
+  set_freq=`cat $policy0/cpuinfo_max_freq`
+else
+  set_freq=$1
+fi
+
+echo "Setting CPU frequency to $set_freq kHz..."
+for policy in /sys/devices/system/cpu/cpufreq/policy*; do
+  echo "userspace" | sudo tee $policy/scaling_governor > /dev/null
+  echo $set_freq | sudo tee $policy/scaling_max_freq > /dev/null
+  echo $set_freq | sudo tee $policy/scaling_min_freq > /dev/null
+  echo $set_freq | sudo tee $policy/scaling_max_freq > /dev/null
+  echo $set_freq | sudo tee $policy/scaling_setspeed > /dev/null
+done
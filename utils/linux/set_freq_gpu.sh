@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+#
+# Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+# no GPU on a generic Linux machine
+echo "No GPU frequency to set on a generic Linux machine."
@@ -0,0 +1,10 @@
+#!/usr/bin/env bash
+
+# Copyright 2023 ETH Zurich and University of Bologna.
+# Licensed under the Apache License, Version 2.0, see LICENSE for details.
+# SPDX-License-Identifier: Apache-2.0
+#
+# Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
+
+# a generic Linux machine has no power modes: the CPU frequency is set by set_freq_cpu.sh
+echo "No power configuration to set on a generic Linux machine."
@@ -7,6 +7,7 @@
 # Author: Sergio Mazzola, ETH Zurich <smazzola@iis.ee.ethz.ch>
 
 import os
+import json
 import yaml
 import copy
 from cerberus import Validator
@@ -18,11 +19,17 @@ if __name__ == '__main__':
     CONFIG_YML = os.getenv('VOLTMETER_YML')
     # outputs
     OUTPUT_MK = os.getenv('VOLTMETER_MK')
+    OUTPUT_BUILD_MK = os.getenv('VOLTMETER_BUILD_MK')
+    OUTPUT_CAMPAIGN = os.getenv('VOLTMETER_CAMPAIGN')
 
     if CONFIG_YML is None:
         raise Exception('VOLTMETER_YML not set')
     if OUTPUT_MK is None:
         raise Exception('VOLTMETER_MK not set')
+    if OUTPUT_BUILD_MK is None:
+        raise Exception('VOLTMETER_BUILD_MK not set')
+    if OUTPUT_CAMPAIGN is None:
+        raise Exception('VOLTMETER_CAMPAIGN not set')
 
     ############################
     # parse YML manifest file
@@ -42,13 +49,24 @@ if __name__ == '__main__':
     ############################
 
     config_yml = v.normalized(config_yml)
+    # generic Linux: CPU counters through perf_event_open, no GPU
+    if config_yml['param-platform']['platform'] == 'linux':
+        if config_yml['param-platform']['profile_gpu']:
+            raise Exception('Invalid {}: no GPU on platform linux'.format(CONFIG_YML))
+        config_yml['param-platform']['cpu_counters'] = 'perf_event'
+    # the synthetic backend has no GPU
+    if config_yml['arguments'].get('backend') == 'synthetic' and config_yml['param-platform']['profile_gpu']:
+        raise Exception('Invalid {}: no GPU with backend synthetic'.format(CONFIG_YML))
     # remove empty arguments
     config = copy.deepcopy(config_yml)
     for key in config_yml['arguments']:
         continue
     # convert paths to absolute
     for key in config['arguments']:
-        if key in ['config_cpu', 'config_gpu', 'trace_dir']:
+        if key in ['config_cpu', 'config_gpu', 'trace_dir', 'online_model', 'model']:
+            config['arguments'][key] = os.path.abspath(config['arguments'][key])
+        # '-' is stdout
+        if key == 'estimate_output' and config['arguments'][key] != '-':
             config['arguments'][key] = os.path.abspath(config['arguments'][key])
     # process benchmarks
     temp_bench = copy.deepcopy(config['arguments']['benchmarks'])
@@ -87,9 +105,23 @@ if __name__ == '__main__':
                 raise Exception('Invalid {}: unbalanced quotes in benchmark arguments'.format(CONFIG_YML))
 
     ############################
-    # generate makefrag
+    # generate makefrags
     ############################
 
+    # only these parameters are compile-time: the profiler configuration is passed
+    # to Voltmeter at runtime, so that changing it does not trigger a rebuild
+    BUILD_PARAMS = ['platform', 'cpu_counters', 'debug_gdb']
+    build_mk = '# This file is automatically generated by parse_config.py\n'
+    build_mk += '# Compile-time parameters parsed from {}\n\n'.format(CONFIG_YML)
+    for key in [k for k in config if k != 'arguments']:
+        for param in [p for p in config[key] if p in BUILD_PARAMS]:
+            value = config[key][param]
+            build_mk += '{} := {}\n'.format(param, int(value) if type(value) is bool else value)
+    # rewrite only if changed, since all objects depend on it
+    if not os.path.exists(OUTPUT_BUILD_MK) or open(OUTPUT_BUILD_MK, 'r').read() != build_mk:
+        with open(OUTPUT_BUILD_MK, 'w') as f:
+            f.write(build_mk)
+
     # each couple lib_path+arguments must be recognized as a single element by the shell so
     # that they refer to only 1 voltemter call; at the same time, also the benchmark arguments
     # are to be passed as a unique string to the flag --benchmark_args
@@ -110,6 +142,12 @@ if __name__ == '__main__':
             f.write('{} := {}\n'.format('trace_dir', config['arguments']['trace_dir'])) # take it from voltmeter args for automatic dir creation
         f.write('\n')
         f.write('# Voltmeter CLI arguments\n')
+        # runtime profiler configuration
+        devices = [d for d in ['cpu', 'gpu'] if config['param-platform']['profile_' + d]]
+        f.write('voltmeter_args += --devices={}\n'.format(','.join(devices)))
+        for param in ['num_run', 'sample_period_us', 'power_period_us', 'freq_period_us', 'realtime', 'trace_version', 'mux_samples']:
+            value = config['param-profiler'][param]
+            f.write('voltmeter_args += --{}={}\n'.format(param, int(value) if type(value) is bool else value))
         for key in config['arguments']:
             # benchmarks
             if key == 'benchmarks':
@@ -134,3 +172,18 @@ if __name__ == '__main__':
             # other arguments
             else:
                 f.write('voltmeter_args += --{}={}\n'.format(key, config['arguments'][key]))
+
+    # expanded manifest, run by a single Voltmeter process with --campaign: it sets the
+    # CPU/GPU frequencies itself and keeps the benchmarks loaded across frequencies; a
+    # device without frequencies is set to its max frequency (0)
+    campaign = {
+        'frequencies_cpu': config['param-platform'].get('frequencies_cpu', [0]),
+        'frequencies_gpu': config['param-platform'].get('frequencies_gpu', [0] if config['param-platform']['profile_gpu'] else []),
+        'benchmarks': []
+    }
+    for b in config['arguments'].get('benchmarks', []):
+        args = b['args'].split(',') if 'args' in b and b['args'] is not None else []
+        campaign['benchmarks'].append({'path': b['path'], 'args': args})
+    with open(OUTPUT_CAMPAIGN, 'w') as f:
+        json.dump(campaign, f, indent=2)
+        f.write('\n')
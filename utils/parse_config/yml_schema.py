@@ -13,7 +13,13 @@
             'platform': {
                 'required': True,
                 'type': 'string',
-                'allowed': ['jetson_agx_xavier']
+                'allowed': ['jetson_agx_xavier', 'linux']
+            },
+            'cpu_counters': {
+                'required': True,
+                'type': 'string',
+                'default': 'pmu',
+                'allowed': ['pmu', 'perf_event']
             },
             'profile_cpu': {
                 'required': True,
@@ -77,6 +83,35 @@
                 'default': 100000,
                 'min': 1
             },
+            'power_period_us': {
+                'required': True,
+                'type': 'integer',
+                'default': 0,
+                'min': 0
+            },
+            'freq_period_us': {
+                'required': True,
+                'type': 'integer',
+                'default': 0,
+                'min': 0
+            },
+            'realtime': {
+                'required': True,
+                'type': 'boolean',
+                'default': False
+            },
+            'trace_version': {
+                'required': True,
+                'type': 'integer',
+                'default': 1,
+                'allowed': [1, 2]
+            },
+            'mux_samples': {
+                'required': True,
+                'type': 'integer',
+                'default': 0,
+                'min': 0
+            },
             'debug_gdb': {
                 'required': True,
                 'type': 'boolean',
@@ -143,12 +178,37 @@
             'mode': {
                 'required': True,
                 'type': 'string',
-                'allowed': ['characterization', 'profile', 'num_passes']
+                'allowed': ['characterization', 'profile', 'num_passes', 'estimate']
             },
             'trace_dir': {
                 'required': True,
                 'type': 'string'
             },
+            'model': {
+                'dependencies': {'mode': 'estimate'},
+                'type': 'string',
+                'nullable': False
+            },
+            'estimate_output': {
+                'dependencies': {'mode': 'estimate'},
+                'type': 'string',
+                'nullable': False
+            },
+            'online_model': {
+                'required': False,
+                'noneof': [{'dependencies': {'mode': 'num_passes'}}],
+                'type': 'string'
+            },
+            'backend': {
+                'required': False,
+                'type': 'string',
+                'allowed': ['hardware', 'synthetic']
+            },
+            'seed': {
+                'dependencies': {'backend': 'synthetic'},
+                'type': 'integer',
+                'min': 0
+            },
             'benchmarks': {
                 'required': True,
                 'noneof': [{'dependencies': {'mode': 'num_passes'}}],